@@ -12,6 +12,7 @@ ApplicationClass::ApplicationClass()
 	m_ShaderManager = 0;
 	m_TextureManager = 0;
 	m_Zone = 0;
+	m_FrameArena = 0;
 }
 
 
@@ -103,6 +104,12 @@ bool ApplicationClass::Initialize(HINSTANCE hinstance, HWND hwnd, int screenWidt
 		return false;
 	}
 
+	result = m_TextureManager->LoadTexture(m_Direct3D->GetDevice(), m_Direct3D->GetDeviceContext(), "../textures/snow_m.tga", 2);
+	if (!result)
+	{
+		return false;
+	}
+
 	// Create the timer object.
 	m_Timer = new TimerClass;
 	if (!m_Timer)
@@ -119,6 +126,25 @@ bool ApplicationClass::Initialize(HINSTANCE hinstance, HWND hwnd, int screenWidt
 	}
 
 
+	// Create the frame arena object.
+	m_FrameArena = new ArenaClass;
+	if (!m_FrameArena)
+	{
+		return false;
+	}
+
+	// Initialize the frame arena, every temporary buffer of the frame loop comes from it.
+	result = m_FrameArena->Initialize(ARENA_FRAME_SIZE);
+	if (!result)
+	{
+		MessageBox(hwnd, L"Could not initialize the frame arena object.", L"Error", MB_OK);
+		return false;
+	}
+
+	m_frameNumber = 0;
+	m_frameAllocations = 0;
+	m_maxFrameAllocations = 0;
+
 	// Create the zone object.
 	m_Zone = new ZoneClass;
 	if(!m_Zone)
@@ -127,7 +153,7 @@ bool ApplicationClass::Initialize(HINSTANCE hinstance, HWND hwnd, int screenWidt
 	}
 
 	// Initialize the zone object.
-	result = m_Zone->Initialize(m_Direct3D, hwnd, screenWidth, screenHeight, SCREEN_DEPTH);
+	result = m_Zone->Initialize(m_Direct3D, hwnd, screenWidth, screenHeight, SCREEN_DEPTH, m_FrameArena);
 	if(!result)
 	{
 		MessageBox(hwnd, L"Could not initialize the zone object.", L"Error", MB_OK);
@@ -148,6 +174,14 @@ void ApplicationClass::Shutdown()
 		m_Zone = 0;
 	}
 
+	// Release the frame arena object.
+	if (m_FrameArena)
+	{
+		m_FrameArena->Shutdown();
+		delete m_FrameArena;
+		m_FrameArena = 0;
+	}
+
 	// Release the texture manager object.
 	if (m_TextureManager)
 	{
@@ -194,6 +228,12 @@ void ApplicationClass::Shutdown()
 bool ApplicationClass::Frame()
 {
 	bool result;
+	int heapAllocations;
+
+
+	// Start the frame with an empty arena and note the heap allocation count.
+	m_FrameArena->Reset();
+	heapAllocations = ArenaClass::GetHeapAllocationCount();
 
 	m_Timer->Frame();
 
@@ -226,5 +266,26 @@ bool ApplicationClass::Frame()
 		return false;
 	}
 
+	// Count the heap allocations made during the frame, the steady state target is zero (debug builds only).
+	m_frameAllocations = ArenaClass::GetHeapAllocationCount() - heapAllocations;
+	if ((m_frameNumber > ALLOCATION_WARMUP_FRAMES) && (m_frameAllocations > m_maxFrameAllocations))
+	{
+		m_maxFrameAllocations = m_frameAllocations;
+	}
+
+	m_frameNumber++;
+
 	return result;
+}
+
+
+int ApplicationClass::GetFrameAllocationCount()
+{
+	return m_frameAllocations;
+}
+
+
+int ApplicationClass::GetMaxFrameAllocationCount()
+{
+	return m_maxFrameAllocations;
 }
\ No newline at end of file
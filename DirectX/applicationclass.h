@@ -12,11 +12,13 @@ const bool FULL_SCREEN = false;
 const bool VSYNC_ENABLED = true;
 const float SCREEN_DEPTH = 1000.0f;
 const float SCREEN_NEAR = 0.1f;
+const int ALLOCATION_WARMUP_FRAMES = 60;
 
 
 ///////////////////////
 // MY CLASS INCLUDES //
 ///////////////////////
+#include "arenaclass.h"
 #include "inputclass.h"
 #include "d3dclass.h"
 #include "shadermanagerclass.h"
@@ -40,6 +42,9 @@ public:
 	void Shutdown();
 	bool Frame();
 
+	int GetFrameAllocationCount();
+	int GetMaxFrameAllocationCount();
+
 private:
 	InputClass* m_Input;
 	D3DClass* m_Direct3D;
@@ -47,6 +52,8 @@ private:
 	TextureManagerClass* m_TextureManager;
 	TimerClass* m_Timer;
 	ZoneClass* m_Zone;
+	ArenaClass* m_FrameArena;
+	int m_frameNumber, m_frameAllocations, m_maxFrameAllocations;
 };
 
 #endif
\ No newline at end of file
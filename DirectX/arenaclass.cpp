@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: arenaclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "arenaclass.h"
+
+#ifdef _DEBUG
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+// Debug builds count every global heap allocation so the frame loop can be checked for heap traffic.
+static std::atomic<int> g_heapAllocationCount(0);
+
+void* operator new(size_t size)
+{
+	void* memory;
+
+
+	g_heapAllocationCount++;
+
+	memory = malloc(size ? size : 1);
+	if (!memory)
+	{
+		throw std::bad_alloc();
+	}
+
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
+#endif
+
+
+ArenaClass::ArenaClass()
+{
+	m_memory = 0;
+	m_capacity = 0;
+	m_offset = 0;
+	m_peak = 0;
+	m_overflowCount = 0;
+}
+
+
+ArenaClass::ArenaClass(const ArenaClass& other)
+{
+}
+
+
+ArenaClass::~ArenaClass()
+{
+}
+
+
+bool ArenaClass::Initialize(size_t capacity)
+{
+	// Create the whole block up front, nothing else is allocated after this.
+	m_memory = new char[capacity];
+	if (!m_memory)
+	{
+		return false;
+	}
+
+	m_capacity = capacity;
+	m_offset = 0;
+	m_peak = 0;
+	m_overflowCount = 0;
+
+	return true;
+}
+
+
+void ArenaClass::Shutdown()
+{
+	// Release the memory block.
+	if (m_memory)
+	{
+		delete[] m_memory;
+		m_memory = 0;
+	}
+
+	m_capacity = 0;
+	m_offset = 0;
+
+	return;
+}
+
+
+void ArenaClass::Reset()
+{
+	m_offset = 0;
+	return;
+}
+
+
+void* ArenaClass::Allocate(size_t size)
+{
+	size_t start;
+
+
+	// Round the start up so every allocation is aligned for SIMD loads.
+	start = (m_offset + (ARENA_ALIGNMENT - 1)) & ~(ARENA_ALIGNMENT - 1);
+
+	// Callers treat a null pointer the same way as a failed new.
+	if ((start + size) > m_capacity)
+	{
+		m_overflowCount++;
+		return 0;
+	}
+
+	m_offset = start + size;
+	if (m_offset > m_peak)
+	{
+		m_peak = m_offset;
+	}
+
+	return m_memory + start;
+}
+
+
+size_t ArenaClass::GetMarker()
+{
+	return m_offset;
+}
+
+
+void ArenaClass::Release(size_t marker)
+{
+	// Give back everything allocated since the marker was taken.
+	m_offset = marker;
+	return;
+}
+
+
+size_t ArenaClass::GetUsed()
+{
+	return m_offset;
+}
+
+
+size_t ArenaClass::GetPeak()
+{
+	return m_peak;
+}
+
+
+int ArenaClass::GetOverflowCount()
+{
+	return m_overflowCount;
+}
+
+
+int ArenaClass::GetHeapAllocationCount()
+{
+#ifdef _DEBUG
+	return g_heapAllocationCount.load();
+#else
+	return 0;
+#endif
+}
+
+
+ScratchClass::ScratchClass(ArenaClass* arena)
+{
+	m_Arena = arena;
+	m_marker = m_Arena->GetMarker();
+}
+
+
+ScratchClass::~ScratchClass()
+{
+	m_Arena->Release(m_marker);
+}
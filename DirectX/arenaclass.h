@@ -0,0 +1,88 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: arenaclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _ARENACLASS_H_
+#define _ARENACLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <stddef.h>
+
+
+/////////////
+// GLOBALS //
+/////////////
+const size_t ARENA_FRAME_SIZE = 4 * 1024 * 1024;
+const size_t ARENA_ALIGNMENT = 16;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: ArenaClass
+////////////////////////////////////////////////////////////////////////////////
+// Linear allocator for temporary buffers. The frame arena is reset at the
+// start of every frame and is only used from the render thread, it is kept
+// for the temporaries of the frame loop. Load time work that wants an arena,
+// like building the geomipmap index pool, creates one of its own.
+class ArenaClass
+{
+public:
+	ArenaClass();
+	ArenaClass(const ArenaClass&);
+	~ArenaClass();
+
+	bool Initialize(size_t);
+	void Shutdown();
+
+	void Reset();
+	void* Allocate(size_t);
+
+	template <typename T>
+	T* AllocateArray(int count)
+	{
+		return (T*)Allocate(sizeof(T) * count);
+	}
+
+	size_t GetMarker();
+	void Release(size_t);
+
+	size_t GetUsed();
+	size_t GetPeak();
+	int GetOverflowCount();
+
+	static int GetHeapAllocationCount();
+
+private:
+	char* m_memory;
+	size_t m_capacity, m_offset, m_peak;
+	int m_overflowCount;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: ScratchClass
+////////////////////////////////////////////////////////////////////////////////
+// Scoped view of an arena, everything allocated through it is given back when
+// it goes out of scope.
+class ScratchClass
+{
+public:
+	ScratchClass(ArenaClass*);
+	~ScratchClass();
+
+	template <typename T>
+	T* AllocateArray(int count)
+	{
+		return m_Arena->AllocateArray<T>(count);
+	}
+
+private:
+	ScratchClass(const ScratchClass&);
+
+private:
+	ArenaClass* m_Arena;
+	size_t m_marker;
+};
+
+#endif
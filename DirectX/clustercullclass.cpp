@@ -0,0 +1,480 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: clustercullclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "clustercullclass.h"
+
+
+ClusterCullClass::ClusterCullClass()
+{
+	int i;
+
+
+	m_Geomipmap = 0;
+	m_clusters = 0;
+	m_cameraX = 0.0f;
+	m_cameraY = 0.0f;
+	m_cameraZ = 0.0f;
+	m_testedTriangles = 0;
+	m_backFacingTriangles = 0;
+	m_outsideTriangles = 0;
+
+	// Empty planes keep everything inside until the first frustum is built.
+	for (i = 0; i < CLUSTER_CULL_PLANES; i++)
+	{
+		m_planes[i].a = 0.0f;
+		m_planes[i].b = 0.0f;
+		m_planes[i].c = 0.0f;
+		m_planes[i].d = 0.0f;
+	}
+}
+
+
+ClusterCullClass::ClusterCullClass(const ClusterCullClass& other)
+{
+}
+
+
+ClusterCullClass::~ClusterCullClass()
+{
+}
+
+
+bool ClusterCullClass::Initialize(const float* heights, int terrainWidth, int terrainHeight, GeomipmapClass* geomipmap)
+{
+	ParallelForClass parallel;
+	int level;
+
+
+	m_Geomipmap = geomipmap;
+	m_terrainWidth = terrainWidth;
+	m_terrainHeight = terrainHeight;
+	m_patchCount = m_Geomipmap->GetPatchCount();
+	m_patchSize = m_Geomipmap->GetPatchSize();
+
+	if (m_Geomipmap->GetLevelCount() > CLUSTER_CULL_MAX_LEVELS)
+	{
+		return false;
+	}
+
+	// The clusters of a patch are stored level after level.
+	m_clustersPerPatch = 0;
+	for (level = 0; level < m_Geomipmap->GetLevelCount(); level++)
+	{
+		m_levelOffsets[level] = m_clustersPerPatch;
+		m_clustersPerPatch += m_Geomipmap->GetClusterCount(level);
+	}
+
+	m_clusters = new ClusterType[m_patchCount * m_clustersPerPatch];
+	if (!m_clusters)
+	{
+		return false;
+	}
+
+	// The patches only read the heights and the index pool, so they are built on all the cores.
+	parallel.Run(m_patchCount, CLUSTER_CULL_PATCH_GRAIN, [&](int first, int last)
+	{
+		int patch;
+
+
+		for (patch = first; patch < last; patch++)
+		{
+			BuildPatch(heights, patch);
+		}
+	});
+
+	return true;
+}
+
+
+void ClusterCullClass::Shutdown()
+{
+	// Release the cluster bounds.
+	if (m_clusters)
+	{
+		delete[] m_clusters;
+		m_clusters = 0;
+	}
+
+	return;
+}
+
+
+void ClusterCullClass::UpdateRegion(const float* heights, int left, int top, int right, int bottom)
+{
+	int patchCountX, patchCountZ, firstX, firstZ, lastX, lastZ, x, z;
+
+
+	patchCountX = (m_terrainWidth - 1) / m_patchSize;
+	patchCountZ = (m_terrainHeight - 1) / m_patchSize;
+
+	// The patches touching the rectangle, a column or row on a patch border belongs to both sides.
+	firstX = (left > 0) ? ((left - 1) / m_patchSize) : 0;
+	firstZ = (top > 0) ? ((top - 1) / m_patchSize) : 0;
+	lastX = right / m_patchSize;
+	lastZ = bottom / m_patchSize;
+
+	if (lastX > (patchCountX - 1))
+	{
+		lastX = patchCountX - 1;
+	}
+
+	if (lastZ > (patchCountZ - 1))
+	{
+		lastZ = patchCountZ - 1;
+	}
+
+	for (z = firstZ; z <= lastZ; z++)
+	{
+		for (x = firstX; x <= lastX; x++)
+		{
+			BuildPatch(heights, (z * patchCountX) + x);
+		}
+	}
+
+	return;
+}
+
+
+void ClusterCullClass::ConstructFrustum(XMMATRIX viewProjectionMatrix)
+{
+	XMFLOAT4X4 matrix;
+	float length;
+	int i;
+
+
+	XMStoreFloat4x4(&matrix, viewProjectionMatrix);
+
+	// The planes come out of the columns of the view projection matrix, x and y run from -w to w and z from 0 to w.
+	m_planes[0].a = matrix.m[0][3] + matrix.m[0][0];
+	m_planes[0].b = matrix.m[1][3] + matrix.m[1][0];
+	m_planes[0].c = matrix.m[2][3] + matrix.m[2][0];
+	m_planes[0].d = matrix.m[3][3] + matrix.m[3][0];
+
+	m_planes[1].a = matrix.m[0][3] - matrix.m[0][0];
+	m_planes[1].b = matrix.m[1][3] - matrix.m[1][0];
+	m_planes[1].c = matrix.m[2][3] - matrix.m[2][0];
+	m_planes[1].d = matrix.m[3][3] - matrix.m[3][0];
+
+	m_planes[2].a = matrix.m[0][3] + matrix.m[0][1];
+	m_planes[2].b = matrix.m[1][3] + matrix.m[1][1];
+	m_planes[2].c = matrix.m[2][3] + matrix.m[2][1];
+	m_planes[2].d = matrix.m[3][3] + matrix.m[3][1];
+
+	m_planes[3].a = matrix.m[0][3] - matrix.m[0][1];
+	m_planes[3].b = matrix.m[1][3] - matrix.m[1][1];
+	m_planes[3].c = matrix.m[2][3] - matrix.m[2][1];
+	m_planes[3].d = matrix.m[3][3] - matrix.m[3][1];
+
+	m_planes[4].a = matrix.m[0][2];
+	m_planes[4].b = matrix.m[1][2];
+	m_planes[4].c = matrix.m[2][2];
+	m_planes[4].d = matrix.m[3][2];
+
+	m_planes[5].a = matrix.m[0][3] - matrix.m[0][2];
+	m_planes[5].b = matrix.m[1][3] - matrix.m[1][2];
+	m_planes[5].c = matrix.m[2][3] - matrix.m[2][2];
+	m_planes[5].d = matrix.m[3][3] - matrix.m[3][2];
+
+	// Normalize the planes so they give distances for the sphere test.
+	for (i = 0; i < CLUSTER_CULL_PLANES; i++)
+	{
+		length = sqrtf((m_planes[i].a * m_planes[i].a) + (m_planes[i].b * m_planes[i].b) + (m_planes[i].c * m_planes[i].c));
+		if (length > 0.0f)
+		{
+			m_planes[i].a /= length;
+			m_planes[i].b /= length;
+			m_planes[i].c /= length;
+			m_planes[i].d /= length;
+		}
+	}
+
+	return;
+}
+
+
+void ClusterCullClass::SetCamera(float cameraX, float cameraY, float cameraZ)
+{
+	m_cameraX = cameraX;
+	m_cameraY = cameraY;
+	m_cameraZ = cameraZ;
+
+	// The statistics cover the clusters tested since the camera was last set, so one frame.
+	m_testedTriangles = 0;
+	m_backFacingTriangles = 0;
+	m_outsideTriangles = 0;
+
+	return;
+}
+
+
+bool ClusterCullClass::IsVisible(int patch, int level, int cluster, int triangleCount)
+{
+	ClusterType* bounds;
+
+
+	bounds = &m_clusters[(patch * m_clustersPerPatch) + m_levelOffsets[level] + cluster];
+
+	m_testedTriangles += triangleCount;
+
+	if (IsOutside(*bounds))
+	{
+		m_outsideTriangles += triangleCount;
+		return false;
+	}
+
+	if (IsBackFacing(*bounds))
+	{
+		m_backFacingTriangles += triangleCount;
+		return false;
+	}
+
+	return true;
+}
+
+
+void ClusterCullClass::GetStats(int& testedTriangles, int& backFacingTriangles, int& outsideTriangles)
+{
+	testedTriangles = m_testedTriangles;
+	backFacingTriangles = m_backFacingTriangles;
+	outsideTriangles = m_outsideTriangles;
+	return;
+}
+
+
+void ClusterCullClass::BuildPatch(const float* heights, int patch)
+{
+	int level, cluster;
+
+
+	for (level = 0; level < m_Geomipmap->GetLevelCount(); level++)
+	{
+		for (cluster = 0; cluster < m_Geomipmap->GetClusterCount(level); cluster++)
+		{
+			BuildCluster(heights, patch, level, cluster, m_clusters[(patch * m_clustersPerPatch) + m_levelOffsets[level] + cluster]);
+		}
+	}
+
+	return;
+}
+
+
+void ClusterCullClass::BuildCluster(const float* heights, int patch, int level, int cluster, ClusterType& bounds)
+{
+	GeomipmapClass::PatchDrawType setDraw, clusterDraw;
+	const unsigned short* indexPool;
+	XMFLOAT3 vertex, normal, boxMin, boxMax;
+	float sumX, sumY, sumZ, length, dot, dx, dy, dz, distance;
+	int pass, stitch, i, k;
+
+
+	indexPool = m_Geomipmap->GetIndexPool();
+
+	boxMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	boxMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	sumX = 0.0f;
+	sumY = 0.0f;
+	sumZ = 0.0f;
+
+	bounds.cutoff = 1.0f;
+	bounds.radius = 0.0f;
+
+	// The first pass finds the box and the average normal, the second how far the vertices and the normals stray from them.
+	for (pass = 0; pass < 2; pass++)
+	{
+		// No stitching and stitching on every side between them hold every triangle the cluster can be drawn with.
+		for (stitch = 0; stitch < 2; stitch++)
+		{
+			m_Geomipmap->GetLevelDraw(level, (stitch == 0) ? 0 : (GeomipmapClass::STITCH_COMBINATIONS - 1), setDraw);
+			setDraw.baseVertex = m_Geomipmap->GetPatchBaseVertex(patch);
+			m_Geomipmap->GetClusterDraw(setDraw, cluster, clusterDraw);
+
+			for (i = clusterDraw.indexOffset; i < (clusterDraw.indexOffset + clusterDraw.indexCount); i += 3)
+			{
+				for (k = 0; k < 3; k++)
+				{
+					GetVertex(heights, clusterDraw.baseVertex + indexPool[i + k], vertex);
+
+					if (pass == 0)
+					{
+						boxMin.x = (vertex.x < boxMin.x) ? vertex.x : boxMin.x;
+						boxMin.y = (vertex.y < boxMin.y) ? vertex.y : boxMin.y;
+						boxMin.z = (vertex.z < boxMin.z) ? vertex.z : boxMin.z;
+						boxMax.x = (vertex.x > boxMax.x) ? vertex.x : boxMax.x;
+						boxMax.y = (vertex.y > boxMax.y) ? vertex.y : boxMax.y;
+						boxMax.z = (vertex.z > boxMax.z) ? vertex.z : boxMax.z;
+					}
+					else
+					{
+						dx = vertex.x - bounds.centerX;
+						dy = vertex.y - bounds.centerY;
+						dz = vertex.z - bounds.centerZ;
+						distance = sqrtf((dx * dx) + (dy * dy) + (dz * dz));
+						if (distance > bounds.radius)
+						{
+							bounds.radius = distance;
+						}
+					}
+				}
+
+				if (!GetTriangleNormal(heights, clusterDraw.baseVertex, indexPool + i, normal))
+				{
+					continue;
+				}
+
+				if (pass == 0)
+				{
+					sumX += normal.x;
+					sumY += normal.y;
+					sumZ += normal.z;
+				}
+				else
+				{
+					dot = (normal.x * bounds.axisX) + (normal.y * bounds.axisY) + (normal.z * bounds.axisZ);
+					if (dot < bounds.cutoff)
+					{
+						bounds.cutoff = dot;
+					}
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			// The sphere is centered on the box.
+			bounds.centerX = (boxMin.x + boxMax.x) / 2.0f;
+			bounds.centerY = (boxMin.y + boxMax.y) / 2.0f;
+			bounds.centerZ = (boxMin.z + boxMax.z) / 2.0f;
+
+			// The cone is around the average normal, without one it can never be back facing.
+			length = sqrtf((sumX * sumX) + (sumY * sumY) + (sumZ * sumZ));
+			if (length <= 0.0f)
+			{
+				bounds.axisX = 0.0f;
+				bounds.axisY = 1.0f;
+				bounds.axisZ = 0.0f;
+				bounds.cutoff = -1.0f;
+			}
+			else
+			{
+				bounds.axisX = sumX / length;
+				bounds.axisY = sumY / length;
+				bounds.axisZ = sumZ / length;
+			}
+		}
+	}
+
+	return;
+}
+
+
+void ClusterCullClass::GetVertex(const float* heights, int bufferVertex, XMFLOAT3& vertex)
+{
+	int index;
+
+
+	// The draws index the vertex buffer, find the grid vertex it was made from.
+	index = m_Geomipmap->GetGridVertex(bufferVertex);
+
+	// Rows run towards negative z like the vertex buffer.
+	vertex.x = (float)(index % m_terrainWidth);
+	vertex.y = heights[index];
+	vertex.z = (float)((m_terrainHeight - 1) - (index / m_terrainWidth));
+	return;
+}
+
+
+bool ClusterCullClass::GetTriangleNormal(const float* heights, int baseVertex, const unsigned short* indices, XMFLOAT3& normal)
+{
+	XMFLOAT3 vertex1, vertex2, vertex3;
+	float ux, uy, uz, vx, vy, vz, length;
+
+
+	GetVertex(heights, baseVertex + indices[0], vertex1);
+	GetVertex(heights, baseVertex + indices[1], vertex2);
+	GetVertex(heights, baseVertex + indices[2], vertex3);
+
+	ux = vertex2.x - vertex1.x;
+	uy = vertex2.y - vertex1.y;
+	uz = vertex2.z - vertex1.z;
+	vx = vertex3.x - vertex1.x;
+	vy = vertex3.y - vertex1.y;
+	vz = vertex3.z - vertex1.z;
+
+	normal.x = (uy * vz) - (uz * vy);
+	normal.y = (uz * vx) - (ux * vz);
+	normal.z = (ux * vy) - (uy * vx);
+
+	// The front face of the terrain is its top.
+	if (normal.y < 0.0f)
+	{
+		normal.x = -normal.x;
+		normal.y = -normal.y;
+		normal.z = -normal.z;
+	}
+
+	length = sqrtf((normal.x * normal.x) + (normal.y * normal.y) + (normal.z * normal.z));
+	if (length <= 0.0f)
+	{
+		return false;
+	}
+
+	normal.x /= length;
+	normal.y /= length;
+	normal.z /= length;
+
+	return true;
+}
+
+
+bool ClusterCullClass::IsBackFacing(const ClusterType& bounds)
+{
+	float dx, dy, dz, distance, cosView, sinView, sinCone;
+
+
+	// A cone of 90 degrees or more always has a normal facing the camera.
+	if (bounds.cutoff <= 0.0f)
+	{
+		return false;
+	}
+
+	dx = bounds.centerX - m_cameraX;
+	dy = bounds.centerY - m_cameraY;
+	dz = bounds.centerZ - m_cameraZ;
+	distance = sqrtf((dx * dx) + (dy * dy) + (dz * dz));
+	if (distance <= bounds.radius)
+	{
+		return false;
+	}
+
+	// Angle between the cone axis and the line from the camera to the sphere center.
+	cosView = ((dx * bounds.axisX) + (dy * bounds.axisY) + (dz * bounds.axisZ)) / distance;
+	sinView = 1.0f - (cosView * cosView);
+	sinView = (sinView > 0.0f) ? sqrtf(sinView) : 0.0f;
+	sinCone = sqrtf(1.0f - (bounds.cutoff * bounds.cutoff));
+
+	/*
+		A triangle faces away when its normal points along the view ray, dot(normal, point - camera) > 0.
+		The normal of the cone closest to facing the camera is at the view angle plus the cone angle and
+		a point of the sphere takes at most the radius off the dot product, so the whole cluster faces away
+		when distance * cos(view + cone) is still above the radius.
+	*/
+	return (distance * ((cosView * bounds.cutoff) - (sinView * sinCone))) > bounds.radius;
+}
+
+
+bool ClusterCullClass::IsOutside(const ClusterType& bounds)
+{
+	int i;
+
+
+	// Outside when the sphere is completely behind any one plane.
+	for (i = 0; i < CLUSTER_CULL_PLANES; i++)
+	{
+		if (((m_planes[i].a * bounds.centerX) + (m_planes[i].b * bounds.centerY) + (m_planes[i].c * bounds.centerZ) + m_planes[i].d) < -bounds.radius)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: clustercullclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _CLUSTERCULLCLASS_H_
+#define _CLUSTERCULLCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <math.h>
+#include <float.h>
+#include <directxmath.h>
+
+#include "geomipmapclass.h"
+#include "parallelforclass.h"
+
+using namespace DirectX;
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int CLUSTER_CULL_PLANES = 6;
+const int CLUSTER_CULL_MAX_LEVELS = 16;
+const int CLUSTER_CULL_PATCH_GRAIN = 16;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: ClusterCullClass
+////////////////////////////////////////////////////////////////////////////////
+// Culls the clusters the geomipmap index sets are split into, blocks of about
+// a hundred triangles that are each a range of their set. Every cluster of
+// every patch and level has a bounding sphere and a cone around the normals
+// of its triangles, both taken over the unstitched and the fully stitched
+// triangles so any stitch mask is covered. A cluster is skipped when it lies
+// outside the view frustum or when every one of its triangles faces away
+// from the camera wherever it is in the sphere, the case of steep slopes seen
+// from behind.
+//
+// The normals are the front faces of the terrain, so they point up. The
+// bounds are worked out from the heights at load on all the cores and again
+// for the patches under a deformation.
+class ClusterCullClass
+{
+private:
+	struct ClusterType
+	{
+		float axisX, axisY, axisZ, cutoff;
+		float centerX, centerY, centerZ, radius;
+	};
+
+	struct PlaneType
+	{
+		float a, b, c, d;
+	};
+
+public:
+	ClusterCullClass();
+	ClusterCullClass(const ClusterCullClass&);
+	~ClusterCullClass();
+
+	bool Initialize(const float*, int, int, GeomipmapClass*);
+	void Shutdown();
+
+	void UpdateRegion(const float*, int, int, int, int);
+
+	void ConstructFrustum(XMMATRIX);
+	void SetCamera(float, float, float);
+	bool IsVisible(int, int, int, int);
+
+	void GetStats(int&, int&, int&);
+
+private:
+	void BuildPatch(const float*, int);
+	void BuildCluster(const float*, int, int, int, ClusterType&);
+	void GetVertex(const float*, int, XMFLOAT3&);
+	bool GetTriangleNormal(const float*, int, const unsigned short*, XMFLOAT3&);
+	bool IsBackFacing(const ClusterType&);
+	bool IsOutside(const ClusterType&);
+
+private:
+	GeomipmapClass* m_Geomipmap;
+	int m_terrainWidth, m_terrainHeight;
+	int m_patchCount, m_patchSize, m_clustersPerPatch;
+	int m_levelOffsets[CLUSTER_CULL_MAX_LEVELS];
+	ClusterType* m_clusters;
+
+	PlaneType m_planes[CLUSTER_CULL_PLANES];
+	float m_cameraX, m_cameraY, m_cameraZ;
+
+	int m_testedTriangles, m_backFacingTriangles, m_outsideTriangles;
+};
+
+#endif
@@ -0,0 +1,1322 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: geomipmapclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "geomipmapclass.h"
+
+
+GeomipmapClass::GeomipmapClass()
+{
+	m_Arena = 0;
+	m_buildPool = 0;
+	m_indexPool = 0;
+	m_ownsIndexPool = false;
+	m_indexSets = 0;
+	m_clusterRanges = 0;
+	m_patches = 0;
+	m_levelErrors = 0;
+}
+
+
+GeomipmapClass::GeomipmapClass(const GeomipmapClass& other)
+{
+}
+
+
+GeomipmapClass::~GeomipmapClass()
+{
+}
+
+
+bool GeomipmapClass::Initialize(int terrainWidth, int terrainHeight, int patchSize, float lodDistance)
+{
+	bool result;
+
+
+	// Check the patch size against the terrain and work out the number of levels.
+	result = SetLayout(terrainWidth, terrainHeight, patchSize, lodDistance);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Build the shared index pool holding every (level, stitch) combination.
+	result = BuildIndexPool();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Reorder the triangles of every index set for the post transform vertex cache.
+	result = OptimizeIndexPool();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Create the patch array.
+	result = CreatePatches();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Store the pool with 16 bit indices, they are relative to the patch corner so they always fit.
+	result = ConvertIndexPool();
+	if (!result)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+bool GeomipmapClass::Initialize(int terrainWidth, int terrainHeight, int patchSize, float lodDistance, unsigned short* indexPool, int indexPoolSize)
+{
+	bool result;
+
+
+	result = SetLayout(terrainWidth, terrainHeight, patchSize, lodDistance);
+	if (!result)
+	{
+		return false;
+	}
+
+	// The index sets come out the same size whatever order the optimizer left their triangles in.
+	result = CountIndexSets();
+	if (!result)
+	{
+		return false;
+	}
+
+	if (m_indexPoolSize != indexPoolSize)
+	{
+		return false;
+	}
+
+	result = CreatePatches();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Use the optimized pool from the terrain file as it is, it belongs to the caller.
+	m_indexPool = indexPool;
+	m_ownsIndexPool = false;
+
+	// Only check that every index stays inside its patch, there is no build pool to compare against.
+	result = VerifyIndexPool();
+	if (!result)
+	{
+		return false;
+	}
+
+	// The pool was measured when it was built.
+	m_acmrBefore = 0.0f;
+	m_acmrAfter = 0.0f;
+
+	return true;
+}
+
+
+bool GeomipmapClass::SetLayout(int terrainWidth, int terrainHeight, int patchSize, float lodDistance)
+{
+	int i;
+
+
+	m_terrainWidth = terrainWidth;
+	m_terrainHeight = terrainHeight;
+	m_patchSize = patchSize;
+	m_lodDistance = lodDistance;
+
+	// The patch size must be a power of two that evenly divides the terrain so every patch shares the same index sets.
+	if ((m_patchSize < 2) || ((m_patchSize & (m_patchSize - 1)) != 0))
+	{
+		return false;
+	}
+
+	// A cluster has to hold whole cells of the finest level.
+	if ((GEOMIPMAP_CLUSTER_SIZE < 2) || ((GEOMIPMAP_CLUSTER_SIZE & (GEOMIPMAP_CLUSTER_SIZE - 1)) != 0))
+	{
+		return false;
+	}
+
+	if ((((m_terrainWidth - 1) % m_patchSize) != 0) || (((m_terrainHeight - 1) % m_patchSize) != 0))
+	{
+		return false;
+	}
+
+	m_patchCountX = (m_terrainWidth - 1) / m_patchSize;
+	m_patchCountZ = (m_terrainHeight - 1) / m_patchSize;
+
+	// Each level doubles the cell size, the coarsest level covers a whole patch with a single cell.
+	m_levelCount = 0;
+	for (i = 2; i <= m_patchSize; i *= 2)
+	{
+		m_levelCount++;
+	}
+
+	return true;
+}
+
+
+bool GeomipmapClass::CreatePatches()
+{
+	int i, j, index;
+
+
+	m_patches = new PatchType[m_patchCountX * m_patchCountZ];
+	if (!m_patches)
+	{
+		return false;
+	}
+
+	for (j = 0; j < m_patchCountZ; j++)
+	{
+		for (i = 0; i < m_patchCountX; i++)
+		{
+			index = (m_patchCountX * j) + i;
+
+			// The base vertex is the top left corner of the patch in its strip of the vertex buffer, the corner vertex is the same corner in the terrain grid.
+			m_patches[index].baseVertex = GetStripVertex(i, j * m_patchSize);
+			m_patches[index].cornerVertex = (m_terrainWidth * j * m_patchSize) + (i * m_patchSize);
+
+			// Store the patch center in world space, rows run towards negative z.
+			m_patches[index].centerX = (float)(i * m_patchSize) + ((float)m_patchSize / 2.0f);
+			m_patches[index].centerZ = (float)(m_terrainHeight - 1) - ((float)(j * m_patchSize) + ((float)m_patchSize / 2.0f));
+
+			m_patches[index].level = 0;
+			m_patches[index].stitchMask = 0;
+			m_patches[index].minHeight = 0.0f;
+			m_patches[index].maxHeight = 0.0f;
+			m_patches[index].distance = 0.0f;
+		}
+	}
+
+	return true;
+}
+
+
+void GeomipmapClass::Shutdown()
+{
+	// Release the build pool if Initialize failed part way.
+	ShutdownBuildPool();
+
+	// Release the level errors.
+	if (m_levelErrors)
+	{
+		delete[] m_levelErrors;
+		m_levelErrors = 0;
+	}
+
+	// Release the patch array.
+	if (m_patches)
+	{
+		delete[] m_patches;
+		m_patches = 0;
+	}
+
+	// Release the cluster ranges.
+	if (m_clusterRanges)
+	{
+		delete[] m_clusterRanges;
+		m_clusterRanges = 0;
+	}
+
+	// Release the index sets.
+	if (m_indexSets)
+	{
+		delete[] m_indexSets;
+		m_indexSets = 0;
+	}
+
+	// Release the index pool, unless it came from the caller.
+	if (m_indexPool && m_ownsIndexPool)
+	{
+		delete[] m_indexPool;
+	}
+	m_indexPool = 0;
+	m_ownsIndexPool = false;
+
+	return;
+}
+
+
+bool GeomipmapClass::ComputeErrors(const float* heights)
+{
+	int i;
+
+
+	m_levelErrors = new float[m_patchCountX * m_patchCountZ * m_levelCount];
+	if (!m_levelErrors)
+	{
+		return false;
+	}
+
+	for (i = 0; i < (m_patchCountX * m_patchCountZ); i++)
+	{
+		ComputePatchErrors(heights, i);
+	}
+
+	return true;
+}
+
+
+void GeomipmapClass::UpdateRegion(const float* heights, int left, int top, int right, int bottom)
+{
+	int i, j, firstX, firstZ, lastX, lastZ;
+
+
+	// A patch shares its border vertices with the next one, so an edit on a border reaches both.
+	firstX = (left > 0) ? (left - 1) / m_patchSize : 0;
+	firstZ = (top > 0) ? (top - 1) / m_patchSize : 0;
+	lastX = right / m_patchSize;
+	lastZ = bottom / m_patchSize;
+
+	lastX = (lastX < m_patchCountX) ? lastX : (m_patchCountX - 1);
+	lastZ = (lastZ < m_patchCountZ) ? lastZ : (m_patchCountZ - 1);
+
+	// Measure the height range and the level errors of the patches under the rectangle again.
+	for (j = firstZ; j <= lastZ; j++)
+	{
+		for (i = firstX; i <= lastX; i++)
+		{
+			ComputePatchErrors(heights, (m_patchCountX * j) + i);
+		}
+	}
+
+	return;
+}
+
+
+void GeomipmapClass::SelectLevels(float cameraX, float cameraZ)
+{
+	int i, level;
+	float dx, dz, distance;
+
+
+	// Pick a level for every patch from its distance to the camera.
+	for (i = 0; i < (m_patchCountX * m_patchCountZ); i++)
+	{
+		dx = m_patches[i].centerX - cameraX;
+		dz = m_patches[i].centerZ - cameraZ;
+		distance = sqrtf((dx * dx) + (dz * dz));
+
+		level = (int)(distance / m_lodDistance);
+		if (level > (m_levelCount - 1))
+		{
+			level = m_levelCount - 1;
+		}
+
+		m_patches[i].level = level;
+	}
+
+	// Limit neighbouring patches to one level apart and work out which sides need stitching.
+	StitchLevels();
+
+	return;
+}
+
+
+void GeomipmapClass::SelectLevels(float cameraX, float cameraY, float cameraZ, float projectionScale, float maxError, int triangleBudget)
+{
+	int i, step;
+	float low, high, bound, error;
+
+
+	// The distances stay the same while the error bound is searched, measure them once.
+	for (i = 0; i < (m_patchCountX * m_patchCountZ); i++)
+	{
+		m_patches[i].distance = GetPatchDistance(i, cameraX, cameraY, cameraZ);
+	}
+
+	// Take the coarsest level of every patch that keeps it within the error bound.
+	ApplyErrorBound(projectionScale, maxError);
+	if ((triangleBudget <= 0) || (GetTriangleCount() <= triangleBudget))
+	{
+		return;
+	}
+
+	// Over the budget, so the bound has to go up. With every patch at its coarsest level the bound is the largest error left.
+	low = maxError;
+	high = maxError;
+	for (i = 0; i < (m_patchCountX * m_patchCountZ); i++)
+	{
+		error = m_levelErrors[(i * m_levelCount) + m_levelCount - 1] * projectionScale / m_patches[i].distance;
+		if (error > high)
+		{
+			high = error;
+		}
+	}
+
+	// Fewer triangles only ever come from a higher bound, so halve the range between one that fits the budget and one that does not.
+	for (step = 0; step < GEOMIPMAP_BUDGET_STEPS; step++)
+	{
+		bound = (low + high) / 2.0f;
+
+		ApplyErrorBound(projectionScale, bound);
+		if (GetTriangleCount() <= triangleBudget)
+		{
+			high = bound;
+		}
+		else
+		{
+			low = bound;
+		}
+	}
+
+	// Settle on the lowest bound found that fits, or the coarsest levels when even they do not.
+	ApplyErrorBound(projectionScale, high);
+
+	return;
+}
+
+
+float GeomipmapClass::GetScreenError(float cameraX, float cameraY, float cameraZ, float projectionScale)
+{
+	int i;
+	float error, screenError;
+
+
+	// Largest error in pixels of any patch at the level it was given.
+	screenError = 0.0f;
+	for (i = 0; i < (m_patchCountX * m_patchCountZ); i++)
+	{
+		error = m_levelErrors[(i * m_levelCount) + m_patches[i].level] * projectionScale / GetPatchDistance(i, cameraX, cameraY, cameraZ);
+		if (error > screenError)
+		{
+			screenError = error;
+		}
+	}
+
+	return screenError;
+}
+
+
+int GeomipmapClass::GetTriangleCount()
+{
+	int i, set, triangleCount;
+
+
+	// Count the triangles of the index set each patch draws with, the stitched sets have a few less.
+	triangleCount = 0;
+	for (i = 0; i < (m_patchCountX * m_patchCountZ); i++)
+	{
+		set = (m_patches[i].level * STITCH_COMBINATIONS) + m_patches[i].stitchMask;
+		triangleCount += m_indexSets[set].indexCount / 3;
+	}
+
+	return triangleCount;
+}
+
+
+int GeomipmapClass::GetPatchCount()
+{
+	return m_patchCountX * m_patchCountZ;
+}
+
+
+int GeomipmapClass::GetPatchSize()
+{
+	return m_patchSize;
+}
+
+
+int GeomipmapClass::GetLevelCount()
+{
+	return m_levelCount;
+}
+
+
+void GeomipmapClass::GetPatchDraw(int patch, PatchDrawType& draw)
+{
+	int set;
+
+
+	set = (m_patches[patch].level * STITCH_COMBINATIONS) + m_patches[patch].stitchMask;
+
+	draw.indexOffset = m_indexSets[set].indexOffset;
+	draw.indexCount = m_indexSets[set].indexCount;
+	draw.baseVertex = m_patches[patch].baseVertex;
+	draw.level = m_patches[patch].level;
+	draw.stitchMask = m_patches[patch].stitchMask;
+
+	return;
+}
+
+
+void GeomipmapClass::GetLevelDraw(int level, int stitchMask, PatchDrawType& draw)
+{
+	int set;
+
+
+	// The index sets never change after Initialize so this is safe from any thread, the caller picks the base vertex.
+	set = (level * STITCH_COMBINATIONS) + stitchMask;
+
+	draw.indexOffset = m_indexSets[set].indexOffset;
+	draw.indexCount = m_indexSets[set].indexCount;
+	draw.baseVertex = 0;
+	draw.level = level;
+	draw.stitchMask = stitchMask;
+
+	return;
+}
+
+
+int GeomipmapClass::GetPatchLevel(int patch)
+{
+	return m_patches[patch].level;
+}
+
+
+int GeomipmapClass::GetPatchBaseVertex(int patch)
+{
+	return m_patches[patch].baseVertex;
+}
+
+
+int GeomipmapClass::GetVertexCount()
+{
+	return GetStripCount() * (m_patchSize + 1) * m_terrainHeight;
+}
+
+
+int GeomipmapClass::GetStripCount()
+{
+	return m_patchCountX;
+}
+
+
+int GeomipmapClass::GetStripVertex(int strip, int row)
+{
+	/*
+		The vertex buffer is split into strips one patch wide that run down the whole terrain. A strip
+		holds its patchSize + 1 columns row by row, so the column it shares with the next strip is in
+		both. Every patch is then a block of its strip with a row stride of patchSize + 1, which keeps
+		the patch indices below (patchSize + 1)^2 whatever the size of the terrain.
+	*/
+	return (strip * (m_patchSize + 1) * m_terrainHeight) + (row * (m_patchSize + 1));
+}
+
+
+int GeomipmapClass::GetBufferVertex(int gridVertex)
+{
+	int row, column, strip;
+
+
+	row = gridVertex / m_terrainWidth;
+	column = gridVertex % m_terrainWidth;
+
+	// A column shared by two strips is taken from the left one, the last column only belongs to the last strip.
+	strip = column / m_patchSize;
+	if (strip == m_patchCountX)
+	{
+		strip--;
+	}
+
+	return GetStripVertex(strip, row) + (column - (strip * m_patchSize));
+}
+
+
+int GeomipmapClass::GetGridVertex(int vertex)
+{
+	int strip, row, column;
+
+
+	strip = vertex / ((m_patchSize + 1) * m_terrainHeight);
+	vertex -= strip * (m_patchSize + 1) * m_terrainHeight;
+
+	row = vertex / (m_patchSize + 1);
+	column = (strip * m_patchSize) + (vertex % (m_patchSize + 1));
+
+	return (row * m_terrainWidth) + column;
+}
+
+
+int GeomipmapClass::GetClusterCount(int level)
+{
+	return GetClustersAcross(level) * GetClustersAcross(level);
+}
+
+
+int GeomipmapClass::GetClustersAcross(int level)
+{
+	int clustersAcross;
+
+
+	// A cluster spans GEOMIPMAP_CLUSTER_SIZE quads at the finest level and doubles with each level, so it keeps about the same
+	// number of triangles until it covers the whole patch.
+	clustersAcross = m_patchSize / (GEOMIPMAP_CLUSTER_SIZE << level);
+	if (clustersAcross < 1)
+	{
+		clustersAcross = 1;
+	}
+
+	return clustersAcross;
+}
+
+
+void GeomipmapClass::GetClusterDraw(const PatchDrawType& patchDraw, int cluster, PatchDrawType& draw)
+{
+	int range;
+
+
+	// The clusters of an index set follow each other in the pool, row by row from the top left of the patch.
+	range = m_indexSets[(patchDraw.level * STITCH_COMBINATIONS) + patchDraw.stitchMask].firstCluster + cluster;
+
+	draw.indexOffset = m_clusterRanges[range].indexOffset;
+	draw.indexCount = m_clusterRanges[range].indexCount;
+	draw.baseVertex = patchDraw.baseVertex;
+	draw.level = patchDraw.level;
+	draw.stitchMask = patchDraw.stitchMask;
+
+	return;
+}
+
+
+unsigned short* GeomipmapClass::GetIndexPool()
+{
+	return m_indexPool;
+}
+
+
+int GeomipmapClass::GetIndexPoolSize()
+{
+	return m_indexPoolSize;
+}
+
+
+void GeomipmapClass::MeasureCache(const PatchDrawType* draws, int drawCount, int cacheSize, bool lru, ArenaClass* arena, float& acmr, float& atvr)
+{
+	int i, misses, triangles, vertices, setMisses, setVertices;
+
+
+	// Simulate a list of patch draws, every draw starts with an empty cache.
+	misses = 0;
+	triangles = 0;
+	vertices = 0;
+	for (i = 0; i < drawCount; i++)
+	{
+		MeasureRange(draws[i].indexOffset, draws[i].indexCount, cacheSize, lru, arena, setMisses, setVertices);
+		misses += setMisses;
+		vertices += setVertices;
+		triangles += draws[i].indexCount / 3;
+	}
+
+	acmr = (triangles > 0) ? (float)misses / (float)triangles : 0.0f;
+	atvr = (vertices > 0) ? (float)misses / (float)vertices : 0.0f;
+
+	return;
+}
+
+
+void GeomipmapClass::GetCacheOptimization(float& acmrBefore, float& acmrAfter)
+{
+	// Whole pool ACMR before and after the reordering, for a FIFO cache of VERTEX_CACHE_REPORT_SIZE entries.
+	acmrBefore = m_acmrBefore;
+	acmrAfter = m_acmrAfter;
+	return;
+}
+
+
+bool GeomipmapClass::CountIndexSets()
+{
+	int level, mask, set, cluster, range;
+
+
+	// Create the index set table.
+	m_indexSets = new IndexSetType[m_levelCount * STITCH_COMBINATIONS];
+	if (!m_indexSets)
+	{
+		return false;
+	}
+
+	// Create the cluster range table, every set of a level has the same clusters.
+	m_clusterRangeCount = 0;
+	for (level = 0; level < m_levelCount; level++)
+	{
+		m_clusterRangeCount += GetClusterCount(level) * STITCH_COMBINATIONS;
+	}
+
+	m_clusterRanges = new ClusterRangeType[m_clusterRangeCount];
+	if (!m_clusterRanges)
+	{
+		return false;
+	}
+
+	// Count the indices of every cluster of every set so the pool can be allocated once.
+	m_indexPoolSize = 0;
+	range = 0;
+	for (level = 0; level < m_levelCount; level++)
+	{
+		for (mask = 0; mask < STITCH_COMBINATIONS; mask++)
+		{
+			set = (level * STITCH_COMBINATIONS) + mask;
+
+			m_indexSets[set].indexOffset = m_indexPoolSize;
+			m_indexSets[set].firstCluster = range;
+
+			for (cluster = 0; cluster < GetClusterCount(level); cluster++)
+			{
+				m_clusterRanges[range].indexOffset = m_indexPoolSize;
+				m_clusterRanges[range].indexCount = BuildCluster(level, mask, cluster, 0);
+
+				m_indexPoolSize += m_clusterRanges[range].indexCount;
+				range++;
+			}
+
+			m_indexSets[set].indexCount = m_indexPoolSize - m_indexSets[set].indexOffset;
+		}
+	}
+
+	return true;
+}
+
+
+bool GeomipmapClass::BuildIndexPool()
+{
+	int level, mask, offset;
+	bool result;
+
+
+	// First pass counts the indices of every set.
+	result = CountIndexSets();
+	if (!result)
+	{
+		return false;
+	}
+
+	// The 32 bit build pool and the working arrays of the optimizer come from a load arena that is gone when Initialize returns.
+	m_Arena = new ArenaClass;
+	if (!m_Arena)
+	{
+		return false;
+	}
+
+	result = m_Arena->Initialize((sizeof(unsigned long) * m_indexPoolSize) + GEOMIPMAP_SCRATCH_SIZE);
+	if (!result)
+	{
+		return false;
+	}
+
+	m_buildPool = m_Arena->AllocateArray<unsigned long>(m_indexPoolSize);
+	if (!m_buildPool)
+	{
+		return false;
+	}
+
+	// Second pass writes the indices.
+	offset = 0;
+	for (level = 0; level < m_levelCount; level++)
+	{
+		for (mask = 0; mask < STITCH_COMBINATIONS; mask++)
+		{
+			offset += BuildIndexSet(level, mask, m_buildPool + offset);
+		}
+	}
+
+	return true;
+}
+
+
+int GeomipmapClass::BuildIndexSet(int level, int stitchMask, unsigned long* indices)
+{
+	int cluster, count;
+
+
+	// The set is its clusters one after the other.
+	count = 0;
+	for (cluster = 0; cluster < GetClusterCount(level); cluster++)
+	{
+		count += BuildCluster(level, stitchMask, cluster, indices ? (indices + count) : 0);
+	}
+
+	return count;
+}
+
+
+int GeomipmapClass::BuildCluster(int level, int stitchMask, int cluster, unsigned long* indices)
+{
+	int half, cellCount, clusterCells, firstRow, firstColumn, cellRow, cellColumn, row, column, center, count, k, next, stride;
+	int ring[8];
+	bool present[8];
+
+
+	/*
+		Every cell of a level is drawn as a fan around its center I.
+		A midpoint is dropped when the cell lies on a side stitched to a
+		coarser neighbour, which leaves the edge with the neighbour's spacing.
+
+		A ---- E ---- B
+		| \    |    / |
+		|   \  |  /   |
+		H ---- I ---- F
+		|   /  |  \   |
+		| /    |    \ |
+		D ---- G ---- C
+	*/
+
+	half = 1 << level;
+	cellCount = m_patchSize / (half * 2);
+	stride = m_patchSize + 1;
+	count = 0;
+
+	// Only the square block of cells under the cluster.
+	clusterCells = cellCount / GetClustersAcross(level);
+	firstRow = (cluster / GetClustersAcross(level)) * clusterCells;
+	firstColumn = (cluster % GetClustersAcross(level)) * clusterCells;
+
+	for (cellRow = firstRow; cellRow < (firstRow + clusterCells); cellRow++)
+	{
+		for (cellColumn = firstColumn; cellColumn < (firstColumn + clusterCells); cellColumn++)
+		{
+			row = cellRow * half * 2;
+			column = cellColumn * half * 2;
+
+			// Indexes are relative to the top left vertex of the patch, the rows of its strip are a patch wide.
+			center = (stride * (row + half)) + (column + half);
+
+			// Go around the cell in clockwise order starting with A.
+			ring[0] = (stride * row) + column;                            // A
+			ring[1] = (stride * row) + (column + half);                   // E
+			ring[2] = (stride * row) + (column + half * 2);               // B
+			ring[3] = (stride * (row + half)) + (column + half * 2);      // F
+			ring[4] = (stride * (row + half * 2)) + (column + half * 2);  // C
+			ring[5] = (stride * (row + half * 2)) + (column + half);      // G
+			ring[6] = (stride * (row + half * 2)) + column;               // D
+			ring[7] = (stride * (row + half)) + column;                   // H
+
+			present[0] = present[2] = present[4] = present[6] = true;
+			present[1] = !((cellRow == 0) && (stitchMask & STITCH_NORTH));
+			present[3] = !((cellColumn == cellCount - 1) && (stitchMask & STITCH_EAST));
+			present[5] = !((cellRow == cellCount - 1) && (stitchMask & STITCH_SOUTH));
+			present[7] = !((cellColumn == 0) && (stitchMask & STITCH_WEST));
+
+			for (k = 0; k < 8; k++)
+			{
+				if (!present[k])
+				{
+					continue;
+				}
+
+				// Find the next vertex present on the ring.
+				next = (k + 1) % 8;
+				if (!present[next])
+				{
+					next = (next + 1) % 8;
+				}
+
+				if (indices)
+				{
+					indices[count] = center;
+					indices[count + 1] = ring[k];
+					indices[count + 2] = ring[next];
+				}
+
+				count += 3;
+			}
+		}
+	}
+
+	return count;
+}
+
+
+bool GeomipmapClass::OptimizeIndexPool()
+{
+	VertexCacheClass vertexCache;
+	int range;
+	float atvr;
+	bool result;
+
+
+	MeasurePool(VERTEX_CACHE_REPORT_SIZE, false, m_acmrBefore, atvr);
+
+	// Each cluster is optimized on its own so its triangles stay a range that can be drawn or culled by itself.
+	for (range = 0; range < m_clusterRangeCount; range++)
+	{
+		result = vertexCache.OptimizeTriangles(m_buildPool + m_clusterRanges[range].indexOffset, m_clusterRanges[range].indexCount, VERTEX_CACHE_SIZE, m_Arena);
+		if (!result)
+		{
+			return false;
+		}
+	}
+
+	MeasurePool(VERTEX_CACHE_REPORT_SIZE, false, m_acmrAfter, atvr);
+
+	return true;
+}
+
+
+bool GeomipmapClass::ConvertIndexPool()
+{
+	bool result;
+
+
+	// Create the 16 bit index pool.
+	m_indexPool = new unsigned short[m_indexPoolSize];
+	if (!m_indexPool)
+	{
+		return false;
+	}
+
+	m_ownsIndexPool = true;
+
+	// Narrow the optimized pool, this fails if any index does not fit.
+	result = ConvertIndices(m_buildPool, m_indexPool, m_indexPoolSize);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Make sure every patch still draws exactly the same grid vertices.
+	result = VerifyIndexPool();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Only the 16 bit pool is kept.
+	ShutdownBuildPool();
+
+	return true;
+}
+
+
+bool GeomipmapClass::ConvertIndices(const unsigned long* source, unsigned short* destination, int indexCount)
+{
+	int i;
+
+
+	for (i = 0; i < indexCount; i++)
+	{
+		if (source[i] > 0xffff)
+		{
+			return false;
+		}
+
+		destination[i] = (unsigned short)source[i];
+	}
+
+	return true;
+}
+
+
+bool GeomipmapClass::VerifyIndexPool()
+{
+	int i, level, mask, set, cluster, range, clusterSize, firstRow, firstColumn, row, column, vertex, patch, vertexCount, stride;
+
+
+	/*
+		Both pools are drawn with the same offsets and base vertex, so the triangles are the
+		same if every 16 bit index widens back to its 32 bit value (a pool loaded from a
+		terrain file has nothing to compare against). Each index must also stay
+		inside the footprint of its cluster, which keeps it inside the patch so every
+		patch's base vertex lands on the intended vertices of its strip, and keeps
+		the cluster ranges right for the culling.
+	*/
+
+	vertexCount = GetVertexCount();
+	stride = m_patchSize + 1;
+
+	for (level = 0; level < m_levelCount; level++)
+	{
+		clusterSize = m_patchSize / GetClustersAcross(level);
+
+		for (mask = 0; mask < STITCH_COMBINATIONS; mask++)
+		{
+			set = (level * STITCH_COMBINATIONS) + mask;
+
+			for (cluster = 0; cluster < GetClusterCount(level); cluster++)
+			{
+				range = m_indexSets[set].firstCluster + cluster;
+				firstRow = (cluster / GetClustersAcross(level)) * clusterSize;
+				firstColumn = (cluster % GetClustersAcross(level)) * clusterSize;
+
+				for (i = m_clusterRanges[range].indexOffset; i < (m_clusterRanges[range].indexOffset + m_clusterRanges[range].indexCount); i++)
+				{
+					if (m_buildPool && ((unsigned long)m_indexPool[i] != m_buildPool[i]))
+					{
+						return false;
+					}
+
+					row = m_indexPool[i] / stride;
+					column = m_indexPool[i] % stride;
+					if ((row < firstRow) || (row > (firstRow + clusterSize)) || (column < firstColumn) || (column > (firstColumn + clusterSize)))
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	// The far corner of every patch must exist in the vertex buffer.
+	for (patch = 0; patch < (m_patchCountX * m_patchCountZ); patch++)
+	{
+		vertex = m_patches[patch].baseVertex + (stride * m_patchSize) + m_patchSize;
+		if (vertex >= vertexCount)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void GeomipmapClass::ShutdownBuildPool()
+{
+	// The build pool goes away with the load arena.
+	m_buildPool = 0;
+
+	if (m_Arena)
+	{
+		m_Arena->Shutdown();
+		delete m_Arena;
+		m_Arena = 0;
+	}
+
+	return;
+}
+
+
+void GeomipmapClass::MeasurePool(int cacheSize, bool lru, float& acmr, float& atvr)
+{
+	int set, misses, triangles, vertices, setMisses, setVertices;
+
+
+	// Every index set counts once, whatever the patches currently use.
+	misses = 0;
+	triangles = 0;
+	vertices = 0;
+	for (set = 0; set < (m_levelCount * STITCH_COMBINATIONS); set++)
+	{
+		MeasureRange(m_indexSets[set].indexOffset, m_indexSets[set].indexCount, cacheSize, lru, m_Arena, setMisses, setVertices);
+		misses += setMisses;
+		vertices += setVertices;
+		triangles += m_indexSets[set].indexCount / 3;
+	}
+
+	acmr = (triangles > 0) ? (float)misses / (float)triangles : 0.0f;
+	atvr = (vertices > 0) ? (float)misses / (float)vertices : 0.0f;
+
+	return;
+}
+
+
+void GeomipmapClass::MeasureRange(int indexOffset, int indexCount, int cacheSize, bool lru, ArenaClass* arena, int& misses, int& vertices)
+{
+	VertexCacheClass vertexCache;
+	unsigned long* indices;
+	int i;
+	ScratchClass scratch(arena);
+
+
+	misses = 0;
+	vertices = 0;
+
+	// While the pool is being built the 32 bit indices can be used directly.
+	if (m_buildPool)
+	{
+		misses = vertexCache.SimulateCache(m_buildPool + indexOffset, indexCount, cacheSize, lru);
+		vertices = vertexCache.CountVertices(m_buildPool + indexOffset, indexCount, arena);
+		return;
+	}
+
+	// Otherwise widen the 16 bit range into a scratch array for the simulator.
+	indices = scratch.AllocateArray<unsigned long>(indexCount);
+	if (!indices)
+	{
+		return;
+	}
+
+	for (i = 0; i < indexCount; i++)
+	{
+		indices[i] = m_indexPool[indexOffset + i];
+	}
+
+	misses = vertexCache.SimulateCache(indices, indexCount, cacheSize, lru);
+	vertices = vertexCache.CountVertices(indices, indexCount, arena);
+
+	return;
+}
+
+
+void GeomipmapClass::StitchLevels()
+{
+	int i, j, index, neighbour, mask;
+	bool changed;
+
+
+	// Lower any patch that is more than one level coarser than a neighbour until the whole grid settles.
+	do
+	{
+		changed = false;
+
+		for (j = 0; j < m_patchCountZ; j++)
+		{
+			for (i = 0; i < m_patchCountX; i++)
+			{
+				index = (m_patchCountX * j) + i;
+
+				if (j > 0)
+				{
+					neighbour = index - m_patchCountX;
+					if (m_patches[index].level > m_patches[neighbour].level + 1)
+					{
+						m_patches[index].level = m_patches[neighbour].level + 1;
+						changed = true;
+					}
+				}
+
+				if (j < m_patchCountZ - 1)
+				{
+					neighbour = index + m_patchCountX;
+					if (m_patches[index].level > m_patches[neighbour].level + 1)
+					{
+						m_patches[index].level = m_patches[neighbour].level + 1;
+						changed = true;
+					}
+				}
+
+				if (i > 0)
+				{
+					neighbour = index - 1;
+					if (m_patches[index].level > m_patches[neighbour].level + 1)
+					{
+						m_patches[index].level = m_patches[neighbour].level + 1;
+						changed = true;
+					}
+				}
+
+				if (i < m_patchCountX - 1)
+				{
+					neighbour = index + 1;
+					if (m_patches[index].level > m_patches[neighbour].level + 1)
+					{
+						m_patches[index].level = m_patches[neighbour].level + 1;
+						changed = true;
+					}
+				}
+			}
+		}
+	} while (changed);
+
+	// The finer patch of each pair drops its edge midpoints to match the coarser neighbour.
+	for (j = 0; j < m_patchCountZ; j++)
+	{
+		for (i = 0; i < m_patchCountX; i++)
+		{
+			index = (m_patchCountX * j) + i;
+			mask = 0;
+
+			if ((j > 0) && (m_patches[index - m_patchCountX].level > m_patches[index].level))
+			{
+				mask |= STITCH_NORTH;
+			}
+
+			if ((i < m_patchCountX - 1) && (m_patches[index + 1].level > m_patches[index].level))
+			{
+				mask |= STITCH_EAST;
+			}
+
+			if ((j < m_patchCountZ - 1) && (m_patches[index + m_patchCountX].level > m_patches[index].level))
+			{
+				mask |= STITCH_SOUTH;
+			}
+
+			if ((i > 0) && (m_patches[index - 1].level > m_patches[index].level))
+			{
+				mask |= STITCH_WEST;
+			}
+
+			m_patches[index].stitchMask = mask;
+		}
+	}
+
+	return;
+}
+
+
+void GeomipmapClass::ComputePatchErrors(const float* heights, int patch)
+{
+	int row, column, level, vertex;
+	float error;
+
+
+	// Store the height range so the distance to the camera can be measured to the patch box.
+	m_patches[patch].minHeight = heights[m_patches[patch].cornerVertex];
+	m_patches[patch].maxHeight = heights[m_patches[patch].cornerVertex];
+	for (row = 0; row <= m_patchSize; row++)
+	{
+		for (column = 0; column <= m_patchSize; column++)
+		{
+			vertex = m_patches[patch].cornerVertex + (m_terrainWidth * row) + column;
+
+			if (heights[vertex] < m_patches[patch].minHeight)
+			{
+				m_patches[patch].minHeight = heights[vertex];
+			}
+
+			if (heights[vertex] > m_patches[patch].maxHeight)
+			{
+				m_patches[patch].maxHeight = heights[vertex];
+			}
+		}
+	}
+
+	// The error of a level is the largest height difference between its triangles and the full resolution heights.
+	for (level = 0; level < m_levelCount; level++)
+	{
+		error = ComputeLevelError(heights, m_patches[patch].cornerVertex, level);
+
+		// Keep the errors growing with the level so a coarser level never looks closer to the heights.
+		if ((level > 0) && (error < m_levelErrors[(patch * m_levelCount) + level - 1]))
+		{
+			error = m_levelErrors[(patch * m_levelCount) + level - 1];
+		}
+
+		m_levelErrors[(patch * m_levelCount) + level] = error;
+	}
+
+	return;
+}
+
+
+float GeomipmapClass::ComputeLevelError(const float* heights, int cornerVertex, int level)
+{
+	int half, cellCount, cellRow, cellColumn, corner, row, column;
+	float error, difference;
+
+
+	half = 1 << level;
+	cellCount = m_patchSize / (half * 2);
+
+	// Compare every vertex of the patch with the cell triangles of the level that cover it.
+	error = 0.0f;
+	for (cellRow = 0; cellRow < cellCount; cellRow++)
+	{
+		for (cellColumn = 0; cellColumn < cellCount; cellColumn++)
+		{
+			corner = cornerVertex + (m_terrainWidth * cellRow * half * 2) + (cellColumn * half * 2);
+
+			for (row = 0; row <= (half * 2); row++)
+			{
+				for (column = 0; column <= (half * 2); column++)
+				{
+					difference = fabsf(heights[corner + (m_terrainWidth * row) + column] - InterpolateCell(heights, corner, half, row, column));
+					if (difference > error)
+					{
+						error = difference;
+					}
+				}
+			}
+		}
+	}
+
+	return error;
+}
+
+
+float GeomipmapClass::InterpolateCell(const float* heights, int corner, int half, int row, int column)
+{
+	int dx, dy, side, first;
+	float center, along, sideHeight, fraction, t;
+
+
+	// Height of the cell's fan (see BuildIndexSet) at a vertex of the cell, the center I is at (half, half).
+	center = heights[corner + (m_terrainWidth * half) + half];
+
+	dx = column - half;
+	dy = row - half;
+	if ((dx == 0) && (dy == 0))
+	{
+		return center;
+	}
+
+	// The vertex lies on the line from the center to a point on the cell's border, the fan triangle holding it
+	// spans the border edge that point is on. Along that line the height goes linearly from the center to the border.
+	if (abs(dx) >= abs(dy))
+	{
+		// East or west side, the border point is a fraction of the way down the side column.
+		side = (dx > 0) ? (half * 2) : 0;
+		t = (float)abs(dx) / (float)half;
+		along = (float)half + ((float)dy * (float)half / (float)abs(dx));
+
+		first = (along < (float)half) ? 0 : half;
+		fraction = (along - (float)first) / (float)half;
+		sideHeight = heights[corner + (m_terrainWidth * first) + side] +
+			(fraction * (heights[corner + (m_terrainWidth * (first + half)) + side] - heights[corner + (m_terrainWidth * first) + side]));
+	}
+	else
+	{
+		// North or south side, the border point is a fraction of the way along the side row.
+		side = (dy > 0) ? (half * 2) : 0;
+		t = (float)abs(dy) / (float)half;
+		along = (float)half + ((float)dx * (float)half / (float)abs(dy));
+
+		first = (along < (float)half) ? 0 : half;
+		fraction = (along - (float)first) / (float)half;
+		sideHeight = heights[corner + (m_terrainWidth * side) + first] +
+			(fraction * (heights[corner + (m_terrainWidth * side) + first + half] - heights[corner + (m_terrainWidth * side) + first]));
+	}
+
+	return center + (t * (sideHeight - center));
+}
+
+
+float GeomipmapClass::GetPatchDistance(int patch, float cameraX, float cameraY, float cameraZ)
+{
+	float dx, dy, dz, distance;
+
+
+	// Distance from the camera to the closest point of the patch box, zero along any axis the camera is inside.
+	dx = fabsf(m_patches[patch].centerX - cameraX) - ((float)m_patchSize / 2.0f);
+	dz = fabsf(m_patches[patch].centerZ - cameraZ) - ((float)m_patchSize / 2.0f);
+	dx = (dx > 0.0f) ? dx : 0.0f;
+	dz = (dz > 0.0f) ? dz : 0.0f;
+
+	dy = 0.0f;
+	if (cameraY < m_patches[patch].minHeight)
+	{
+		dy = m_patches[patch].minHeight - cameraY;
+	}
+	else if (cameraY > m_patches[patch].maxHeight)
+	{
+		dy = cameraY - m_patches[patch].maxHeight;
+	}
+
+	// Keep the projected errors finite for the patch under the camera.
+	distance = sqrtf((dx * dx) + (dy * dy) + (dz * dz));
+	if (distance < 1.0f)
+	{
+		distance = 1.0f;
+	}
+
+	return distance;
+}
+
+
+void GeomipmapClass::ApplyErrorBound(float projectionScale, float bound)
+{
+	int i, level;
+
+
+	// The error of a level projects to error * projectionScale / distance pixels, take the coarsest level within the bound.
+	for (i = 0; i < (m_patchCountX * m_patchCountZ); i++)
+	{
+		level = m_levelCount - 1;
+		while ((level > 0) && ((m_levelErrors[(i * m_levelCount) + level] * projectionScale) > (bound * m_patches[i].distance)))
+		{
+			level--;
+		}
+
+		m_patches[i].level = level;
+	}
+
+	// Stitching only ever moves patches to finer levels, so the bound still holds after it.
+	StitchLevels();
+
+	return;
+}
@@ -0,0 +1,155 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: geomipmapclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _GEOMIPMAPCLASS_H_
+#define _GEOMIPMAPCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <math.h>
+#include <stdlib.h>
+
+#include "vertexcacheclass.h"
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int GEOMIPMAP_PATCH_SIZE = 32;
+const float GEOMIPMAP_LOD_DISTANCE = 48.0f;
+const int GEOMIPMAP_BUDGET_STEPS = 16;
+const int GEOMIPMAP_CLUSTER_SIZE = 8;
+const size_t GEOMIPMAP_SCRATCH_SIZE = 4 * 1024 * 1024;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: GeomipmapClass
+////////////////////////////////////////////////////////////////////////////////
+class GeomipmapClass
+{
+public:
+	// Sides of a patch that must be stitched to a coarser neighbour.
+	enum
+	{
+		STITCH_NORTH = 1,
+		STITCH_EAST = 2,
+		STITCH_SOUTH = 4,
+		STITCH_WEST = 8,
+		STITCH_COMBINATIONS = 16
+	};
+
+	struct PatchDrawType
+	{
+		int indexOffset;
+		int indexCount;
+		int baseVertex;
+		int level;
+		int stitchMask;
+	};
+
+private:
+	struct IndexSetType
+	{
+		int indexOffset;
+		int indexCount;
+		int firstCluster;
+	};
+
+	struct ClusterRangeType
+	{
+		int indexOffset;
+		int indexCount;
+	};
+
+	struct PatchType
+	{
+		int level;
+		int stitchMask;
+		int baseVertex, cornerVertex;
+		float centerX, centerZ;
+		float minHeight, maxHeight;
+		float distance;
+	};
+
+public:
+	GeomipmapClass();
+	GeomipmapClass(const GeomipmapClass&);
+	~GeomipmapClass();
+
+	bool Initialize(int, int, int, float);
+	bool Initialize(int, int, int, float, unsigned short*, int);
+	void Shutdown();
+
+	bool ComputeErrors(const float*);
+	void UpdateRegion(const float*, int, int, int, int);
+
+	void SelectLevels(float, float);
+	void SelectLevels(float, float, float, float, float, int);
+	float GetScreenError(float, float, float, float);
+	int GetTriangleCount();
+
+	int GetPatchCount();
+	int GetPatchSize();
+	int GetLevelCount();
+	void GetPatchDraw(int, PatchDrawType&);
+	void GetLevelDraw(int, int, PatchDrawType&);
+	int GetPatchLevel(int);
+	int GetPatchBaseVertex(int);
+	int GetVertexCount();
+	int GetStripCount();
+	int GetStripVertex(int, int);
+	int GetBufferVertex(int);
+	int GetGridVertex(int);
+	int GetClusterCount(int);
+	int GetClustersAcross(int);
+	void GetClusterDraw(const PatchDrawType&, int, PatchDrawType&);
+
+	unsigned short* GetIndexPool();
+	int GetIndexPoolSize();
+
+	void MeasureCache(const PatchDrawType*, int, int, bool, ArenaClass*, float&, float&);
+	void GetCacheOptimization(float&, float&);
+
+private:
+	bool SetLayout(int, int, int, float);
+	bool CreatePatches();
+	bool CountIndexSets();
+	bool BuildIndexPool();
+	int BuildIndexSet(int, int, unsigned long*);
+	int BuildCluster(int, int, int, unsigned long*);
+	bool OptimizeIndexPool();
+	bool ConvertIndexPool();
+	bool ConvertIndices(const unsigned long*, unsigned short*, int);
+	void ShutdownBuildPool();
+	bool VerifyIndexPool();
+	void MeasurePool(int, bool, float&, float&);
+	void MeasureRange(int, int, int, bool, ArenaClass*, int&, int&);
+	void StitchLevels();
+	void ComputePatchErrors(const float*, int);
+	float ComputeLevelError(const float*, int, int);
+	float InterpolateCell(const float*, int, int, int, int);
+	float GetPatchDistance(int, float, float, float);
+	void ApplyErrorBound(float, float);
+
+private:
+	int m_terrainWidth, m_terrainHeight;
+	int m_patchSize, m_patchCountX, m_patchCountZ;
+	int m_levelCount;
+	float m_lodDistance;
+	ArenaClass* m_Arena;
+
+	unsigned long* m_buildPool;
+	unsigned short* m_indexPool;
+	int m_indexPoolSize;
+	bool m_ownsIndexPool;
+	IndexSetType* m_indexSets;
+	ClusterRangeType* m_clusterRanges;
+	int m_clusterRangeCount;
+	PatchType* m_patches;
+	float* m_levelErrors;
+	float m_acmrBefore, m_acmrAfter;
+};
+
+#endif
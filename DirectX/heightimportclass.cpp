@@ -0,0 +1,500 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: heightimportclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "heightimportclass.h"
+
+
+HeightImportClass::HeightImportClass()
+{
+	m_file = 0;
+	m_buffer = 0;
+	m_format = FORMAT_RAW;
+	m_width = 0;
+	m_height = 0;
+	m_sampleSize = 0;
+	m_step = 1;
+	m_bigEndian = false;
+	m_topDown = true;
+	m_dataOffset = 0;
+}
+
+
+HeightImportClass::HeightImportClass(const HeightImportClass& other)
+{
+}
+
+
+HeightImportClass::~HeightImportClass()
+{
+}
+
+
+bool HeightImportClass::Open(const char* filename, int rawWidth, int rawHeight)
+{
+	const char* extension;
+	int error;
+
+
+	// Work out the format from the extension.
+	extension = strrchr(filename, '.');
+	if (!extension)
+	{
+		return false;
+	}
+
+	if ((_stricmp(extension, ".raw") == 0) || (_stricmp(extension, ".r16") == 0))
+	{
+		m_format = FORMAT_RAW;
+	}
+	else if (_stricmp(extension, ".pgm") == 0)
+	{
+		m_format = FORMAT_PGM;
+	}
+	else if (_stricmp(extension, ".tga") == 0)
+	{
+		m_format = FORMAT_TARGA;
+	}
+	else
+	{
+		return false;
+	}
+
+	// Open the height map file for reading in binary.
+	error = fopen_s(&m_file, filename, "rb");
+	if (error != 0)
+	{
+		m_file = 0;
+		return false;
+	}
+
+	// The rows are streamed through this buffer, it is the only memory the import needs.
+	m_buffer = new unsigned char[HEIGHT_IMPORT_BUFFER_SIZE];
+	if (!m_buffer)
+	{
+		return false;
+	}
+
+	// Read the header to find the size, the sample layout and where the samples start.
+	switch (m_format)
+	{
+		case FORMAT_RAW:
+			return ReadRawHeader(rawWidth, rawHeight);
+
+		case FORMAT_PGM:
+			return ReadPgmHeader();
+	}
+
+	return ReadTargaHeader();
+}
+
+
+void HeightImportClass::Close()
+{
+	// Release the row buffer.
+	if (m_buffer)
+	{
+		delete[] m_buffer;
+		m_buffer = 0;
+	}
+
+	// Close the file.
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = 0;
+	}
+
+	return;
+}
+
+
+int HeightImportClass::GetWidth()
+{
+	return m_width;
+}
+
+
+int HeightImportClass::GetHeight()
+{
+	return m_height;
+}
+
+
+bool HeightImportClass::Read(float* heights, int width, int height, int step)
+{
+	// The whole map is one band.
+	return ReadBand(heights, width, height, step, 0, height);
+}
+
+
+bool HeightImportClass::ReadBand(float* heights, int width, int height, int step, int firstRow, int bandHeight)
+{
+	int row, visualRow, rowCount, columnCount, lastRow, firstVisualRow, lastVisualRow, firstFileRow, lastFileRow, i, j;
+	float rowWeight;
+
+
+	m_step = step;
+
+	// The number of rows and columns the kept samples fill, the rest is padding.
+	rowCount = (m_height + step - 1) / step;
+	columnCount = (m_width + step - 1) / step;
+	if ((rowCount > height) || (columnCount > width) || (firstRow < 0) || (bandHeight < 1) || ((firstRow + bandHeight) > height))
+	{
+		return false;
+	}
+
+	// A band that is all padding repeats the last kept row, it is read into the first row of the band.
+	if (firstRow >= rowCount)
+	{
+		if (!ReadBand(heights, width, height, step, rowCount - 1, 1))
+		{
+			return false;
+		}
+
+		for (j = 1; j < bandHeight; j++)
+		{
+			memcpy(&heights[j * width], heights, width * sizeof(float));
+		}
+
+		return true;
+	}
+
+	// The kept rows of the band, the filtered samples are summed in place.
+	lastRow = ((firstRow + bandHeight) < rowCount) ? (firstRow + bandHeight - 1) : (rowCount - 1);
+
+	for (j = firstRow; j <= lastRow; j++)
+	{
+		for (i = 0; i < columnCount; i++)
+		{
+			heights[((j - firstRow) * width) + i] = 0.0f;
+		}
+	}
+
+	// Only the file rows less than a step from the kept rows add to them.
+	firstVisualRow = ((((firstRow - 1) * step) + 1) > 0) ? (((firstRow - 1) * step) + 1) : 0;
+	lastVisualRow = ((((lastRow + 1) * step) - 1) < m_height) ? (((lastRow + 1) * step) - 1) : (m_height - 1);
+
+	// A bottom up file is flipped on the way in so row 0 of the height map is always the north edge.
+	firstFileRow = m_topDown ? firstVisualRow : (m_height - 1 - lastVisualRow);
+	lastFileRow = m_topDown ? lastVisualRow : (m_height - 1 - firstVisualRow);
+
+	if (_fseeki64(m_file, m_dataOffset + ((long long)firstFileRow * m_width * m_sampleSize), SEEK_SET) != 0)
+	{
+		return false;
+	}
+
+	// Go through those rows in the order of the file.
+	for (row = firstFileRow; row <= lastFileRow; row++)
+	{
+		visualRow = m_topDown ? row : (m_height - 1 - row);
+
+		if (!ReadRow(heights, width, firstRow, lastRow, visualRow))
+		{
+			return false;
+		}
+	}
+
+	// Divide the sums by the weights that fell inside the map, they are smaller along the edges.
+	for (j = firstRow; j <= lastRow; j++)
+	{
+		rowWeight = GetFilterWeight(j, m_height);
+		for (i = 0; i < columnCount; i++)
+		{
+			heights[((j - firstRow) * width) + i] /= rowWeight * GetFilterWeight(i, m_width);
+		}
+	}
+
+	// Pad a map that is not a full terrain size by repeating the last column and the last row.
+	for (j = firstRow; j <= lastRow; j++)
+	{
+		for (i = columnCount; i < width; i++)
+		{
+			heights[((j - firstRow) * width) + i] = heights[((j - firstRow) * width) + columnCount - 1];
+		}
+	}
+
+	for (j = lastRow + 1; j < (firstRow + bandHeight); j++)
+	{
+		memcpy(&heights[(j - firstRow) * width], &heights[(lastRow - firstRow) * width], width * sizeof(float));
+	}
+
+	return true;
+}
+
+
+bool HeightImportClass::ReadRawHeader(int rawWidth, int rawHeight)
+{
+	long long fileSize, sampleCount;
+
+
+	// Find the length of the file.
+	if (_fseeki64(m_file, 0, SEEK_END) != 0)
+	{
+		return false;
+	}
+
+	fileSize = _ftelli64(m_file);
+	if (fileSize <= 0)
+	{
+		return false;
+	}
+
+	m_sampleSize = 2;
+	m_bigEndian = false;
+	m_topDown = true;
+	m_dataOffset = 0;
+
+	// The size in the setup file wins, without one the map has to be square.
+	sampleCount = fileSize / m_sampleSize;
+	if ((rawWidth > 0) && (rawHeight > 0))
+	{
+		m_width = rawWidth;
+		m_height = rawHeight;
+	}
+	else
+	{
+		m_width = (int)sqrt((double)sampleCount);
+		while (((long long)m_width * m_width) < sampleCount)
+		{
+			m_width++;
+		}
+		m_height = m_width;
+	}
+
+	// The file has to hold every sample of that size.
+	if (((long long)m_width * m_height) > sampleCount)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+bool HeightImportClass::ReadPgmHeader()
+{
+	int maxValue;
+
+
+	// A binary graymap starts with P5.
+	if ((fgetc(m_file) != 'P') || (fgetc(m_file) != '5'))
+	{
+		return false;
+	}
+
+	// Read the width, the height and the largest sample value.
+	if (!ReadPgmNumber(m_width) || !ReadPgmNumber(m_height) || !ReadPgmNumber(maxValue))
+	{
+		return false;
+	}
+
+	if ((m_width <= 0) || (m_height <= 0) || (maxValue <= 0) || (maxValue > 65535))
+	{
+		return false;
+	}
+
+	// A single white space character separates the header from the samples.
+	if (fgetc(m_file) == EOF)
+	{
+		return false;
+	}
+
+	// Samples over a byte are stored most significant byte first.
+	m_sampleSize = (maxValue < 256) ? 1 : 2;
+	m_bigEndian = true;
+	m_topDown = true;
+	m_dataOffset = _ftelli64(m_file);
+
+	return (m_dataOffset > 0);
+}
+
+
+bool HeightImportClass::ReadPgmNumber(int& value)
+{
+	int input;
+
+
+	// Skip the white space and the comments in front of the number.
+	input = fgetc(m_file);
+	while ((input == ' ') || (input == '\t') || (input == '\r') || (input == '\n') || (input == '#'))
+	{
+		if (input == '#')
+		{
+			while ((input != '\n') && (input != EOF))
+			{
+				input = fgetc(m_file);
+			}
+		}
+
+		input = fgetc(m_file);
+	}
+
+	if ((input < '0') || (input > '9'))
+	{
+		return false;
+	}
+
+	// Read the digits and leave the character after them in the stream.
+	value = 0;
+	while ((input >= '0') && (input <= '9'))
+	{
+		if (value > 100000000)
+		{
+			return false;
+		}
+
+		value = (value * 10) + (input - '0');
+		input = fgetc(m_file);
+	}
+
+	if (input != EOF)
+	{
+		ungetc(input, m_file);
+	}
+
+	return true;
+}
+
+
+bool HeightImportClass::ReadTargaHeader()
+{
+	TargaHeaderType header;
+	unsigned int count;
+
+
+	// Read in the file header.
+	count = (unsigned int)fread(&header, sizeof(TargaHeaderType), 1, m_file);
+	if (count != 1)
+	{
+		return false;
+	}
+
+	// Only uncompressed grayscale images without a color map are height maps.
+	if ((header.imageType != 3) || (header.colorMapType != 0) || ((header.bpp != 8) && (header.bpp != 16)))
+	{
+		return false;
+	}
+
+	m_width = (int)header.width;
+	m_height = (int)header.height;
+	if ((m_width <= 0) || (m_height <= 0))
+	{
+		return false;
+	}
+
+	// Targa images are bottom up unless the descriptor says the origin is at the top.
+	m_sampleSize = header.bpp / 8;
+	m_bigEndian = false;
+	m_topDown = ((header.descriptor & 0x20) != 0);
+	m_dataOffset = sizeof(TargaHeaderType) + header.idLength;
+
+	return true;
+}
+
+
+bool HeightImportClass::ReadRow(float* heights, int width, int firstRow, int lastRow, int visualRow)
+{
+	int column, sampleCount, pieceSamples, i, keptColumn, columnOffset, keptRow, rowOffset, columnCount;
+	unsigned int count;
+	const unsigned char* sample;
+	float* nearRow;
+	float* farRow;
+	float value, nearWeight, farWeight;
+
+
+	/*
+		The tent filter is a step wide on either side, so a sample between two kept rows adds to
+		both of them. The one it is closer to gets the larger weight, a sample on a kept row only
+		adds to that row. The columns are shared out the same way. Kept rows outside the band
+		that is being read are skipped.
+	*/
+	keptRow = visualRow / m_step;
+	rowOffset = visualRow % m_step;
+
+	nearRow = ((keptRow >= firstRow) && (keptRow <= lastRow)) ? &heights[(keptRow - firstRow) * width] : 0;
+	farRow = ((rowOffset > 0) && ((keptRow + 1) >= firstRow) && ((keptRow + 1) <= lastRow)) ? &heights[(keptRow + 1 - firstRow) * width] : 0;
+	nearWeight = (float)(m_step - rowOffset);
+	farWeight = (float)rowOffset;
+
+	columnCount = (m_width + m_step - 1) / m_step;
+
+	// The buffer holds a whole number of samples, long rows are read in several pieces.
+	pieceSamples = HEIGHT_IMPORT_BUFFER_SIZE / m_sampleSize;
+
+	for (column = 0; column < m_width; column += sampleCount)
+	{
+		sampleCount = ((m_width - column) < pieceSamples) ? (m_width - column) : pieceSamples;
+
+		count = (unsigned int)fread(m_buffer, m_sampleSize, sampleCount, m_file);
+		if (count != (unsigned int)sampleCount)
+		{
+			return false;
+		}
+
+		// Add every sample of the piece to the kept samples around it.
+		for (i = 0; i < sampleCount; i++)
+		{
+			sample = &m_buffer[i * m_sampleSize];
+
+			if (m_sampleSize == 1)
+			{
+				value = (float)sample[0];
+			}
+			else if (m_bigEndian)
+			{
+				value = (float)((sample[0] << 8) | sample[1]);
+			}
+			else
+			{
+				value = (float)(sample[0] | (sample[1] << 8));
+			}
+
+			keptColumn = (column + i) / m_step;
+			columnOffset = (column + i) % m_step;
+
+			if (nearRow)
+			{
+				nearRow[keptColumn] += value * nearWeight * (float)(m_step - columnOffset);
+			}
+			if (farRow)
+			{
+				farRow[keptColumn] += value * farWeight * (float)(m_step - columnOffset);
+			}
+
+			if ((columnOffset > 0) && ((keptColumn + 1) < columnCount))
+			{
+				if (nearRow)
+				{
+					nearRow[keptColumn + 1] += value * nearWeight * (float)columnOffset;
+				}
+				if (farRow)
+				{
+					farRow[keptColumn + 1] += value * farWeight * (float)columnOffset;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+
+float HeightImportClass::GetFilterWeight(int kept, int size)
+{
+	int offset, sample;
+	float weight;
+
+
+	// Sum of the tent weights along one side of the kept sample that land inside the map.
+	weight = 0.0f;
+	for (offset = 1 - m_step; offset < m_step; offset++)
+	{
+		sample = (kept * m_step) + offset;
+		if ((sample >= 0) && (sample < size))
+		{
+			weight += (float)(m_step - abs(offset));
+		}
+	}
+
+	return weight;
+}
@@ -0,0 +1,92 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: heightimportclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _HEIGHTIMPORTCLASS_H_
+#define _HEIGHTIMPORTCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int HEIGHT_IMPORT_BUFFER_SIZE = 1024 * 1024;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: HeightImportClass
+////////////////////////////////////////////////////////////////////////////////
+// Streams a height map file straight into the terrain height array. The file
+// is read a row at a time through a fixed buffer, so survey maps far bigger
+// than the terrain never have to fit in memory. A map bigger than the terrain
+// is reduced by the step as it streams in, every kept sample is the tent
+// filtered average of the samples less than a step away, so no ridge falls
+// between the kept rows. The rows land north up whatever order the file
+// stores them in and the samples keep the units of the file, unscaled. A
+// band of rows can be read on its own, only the file rows under it are read.
+//
+// The format comes from the extension: .raw and .r16 are 16 bit little endian
+// samples with the size from the setup file or a square size from the file
+// length, .pgm is a binary 8 or 16 bit graymap and .tga an uncompressed 8 or
+// 16 bit grayscale targa. Close has to be called whether or not Open succeeded.
+class HeightImportClass
+{
+private:
+	enum
+	{
+		FORMAT_RAW,
+		FORMAT_PGM,
+		FORMAT_TARGA
+	};
+
+	struct TargaHeaderType
+	{
+		unsigned char idLength;
+		unsigned char colorMapType;
+		unsigned char imageType;
+		unsigned char colorMap[5];
+		unsigned short originX, originY;
+		unsigned short width, height;
+		unsigned char bpp;
+		unsigned char descriptor;
+	};
+
+public:
+	HeightImportClass();
+	HeightImportClass(const HeightImportClass&);
+	~HeightImportClass();
+
+	bool Open(const char*, int, int);
+	void Close();
+
+	int GetWidth();
+	int GetHeight();
+
+	bool Read(float*, int, int, int);
+	bool ReadBand(float*, int, int, int, int, int);
+
+private:
+	bool ReadRawHeader(int, int);
+	bool ReadPgmHeader();
+	bool ReadPgmNumber(int&);
+	bool ReadTargaHeader();
+	bool ReadRow(float*, int, int, int, int);
+	float GetFilterWeight(int, int);
+
+private:
+	FILE* m_file;
+	unsigned char* m_buffer;
+	int m_format, m_width, m_height, m_sampleSize, m_step;
+	bool m_bigEndian, m_topDown;
+	long long m_dataOffset;
+};
+
+#endif
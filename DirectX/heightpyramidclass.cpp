@@ -0,0 +1,648 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: heightpyramidclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "heightpyramidclass.h"
+
+
+HeightPyramidClass::HeightPyramidClass()
+{
+	m_heights = 0;
+	m_minHeights = 0;
+	m_maxHeights = 0;
+	m_ownsLevels = false;
+	m_levelCount = 0;
+	m_levelSize = 0;
+}
+
+
+HeightPyramidClass::HeightPyramidClass(const HeightPyramidClass& other)
+{
+}
+
+
+HeightPyramidClass::~HeightPyramidClass()
+{
+}
+
+
+bool HeightPyramidClass::Initialize(const float* heights, int width, int height)
+{
+	int i;
+	bool result;
+
+
+	m_heights = heights;
+
+	// Work out the size of every level.
+	result = SetLevels(width, height);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Create the arrays holding every level.
+	m_minHeights = new float[m_levelSize];
+	if (!m_minHeights)
+	{
+		return false;
+	}
+
+	m_maxHeights = new float[m_levelSize];
+	if (!m_maxHeights)
+	{
+		return false;
+	}
+
+	m_ownsLevels = true;
+
+	for (i = 0; i < m_levelCount; i++)
+	{
+		BuildLevel(i, 0, 0, m_levelWidth[i] - 1, m_levelHeight[i] - 1);
+	}
+
+	return true;
+}
+
+
+bool HeightPyramidClass::Initialize(const float* heights, int width, int height, float* minHeights, float* maxHeights)
+{
+	bool result;
+
+
+	m_heights = heights;
+
+	// The levels were built when the terrain file was written, only their layout is needed.
+	result = SetLevels(width, height);
+	if (!result)
+	{
+		return false;
+	}
+
+	m_minHeights = minHeights;
+	m_maxHeights = maxHeights;
+	m_ownsLevels = false;
+
+	return true;
+}
+
+
+void HeightPyramidClass::Shutdown()
+{
+	// Release the height levels, the heights themselves belong to the caller.
+	if (m_ownsLevels)
+	{
+		delete[] m_minHeights;
+		delete[] m_maxHeights;
+	}
+
+	m_minHeights = 0;
+	m_maxHeights = 0;
+	m_ownsLevels = false;
+
+	m_heights = 0;
+	m_levelCount = 0;
+
+	return;
+}
+
+
+bool HeightPyramidClass::IntersectRay(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, float& distance)
+{
+	NodeType stack[HEIGHT_PYRAMID_STACK_SIZE];
+	NodeType node, child;
+	XMFLOAT3 inverse, boxMin, boxMax;
+	int stackCount, nearX, nearY, k, order;
+	float best, tEnter, tExit, t;
+	bool hit;
+
+
+	/*
+		Walk the pyramid from the top, children are visited nearest first along the ray so
+		a node that starts past the closest hit so far is skipped along with all of its cells.
+		A node the ray passes over is skipped the same way.
+		The rows run against z, flip the ray into row space once (distances do not change).
+	*/
+	origin.z = (float)(m_height - 1) - origin.z;
+	direction.z = -direction.z;
+
+	inverse = GetInverseDirection(direction);
+
+	// Clip the ray to the whole terrain, a short piece is quicker to march than to walk down the pyramid for.
+	boxMin = XMFLOAT3(0.0f, GetMinHeight(), 0.0f);
+	boxMax = XMFLOAT3((float)(m_width - 1), GetMaxHeight(), (float)(m_height - 1));
+
+	if (!IntersectBox(origin, inverse, boxMin, boxMax, maxDistance, tEnter, tExit))
+	{
+		return false;
+	}
+
+	if (((tExit - tEnter) * (fabsf(direction.x) + fabsf(direction.z))) < (float)HEIGHT_PYRAMID_MARCH_CELLS)
+	{
+		return MarchCells(origin, direction, tEnter, tExit, maxDistance, distance);
+	}
+
+	nearX = (direction.x >= 0.0f) ? 0 : 1;
+	nearY = (direction.z >= 0.0f) ? 0 : 1;
+
+	best = maxDistance;
+	hit = false;
+
+	stack[0].level = m_levelCount - 1;
+	stack[0].x = 0;
+	stack[0].y = 0;
+	stackCount = 1;
+
+	while (stackCount > 0)
+	{
+		stackCount--;
+		node = stack[stackCount];
+
+		// Bound the node by its cells and everything between its lowest and highest corner.
+		boxMin.x = (float)(node.x << node.level);
+		boxMin.y = m_minHeights[m_levelOffset[node.level] + (node.y * m_levelWidth[node.level]) + node.x];
+		boxMin.z = (float)(node.y << node.level);
+		boxMax.x = (float)((((node.x + 1) << node.level) < (m_width - 1)) ? ((node.x + 1) << node.level) : (m_width - 1));
+		boxMax.y = m_maxHeights[m_levelOffset[node.level] + (node.y * m_levelWidth[node.level]) + node.x];
+		boxMax.z = (float)((((node.y + 1) << node.level) < (m_height - 1)) ? ((node.y + 1) << node.level) : (m_height - 1));
+
+		if (!IntersectBox(origin, inverse, boxMin, boxMax, best, tEnter, tExit))
+		{
+			continue;
+		}
+
+		// Small nodes are marched cell by cell over the part of the ray inside them.
+		if (node.level <= HEIGHT_PYRAMID_LEAF_LEVEL)
+		{
+			if (MarchCells(origin, direction, tEnter, tExit, best, t))
+			{
+				best = t;
+				hit = true;
+			}
+
+			continue;
+		}
+
+		// Push the far children first so the near ones come off the stack first.
+		for (k = 3; k >= 0; k--)
+		{
+			order = (k == 1) ? 2 : ((k == 2) ? 1 : k);
+
+			child.level = node.level - 1;
+			child.x = (node.x * 2) + ((order & 1) ^ nearX);
+			child.y = (node.y * 2) + (((order >> 1) & 1) ^ nearY);
+
+			if ((child.x < m_levelWidth[child.level]) && (child.y < m_levelHeight[child.level]))
+			{
+				stack[stackCount] = child;
+				stackCount++;
+			}
+		}
+	}
+
+	if (hit)
+	{
+		distance = best;
+	}
+
+	return hit;
+}
+
+
+bool HeightPyramidClass::IntersectRayLinear(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, float& distance)
+{
+	XMFLOAT3 inverse, boxMin, boxMax;
+	float tEnter, tExit;
+
+
+	// The plain cell by cell march over the whole ray, kept as the reference for the pyramid and for the timings.
+	origin.z = (float)(m_height - 1) - origin.z;
+	direction.z = -direction.z;
+
+	// Clip the ray to the whole terrain.
+	boxMin = XMFLOAT3(0.0f, GetMinHeight(), 0.0f);
+	boxMax = XMFLOAT3((float)(m_width - 1), GetMaxHeight(), (float)(m_height - 1));
+
+	inverse = GetInverseDirection(direction);
+	if (!IntersectBox(origin, inverse, boxMin, boxMax, maxDistance, tEnter, tExit))
+	{
+		return false;
+	}
+
+	return MarchCells(origin, direction, tEnter, tExit, maxDistance, distance);
+}
+
+
+bool HeightPyramidClass::MarchCells(const XMFLOAT3& origin, const XMFLOAT3& direction, float tEnter, float tExit, float maxDistance, float& distance)
+{
+	int column, row, stepX, stepY;
+	float tMaxX, tMaxY, tDeltaX, tDeltaY, t;
+
+
+	// Find the cell the ray enters in.
+	column = (int)floorf(origin.x + (direction.x * tEnter));
+	column = (column < 0) ? 0 : ((column > (m_width - 2)) ? (m_width - 2) : column);
+	row = (int)floorf(origin.z + (direction.z * tEnter));
+	row = (row < 0) ? 0 : ((row > (m_height - 2)) ? (m_height - 2) : row);
+
+	// Step through the cells in the order the ray crosses them.
+	stepX = (direction.x >= 0.0f) ? 1 : -1;
+	stepY = (direction.z >= 0.0f) ? 1 : -1;
+
+	tMaxX = FLT_MAX;
+	tDeltaX = FLT_MAX;
+	if (fabsf(direction.x) > FLT_EPSILON)
+	{
+		tMaxX = ((float)(column + ((stepX > 0) ? 1 : 0)) - origin.x) / direction.x;
+		tDeltaX = 1.0f / fabsf(direction.x);
+	}
+
+	tMaxY = FLT_MAX;
+	tDeltaY = FLT_MAX;
+	if (fabsf(direction.z) > FLT_EPSILON)
+	{
+		tMaxY = ((float)(row + ((stepY > 0) ? 1 : 0)) - origin.z) / direction.z;
+		tDeltaY = 1.0f / fabsf(direction.z);
+	}
+
+	while (true)
+	{
+		// The cells come in ray order so the first hit is the closest.
+		if (IntersectCell(column, row, origin, direction, maxDistance, t))
+		{
+			distance = t;
+			return true;
+		}
+
+		if (tMaxX < tMaxY)
+		{
+			if (tMaxX > tExit)
+			{
+				return false;
+			}
+
+			column += stepX;
+			tMaxX += tDeltaX;
+		}
+		else
+		{
+			if (tMaxY > tExit)
+			{
+				return false;
+			}
+
+			row += stepY;
+			tMaxY += tDeltaY;
+		}
+
+		if ((column < 0) || (column > (m_width - 2)) || (row < 0) || (row > (m_height - 2)))
+		{
+			return false;
+		}
+	}
+}
+
+
+void HeightPyramidClass::IntersectRays(const RayType* rays, int count, float* distances)
+{
+	ParallelForClass parallel;
+
+
+	// The pyramid is only read so the rays can be spread over all the cores, a miss gives -1.
+	parallel.Run(count, HEIGHT_PYRAMID_RAY_GRAIN, [&](int first, int last)
+	{
+		int i;
+		float distance;
+
+
+		for (i = first; i < last; i++)
+		{
+			distances[i] = -1.0f;
+			if (IntersectRay(rays[i].origin, rays[i].direction, rays[i].maxDistance, distance))
+			{
+				distances[i] = distance;
+			}
+		}
+	});
+
+	return;
+}
+
+
+void HeightPyramidClass::UpdateRegion(int firstColumn, int firstRow, int lastColumn, int lastRow)
+{
+	int level, firstX, firstY, lastX, lastY;
+
+
+	// Every cell with one of the changed vertices as a corner.
+	firstX = (firstColumn > 0) ? firstColumn - 1 : 0;
+	firstY = (firstRow > 0) ? firstRow - 1 : 0;
+	lastX = (lastColumn < (m_width - 2)) ? lastColumn : (m_width - 2);
+	lastY = (lastRow < (m_height - 2)) ? lastRow : (m_height - 2);
+
+	// Each level up covers the same area with half as many nodes.
+	for (level = 0; level < m_levelCount; level++)
+	{
+		BuildLevel(level, firstX, firstY, lastX, lastY);
+
+		firstX /= 2;
+		firstY /= 2;
+		lastX /= 2;
+		lastY /= 2;
+	}
+
+	return;
+}
+
+
+int HeightPyramidClass::GetLevelCount()
+{
+	return m_levelCount;
+}
+
+
+int HeightPyramidClass::GetLevelSize()
+{
+	return m_levelSize;
+}
+
+
+const float* HeightPyramidClass::GetMinHeights()
+{
+	return m_minHeights;
+}
+
+
+const float* HeightPyramidClass::GetMaxHeights()
+{
+	return m_maxHeights;
+}
+
+
+float HeightPyramidClass::GetMinHeight()
+{
+	return m_minHeights[m_levelOffset[m_levelCount - 1]];
+}
+
+
+float HeightPyramidClass::GetMaxHeight()
+{
+	return m_maxHeights[m_levelOffset[m_levelCount - 1]];
+}
+
+
+void HeightPyramidClass::GetCellBounds(int level, int x, int y, float& minHeight, float& maxHeight)
+{
+	// A node of the level, y counts rows from the top like the grid.
+	minHeight = m_minHeights[m_levelOffset[level] + (y * m_levelWidth[level]) + x];
+	maxHeight = m_maxHeights[m_levelOffset[level] + (y * m_levelWidth[level]) + x];
+	return;
+}
+
+
+bool HeightPyramidClass::SetLevels(int width, int height)
+{
+	int levelWidth, levelHeight;
+
+
+	// There has to be at least one cell.
+	if ((width < 2) || (height < 2))
+	{
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+
+	// Level 0 has one entry per grid cell, every level above halves both sizes until a single node is left.
+	levelWidth = m_width - 1;
+	levelHeight = m_height - 1;
+	m_levelSize = 0;
+	m_levelCount = 0;
+
+	while (true)
+	{
+		if (m_levelCount == HEIGHT_PYRAMID_MAX_LEVELS)
+		{
+			return false;
+		}
+
+		m_levelWidth[m_levelCount] = levelWidth;
+		m_levelHeight[m_levelCount] = levelHeight;
+		m_levelOffset[m_levelCount] = m_levelSize;
+		m_levelSize += levelWidth * levelHeight;
+		m_levelCount++;
+
+		if ((levelWidth == 1) && (levelHeight == 1))
+		{
+			break;
+		}
+
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+
+	return true;
+}
+
+
+void HeightPyramidClass::BuildLevel(int level, int firstX, int firstY, int lastX, int lastY)
+{
+	int i, j, k, index, below, belowWidth, belowHeight, x, y;
+	float lowest, highest;
+
+
+	// Only the nodes from (firstX, firstY) to (lastX, lastY) are rebuilt, the levels below them must be up to date.
+	for (j = firstY; j <= lastY; j++)
+	{
+		for (i = firstX; i <= lastX; i++)
+		{
+			if (level == 0)
+			{
+				// The lowest and highest of the four corners of the cell.
+				index = (j * m_width) + i;
+				lowest = fminf(fminf(m_heights[index], m_heights[index + 1]), fminf(m_heights[index + m_width], m_heights[index + m_width + 1]));
+				highest = fmaxf(fmaxf(m_heights[index], m_heights[index + 1]), fmaxf(m_heights[index + m_width], m_heights[index + m_width + 1]));
+			}
+			else
+			{
+				// The lowest and highest of the (up to) four nodes under this one.
+				below = m_levelOffset[level - 1];
+				belowWidth = m_levelWidth[level - 1];
+				belowHeight = m_levelHeight[level - 1];
+
+				lowest = FLT_MAX;
+				highest = -FLT_MAX;
+				for (k = 0; k < 4; k++)
+				{
+					x = (i * 2) + (k & 1);
+					y = (j * 2) + (k >> 1);
+					if ((x < belowWidth) && (y < belowHeight))
+					{
+						lowest = fminf(lowest, m_minHeights[below + (y * belowWidth) + x]);
+						highest = fmaxf(highest, m_maxHeights[below + (y * belowWidth) + x]);
+					}
+				}
+			}
+
+			m_minHeights[m_levelOffset[level] + (j * m_levelWidth[level]) + i] = lowest;
+			m_maxHeights[m_levelOffset[level] + (j * m_levelWidth[level]) + i] = highest;
+		}
+	}
+
+	return;
+}
+
+
+bool HeightPyramidClass::IntersectBox(const XMFLOAT3& origin, const XMFLOAT3& inverse, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax,
+	float maxDistance, float& tEnter, float& tExit)
+{
+	float t0, t1;
+
+
+	// Slab test, the ray is clipped against each pair of planes in turn.
+	t0 = (boxMin.x - origin.x) * inverse.x;
+	t1 = (boxMax.x - origin.x) * inverse.x;
+	tEnter = fmaxf(0.0f, fminf(t0, t1));
+	tExit = fminf(maxDistance, fmaxf(t0, t1));
+
+	t0 = (boxMin.z - origin.z) * inverse.z;
+	t1 = (boxMax.z - origin.z) * inverse.z;
+	tEnter = fmaxf(tEnter, fminf(t0, t1));
+	tExit = fminf(tExit, fmaxf(t0, t1));
+
+	t0 = (boxMin.y - origin.y) * inverse.y;
+	t1 = (boxMax.y - origin.y) * inverse.y;
+	tEnter = fmaxf(tEnter, fminf(t0, t1));
+	tExit = fminf(tExit, fmaxf(t0, t1));
+
+	return (tEnter <= tExit);
+}
+
+
+XMFLOAT3 HeightPyramidClass::GetInverseDirection(const XMFLOAT3& direction)
+{
+	XMFLOAT3 inverse;
+
+
+	// Keep the reciprocals finite so a ray parallel to a slab never multiplies zero by infinity.
+	inverse.x = 1.0f / ((fabsf(direction.x) > HEIGHT_PYRAMID_MIN_DIRECTION) ? direction.x : ((direction.x < 0.0f) ? -HEIGHT_PYRAMID_MIN_DIRECTION : HEIGHT_PYRAMID_MIN_DIRECTION));
+	inverse.y = 1.0f / ((fabsf(direction.y) > HEIGHT_PYRAMID_MIN_DIRECTION) ? direction.y : ((direction.y < 0.0f) ? -HEIGHT_PYRAMID_MIN_DIRECTION : HEIGHT_PYRAMID_MIN_DIRECTION));
+	inverse.z = 1.0f / ((fabsf(direction.z) > HEIGHT_PYRAMID_MIN_DIRECTION) ? direction.z : ((direction.z < 0.0f) ? -HEIGHT_PYRAMID_MIN_DIRECTION : HEIGHT_PYRAMID_MIN_DIRECTION));
+
+	return inverse;
+}
+
+
+bool HeightPyramidClass::IntersectCell(int column, int row, const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, float& distance)
+{
+	XMFLOAT3 p00, p10, p01, p11;
+	int index;
+	float best, t;
+	bool hit;
+
+
+	index = (row * m_width) + column;
+	p00 = XMFLOAT3((float)column, m_heights[index], (float)row);
+	p10 = XMFLOAT3((float)(column + 1), m_heights[index + 1], (float)row);
+	p01 = XMFLOAT3((float)column, m_heights[index + m_width], (float)(row + 1));
+	p11 = XMFLOAT3((float)(column + 1), m_heights[index + m_width + 1], (float)(row + 1));
+
+	best = maxDistance;
+	hit = false;
+
+	// The cell is split along the same union jack diagonal as the mesh.
+	if (((column + row) & 1) == 0)
+	{
+		if (IntersectTriangle(origin, direction, p00, p10, p11, best, t))
+		{
+			best = t;
+			hit = true;
+		}
+
+		if (IntersectTriangle(origin, direction, p00, p11, p01, best, t))
+		{
+			best = t;
+			hit = true;
+		}
+	}
+	else
+	{
+		if (IntersectTriangle(origin, direction, p00, p10, p01, best, t))
+		{
+			best = t;
+			hit = true;
+		}
+
+		if (IntersectTriangle(origin, direction, p10, p11, p01, best, t))
+		{
+			best = t;
+			hit = true;
+		}
+	}
+
+	if (hit)
+	{
+		distance = best;
+	}
+
+	return hit;
+}
+
+
+bool HeightPyramidClass::IntersectTriangle(const XMFLOAT3& origin, const XMFLOAT3& direction, const XMFLOAT3& v0, const XMFLOAT3& v1,
+	const XMFLOAT3& v2, float maxDistance, float& distance)
+{
+	float e1[3], e2[3], p[3], s[3], q[3], determinant, inverse, u, v, t;
+
+
+	// Moller-Trumbore, both sides count so rays from below the ground hit as well.
+	e1[0] = v1.x - v0.x;
+	e1[1] = v1.y - v0.y;
+	e1[2] = v1.z - v0.z;
+	e2[0] = v2.x - v0.x;
+	e2[1] = v2.y - v0.y;
+	e2[2] = v2.z - v0.z;
+
+	p[0] = (direction.y * e2[2]) - (direction.z * e2[1]);
+	p[1] = (direction.z * e2[0]) - (direction.x * e2[2]);
+	p[2] = (direction.x * e2[1]) - (direction.y * e2[0]);
+
+	determinant = (e1[0] * p[0]) + (e1[1] * p[1]) + (e1[2] * p[2]);
+	if (fabsf(determinant) < 1e-12f)
+	{
+		return false;
+	}
+
+	inverse = 1.0f / determinant;
+
+	s[0] = origin.x - v0.x;
+	s[1] = origin.y - v0.y;
+	s[2] = origin.z - v0.z;
+
+	// A small tolerance on the edges so rays along a shared edge do not slip between the triangles.
+	u = ((s[0] * p[0]) + (s[1] * p[1]) + (s[2] * p[2])) * inverse;
+	if ((u < -1e-6f) || (u > 1.000001f))
+	{
+		return false;
+	}
+
+	q[0] = (s[1] * e1[2]) - (s[2] * e1[1]);
+	q[1] = (s[2] * e1[0]) - (s[0] * e1[2]);
+	q[2] = (s[0] * e1[1]) - (s[1] * e1[0]);
+
+	v = ((direction.x * q[0]) + (direction.y * q[1]) + (direction.z * q[2])) * inverse;
+	if ((v < -1e-6f) || ((u + v) > 1.000001f))
+	{
+		return false;
+	}
+
+	t = ((e2[0] * q[0]) + (e2[1] * q[1]) + (e2[2] * q[2])) * inverse;
+	if ((t < 0.0f) || (t > maxDistance))
+	{
+		return false;
+	}
+
+	distance = t;
+
+	return true;
+}
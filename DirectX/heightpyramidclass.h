@@ -0,0 +1,98 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: heightpyramidclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _HEIGHTPYRAMIDCLASS_H_
+#define _HEIGHTPYRAMIDCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <directxmath.h>
+#include <float.h>
+#include <math.h>
+
+#include "parallelforclass.h"
+
+using namespace DirectX;
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int HEIGHT_PYRAMID_MAX_LEVELS = 16;
+const int HEIGHT_PYRAMID_STACK_SIZE = 64;
+const int HEIGHT_PYRAMID_RAY_GRAIN = 64;
+const float HEIGHT_PYRAMID_MIN_DIRECTION = 1e-20f;
+const int HEIGHT_PYRAMID_MARCH_CELLS = 64;
+const int HEIGHT_PYRAMID_LEAF_LEVEL = 2;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: HeightPyramidClass
+////////////////////////////////////////////////////////////////////////////////
+// Minimum and maximum height mipmap over the cells of a heightfield, used to
+// cast rays against the terrain. Level 0 holds the lowest and highest corner of
+// every grid cell and each level above covers the 2x2 cells under it.
+//
+// Rays are in terrain space: x is the column and z runs from the last row
+// (z = 0) up to row 0 (z = height - 1), the same as the terrain vertices.
+// The heights are not copied so they have to outlive the pyramid, and neither
+// are levels handed in from a terrain file.
+class HeightPyramidClass
+{
+public:
+	struct RayType
+	{
+		XMFLOAT3 origin;
+		XMFLOAT3 direction;
+		float maxDistance;
+	};
+
+private:
+	struct NodeType
+	{
+		int level, x, y;
+	};
+
+public:
+	HeightPyramidClass();
+	HeightPyramidClass(const HeightPyramidClass&);
+	~HeightPyramidClass();
+
+	bool Initialize(const float*, int, int);
+	bool Initialize(const float*, int, int, float*, float*);
+	void Shutdown();
+
+	bool IntersectRay(XMFLOAT3, XMFLOAT3, float, float&);
+	bool IntersectRayLinear(XMFLOAT3, XMFLOAT3, float, float&);
+	void IntersectRays(const RayType*, int, float*);
+
+	void UpdateRegion(int, int, int, int);
+
+	int GetLevelCount();
+	int GetLevelSize();
+	const float* GetMinHeights();
+	const float* GetMaxHeights();
+	float GetMinHeight();
+	float GetMaxHeight();
+	void GetCellBounds(int, int, int, float&, float&);
+
+private:
+	bool SetLevels(int, int);
+	void BuildLevel(int, int, int, int, int);
+	XMFLOAT3 GetInverseDirection(const XMFLOAT3&);
+	bool IntersectBox(const XMFLOAT3&, const XMFLOAT3&, const XMFLOAT3&, const XMFLOAT3&, float, float&, float&);
+	bool MarchCells(const XMFLOAT3&, const XMFLOAT3&, float, float, float, float&);
+	bool IntersectCell(int, int, const XMFLOAT3&, const XMFLOAT3&, float, float&);
+	bool IntersectTriangle(const XMFLOAT3&, const XMFLOAT3&, const XMFLOAT3&, const XMFLOAT3&, const XMFLOAT3&, float, float&);
+
+private:
+	const float* m_heights;
+	int m_width, m_height, m_levelCount, m_levelSize;
+	int m_levelWidth[HEIGHT_PYRAMID_MAX_LEVELS], m_levelHeight[HEIGHT_PYRAMID_MAX_LEVELS], m_levelOffset[HEIGHT_PYRAMID_MAX_LEVELS];
+	float *m_minHeights, *m_maxHeights;
+	bool m_ownsLevels;
+};
+
+#endif
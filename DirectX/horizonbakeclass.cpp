@@ -0,0 +1,520 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: horizonbakeclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "horizonbakeclass.h"
+
+
+HorizonBakeClass::HorizonBakeClass()
+{
+	int k;
+
+
+	m_heights = 0;
+	m_horizons = 0;
+	m_occlusion = 0;
+	m_sweepLines = 0;
+	m_sweepCount = 0;
+	m_hullDistances = 0;
+	m_hullHeights = 0;
+	m_changedBlocks = 0;
+
+	for (k = 0; k < HORIZON_BAKE_DIRECTIONS; k++)
+	{
+		m_dirtyLines[k] = 0;
+	}
+}
+
+
+HorizonBakeClass::HorizonBakeClass(const HorizonBakeClass& other)
+{
+}
+
+
+HorizonBakeClass::~HorizonBakeClass()
+{
+}
+
+
+bool HorizonBakeClass::Initialize(const float* heights, int terrainWidth, int terrainHeight)
+{
+	ParallelForClass parallel;
+	int vertexCount, maxLineCount, k;
+
+
+	m_heights = heights;
+	m_terrainWidth = terrainWidth;
+	m_terrainHeight = terrainHeight;
+
+	vertexCount = m_terrainWidth * m_terrainHeight;
+	maxLineCount = m_terrainWidth + m_terrainHeight - 1;
+
+	// Create the two planes of horizons, four directions to a texel.
+	m_horizons = new unsigned char[vertexCount * HORIZON_BAKE_DIRECTIONS];
+	if (!m_horizons)
+	{
+		return false;
+	}
+
+	m_occlusion = new unsigned char[vertexCount];
+	if (!m_occlusion)
+	{
+		return false;
+	}
+
+	// Start with an open sky everywhere, the first bake then only changes the texels that see a horizon.
+	memset(m_horizons, 0, vertexCount * HORIZON_BAKE_DIRECTIONS);
+	memset(m_occlusion, 255, vertexCount);
+
+	// Every thread keeps its own hull, the hull of a line never holds more vertices than the longest line.
+	m_slotCount = parallel.GetThreadCount();
+
+	m_hullDistances = new float[m_slotCount * maxLineCount];
+	if (!m_hullDistances)
+	{
+		return false;
+	}
+
+	m_hullHeights = new float[m_slotCount * maxLineCount];
+	if (!m_hullHeights)
+	{
+		return false;
+	}
+
+	// Every thread also marks the blocks it changed in a set of its own, they are merged into the first set after the sweep.
+	m_blockCountX = (m_terrainWidth + HORIZON_BAKE_BLOCK_SIZE - 1) / HORIZON_BAKE_BLOCK_SIZE;
+	m_blockCountY = (m_terrainHeight + HORIZON_BAKE_BLOCK_SIZE - 1) / HORIZON_BAKE_BLOCK_SIZE;
+
+	m_changedBlocks = new bool[m_slotCount * m_blockCountX * m_blockCountY];
+	if (!m_changedBlocks)
+	{
+		return false;
+	}
+
+	// Create the flags of the lines that have to be swept again and the list they are gathered into.
+	for (k = 0; k < HORIZON_BAKE_DIRECTIONS; k++)
+	{
+		m_dirtyLines[k] = new bool[maxLineCount];
+		if (!m_dirtyLines[k])
+		{
+			return false;
+		}
+
+		memset(m_dirtyLines[k], 0, maxLineCount * sizeof(bool));
+	}
+
+	m_sweepLines = new int[HORIZON_BAKE_DIRECTIONS * maxLineCount];
+	if (!m_sweepLines)
+	{
+		return false;
+	}
+
+	// Bake the whole terrain.
+	AddRect(0, 0, m_terrainWidth - 1, m_terrainHeight - 1);
+	Update();
+
+	return true;
+}
+
+
+void HorizonBakeClass::Shutdown()
+{
+	int k;
+
+
+	// Release the changed blocks and the hull workspaces.
+	if (m_changedBlocks)
+	{
+		delete[] m_changedBlocks;
+		m_changedBlocks = 0;
+	}
+
+	if (m_hullHeights)
+	{
+		delete[] m_hullHeights;
+		m_hullHeights = 0;
+	}
+
+	if (m_hullDistances)
+	{
+		delete[] m_hullDistances;
+		m_hullDistances = 0;
+	}
+
+	// Release the line lists.
+	if (m_sweepLines)
+	{
+		delete[] m_sweepLines;
+		m_sweepLines = 0;
+	}
+
+	for (k = 0; k < HORIZON_BAKE_DIRECTIONS; k++)
+	{
+		if (m_dirtyLines[k])
+		{
+			delete[] m_dirtyLines[k];
+			m_dirtyLines[k] = 0;
+		}
+	}
+
+	// Release the baked maps.
+	if (m_occlusion)
+	{
+		delete[] m_occlusion;
+		m_occlusion = 0;
+	}
+
+	if (m_horizons)
+	{
+		delete[] m_horizons;
+		m_horizons = 0;
+	}
+
+	m_heights = 0;
+
+	return;
+}
+
+
+void HorizonBakeClass::AddRect(int left, int top, int right, int bottom)
+{
+	int i, j, k;
+
+
+	// Clamp the rectangle to the terrain, the corners are included.
+	left = (left > 0) ? left : 0;
+	top = (top > 0) ? top : 0;
+	right = (right < (m_terrainWidth - 1)) ? right : (m_terrainWidth - 1);
+	bottom = (bottom < (m_terrainHeight - 1)) ? bottom : (m_terrainHeight - 1);
+
+	// A line that crosses the rectangle enters it through a vertex on its border, so only the border is walked.
+	for (k = 0; k < HORIZON_BAKE_DIRECTIONS; k++)
+	{
+		for (i = left; i <= right; i++)
+		{
+			m_dirtyLines[k][GetLine(k, i, top)] = true;
+			m_dirtyLines[k][GetLine(k, i, bottom)] = true;
+		}
+
+		for (j = top; j <= bottom; j++)
+		{
+			m_dirtyLines[k][GetLine(k, left, j)] = true;
+			m_dirtyLines[k][GetLine(k, right, j)] = true;
+		}
+	}
+
+	return;
+}
+
+
+void HorizonBakeClass::Update()
+{
+	ParallelForClass parallel;
+	int maxLineCount, blockCount, k, line, block;
+
+
+	// Gather the flagged lines of every direction into one list and clear the flags.
+	maxLineCount = m_terrainWidth + m_terrainHeight - 1;
+	blockCount = m_blockCountX * m_blockCountY;
+
+	memset(m_changedBlocks, 0, m_slotCount * blockCount * sizeof(bool));
+
+	m_sweepCount = 0;
+	for (k = 0; k < HORIZON_BAKE_DIRECTIONS; k++)
+	{
+		for (line = 0; line < GetLineCount(k); line++)
+		{
+			if (m_dirtyLines[k][line])
+			{
+				m_sweepLines[m_sweepCount] = (k * maxLineCount) + line;
+				m_sweepCount++;
+				m_dirtyLines[k][line] = false;
+			}
+		}
+	}
+
+	if (m_sweepCount == 0)
+	{
+		return;
+	}
+
+	// Every line is independent, the directions write different bytes of the horizon planes. Each slot takes every
+	// m_slotCount'th line with its own hull workspace, so nothing is allocated here.
+	parallel.Run(m_slotCount, 1, [&](int firstSlot, int lastSlot)
+	{
+		int slot, i;
+
+
+		for (slot = firstSlot; slot < lastSlot; slot++)
+		{
+			for (i = slot; i < m_sweepCount; i += m_slotCount)
+			{
+				SweepLine(m_sweepLines[i] / maxLineCount, m_sweepLines[i] % maxLineCount, slot);
+			}
+		}
+	});
+
+	// Merge the changed blocks of every other slot into the first one.
+	for (k = 1; k < m_slotCount; k++)
+	{
+		for (block = 0; block < blockCount; block++)
+		{
+			m_changedBlocks[block] = m_changedBlocks[block] || m_changedBlocks[(k * blockCount) + block];
+		}
+	}
+
+	// The occlusion of a vertex depends on all its directions, so it is worked out once they are all done.
+	BuildOcclusion();
+
+	return;
+}
+
+
+const unsigned char* HorizonBakeClass::GetHorizons(int plane)
+{
+	return &m_horizons[plane * m_terrainWidth * m_terrainHeight * 4];
+}
+
+
+const unsigned char* HorizonBakeClass::GetOcclusion()
+{
+	return m_occlusion;
+}
+
+
+int HorizonBakeClass::GetLineSweepCount()
+{
+	return m_sweepCount;
+}
+
+
+int HorizonBakeClass::GetBlockCountX()
+{
+	return m_blockCountX;
+}
+
+
+int HorizonBakeClass::GetBlockCountY()
+{
+	return m_blockCountY;
+}
+
+
+bool HorizonBakeClass::IsBlockChanged(int blockX, int blockY)
+{
+	// Only the texels of the changed blocks differ from before the last update.
+	return m_changedBlocks[(blockY * m_blockCountX) + blockX];
+}
+
+
+int HorizonBakeClass::GetLineCount(int direction)
+{
+	int count;
+
+
+	// A line starts on every vertex the direction leaves the terrain from, the far column and the far row.
+	count = 0;
+	if (HORIZON_BAKE_STEP_X[direction] != 0)
+	{
+		count += m_terrainHeight;
+	}
+
+	if (HORIZON_BAKE_STEP_Y[direction] != 0)
+	{
+		count += (HORIZON_BAKE_STEP_X[direction] != 0) ? (m_terrainWidth - 1) : m_terrainWidth;
+	}
+
+	return count;
+}
+
+
+void HorizonBakeClass::GetLineStart(int direction, int line, int& i, int& j)
+{
+	int stepX, stepY;
+
+
+	stepX = HORIZON_BAKE_STEP_X[direction];
+	stepY = HORIZON_BAKE_STEP_Y[direction];
+
+	// The lines on the far column come first, one per row.
+	if (stepX != 0)
+	{
+		if (line < m_terrainHeight)
+		{
+			i = (stepX > 0) ? (m_terrainWidth - 1) : 0;
+			j = line;
+			return;
+		}
+
+		line -= m_terrainHeight;
+	}
+
+	// Then the far row, without the corner the column already has.
+	i = ((stepX < 0) ? 1 : 0) + line;
+	j = (stepY > 0) ? (m_terrainHeight - 1) : 0;
+
+	return;
+}
+
+
+int HorizonBakeClass::GetLine(int direction, int i, int j)
+{
+	int stepX, stepY, steps, columnSteps, rowSteps;
+
+
+	stepX = HORIZON_BAKE_STEP_X[direction];
+	stepY = HORIZON_BAKE_STEP_Y[direction];
+
+	// Walk the vertex forward to where its line starts.
+	columnSteps = (stepX > 0) ? (m_terrainWidth - 1 - i) : i;
+	rowSteps = (stepY > 0) ? (m_terrainHeight - 1 - j) : j;
+
+	if (stepX == 0)
+	{
+		steps = rowSteps;
+	}
+	else if (stepY == 0)
+	{
+		steps = columnSteps;
+	}
+	else
+	{
+		steps = (columnSteps < rowSteps) ? columnSteps : rowSteps;
+	}
+
+	i += steps * stepX;
+	j += steps * stepY;
+
+	// Number it the same way GetLineStart does.
+	if ((stepX != 0) && (i == ((stepX > 0) ? (m_terrainWidth - 1) : 0)))
+	{
+		return j;
+	}
+
+	return ((stepX != 0) ? m_terrainHeight : 0) + i - ((stepX < 0) ? 1 : 0);
+}
+
+
+void HorizonBakeClass::SweepLine(int direction, int line, int slot)
+{
+	int i, j, stepX, stepY, hullCount, index, maxLineCount;
+	float stepLength, distance, height, rise, run, sine;
+	float *hullDistances, *hullHeights;
+	unsigned char* horizons;
+	unsigned char value;
+	bool* changedBlocks;
+
+
+	// The hull and the changed blocks of the thread sweeping the line.
+	maxLineCount = m_terrainWidth + m_terrainHeight - 1;
+	hullDistances = &m_hullDistances[slot * maxLineCount];
+	hullHeights = &m_hullHeights[slot * maxLineCount];
+	changedBlocks = &m_changedBlocks[slot * m_blockCountX * m_blockCountY];
+
+	stepX = HORIZON_BAKE_STEP_X[direction];
+	stepY = HORIZON_BAKE_STEP_Y[direction];
+	stepLength = ((stepX != 0) && (stepY != 0)) ? sqrtf(2.0f) : 1.0f;
+
+	// The byte of this direction in its plane.
+	horizons = &m_horizons[((direction / 4) * m_terrainWidth * m_terrainHeight * 4) + (direction % 4)];
+
+	GetLineStart(direction, line, i, j);
+
+	// Walk back from the far end, everything on the hull is in front of the vertex looking in the direction.
+	hullCount = 0;
+	distance = 0.0f;
+
+	while ((i >= 0) && (i < m_terrainWidth) && (j >= 0) && (j < m_terrainHeight))
+	{
+		index = (j * m_terrainWidth) + i;
+		height = m_heights[index];
+
+		// Drop the hull vertices that are under the line from this vertex to the one behind them.
+		while ((hullCount >= 2) && (((hullHeights[hullCount - 2] - height) * (distance - hullDistances[hullCount - 1])) >=
+			((hullHeights[hullCount - 1] - height) * (distance - hullDistances[hullCount - 2]))))
+		{
+			hullCount--;
+		}
+
+		// The top of the hull is the horizon, anything under the horizontal leaves the whole sky open.
+		sine = 0.0f;
+		if (hullCount > 0)
+		{
+			rise = hullHeights[hullCount - 1] - height;
+			run = distance - hullDistances[hullCount - 1];
+			if (rise > 0.0f)
+			{
+				sine = rise / sqrtf((rise * rise) + (run * run));
+			}
+		}
+
+		// Only a texel that really changed marks its block.
+		value = (unsigned char)((sine * 255.0f) + 0.5f);
+		if (horizons[index * 4] != value)
+		{
+			horizons[index * 4] = value;
+			changedBlocks[((j / HORIZON_BAKE_BLOCK_SIZE) * m_blockCountX) + (i / HORIZON_BAKE_BLOCK_SIZE)] = true;
+		}
+
+		hullDistances[hullCount] = distance;
+		hullHeights[hullCount] = height;
+		hullCount++;
+
+		i -= stepX;
+		j -= stepY;
+		distance += stepLength;
+	}
+
+	return;
+}
+
+
+void HorizonBakeClass::BuildOcclusion()
+{
+	ParallelForClass parallel;
+
+
+	// Only the blocks whose horizons changed, a row of blocks at a time.
+	parallel.Run(m_blockCountY, 1, [&](int firstBlockY, int lastBlockY)
+	{
+		const unsigned char *first4, *last4;
+		int blockX, blockY, i, j, lastI, lastJ, index, k, open;
+
+
+		first4 = GetHorizons(0);
+		last4 = GetHorizons(1);
+
+		for (blockY = firstBlockY; blockY < lastBlockY; blockY++)
+		{
+			for (blockX = 0; blockX < m_blockCountX; blockX++)
+			{
+				if (!IsBlockChanged(blockX, blockY))
+				{
+					continue;
+				}
+
+				lastI = ((blockX + 1) * HORIZON_BAKE_BLOCK_SIZE < m_terrainWidth) ? (blockX + 1) * HORIZON_BAKE_BLOCK_SIZE : m_terrainWidth;
+				lastJ = ((blockY + 1) * HORIZON_BAKE_BLOCK_SIZE < m_terrainHeight) ? (blockY + 1) * HORIZON_BAKE_BLOCK_SIZE : m_terrainHeight;
+
+				for (j = blockY * HORIZON_BAKE_BLOCK_SIZE; j < lastJ; j++)
+				{
+					for (i = blockX * HORIZON_BAKE_BLOCK_SIZE; i < lastI; i++)
+					{
+						index = (j * m_terrainWidth) + i;
+
+						// The cosine weighted sky above a horizon is the squared cosine of its elevation, summed in 255 squared units.
+						open = 0;
+						for (k = 0; k < 4; k++)
+						{
+							open += (255 * 255) - (first4[(index * 4) + k] * first4[(index * 4) + k]);
+							open += (255 * 255) - (last4[(index * 4) + k] * last4[(index * 4) + k]);
+						}
+
+						m_occlusion[index] = (unsigned char)((open + ((HORIZON_BAKE_DIRECTIONS * 255) / 2)) / (HORIZON_BAKE_DIRECTIONS * 255));
+					}
+				}
+			}
+		}
+	});
+
+	return;
+}
@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: horizonbakeclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _HORIZONBAKECLASS_H_
+#define _HORIZONBAKECLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <math.h>
+#include <string.h>
+
+#include "parallelforclass.h"
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int HORIZON_BAKE_DIRECTIONS = 8;
+const int HORIZON_BAKE_BLOCK_SIZE = 32;
+
+// Grid steps of the directions, counter clockwise from east seen from above. The rows run south.
+const int HORIZON_BAKE_STEP_X[HORIZON_BAKE_DIRECTIONS] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int HORIZON_BAKE_STEP_Y[HORIZON_BAKE_DIRECTIONS] = { 0, -1, -1, -1, 0, 1, 1, 1 };
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: HorizonBakeClass
+////////////////////////////////////////////////////////////////////////////////
+// Bakes the horizon of every terrain vertex in eight directions and the
+// ambient occlusion that follows from them. Every direction runs along the
+// grid rows, columns or diagonals, so each vertex sits on one line per
+// direction and the lines are swept from the far end while an upper convex
+// hull of the heights already passed is kept on a stack. The hull vertex left
+// on top after the new vertex pops the ones under it is the highest point it
+// can see in that direction, so a whole line costs linear time instead of a
+// ray march per vertex. The lines are swept on all the cores.
+//
+// The horizons are stored as the sine of their elevation, four directions to
+// an RGBA8 texel in two planes, and the occlusion as one byte of open sky
+// from 0 to 255, cosine weighted. The lines crossing changed rectangles can be
+// swept again on their own. Every thread sweeps its share of the lines with a
+// hull workspace of its own and marks the blocks of texels whose horizons
+// actually changed, only those blocks get their occlusion worked out again
+// and need to be uploaded.
+class HorizonBakeClass
+{
+public:
+	HorizonBakeClass();
+	HorizonBakeClass(const HorizonBakeClass&);
+	~HorizonBakeClass();
+
+	bool Initialize(const float*, int, int);
+	void Shutdown();
+
+	void AddRect(int, int, int, int);
+	void Update();
+
+	const unsigned char* GetHorizons(int);
+	const unsigned char* GetOcclusion();
+	int GetLineSweepCount();
+
+	int GetBlockCountX();
+	int GetBlockCountY();
+	bool IsBlockChanged(int, int);
+
+private:
+	int GetLineCount(int);
+	void GetLineStart(int, int, int&, int&);
+	int GetLine(int, int, int);
+	void SweepLine(int, int, int);
+	void BuildOcclusion();
+
+private:
+	const float* m_heights;
+	int m_terrainWidth, m_terrainHeight;
+	unsigned char* m_horizons;
+	unsigned char* m_occlusion;
+	bool* m_dirtyLines[HORIZON_BAKE_DIRECTIONS];
+	int* m_sweepLines;
+	int m_sweepCount;
+	int m_slotCount;
+	float *m_hullDistances, *m_hullHeights;
+	int m_blockCountX, m_blockCountY;
+	bool* m_changedBlocks;
+};
+
+#endif
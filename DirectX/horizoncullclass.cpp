@@ -0,0 +1,356 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: horizoncullclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "horizoncullclass.h"
+
+
+HorizonCullClass::HorizonCullClass()
+{
+	m_order = 0;
+	m_nearDistances = 0;
+	m_visible = 0;
+	m_maxChunkCount = 0;
+	m_chunkCount = 0;
+	m_culledCount = 0;
+	m_culledSum = 0.0f;
+	m_frameCount = 0;
+}
+
+
+HorizonCullClass::HorizonCullClass(const HorizonCullClass& other)
+{
+}
+
+
+HorizonCullClass::~HorizonCullClass()
+{
+}
+
+
+bool HorizonCullClass::Initialize(int maxChunkCount)
+{
+	int i;
+
+
+	m_maxChunkCount = maxChunkCount;
+
+	// Create the per chunk arrays once, the culling itself does not allocate.
+	m_order = new int[maxChunkCount];
+	if (!m_order)
+	{
+		return false;
+	}
+
+	m_nearDistances = new float[maxChunkCount];
+	if (!m_nearDistances)
+	{
+		return false;
+	}
+
+	m_visible = new bool[maxChunkCount];
+	if (!m_visible)
+	{
+		return false;
+	}
+
+	// Everything is visible until the first cull.
+	for (i = 0; i < maxChunkCount; i++)
+	{
+		m_visible[i] = true;
+	}
+
+	return true;
+}
+
+
+void HorizonCullClass::Shutdown()
+{
+	// Release the per chunk arrays.
+	if (m_visible)
+	{
+		delete[] m_visible;
+		m_visible = 0;
+	}
+
+	if (m_nearDistances)
+	{
+		delete[] m_nearDistances;
+		m_nearDistances = 0;
+	}
+
+	if (m_order)
+	{
+		delete[] m_order;
+		m_order = 0;
+	}
+
+	return;
+}
+
+
+int HorizonCullClass::Cull(const BoxType* chunks, int count, const BoxType* cells, int cellsPerChunk, float eyeX, float eyeY, float eyeZ)
+{
+	int i, k, cell, bin;
+	float farDistance;
+
+
+	if (count > m_maxChunkCount)
+	{
+		count = m_maxChunkCount;
+	}
+
+	// Nothing hides anything yet.
+	for (bin = 0; bin < HORIZON_CULL_BINS; bin++)
+	{
+		m_slopes[bin] = -FLT_MAX;
+		m_distances[bin] = 0.0f;
+	}
+
+	// Go through the chunks from the nearest one out.
+	for (i = 0; i < count; i++)
+	{
+		GetDistances(chunks[i], eyeX, eyeZ, m_nearDistances[i], farDistance);
+		m_order[i] = i;
+	}
+
+	SortChunks(count);
+
+	m_culledCount = 0;
+
+	for (k = 0; k < count; k++)
+	{
+		i = m_order[k];
+
+		// The chunk box is enough to hide the whole chunk, the cells are only looked at when it is not.
+		m_visible[i] = IsAboveHorizon(chunks[i], eyeX, eyeY, eyeZ);
+		if (m_visible[i] && (cellsPerChunk > 1))
+		{
+			m_visible[i] = false;
+			for (cell = 0; (cell < cellsPerChunk) && !m_visible[i]; cell++)
+			{
+				m_visible[i] = IsAboveHorizon(cells[(i * cellsPerChunk) + cell], eyeX, eyeY, eyeZ);
+			}
+		}
+
+		// A hidden chunk is below the horizon, it cannot raise it.
+		if (!m_visible[i])
+		{
+			m_culledCount++;
+			continue;
+		}
+
+		for (cell = 0; cell < cellsPerChunk; cell++)
+		{
+			RaiseHorizon(cells[(i * cellsPerChunk) + cell], eyeX, eyeY, eyeZ);
+		}
+	}
+
+	// Keep the numbers for the report.
+	m_chunkCount = count;
+	if (count > 0)
+	{
+		m_culledSum += GetCulledPercentage();
+		m_frameCount++;
+	}
+
+	return m_culledCount;
+}
+
+
+bool HorizonCullClass::IsVisible(int chunk)
+{
+	return m_visible[chunk];
+}
+
+
+float HorizonCullClass::GetCulledPercentage()
+{
+	if (m_chunkCount == 0)
+	{
+		return 0.0f;
+	}
+
+	return ((float)m_culledCount * 100.0f) / (float)m_chunkCount;
+}
+
+
+float HorizonCullClass::GetAverageCulledPercentage()
+{
+	if (m_frameCount == 0)
+	{
+		return 0.0f;
+	}
+
+	return m_culledSum / (float)m_frameCount;
+}
+
+
+void HorizonCullClass::SortChunks(int count)
+{
+	int i, j, chunk;
+
+
+	// Insertion sort on the nearest distance, there are only a few hundred chunks at most.
+	for (i = 1; i < count; i++)
+	{
+		chunk = m_order[i];
+
+		for (j = i; (j > 0) && (m_nearDistances[m_order[j - 1]] > m_nearDistances[chunk]); j--)
+		{
+			m_order[j] = m_order[j - 1];
+		}
+
+		m_order[j] = chunk;
+	}
+
+	return;
+}
+
+
+void HorizonCullClass::GetDistances(const BoxType& box, float eyeX, float eyeZ, float& nearDistance, float& farDistance)
+{
+	float dx, dz;
+
+
+	// The nearest and farthest horizontal distance from the camera to the box.
+	dx = (box.minX > eyeX) ? box.minX - eyeX : ((eyeX > box.maxX) ? eyeX - box.maxX : 0.0f);
+	dz = (box.minZ > eyeZ) ? box.minZ - eyeZ : ((eyeZ > box.maxZ) ? eyeZ - box.maxZ : 0.0f);
+	nearDistance = sqrtf((dx * dx) + (dz * dz));
+
+	dx = fmaxf(fabsf(box.minX - eyeX), fabsf(box.maxX - eyeX));
+	dz = fmaxf(fabsf(box.minZ - eyeZ), fabsf(box.maxZ - eyeZ));
+	farDistance = sqrtf((dx * dx) + (dz * dz));
+
+	return;
+}
+
+
+bool HorizonCullClass::IsAboveHorizon(const BoxType& box, float eyeX, float eyeY, float eyeZ)
+{
+	float nearDistance, farDistance, height, slope, start, end, binWidth;
+	int bin, lastBin;
+
+
+	// The camera is over the box, it is always drawn.
+	GetDistances(box, eyeX, eyeZ, nearDistance, farDistance);
+	if (nearDistance <= 0.0f)
+	{
+		return true;
+	}
+
+	/*
+		The steepest slope any point of the box can have is its top over the nearest distance,
+		or over the farthest distance when the top is below the camera. The horizon only counts
+		in a bin if everything that raised it is in front of the box.
+	*/
+	height = box.maxY - eyeY;
+	slope = height / ((height >= 0.0f) ? nearDistance : farDistance);
+
+	GetSpan(box, eyeX, eyeZ, start, end);
+
+	binWidth = (2.0f * HORIZON_CULL_PI) / (float)HORIZON_CULL_BINS;
+	lastBin = (int)floorf(end / binWidth);
+
+	for (bin = (int)floorf(start / binWidth); bin <= lastBin; bin++)
+	{
+		if ((nearDistance < m_distances[WrapBin(bin)]) || (slope > m_slopes[WrapBin(bin)]))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void HorizonCullClass::RaiseHorizon(const BoxType& box, float eyeX, float eyeY, float eyeZ)
+{
+	float nearDistance, farDistance, height, slope, start, end, binWidth;
+	int bin, lastBin;
+
+
+	// A box the camera is over has no angular extent to hide anything with.
+	GetDistances(box, eyeX, eyeZ, nearDistance, farDistance);
+	if (nearDistance <= 0.0f)
+	{
+		return;
+	}
+
+	// The shallowest slope of the ground on the box, the mirror image of the test.
+	height = box.minY - eyeY;
+	slope = height / ((height >= 0.0f) ? farDistance : nearDistance);
+
+	GetSpan(box, eyeX, eyeZ, start, end);
+
+	// Only the bins whose every direction crosses the box are raised.
+	binWidth = (2.0f * HORIZON_CULL_PI) / (float)HORIZON_CULL_BINS;
+	lastBin = (int)floorf(end / binWidth) - 1;
+
+	for (bin = (int)ceilf(start / binWidth); bin <= lastBin; bin++)
+	{
+		if (slope > m_slopes[WrapBin(bin)])
+		{
+			m_slopes[WrapBin(bin)] = slope;
+			m_distances[WrapBin(bin)] = fmaxf(m_distances[WrapBin(bin)], farDistance);
+		}
+	}
+
+	return;
+}
+
+
+void HorizonCullClass::GetSpan(const BoxType& box, float eyeX, float eyeZ, float& start, float& end)
+{
+	float cornerX[4], cornerZ[4];
+	float center, angle;
+	int i;
+
+
+	cornerX[0] = box.minX;
+	cornerZ[0] = box.minZ;
+	cornerX[1] = box.maxX;
+	cornerZ[1] = box.minZ;
+	cornerX[2] = box.maxX;
+	cornerZ[2] = box.maxZ;
+	cornerX[3] = box.minX;
+	cornerZ[3] = box.maxZ;
+
+	/*
+		The camera is outside the box so it spans less than half a turn. Measure the corners
+		from the direction of the box center so the span never wraps around.
+	*/
+	center = atan2f(((box.minZ + box.maxZ) * 0.5f) - eyeZ, ((box.minX + box.maxX) * 0.5f) - eyeX);
+
+	start = 0.0f;
+	end = 0.0f;
+	for (i = 0; i < 4; i++)
+	{
+		angle = atan2f(cornerZ[i] - eyeZ, cornerX[i] - eyeX) - center;
+
+		if (angle > HORIZON_CULL_PI)
+		{
+			angle -= 2.0f * HORIZON_CULL_PI;
+		}
+		else if (angle < -HORIZON_CULL_PI)
+		{
+			angle += 2.0f * HORIZON_CULL_PI;
+		}
+
+		start = fminf(start, angle);
+		end = fmaxf(end, angle);
+	}
+
+	start += center;
+	end += center;
+
+	return;
+}
+
+
+int HorizonCullClass::WrapBin(int bin)
+{
+	// The spans can reach past either end of the circle.
+	bin = bin % HORIZON_CULL_BINS;
+
+	return (bin < 0) ? bin + HORIZON_CULL_BINS : bin;
+}
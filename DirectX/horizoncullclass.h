@@ -0,0 +1,82 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: horizoncullclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _HORIZONCULLCLASS_H_
+#define _HORIZONCULLCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <math.h>
+#include <float.h>
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int HORIZON_CULL_BINS = 1024;
+const float HORIZON_CULL_PI = 3.14159265358979f;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: HorizonCullClass
+////////////////////////////////////////////////////////////////////////////////
+// Occlusion culling of terrain chunks against the horizon seen from the
+// camera. The chunks are walked front to back while a buffer of azimuth bins
+// around the camera keeps the steepest slope the ground is known to reach in
+// each direction. A chunk is hidden when the tops of all its cells are below
+// that slope everywhere they span. A visible chunk then raises the horizon
+// with the bottoms of its cells over the directions each one covers
+// completely, since the ground is at least that high everywhere on a cell.
+//
+// Every chunk comes with the same number of cell boxes, chunk after chunk, a
+// single cell per chunk uses the chunk box itself. Slopes are height over
+// horizontal distance. The class only uses the boxes it is given and has no
+// D3D or Windows dependencies.
+class HorizonCullClass
+{
+public:
+	struct BoxType
+	{
+		float minX, minY, minZ;
+		float maxX, maxY, maxZ;
+	};
+
+public:
+	HorizonCullClass();
+	HorizonCullClass(const HorizonCullClass&);
+	~HorizonCullClass();
+
+	bool Initialize(int);
+	void Shutdown();
+
+	int Cull(const BoxType*, int, const BoxType*, int, float, float, float);
+	bool IsVisible(int);
+
+	float GetCulledPercentage();
+	float GetAverageCulledPercentage();
+
+private:
+	void SortChunks(int);
+	void GetDistances(const BoxType&, float, float, float&, float&);
+	bool IsAboveHorizon(const BoxType&, float, float, float);
+	void RaiseHorizon(const BoxType&, float, float, float);
+	void GetSpan(const BoxType&, float, float, float&, float&);
+	int WrapBin(int);
+
+private:
+	int m_maxChunkCount;
+	int* m_order;
+	float* m_nearDistances;
+	bool* m_visible;
+
+	float m_slopes[HORIZON_CULL_BINS];
+	float m_distances[HORIZON_CULL_BINS];
+
+	int m_chunkCount, m_culledCount;
+	float m_culledSum;
+	int m_frameCount;
+};
+
+#endif
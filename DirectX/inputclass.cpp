@@ -100,6 +100,10 @@ bool InputClass::Initialize(HINSTANCE hinstance, HWND hwnd, int screenWidth, int
 
 	m_F1_released = true;
 	m_F2_released = true;
+	m_F3_released = true;
+	m_F4_released = true;
+	m_F5_released = true;
+	m_F6_released = true;
 
 	return true;
 
@@ -373,5 +377,85 @@ bool InputClass::IsF2Toggled()
 		m_F2_released = true;
 	}
 
+	return false;
+}
+
+
+bool InputClass::IsF3Toggled()
+{
+	// Do a bitwise and on the keyboard state to check if the key is currently being pressed.
+	if (m_keyboardState[DIK_F3] & 0x80)
+	{
+		if (m_F3_released)
+		{
+			m_F3_released = false;
+			return true;
+		}
+	}
+	else
+	{
+		m_F3_released = true;
+	}
+
+	return false;
+}
+
+
+bool InputClass::IsF4Toggled()
+{
+	// Do a bitwise and on the keyboard state to check if the key is currently being pressed.
+	if (m_keyboardState[DIK_F4] & 0x80)
+	{
+		if (m_F4_released)
+		{
+			m_F4_released = false;
+			return true;
+		}
+	}
+	else
+	{
+		m_F4_released = true;
+	}
+
+	return false;
+}
+
+
+bool InputClass::IsF5Toggled()
+{
+	// Do a bitwise and on the keyboard state to check if the key is currently being pressed.
+	if (m_keyboardState[DIK_F5] & 0x80)
+	{
+		if (m_F5_released)
+		{
+			m_F5_released = false;
+			return true;
+		}
+	}
+	else
+	{
+		m_F5_released = true;
+	}
+
+	return false;
+}
+
+
+bool InputClass::IsF6Toggled()
+{
+	// Do a bitwise and on the keyboard state to check if the key is currently being pressed.
+	if (m_keyboardState[DIK_F6] & 0x80)
+	{
+		if (m_F6_released)
+		{
+			m_F6_released = false;
+			return true;
+		}
+	}
+	else
+	{
+		m_F6_released = true;
+	}
+
 	return false;
 }
\ No newline at end of file
@@ -51,6 +51,10 @@ public:
 
 	bool IsF1Toggled();
 	bool IsF2Toggled();
+	bool IsF3Toggled();
+	bool IsF4Toggled();
+	bool IsF5Toggled();
+	bool IsF6Toggled();
 
 private:
 	bool ReadKeyboard();
@@ -70,6 +74,10 @@ private:
 
 	bool m_F1_released;
 	bool m_F2_released;
+	bool m_F3_released;
+	bool m_F4_released;
+	bool m_F5_released;
+	bool m_F6_released;
 };
 
 #endif
\ No newline at end of file
@@ -9,6 +9,9 @@ LightShaderClass::LightShaderClass()
 	m_sampleState = 0;
 	m_matrixBuffer = 0;
 	m_lightBuffer = 0;
+	m_packedVertexShader = 0;
+	m_packedLayout = 0;
+	m_packedBuffer = 0;
 }
 
 LightShaderClass::LightShaderClass(const LightShaderClass& other)
@@ -81,6 +84,59 @@ bool LightShaderClass::Render(ID3D11DeviceContext* deviceContext, int indexCount
 	return true;
 }
 
+bool LightShaderClass::SetShader(ID3D11DeviceContext* deviceContext, XMMATRIX worldMatrix, XMMATRIX viewMatrix,
+	XMMATRIX projectionMatrix, ID3D11ShaderResourceView* texture, XMFLOAT3 lightDirection, XMFLOAT4 diffuseColor)
+{
+	bool result;
+
+
+	// Set the shader parameters that it will use for rendering.
+	result = SetShaderParameters(deviceContext, worldMatrix, viewMatrix, projectionMatrix, texture, lightDirection, diffuseColor);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Bind the shader without drawing, the caller issues its own draw calls afterwards.
+	SetShaderState(deviceContext, false);
+
+	return true;
+}
+
+bool LightShaderClass::SetShader(ID3D11DeviceContext* deviceContext, XMMATRIX worldMatrix, XMMATRIX viewMatrix,
+	XMMATRIX projectionMatrix, ID3D11ShaderResourceView* texture, ID3D11ShaderResourceView* splatMap, ID3D11ShaderResourceView* snowTexture,
+	XMFLOAT3 lightDirection, XMFLOAT4 diffuseColor, XMFLOAT4 packedDecode, bool packed)
+{
+	bool result;
+
+
+	// Set the shader parameters that it will use for rendering.
+	result = SetShaderParameters(deviceContext, worldMatrix, viewMatrix, projectionMatrix, texture, lightDirection, diffuseColor);
+	if (!result)
+	{
+		return false;
+	}
+
+	// The material weights and the snow texture go after the baked maps and the normal map the terrain binds.
+	deviceContext->PSSetShaderResources(5, 1, &splatMap);
+	deviceContext->PSSetShaderResources(6, 1, &snowTexture);
+
+	// The packed vertex shader also needs the height and texture scales to decode the vertices.
+	if (packed)
+	{
+		result = SetPackedParameters(deviceContext, packedDecode);
+		if (!result)
+		{
+			return false;
+		}
+	}
+
+	// Bind the shader without drawing, the caller issues its own draw calls afterwards.
+	SetShaderState(deviceContext, packed);
+
+	return true;
+}
+
 bool LightShaderClass::InitializeShader(ID3D11Device* device, HWND hwnd, WCHAR* vsFilename, WCHAR* psFilename)
 {
 	HRESULT result;
@@ -88,10 +144,12 @@ bool LightShaderClass::InitializeShader(ID3D11Device* device, HWND hwnd, WCHAR*
 	ID3D10Blob* vertexShaderBuffer;
 	ID3D10Blob* pixelShaderBuffer;
 	D3D11_INPUT_ELEMENT_DESC polygonLayout[3];
+	D3D11_INPUT_ELEMENT_DESC packedLayout[1];
 	unsigned int numElements;
 	D3D11_SAMPLER_DESC samplerDesc;
 	D3D11_BUFFER_DESC matrixBufferDesc;
 	D3D11_BUFFER_DESC lightBufferDesc;
+	D3D11_BUFFER_DESC packedBufferDesc;
 
 
 	// Initialize the pointers this function will use to null.
@@ -151,7 +209,7 @@ bool LightShaderClass::InitializeShader(ID3D11Device* device, HWND hwnd, WCHAR*
 	}
 
 	// Create the vertex input layout description.
-	// This setup needs to match the VertexType stucture in the ModelClass and in the shader.
+	// This setup needs to match the VertexType stucture in the TerrainClass and in the shader.
 	polygonLayout[0].SemanticName = "POSITION";
 	polygonLayout[0].SemanticIndex = 0;
 	polygonLayout[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
@@ -160,17 +218,17 @@ bool LightShaderClass::InitializeShader(ID3D11Device* device, HWND hwnd, WCHAR*
 	polygonLayout[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	polygonLayout[0].InstanceDataStepRate = 0;
 
-	polygonLayout[1].SemanticName = "TEXCOORD";
+	polygonLayout[1].SemanticName = "NORMAL";
 	polygonLayout[1].SemanticIndex = 0;
-	polygonLayout[1].Format = DXGI_FORMAT_R32G32_FLOAT;
+	polygonLayout[1].Format = DXGI_FORMAT_R32G32B32_FLOAT;
 	polygonLayout[1].InputSlot = 0;
 	polygonLayout[1].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
 	polygonLayout[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 	polygonLayout[1].InstanceDataStepRate = 0;
 
-	polygonLayout[2].SemanticName = "NORMAL";
+	polygonLayout[2].SemanticName = "TEXCOORD";
 	polygonLayout[2].SemanticIndex = 0;
-	polygonLayout[2].Format = DXGI_FORMAT_R32G32B32_FLOAT;
+	polygonLayout[2].Format = DXGI_FORMAT_R32G32_FLOAT;
 	polygonLayout[2].InputSlot = 0;
 	polygonLayout[2].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
 	polygonLayout[2].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
@@ -194,6 +252,57 @@ bool LightShaderClass::InitializeShader(ID3D11Device* device, HWND hwnd, WCHAR*
 	pixelShaderBuffer->Release();
 	pixelShaderBuffer = 0;
 
+	// Compile the packed vertex shader code, it decodes the 8 byte terrain vertex.
+	result = D3DCompileFromFile(vsFilename, NULL, NULL, "LightPackedVertexShader", "vs_4_0", D3D10_SHADER_ENABLE_STRICTNESS, 0,
+		&vertexShaderBuffer, &errorMessage);
+	if (FAILED(result))
+	{
+		// If the shader failed to compile it should have writen something to the error message.
+		if (errorMessage)
+		{
+			OutputShaderErrorMessage(errorMessage, hwnd, vsFilename);
+		}
+		// If there was nothing in the error message then it simply could not find the shader file itself.
+		else
+		{
+			MessageBox(hwnd, vsFilename, L"Missing Shader File", MB_OK);
+		}
+
+		return false;
+	}
+
+	// Create the packed vertex shader from the buffer.
+	result = device->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &m_packedVertexShader);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// The packed vertex is read as four 16 bit integers: grid x, grid z, height and octahedral normal.
+	// This setup needs to match the PackedVertexType structure in the VertexPackClass.
+	packedLayout[0].SemanticName = "POSITION";
+	packedLayout[0].SemanticIndex = 0;
+	packedLayout[0].Format = DXGI_FORMAT_R16G16B16A16_UINT;
+	packedLayout[0].InputSlot = 0;
+	packedLayout[0].AlignedByteOffset = 0;
+	packedLayout[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+	packedLayout[0].InstanceDataStepRate = 0;
+
+	// Get a count of the elements in the layout.
+	numElements = sizeof(packedLayout) / sizeof(packedLayout[0]);
+
+	// Create the packed vertex input layout.
+	result = device->CreateInputLayout(packedLayout, numElements, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(),
+		&m_packedLayout);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Release the packed vertex shader buffer.
+	vertexShaderBuffer->Release();
+	vertexShaderBuffer = 0;
+
 	// Create a texture sampler state description.
 	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
@@ -247,11 +356,47 @@ bool LightShaderClass::InitializeShader(ID3D11Device* device, HWND hwnd, WCHAR*
 		return false;
 	}
 
+	// Setup the description of the packed vertex decode constant buffer that is in the vertex shader.
+	packedBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	packedBufferDesc.ByteWidth = sizeof(PackedBufferType);
+	packedBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	packedBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	packedBufferDesc.MiscFlags = 0;
+	packedBufferDesc.StructureByteStride = 0;
+
+	// Create the packed decode constant buffer.
+	result = device->CreateBuffer(&packedBufferDesc, NULL, &m_packedBuffer);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
 	return true;
 }
 
 void LightShaderClass::ShutdownShader()
 {
+	// Release the packed decode constant buffer.
+	if (m_packedBuffer)
+	{
+		m_packedBuffer->Release();
+		m_packedBuffer = 0;
+	}
+
+	// Release the packed layout.
+	if (m_packedLayout)
+	{
+		m_packedLayout->Release();
+		m_packedLayout = 0;
+	}
+
+	// Release the packed vertex shader.
+	if (m_packedVertexShader)
+	{
+		m_packedVertexShader->Release();
+		m_packedVertexShader = 0;
+	}
+
 	// Release the light constant buffer.
 	if (m_lightBuffer)
 	{
@@ -473,18 +618,70 @@ bool LightShaderClass::SetShaderParameters(ID3D11DeviceContext* deviceContext, X
 	return true;
 }
 
-void LightShaderClass::RenderShader(ID3D11DeviceContext* deviceContext, int indexCount)
+bool LightShaderClass::SetPackedParameters(ID3D11DeviceContext* deviceContext, XMFLOAT4 packedDecode)
+{
+	HRESULT result;
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	PackedBufferType* dataPtr;
+	unsigned int bufferNumber;
+
+
+	// Lock the packed decode constant buffer so it can be written to.
+	result = deviceContext->Map(m_packedBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Get a pointer to the data in the constant buffer.
+	dataPtr = (PackedBufferType*)mappedResource.pData;
+
+	// Copy the decode scales into the constant buffer.
+	dataPtr->heightScale = packedDecode.x;
+	dataPtr->heightOffset = packedDecode.y;
+	dataPtr->textureScale = packedDecode.z;
+	dataPtr->padding = 0.0f;
+
+	// Unlock the constant buffer.
+	deviceContext->Unmap(m_packedBuffer, 0);
+
+	// The decode buffer sits after the matrix buffer in the vertex shader.
+	bufferNumber = 1;
+
+	// Set the packed decode constant buffer in the vertex shader.
+	deviceContext->VSSetConstantBuffers(bufferNumber, 1, &m_packedBuffer);
+
+	return true;
+}
+
+void LightShaderClass::SetShaderState(ID3D11DeviceContext* deviceContext, bool packed)
 {
-	// Set the vertex input layout.
-	deviceContext->IASetInputLayout(m_layout);
+	// Set the vertex input layout and the vertex shader that matches it.
+	if (packed)
+	{
+		deviceContext->IASetInputLayout(m_packedLayout);
+		deviceContext->VSSetShader(m_packedVertexShader, NULL, 0);
+	}
+	else
+	{
+		deviceContext->IASetInputLayout(m_layout);
+		deviceContext->VSSetShader(m_vertexShader, NULL, 0);
+	}
 
-	// Set the vertex and pixel shaders that will be used to render this triangle.
-	deviceContext->VSSetShader(m_vertexShader, NULL, 0);
+	// Set the pixel shader that will be used to render this triangle.
 	deviceContext->PSSetShader(m_pixelShader, NULL, 0);
 
 	// Set the sampler state in the pixel shader.
 	deviceContext->PSSetSamplers(0, 1, &m_sampleState);
 
+	return;
+}
+
+void LightShaderClass::RenderShader(ID3D11DeviceContext* deviceContext, int indexCount)
+{
+	// Set the layout, shaders and sampler.
+	SetShaderState(deviceContext, false);
+
 	// Render the triangle.
 	deviceContext->DrawIndexed(indexCount, 0, 0);
 
@@ -34,6 +34,14 @@ private:
 		float padding;  // Added extra padding so structure is a multiple of 16 for CreateBuffer function requirements.
 	};
 
+	struct PackedBufferType
+	{
+		float heightScale;
+		float heightOffset;
+		float textureScale;
+		float padding;
+	};
+
 public:
 	LightShaderClass();
 	LightShaderClass(const LightShaderClass&);
@@ -44,6 +52,9 @@ public:
 	bool Render(ID3D11DeviceContext*, int, XMMATRIX, XMMATRIX, XMMATRIX, ID3D11ShaderResourceView*, XMFLOAT3, XMFLOAT4, XMFLOAT4);
 	bool Render(ID3D11DeviceContext* deviceContext, int indexCount, XMMATRIX worldMatrix, XMMATRIX viewMatrix,
 		XMMATRIX projectionMatrix, ID3D11ShaderResourceView* texture, XMFLOAT3 lightDirection, XMFLOAT4 diffuseColor);
+	bool SetShader(ID3D11DeviceContext*, XMMATRIX, XMMATRIX, XMMATRIX, ID3D11ShaderResourceView*, XMFLOAT3, XMFLOAT4);
+	bool SetShader(ID3D11DeviceContext*, XMMATRIX, XMMATRIX, XMMATRIX, ID3D11ShaderResourceView*, ID3D11ShaderResourceView*, ID3D11ShaderResourceView*,
+		XMFLOAT3, XMFLOAT4, XMFLOAT4, bool);
 
 private:
 	bool InitializeShader(ID3D11Device*, HWND, WCHAR*, WCHAR*);
@@ -54,6 +65,8 @@ private:
 	bool SetShaderParameters(ID3D11DeviceContext* deviceContext, XMMATRIX worldMatrix, XMMATRIX viewMatrix,
 		XMMATRIX projectionMatrix, ID3D11ShaderResourceView* texture, XMFLOAT3 lightDirection,
 		XMFLOAT4 diffuseColor);
+	bool SetPackedParameters(ID3D11DeviceContext*, XMFLOAT4);
+	void SetShaderState(ID3D11DeviceContext*, bool);
 	void RenderShader(ID3D11DeviceContext*, int);
 
 private:
@@ -64,6 +77,10 @@ private:
 	ID3D11Buffer* m_matrixBuffer;
 
 	ID3D11Buffer* m_lightBuffer;
+
+	ID3D11VertexShader* m_packedVertexShader;
+	ID3D11InputLayout* m_packedLayout;
+	ID3D11Buffer* m_packedBuffer;
 };
 
 #endif
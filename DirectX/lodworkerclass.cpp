@@ -0,0 +1,463 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: lodworkerclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "lodworkerclass.h"
+
+
+LodWorkerClass::LodWorkerClass()
+{
+	int i;
+
+
+	m_Geomipmap = 0;
+	m_Roam = 0;
+
+	for (i = 0; i < LOD_WORKER_SLOTS; i++)
+	{
+		m_frames[i].draws = 0;
+		m_frames[i].indices = 0;
+	}
+}
+
+
+LodWorkerClass::LodWorkerClass(const LodWorkerClass& other)
+{
+}
+
+
+LodWorkerClass::~LodWorkerClass()
+{
+}
+
+
+bool LodWorkerClass::Initialize(GeomipmapClass* geomipmap, RoamClass* roam)
+{
+	INT64 frequency;
+	int i, j;
+
+
+	m_Geomipmap = geomipmap;
+	m_Roam = roam;
+
+	// Get the cycles per second speed for the latency measurements.
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	if (frequency == 0)
+	{
+		return false;
+	}
+
+	m_frequency = (float)frequency;
+
+	// The index buffer size never changes, keep it here so the render thread does not need the ROAM object.
+	m_maxIndexCount = m_Roam->GetMaxIndexCount();
+
+	// The ROAM indices already on the GPU are version 0, no ranges are dirty yet.
+	m_roamVersion = 0;
+	for (i = 0; i < LOD_WORKER_HISTORY; i++)
+	{
+		m_historyFirst[i] = -1;
+		m_historyLast[i] = -1;
+	}
+
+	// Create the three slots, each one holds a full copy of the current ROAM indices.
+	for (i = 0; i < LOD_WORKER_SLOTS; i++)
+	{
+		m_frames[i].draws = new GeomipmapClass::PatchDrawType[m_Geomipmap->GetPatchCount()];
+		if (!m_frames[i].draws)
+		{
+			return false;
+		}
+
+		m_frames[i].indices = new unsigned long[m_maxIndexCount];
+		if (!m_frames[i].indices)
+		{
+			return false;
+		}
+
+		memcpy(m_frames[i].indices, m_Roam->GetIndices(), sizeof(unsigned long) * m_maxIndexCount);
+
+		m_frames[i].mode = LOD_WORKER_NO_FRAME;
+		m_frames[i].sequence = LOD_WORKER_NO_FRAME;
+		m_frames[i].latency = 0.0f;
+		m_frames[i].drawCount = 0;
+		m_frames[i].indexCount = m_Roam->GetIndexCount();
+		m_frames[i].roamVersion = 0;
+		m_frames[i].screenError = 0.0f;
+		m_frames[i].triangleCount = 0;
+
+		for (j = 0; j < LOD_WORKER_HISTORY; j++)
+		{
+			m_frames[i].dirtyFirst[j] = -1;
+			m_frames[i].dirtyLast[j] = -1;
+		}
+	}
+
+	// Slot 0 is on screen, slot 1 is ready (but not new) and slot 2 is the worker's.
+	m_front = 0;
+	m_ready = 1;
+	m_back = 2;
+
+	// Clear the request and the statistics.
+	m_requestPending = false;
+	m_stop = false;
+	m_requestScale = 0.0f;
+	m_requestMaxError = 0.0f;
+	m_requestBudget = 0;
+	m_projectionScale = 0.0f;
+	m_maxError = 0.0f;
+	m_triangleBudget = 0;
+	m_submitSequence = 0;
+	m_frameCount = 0;
+	m_staleFrameCount = 0;
+	m_latencyCount = 0;
+	m_latencySum = 0.0f;
+	m_maxLatency = 0.0f;
+
+	// Start the worker thread.
+	m_thread = thread(&LodWorkerClass::Run, this);
+
+	return true;
+}
+
+
+void LodWorkerClass::Shutdown()
+{
+	int i;
+
+
+	// Stop the worker thread and wait for it to finish its current frame.
+	if (m_thread.joinable())
+	{
+		{
+			lock_guard<mutex> lock(m_requestMutex);
+			m_stop = true;
+		}
+
+		m_requestCondition.notify_one();
+		m_thread.join();
+	}
+
+	// Release the slots.
+	for (i = 0; i < LOD_WORKER_SLOTS; i++)
+	{
+		if (m_frames[i].indices)
+		{
+			delete[] m_frames[i].indices;
+			m_frames[i].indices = 0;
+		}
+
+		if (m_frames[i].draws)
+		{
+			delete[] m_frames[i].draws;
+			m_frames[i].draws = 0;
+		}
+	}
+
+	return;
+}
+
+
+void LodWorkerClass::SetErrorTarget(float projectionScale, float maxError, int triangleBudget)
+{
+	// The worker picks the target up with the next camera.
+	lock_guard<mutex> lock(m_requestMutex);
+
+	m_requestScale = projectionScale;
+	m_requestMaxError = maxError;
+	m_requestBudget = triangleBudget;
+
+	return;
+}
+
+
+void LodWorkerClass::UpdateRegion(const float* heights, int left, int top, int right, int bottom)
+{
+	// The worker reads the patch errors and height ranges while it selects the levels, wait for it to finish.
+	lock_guard<mutex> lock(m_geomipmapMutex);
+
+	m_Geomipmap->UpdateRegion(heights, left, top, right, bottom);
+
+	return;
+}
+
+
+void LodWorkerClass::SubmitCamera(float cameraX, float cameraY, float cameraZ, int mode)
+{
+	// Hand the camera to the worker, an older request it has not started yet is simply replaced.
+	{
+		lock_guard<mutex> lock(m_requestMutex);
+
+		m_requestX = cameraX;
+		m_requestY = cameraY;
+		m_requestZ = cameraZ;
+		m_requestMode = mode;
+		m_requestSequence = m_submitSequence;
+		QueryPerformanceCounter((LARGE_INTEGER*)&m_requestTime);
+		m_requestPending = true;
+	}
+
+	m_requestCondition.notify_one();
+
+	m_submitSequence++;
+
+	return;
+}
+
+
+LodWorkerClass::FrameType* LodWorkerClass::AcquireFrame()
+{
+	int ready;
+
+
+	// Swap the ready slot in only if the worker published something new since the last swap.
+	if (m_ready.load() & LOD_WORKER_NEW_FRAME)
+	{
+		ready = m_ready.exchange(m_front);
+		m_front = ready & LOD_WORKER_SLOT_MASK;
+
+		m_latencySum += m_frames[m_front].latency;
+		m_latencyCount++;
+		if (m_frames[m_front].latency > m_maxLatency)
+		{
+			m_maxLatency = m_frames[m_front].latency;
+		}
+	}
+
+	// The frame just submitted is expected to be worked on now, anything older than the one before it is stale.
+	if (m_frames[m_front].sequence < (m_submitSequence - 2))
+	{
+		m_staleFrameCount++;
+	}
+
+	m_frameCount++;
+
+	return &m_frames[m_front];
+}
+
+
+bool LodWorkerClass::GetRoamUpload(FrameType* frame, int gpuVersion, int& firstIndex, int& indexCount)
+{
+	// Work out which indices changed between the version on the GPU and the one in the frame.
+	return GetDirtyUnion(frame->dirtyFirst, frame->dirtyLast, gpuVersion, frame->roamVersion, firstIndex, indexCount);
+}
+
+
+float LodWorkerClass::GetAverageLatency()
+{
+	if (m_latencyCount == 0)
+	{
+		return 0.0f;
+	}
+
+	return m_latencySum / (float)m_latencyCount;
+}
+
+
+float LodWorkerClass::GetMaxLatency()
+{
+	return m_maxLatency;
+}
+
+
+int LodWorkerClass::GetStaleFrameCount()
+{
+	return m_staleFrameCount;
+}
+
+
+int LodWorkerClass::GetFrameCount()
+{
+	return m_frameCount;
+}
+
+
+void LodWorkerClass::Run()
+{
+	FrameType* frame;
+	float cameraX, cameraY, cameraZ;
+	int mode, sequence;
+	INT64 requestTime, endTime;
+
+
+	while (true)
+	{
+		// Wait for a camera from the render thread.
+		{
+			unique_lock<mutex> lock(m_requestMutex);
+
+			while (!m_requestPending && !m_stop)
+			{
+				m_requestCondition.wait(lock);
+			}
+
+			if (m_stop)
+			{
+				return;
+			}
+
+			cameraX = m_requestX;
+			cameraY = m_requestY;
+			cameraZ = m_requestZ;
+			mode = m_requestMode;
+			sequence = m_requestSequence;
+			requestTime = m_requestTime;
+			m_projectionScale = m_requestScale;
+			m_maxError = m_requestMaxError;
+			m_triangleBudget = m_requestBudget;
+			m_requestPending = false;
+		}
+
+		// Build the frame in the back slot, the render thread never touches it.
+		frame = &m_frames[m_back];
+
+		if (mode == LOD_WORKER_ROAM)
+		{
+			BuildRoamFrame(frame, cameraX, cameraY, cameraZ);
+		}
+		else
+		{
+			BuildGeomipmapFrame(frame, cameraX, cameraY, cameraZ, (mode == LOD_WORKER_SCREEN_ERROR));
+		}
+
+		frame->mode = mode;
+		frame->sequence = sequence;
+
+		// The latency covers the time the request waited as well as the build.
+		QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+		frame->latency = ((float)(endTime - requestTime) / m_frequency) * 1000.0f;
+
+		// Publish the slot and take back whichever one was waiting.
+		m_back = m_ready.exchange(m_back | LOD_WORKER_NEW_FRAME) & LOD_WORKER_SLOT_MASK;
+	}
+}
+
+
+void LodWorkerClass::BuildGeomipmapFrame(FrameType* frame, float cameraX, float cameraY, float cameraZ, bool screenError)
+{
+	int i;
+	lock_guard<mutex> lock(m_geomipmapMutex);
+
+
+	// Select the patch levels from the error target when there is one, otherwise from the distance rings.
+	if (screenError && (m_projectionScale > 0.0f))
+	{
+		m_Geomipmap->SelectLevels(cameraX, cameraY, cameraZ, m_projectionScale, m_maxError, m_triangleBudget);
+	}
+	else
+	{
+		m_Geomipmap->SelectLevels(cameraX, cameraZ);
+	}
+
+	// Store the draw of every patch.
+	for (i = 0; i < m_Geomipmap->GetPatchCount(); i++)
+	{
+		m_Geomipmap->GetPatchDraw(i, frame->draws[i]);
+	}
+
+	frame->drawCount = m_Geomipmap->GetPatchCount();
+
+	frame->triangleCount = m_Geomipmap->GetTriangleCount();
+	frame->screenError = (m_projectionScale > 0.0f) ? m_Geomipmap->GetScreenError(cameraX, cameraY, cameraZ, m_projectionScale) : 0.0f;
+
+	return;
+}
+
+
+void LodWorkerClass::BuildRoamFrame(FrameType* frame, float cameraX, float cameraY, float cameraZ)
+{
+	int slot, firstIndex, indexCount;
+
+
+	// Measure the errors in pixels against the same target as the geomipmap once there is one.
+	if (m_projectionScale > 0.0f)
+	{
+		m_Roam->SetErrorTarget(m_projectionScale, m_maxError, m_triangleBudget);
+	}
+
+	// Apply this frame's bounded set of splits and merges.
+	m_Roam->Update(cameraX, cameraY, cameraZ);
+
+	// Record the range it touched as the next version.
+	m_roamVersion++;
+	slot = m_roamVersion % LOD_WORKER_HISTORY;
+	if (m_Roam->GetDirtyRange(firstIndex, indexCount))
+	{
+		m_historyFirst[slot] = firstIndex;
+		m_historyLast[slot] = firstIndex + indexCount;
+		m_Roam->ClearDirtyRange();
+	}
+	else
+	{
+		m_historyFirst[slot] = -1;
+		m_historyLast[slot] = -1;
+	}
+
+	// Bring the slot's copy of the indices up to date from whatever version it last held.
+	if (GetDirtyUnion(m_historyFirst, m_historyLast, frame->roamVersion, m_roamVersion, firstIndex, indexCount))
+	{
+		memcpy(frame->indices + firstIndex, m_Roam->GetIndices() + firstIndex, sizeof(unsigned long) * indexCount);
+	}
+
+	frame->indexCount = m_Roam->GetIndexCount();
+	frame->roamVersion = m_roamVersion;
+	frame->triangleCount = m_Roam->GetTriangleCount();
+	frame->screenError = m_Roam->GetScreenError();
+
+	// The render thread needs the history to find what changed since its own upload.
+	memcpy(frame->dirtyFirst, m_historyFirst, sizeof(m_historyFirst));
+	memcpy(frame->dirtyLast, m_historyLast, sizeof(m_historyLast));
+
+	return;
+}
+
+
+bool LodWorkerClass::GetDirtyUnion(const int* historyFirst, const int* historyLast, int fromVersion, int toVersion, int& firstIndex, int& indexCount)
+{
+	int version, slot, first, last;
+
+
+	if (fromVersion == toVersion)
+	{
+		return false;
+	}
+
+	// Too far behind for the history, take everything.
+	if ((toVersion - fromVersion) > LOD_WORKER_HISTORY)
+	{
+		firstIndex = 0;
+		indexCount = m_maxIndexCount;
+		return true;
+	}
+
+	// Merge the ranges of every version after the one already held.
+	first = -1;
+	last = -1;
+	for (version = fromVersion + 1; version <= toVersion; version++)
+	{
+		slot = version % LOD_WORKER_HISTORY;
+		if (historyFirst[slot] == -1)
+		{
+			continue;
+		}
+
+		if ((first == -1) || (historyFirst[slot] < first))
+		{
+			first = historyFirst[slot];
+		}
+
+		if (historyLast[slot] > last)
+		{
+			last = historyLast[slot];
+		}
+	}
+
+	if (first == -1)
+	{
+		return false;
+	}
+
+	firstIndex = first;
+	indexCount = last - first;
+
+	return true;
+}
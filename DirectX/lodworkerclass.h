@@ -0,0 +1,120 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: lodworkerclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _LODWORKERCLASS_H_
+#define _LODWORKERCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <windows.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "geomipmapclass.h"
+#include "roamclass.h"
+
+using namespace std;
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int LOD_WORKER_GEOMIPMAP = 0;
+const int LOD_WORKER_ROAM = 1;
+const int LOD_WORKER_SCREEN_ERROR = 2;
+const int LOD_WORKER_SLOTS = 3;
+const int LOD_WORKER_HISTORY = 16;
+const int LOD_WORKER_NEW_FRAME = 4;
+const int LOD_WORKER_SLOT_MASK = 3;
+const int LOD_WORKER_NO_FRAME = -1;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: LodWorkerClass
+////////////////////////////////////////////////////////////////////////////////
+class LodWorkerClass
+{
+public:
+	// One slot of the triple buffer, written by the worker and read by the render thread.
+	struct FrameType
+	{
+		int mode;
+		int sequence;
+		float latency;
+
+		GeomipmapClass::PatchDrawType* draws;
+		int drawCount;
+
+		unsigned long* indices;
+		int indexCount;
+		int roamVersion;
+
+		// Largest error left on screen in pixels and the triangles selected to get there.
+		float screenError;
+		int triangleCount;
+		int dirtyFirst[LOD_WORKER_HISTORY];
+		int dirtyLast[LOD_WORKER_HISTORY];
+	};
+
+public:
+	LodWorkerClass();
+	LodWorkerClass(const LodWorkerClass&);
+	~LodWorkerClass();
+
+	bool Initialize(GeomipmapClass*, RoamClass*);
+	void Shutdown();
+
+	void SetErrorTarget(float, float, int);
+	void UpdateRegion(const float*, int, int, int, int);
+	void SubmitCamera(float, float, float, int);
+	FrameType* AcquireFrame();
+	bool GetRoamUpload(FrameType*, int, int&, int&);
+
+	float GetAverageLatency();
+	float GetMaxLatency();
+	int GetStaleFrameCount();
+	int GetFrameCount();
+
+private:
+	void Run();
+	void BuildGeomipmapFrame(FrameType*, float, float, float, bool);
+	void BuildRoamFrame(FrameType*, float, float, float);
+	bool GetDirtyUnion(const int*, const int*, int, int, int&, int&);
+
+private:
+	GeomipmapClass* m_Geomipmap;
+	RoamClass* m_Roam;
+
+	FrameType m_frames[LOD_WORKER_SLOTS];
+	atomic<int> m_ready;
+	int m_back, m_front;
+
+	thread m_thread;
+	mutex m_geomipmapMutex;
+	mutex m_requestMutex;
+	condition_variable m_requestCondition;
+	bool m_requestPending, m_stop;
+	float m_requestX, m_requestY, m_requestZ;
+	int m_requestMode, m_requestSequence;
+	INT64 m_requestTime;
+	float m_requestScale, m_requestMaxError;
+	int m_requestBudget;
+	float m_projectionScale, m_maxError;
+	int m_triangleBudget;
+
+	float m_frequency;
+	int m_maxIndexCount;
+	int m_roamVersion;
+	int m_historyFirst[LOD_WORKER_HISTORY];
+	int m_historyLast[LOD_WORKER_HISTORY];
+
+	int m_submitSequence, m_frameCount, m_staleFrameCount, m_latencyCount;
+	float m_latencySum, m_maxLatency;
+};
+
+#endif
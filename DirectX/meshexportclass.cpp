@@ -0,0 +1,740 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: meshexportclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "meshexportclass.h"
+
+
+MeshExportClass::MeshExportClass()
+{
+	m_heights = 0;
+	m_normals = 0;
+	m_width = 0;
+	m_height = 0;
+	m_remap = 0;
+	m_buffer = 0;
+	m_triangles = 0;
+	m_bufferUsed = 0;
+	m_filePtr = 0;
+	m_bytesWritten = 0;
+	m_Geomipmap = 0;
+	m_indexPool = 0;
+	m_draws = 0;
+	m_drawCount = 0;
+	m_indices = 0;
+	m_indexCount = 0;
+	m_vertexCount = 0;
+	m_triangleCount = 0;
+	m_shortIndices = false;
+}
+
+
+MeshExportClass::MeshExportClass(const MeshExportClass& other)
+{
+}
+
+
+MeshExportClass::~MeshExportClass()
+{
+}
+
+
+bool MeshExportClass::Initialize(const float* heights, const unsigned short* normals, int width, int height)
+{
+	// Without resident normals they are worked out from the heights as the vertices are written.
+	m_heights = heights;
+	m_normals = normals;
+	m_width = width;
+	m_height = height;
+
+	// Create the remap table, the new index of every grid vertex the triangles use.
+	m_remap = new int[m_width * m_height];
+	if (!m_remap)
+	{
+		return false;
+	}
+
+	// Create the write buffer and the triangles read from the index source a chunk at a time.
+	m_buffer = new unsigned char[MESH_EXPORT_BUFFER_SIZE];
+	if (!m_buffer)
+	{
+		return false;
+	}
+
+	m_triangles = new unsigned long[MESH_EXPORT_TRIANGLE_CHUNK * 3];
+	if (!m_triangles)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+void MeshExportClass::Shutdown()
+{
+	// Release the triangle chunk, the write buffer and the remap table.
+	if (m_triangles)
+	{
+		delete[] m_triangles;
+		m_triangles = 0;
+	}
+
+	if (m_buffer)
+	{
+		delete[] m_buffer;
+		m_buffer = 0;
+	}
+
+	if (m_remap)
+	{
+		delete[] m_remap;
+		m_remap = 0;
+	}
+
+	return;
+}
+
+
+bool MeshExportClass::Export(const char* filename, int format, bool quantized, GeomipmapClass* geomipmap, const GeomipmapClass::PatchDrawType* draws,
+	int drawCount)
+{
+	// Patch draws into the 16 bit index pool, each offset to its patch corner by the base vertex.
+	m_Geomipmap = geomipmap;
+	m_indexPool = geomipmap->GetIndexPool();
+	m_draws = draws;
+	m_drawCount = drawCount;
+	m_indices = 0;
+	m_indexCount = 0;
+
+	return ExportMesh(filename, format, quantized);
+}
+
+
+bool MeshExportClass::Export(const char* filename, int format, bool quantized, const unsigned long* indices, int indexCount)
+{
+	// A plain list of grid indices.
+	m_Geomipmap = 0;
+	m_indexPool = 0;
+	m_draws = 0;
+	m_drawCount = 0;
+	m_indices = indices;
+	m_indexCount = indexCount;
+
+	return ExportMesh(filename, format, quantized);
+}
+
+
+int MeshExportClass::GetVertexCount()
+{
+	return m_vertexCount;
+}
+
+
+int MeshExportClass::GetTriangleCount()
+{
+	return m_triangleCount;
+}
+
+
+unsigned long long MeshExportClass::GetBytesWritten()
+{
+	return m_bytesWritten;
+}
+
+
+bool MeshExportClass::ExportMesh(const char* filename, int format, bool quantized)
+{
+	int error;
+	bool result;
+
+
+	// Find the vertices the triangles use and how many triangles there are before anything is written.
+	result = MarkVertices();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Open the file for writing in binary.
+	error = fopen_s(&m_filePtr, filename, "wb");
+	if (error != 0)
+	{
+		m_filePtr = 0;
+		return false;
+	}
+
+	m_bufferUsed = 0;
+	m_bytesWritten = 0;
+
+	// The header, then the vertices and then the indices.
+	if (format == MESH_EXPORT_GLB)
+	{
+		result = WriteGlbHeader(quantized);
+	}
+	else
+	{
+		result = WritePlyHeader(quantized);
+	}
+
+	if (result)
+	{
+		result = WriteVertices(format, quantized);
+	}
+
+	if (result)
+	{
+		result = WriteIndices(format);
+	}
+
+	if (result)
+	{
+		result = Flush();
+	}
+
+	// Close the file.
+	error = fclose(m_filePtr);
+	m_filePtr = 0;
+
+	if (!result || (error != 0))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+int MeshExportClass::ReadTriangles(int& draw, int& offset, unsigned long* triangles)
+{
+	unsigned long a, b, c;
+	int count;
+
+
+	// Copy the next chunk of triangles as grid indices, leaving out the degenerate ones.
+	count = 0;
+	while (count < MESH_EXPORT_TRIANGLE_CHUNK)
+	{
+		if (m_draws)
+		{
+			if (draw >= m_drawCount)
+			{
+				break;
+			}
+
+			if ((offset + 2) >= m_draws[draw].indexCount)
+			{
+				draw++;
+				offset = 0;
+				continue;
+			}
+
+			// The draws index the vertex buffer, map them back to the grid.
+			a = m_Geomipmap->GetGridVertex(m_draws[draw].baseVertex + m_indexPool[m_draws[draw].indexOffset + offset]);
+			b = m_Geomipmap->GetGridVertex(m_draws[draw].baseVertex + m_indexPool[m_draws[draw].indexOffset + offset + 1]);
+			c = m_Geomipmap->GetGridVertex(m_draws[draw].baseVertex + m_indexPool[m_draws[draw].indexOffset + offset + 2]);
+		}
+		else
+		{
+			if ((offset + 2) >= m_indexCount)
+			{
+				break;
+			}
+
+			a = m_indices[offset];
+			b = m_indices[offset + 1];
+			c = m_indices[offset + 2];
+		}
+
+		offset += 3;
+
+		if ((a == b) || (b == c) || (a == c))
+		{
+			continue;
+		}
+
+		triangles[(count * 3)] = a;
+		triangles[(count * 3) + 1] = b;
+		triangles[(count * 3) + 2] = c;
+		count++;
+	}
+
+	return count;
+}
+
+
+bool MeshExportClass::MarkVertices()
+{
+	int draw, offset, count, i, j, index;
+	float height, extent;
+
+
+	for (i = 0; i < (m_width * m_height); i++)
+	{
+		m_remap[i] = -1;
+	}
+
+	// Mark every vertex a triangle uses.
+	m_triangleCount = 0;
+	draw = 0;
+	offset = 0;
+
+	count = ReadTriangles(draw, offset, m_triangles);
+	while (count > 0)
+	{
+		for (i = 0; i < (count * 3); i++)
+		{
+			if (m_triangles[i] >= (unsigned long)(m_width * m_height))
+			{
+				return false;
+			}
+
+			m_remap[m_triangles[i]] = 0;
+		}
+
+		m_triangleCount += count;
+		count = ReadTriangles(draw, offset, m_triangles);
+	}
+
+	if (m_triangleCount == 0)
+	{
+		return false;
+	}
+
+	// Number the marked vertices in grid order and find the bounds of the positions.
+	m_vertexCount = 0;
+	m_minX = m_width;
+	m_maxX = 0;
+	m_minRow = m_height;
+	m_maxRow = 0;
+	m_minHeight = FLT_MAX;
+	m_maxHeight = -FLT_MAX;
+
+	for (j = 0; j < m_height; j++)
+	{
+		for (i = 0; i < m_width; i++)
+		{
+			index = (j * m_width) + i;
+			if (m_remap[index] < 0)
+			{
+				continue;
+			}
+
+			m_remap[index] = m_vertexCount;
+			m_vertexCount++;
+
+			height = m_heights[index];
+			m_minHeight = (height < m_minHeight) ? height : m_minHeight;
+			m_maxHeight = (height > m_maxHeight) ? height : m_maxHeight;
+			m_minX = (i < m_minX) ? i : m_minX;
+			m_maxX = (i > m_maxX) ? i : m_maxX;
+			m_minRow = (j < m_minRow) ? j : m_minRow;
+			m_maxRow = (j > m_maxRow) ? j : m_maxRow;
+		}
+	}
+
+	// Quantized heights cover the range of the exported vertices, a flat mesh keeps a step of one.
+	m_heightStep = (m_maxHeight > m_minHeight) ? (m_maxHeight - m_minHeight) / 65535.0f : 1.0f;
+
+	// The GLB steps the same on every axis, the widest of the three ranges sets it.
+	extent = (float)(m_maxX - m_minX);
+	extent = ((float)(m_maxRow - m_minRow) > extent) ? (float)(m_maxRow - m_minRow) : extent;
+	extent = ((m_maxHeight - m_minHeight) > extent) ? (m_maxHeight - m_minHeight) : extent;
+	m_positionStep = (extent > 0.0f) ? extent / 65535.0f : 1.0f;
+
+	// The indices only need 16 bits when every vertex fits.
+	m_shortIndices = (m_vertexCount <= 65535);
+
+	return true;
+}
+
+
+bool MeshExportClass::WriteGlbHeader(bool quantized)
+{
+	char json[4096];
+	unsigned int header[5];
+	unsigned int vertexStride, vertexBytes, indexBytes, binaryBytes, totalBytes, jsonLength;
+	unsigned long long binarySize;
+	int length;
+
+
+	// Interleaved vertices, 4 byte aligned attributes as glTF wants them, then the indices padded to 4 bytes.
+	vertexStride = quantized ? 16 : 32;
+
+	binarySize = ((unsigned long long)m_vertexCount * vertexStride) + (((unsigned long long)m_triangleCount * 3 * (m_shortIndices ? 2 : 4) + 3) & ~3ULL);
+	if (binarySize > 0xffff0000ULL)
+	{
+		return false;
+	}
+
+	vertexBytes = m_vertexCount * vertexStride;
+	indexBytes = m_triangleCount * 3 * (m_shortIndices ? 2 : 4);
+	binaryBytes = (unsigned int)binarySize;
+
+	length = sprintf_s(json, sizeof(json),
+		"{\"asset\":{\"version\":\"2.0\",\"generator\":\"DirectX terrain export\"},"
+		"%s"
+		"\"scene\":0,\"scenes\":[{\"nodes\":[0]}],",
+		quantized ? "\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"]," : "");
+
+	// Quantized positions are steps from the lowest corner of the bounds, the node turns them back into world units.
+	if (quantized)
+	{
+		length += sprintf_s(json + length, sizeof(json) - length,
+			"\"nodes\":[{\"mesh\":0,\"translation\":[%d,%.9g,%d],\"scale\":[%.9g,%.9g,%.9g]}],",
+			m_minX, m_minHeight, m_minRow - (m_height - 1), m_positionStep, m_positionStep, m_positionStep);
+	}
+	else
+	{
+		length += sprintf_s(json + length, sizeof(json) - length, "\"nodes\":[{\"mesh\":0}],");
+	}
+
+	length += sprintf_s(json + length, sizeof(json) - length,
+		"\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3,\"mode\":4}]}],"
+		"\"buffers\":[{\"byteLength\":%u}],"
+		"\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%u,\"byteStride\":%u,\"target\":34962},"
+		"{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"target\":34963}],",
+		binaryBytes, vertexBytes, vertexStride, vertexBytes, indexBytes);
+
+	if (quantized)
+	{
+		length += sprintf_s(json + length, sizeof(json) - length,
+			"\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5123,\"count\":%d,\"type\":\"VEC3\",\"min\":[%d,%d,%d],\"max\":[%d,%d,%d]},"
+			"{\"bufferView\":0,\"byteOffset\":8,\"componentType\":5120,\"normalized\":true,\"count\":%d,\"type\":\"VEC3\"},"
+			"{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5123,\"normalized\":true,\"count\":%d,\"type\":\"VEC2\"},",
+			m_vertexCount, 0, 0, 0, (int)Quantize((float)m_maxX, (float)m_minX, m_positionStep), (int)Quantize(m_maxHeight, m_minHeight, m_positionStep),
+			(int)Quantize((float)m_maxRow, (float)m_minRow, m_positionStep), m_vertexCount, m_vertexCount);
+	}
+	else
+	{
+		length += sprintf_s(json + length, sizeof(json) - length,
+			"\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":%d,\"type\":\"VEC3\",\"min\":[%d,%.9g,%d],\"max\":[%d,%.9g,%d]},"
+			"{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":%d,\"type\":\"VEC3\"},"
+			"{\"bufferView\":0,\"byteOffset\":24,\"componentType\":5126,\"count\":%d,\"type\":\"VEC2\"},",
+			m_vertexCount, m_minX, m_minHeight, m_minRow - (m_height - 1), m_maxX, m_maxHeight, m_maxRow - (m_height - 1), m_vertexCount, m_vertexCount);
+	}
+
+	length += sprintf_s(json + length, sizeof(json) - length,
+		"{\"bufferView\":1,\"byteOffset\":0,\"componentType\":%d,\"count\":%d,\"type\":\"SCALAR\"}]}",
+		m_shortIndices ? 5123 : 5125, m_triangleCount * 3);
+
+	// The JSON chunk is padded to 4 bytes with spaces.
+	while ((length % 4) != 0)
+	{
+		json[length] = ' ';
+		length++;
+	}
+	jsonLength = (unsigned int)length;
+
+	totalBytes = 12 + 8 + jsonLength + 8 + binaryBytes;
+
+	// The GLB header followed by the JSON chunk header, "glTF" version 2 and "JSON".
+	header[0] = 0x46546c67;
+	header[1] = 2;
+	header[2] = totalBytes;
+	header[3] = jsonLength;
+	header[4] = 0x4e4f534a;
+
+	if (!Write(header, sizeof(header)) || !Write(json, jsonLength))
+	{
+		return false;
+	}
+
+	// The binary chunk header, "BIN" and a zero, the data is streamed after it.
+	header[0] = binaryBytes;
+	header[1] = 0x004e4942;
+
+	return Write(header, 2 * sizeof(unsigned int));
+}
+
+
+bool MeshExportClass::WritePlyHeader(bool quantized)
+{
+	char text[2048];
+	int length;
+
+
+	length = sprintf_s(text, sizeof(text),
+		"ply\nformat binary_little_endian 1.0\ncomment DirectX terrain export, right handed with y up\n");
+
+	// Quantized files need the height scale and the row offset to get back to world units.
+	if (quantized)
+	{
+		length += sprintf_s(text + length, sizeof(text) - length,
+			"comment quantized: world x = x, world y = y * %.9g + %.9g, world z = z - %d\n"
+			"element vertex %d\nproperty ushort x\nproperty ushort y\nproperty ushort z\n"
+			"property char nx\nproperty char ny\nproperty char nz\nproperty ushort s\nproperty ushort t\n",
+			m_heightStep, m_minHeight, m_height - 1, m_vertexCount);
+	}
+	else
+	{
+		length += sprintf_s(text + length, sizeof(text) - length,
+			"element vertex %d\nproperty float x\nproperty float y\nproperty float z\n"
+			"property float nx\nproperty float ny\nproperty float nz\nproperty float s\nproperty float t\n",
+			m_vertexCount);
+	}
+
+	length += sprintf_s(text + length, sizeof(text) - length,
+		"element face %d\nproperty list uchar uint vertex_indices\nend_header\n", m_triangleCount);
+
+	return Write(text, length);
+}
+
+
+bool MeshExportClass::WriteVertices(int format, bool quantized)
+{
+	unsigned char vertex[32];
+	int index, size;
+
+
+	// The marked vertices in grid order, the same order they were numbered in.
+	for (index = 0; index < (m_width * m_height); index++)
+	{
+		if (m_remap[index] < 0)
+		{
+			continue;
+		}
+
+		size = EncodeVertex(index, format, quantized, vertex);
+		if (!Write(vertex, size))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool MeshExportClass::WriteIndices(int format)
+{
+	unsigned char face[13];
+	unsigned short shortIndices[3];
+	unsigned int indices[3], padding;
+	int draw, offset, count, i;
+
+
+	// Stream the triangles again a chunk at a time with the new vertex numbers, the flipped z turns the front faces
+	// around so the last two corners swap to keep them counter clockwise.
+	draw = 0;
+	offset = 0;
+
+	count = ReadTriangles(draw, offset, m_triangles);
+	while (count > 0)
+	{
+		for (i = 0; i < count; i++)
+		{
+			indices[0] = m_remap[m_triangles[(i * 3)]];
+			indices[1] = m_remap[m_triangles[(i * 3) + 2]];
+			indices[2] = m_remap[m_triangles[(i * 3) + 1]];
+
+			if (format == MESH_EXPORT_PLY)
+			{
+				// A face is the vertex count followed by the indices.
+				face[0] = 3;
+				memcpy(&face[1], indices, sizeof(indices));
+				if (!Write(face, sizeof(face)))
+				{
+					return false;
+				}
+			}
+			else if (m_shortIndices)
+			{
+				shortIndices[0] = (unsigned short)indices[0];
+				shortIndices[1] = (unsigned short)indices[1];
+				shortIndices[2] = (unsigned short)indices[2];
+				if (!Write(shortIndices, sizeof(shortIndices)))
+				{
+					return false;
+				}
+			}
+			else
+			{
+				if (!Write(indices, sizeof(indices)))
+				{
+					return false;
+				}
+			}
+		}
+
+		count = ReadTriangles(draw, offset, m_triangles);
+	}
+
+	// The binary chunk of a GLB ends on a 4 byte boundary.
+	if ((format == MESH_EXPORT_GLB) && m_shortIndices && ((m_triangleCount % 2) != 0))
+	{
+		padding = 0;
+		if (!Write(&padding, 2))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+int MeshExportClass::EncodeVertex(int index, int format, bool quantized, unsigned char* vertex)
+{
+	float position[3], normalValues[3], texture[2];
+	unsigned short quantizedPosition[4], quantizedTexture[2];
+	signed char quantizedNormal[4];
+	XMFLOAT3 normal;
+	int i, j, k;
+
+
+	i = index % m_width;
+	j = index / m_width;
+
+	// The engine is left handed with z running against the rows, the files get z flipped.
+	normal = GetNormal(i, j);
+
+	position[0] = (float)i;
+	position[1] = m_heights[index];
+	position[2] = (float)(j - (m_height - 1));
+
+	normalValues[0] = normal.x;
+	normalValues[1] = normal.y;
+	normalValues[2] = -normal.z;
+
+	texture[0] = (float)i / (float)(m_width - 1);
+	texture[1] = (float)j / (float)(m_height - 1);
+
+	if (!quantized)
+	{
+		memcpy(&vertex[0], position, sizeof(position));
+		memcpy(&vertex[12], normalValues, sizeof(normalValues));
+		memcpy(&vertex[24], texture, sizeof(texture));
+		return 32;
+	}
+
+	// The GLB steps evenly from the corner of the bounds, the PLY keeps the grid and steps only the heights.
+	if (format == MESH_EXPORT_GLB)
+	{
+		quantizedPosition[0] = Quantize((float)i, (float)m_minX, m_positionStep);
+		quantizedPosition[1] = Quantize(position[1], m_minHeight, m_positionStep);
+		quantizedPosition[2] = Quantize((float)j, (float)m_minRow, m_positionStep);
+	}
+	else
+	{
+		quantizedPosition[0] = (unsigned short)i;
+		quantizedPosition[1] = Quantize(position[1], m_minHeight, m_heightStep);
+		quantizedPosition[2] = (unsigned short)j;
+	}
+	quantizedPosition[3] = 0;
+
+	for (k = 0; k < 3; k++)
+	{
+		quantizedNormal[k] = (signed char)floorf((normalValues[k] * 127.0f) + 0.5f);
+	}
+	quantizedNormal[3] = 0;
+
+	quantizedTexture[0] = (unsigned short)floorf((texture[0] * 65535.0f) + 0.5f);
+	quantizedTexture[1] = (unsigned short)floorf((texture[1] * 65535.0f) + 0.5f);
+
+	// The GLB keeps every attribute on a 4 byte boundary, the PLY packs them.
+	if (format == MESH_EXPORT_GLB)
+	{
+		memcpy(&vertex[0], quantizedPosition, 8);
+		memcpy(&vertex[8], quantizedNormal, 4);
+		memcpy(&vertex[12], quantizedTexture, 4);
+		return 16;
+	}
+
+	memcpy(&vertex[0], quantizedPosition, 6);
+	memcpy(&vertex[6], quantizedNormal, 3);
+	memcpy(&vertex[9], quantizedTexture, 4);
+	return 13;
+}
+
+
+XMFLOAT3 MeshExportClass::GetNormal(int i, int j)
+{
+	float dx, dz, length;
+	int left, right, up, down;
+
+
+	if (m_normals)
+	{
+		return VertexPackClass::DecodeNormal(m_normals[(j * m_width) + i]);
+	}
+
+	// Central differences, one sided at the edges, the rows run against z.
+	left = (i > 0) ? i - 1 : i;
+	right = (i < (m_width - 1)) ? i + 1 : i;
+	up = (j > 0) ? j - 1 : j;
+	down = (j < (m_height - 1)) ? j + 1 : j;
+
+	dx = (m_heights[(j * m_width) + right] - m_heights[(j * m_width) + left]) / (float)(right - left);
+	dz = (m_heights[(up * m_width) + i] - m_heights[(down * m_width) + i]) / (float)(down - up);
+
+	length = sqrtf((dx * dx) + 1.0f + (dz * dz));
+
+	return XMFLOAT3(-dx / length, 1.0f / length, -dz / length);
+}
+
+
+unsigned short MeshExportClass::Quantize(float position, float minimum, float step)
+{
+	float value;
+
+
+	value = ((position - minimum) / step) + 0.5f;
+	value = (value < 0.0f) ? 0.0f : ((value > 65535.0f) ? 65535.0f : value);
+
+	return (unsigned short)value;
+}
+
+
+bool MeshExportClass::Write(const void* data, int size)
+{
+	const unsigned char* bytes;
+	int count;
+
+
+	bytes = (const unsigned char*)data;
+
+	// Fill the buffer and write it out whenever it is full.
+	while (size > 0)
+	{
+		count = MESH_EXPORT_BUFFER_SIZE - m_bufferUsed;
+		count = (size < count) ? size : count;
+
+		memcpy(&m_buffer[m_bufferUsed], bytes, count);
+		m_bufferUsed += count;
+		bytes += count;
+		size -= count;
+
+		if (m_bufferUsed == MESH_EXPORT_BUFFER_SIZE)
+		{
+			if (!Flush())
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+bool MeshExportClass::Flush()
+{
+	size_t count;
+
+
+	if (m_bufferUsed == 0)
+	{
+		return true;
+	}
+
+	count = fwrite(m_buffer, 1, m_bufferUsed, m_filePtr);
+	if (count != (size_t)m_bufferUsed)
+	{
+		return false;
+	}
+
+	m_bytesWritten += m_bufferUsed;
+	m_bufferUsed = 0;
+
+	return true;
+}
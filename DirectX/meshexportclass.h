@@ -0,0 +1,113 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: meshexportclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _MESHEXPORTCLASS_H_
+#define _MESHEXPORTCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <directxmath.h>
+
+#include "geomipmapclass.h"
+#include "vertexpackclass.h"
+
+using namespace DirectX;
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int MESH_EXPORT_GLB = 0;
+const int MESH_EXPORT_PLY = 1;
+const int MESH_EXPORT_BUFFER_SIZE = 65536;
+const int MESH_EXPORT_TRIANGLE_CHUNK = 4096;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: MeshExportClass
+////////////////////////////////////////////////////////////////////////////////
+// Writes terrain triangles to a binary glTF (GLB) or PLY file for tools that
+// work outside the engine. The triangles come either as geomipmap patch draws
+// into the 16 bit index pool, mapped from the patch strips of the vertex buffer
+// back to the grid, or as 32 bit grid indices like the ROAM frames, so
+// the full resolution model and whatever the LOD picked export the same way.
+//
+// Only the vertices the triangles use are written, in grid order. A first pass
+// over the indices marks them and counts the triangles so the headers can go
+// out first, then the vertices and the indices are streamed through a fixed
+// buffer. Apart from one remap entry per grid vertex nothing grows with the
+// mesh. Degenerate triangles, the holes of the ROAM index list, are dropped.
+//
+// The files are right handed with y up like glTF, so z is the grid row less the
+// last row and the triangles are counter clockwise in front. The texture coordinates span the terrain once, the same as the baked
+// maps. Quantized files hold the positions and texture coordinates in 16 bits
+// and the normals in 8. The GLB uses KHR_mesh_quantization with one step on
+// all three axes in the node transform, a scale that is not uniform would bend
+// the normals in a viewer. The PLY keeps whole grid columns and rows and has
+// the height scale in a comment.
+class MeshExportClass
+{
+public:
+	MeshExportClass();
+	MeshExportClass(const MeshExportClass&);
+	~MeshExportClass();
+
+	bool Initialize(const float*, const unsigned short*, int, int);
+	void Shutdown();
+
+	bool Export(const char*, int, bool, GeomipmapClass*, const GeomipmapClass::PatchDrawType*, int);
+	bool Export(const char*, int, bool, const unsigned long*, int);
+
+	int GetVertexCount();
+	int GetTriangleCount();
+	unsigned long long GetBytesWritten();
+
+private:
+	bool ExportMesh(const char*, int, bool);
+	int ReadTriangles(int&, int&, unsigned long*);
+	bool MarkVertices();
+
+	bool WriteGlbHeader(bool);
+	bool WritePlyHeader(bool);
+	bool WriteVertices(int, bool);
+	bool WriteIndices(int);
+
+	int EncodeVertex(int, int, bool, unsigned char*);
+	XMFLOAT3 GetNormal(int, int);
+	unsigned short Quantize(float, float, float);
+
+	bool Write(const void*, int);
+	bool Flush();
+
+private:
+	const float* m_heights;
+	const unsigned short* m_normals;
+	int m_width, m_height;
+	int* m_remap;
+	unsigned char* m_buffer;
+	unsigned long* m_triangles;
+	int m_bufferUsed;
+	FILE* m_filePtr;
+	unsigned long long m_bytesWritten;
+
+	GeomipmapClass* m_Geomipmap;
+	const unsigned short* m_indexPool;
+	const GeomipmapClass::PatchDrawType* m_draws;
+	int m_drawCount;
+	const unsigned long* m_indices;
+	int m_indexCount;
+
+	int m_vertexCount, m_triangleCount;
+	int m_minX, m_maxX, m_minRow, m_maxRow;
+	float m_minHeight, m_maxHeight, m_heightStep, m_positionStep;
+	bool m_shortIndices;
+};
+
+#endif
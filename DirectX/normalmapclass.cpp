@@ -0,0 +1,593 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: normalmapclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "normalmapclass.h"
+
+
+NormalMapClass::NormalMapClass()
+{
+	m_size = 0;
+	m_levelCount = 0;
+	m_texelCount = 0;
+	m_tileSize = 0;
+	m_extent = 0.0f;
+	m_texels = 0;
+	m_ownsTexels = false;
+}
+
+
+NormalMapClass::NormalMapClass(const NormalMapClass& other)
+{
+}
+
+
+NormalMapClass::~NormalMapClass()
+{
+}
+
+
+bool NormalMapClass::Initialize(const float* heights, int width, int height, float extent)
+{
+	bool result;
+
+
+	// One texel per cell of a square heightfield.
+	if (width != height)
+	{
+		return false;
+	}
+
+	result = InitializeBands(width - 1, extent);
+	if (!result)
+	{
+		return false;
+	}
+
+	// All the heights are there, every tile is baked at once.
+	BakeTiles(heights, width, 0, GetBandCount());
+
+	FinishBands();
+
+	return true;
+}
+
+
+bool NormalMapClass::Initialize(int size, float extent, unsigned short* texels)
+{
+	bool result;
+
+
+	// The levels come from a terrain file, they are used where they are.
+	result = SetLevels(size);
+	if (!result || !texels || (extent <= 0.0f))
+	{
+		return false;
+	}
+
+	m_extent = extent;
+	m_texels = texels;
+	m_ownsTexels = false;
+
+	return true;
+}
+
+
+bool NormalMapClass::InitializeBands(int size, float extent)
+{
+	bool result;
+
+
+	// A power of two cells wide, worked on four texels at a time.
+	if ((size < 4) || (extent <= 0.0f))
+	{
+		return false;
+	}
+
+	result = SetLevels(size);
+	if (!result)
+	{
+		return false;
+	}
+
+	m_extent = extent;
+
+	// Create the texels of every level.
+	m_texels = new unsigned short[m_texelCount];
+	if (!m_texels)
+	{
+		return false;
+	}
+
+	m_ownsTexels = true;
+
+	// A band is one row of tiles.
+	m_tileSize = (m_size < NORMAL_MAP_TILE_SIZE) ? m_size : NORMAL_MAP_TILE_SIZE;
+
+	return true;
+}
+
+
+void NormalMapClass::BakeBand(const float* heights, int band)
+{
+	// The heights start at the top row of the band and are a row wider than the map.
+	BakeTiles(heights, m_size + 1, band, 1);
+
+	return;
+}
+
+
+void NormalMapClass::FinishBands()
+{
+	int tileCount, level;
+
+
+	// The levels above the tiles are only a few texels, they are averaged from the level below.
+	tileCount = m_size / m_tileSize;
+
+	for (level = 1; (m_size >> level) >= 1; level++)
+	{
+		if ((m_size >> level) < tileCount)
+		{
+			BuildLevel(level, 0, 0, (m_size >> level) - 1, (m_size >> level) - 1);
+		}
+	}
+
+	return;
+}
+
+
+void NormalMapClass::Shutdown()
+{
+	// Release the texels if they were baked here.
+	if (m_texels && m_ownsTexels)
+	{
+		delete[] m_texels;
+	}
+	m_texels = 0;
+	m_ownsTexels = false;
+
+	return;
+}
+
+
+void NormalMapClass::UpdateRegion(const float* heights, int width, int height, int& left, int& top, int& right, int& bottom)
+{
+	int texelsPerCell, firstX, firstY, lastX, lastY, cellX, cellY, i, j, level;
+	const float* row;
+	float scale, fx, fz, dx, dz, length;
+
+
+	/*
+		The heights that were edited are those of the vertices, the cells around them are baked
+		again from the bilinear surface through them. The fine detail is gone there but the map
+		matches the deformed terrain, the caller gets back the texel rectangle of the top level.
+	*/
+	texelsPerCell = m_size / (width - 1);
+	if ((width != height) || (texelsPerCell < 1) || ((texelsPerCell * (width - 1)) != m_size))
+	{
+		left = top = 0;
+		right = bottom = -1;
+		return;
+	}
+
+	firstX = (left > 0) ? left - 1 : 0;
+	firstY = (top > 0) ? top - 1 : 0;
+	lastX = (right < (width - 1)) ? right : width - 2;
+	lastY = (bottom < (height - 1)) ? bottom : height - 2;
+
+	if ((firstX > lastX) || (firstY > lastY))
+	{
+		left = top = 0;
+		right = bottom = -1;
+		return;
+	}
+
+	scale = (float)(width - 1) / m_extent;
+
+	for (cellY = firstY; cellY <= lastY; cellY++)
+	{
+		row = &heights[cellY * width];
+
+		for (cellX = firstX; cellX <= lastX; cellX++)
+		{
+			for (j = 0; j < texelsPerCell; j++)
+			{
+				fz = ((float)j + 0.5f) / (float)texelsPerCell;
+
+				for (i = 0; i < texelsPerCell; i++)
+				{
+					fx = ((float)i + 0.5f) / (float)texelsPerCell;
+
+					// Slopes of the bilinear surface at the texel center, the rows run against z.
+					dx = (((row[cellX + 1] - row[cellX]) * (1.0f - fz)) + ((row[width + cellX + 1] - row[width + cellX]) * fz)) * scale;
+					dz = (((row[cellX] - row[width + cellX]) * (1.0f - fx)) + ((row[cellX + 1] - row[width + cellX + 1]) * fx)) * scale;
+					length = sqrtf((dx * dx) + 1.0f + (dz * dz));
+
+					m_texels[(((cellY * texelsPerCell) + j) * m_size) + (cellX * texelsPerCell) + i] = EncodeNormal(-dx / length, 1.0f / length, -dz / length);
+				}
+			}
+		}
+	}
+
+	left = firstX * texelsPerCell;
+	top = firstY * texelsPerCell;
+	right = ((lastX + 1) * texelsPerCell) - 1;
+	bottom = ((lastY + 1) * texelsPerCell) - 1;
+
+	// Average the changed texels up through the mips.
+	for (level = 1; level < m_levelCount; level++)
+	{
+		BuildLevel(level, left >> level, top >> level, right >> level, bottom >> level);
+	}
+
+	return;
+}
+
+
+int NormalMapClass::GetSize()
+{
+	return m_size;
+}
+
+
+int NormalMapClass::GetBandHeight()
+{
+	return m_tileSize;
+}
+
+
+int NormalMapClass::GetBandCount()
+{
+	return (m_tileSize > 0) ? (m_size / m_tileSize) : 0;
+}
+
+
+int NormalMapClass::GetLevelCount()
+{
+	return m_levelCount;
+}
+
+
+int NormalMapClass::GetLevelSize(int level)
+{
+	return m_size >> level;
+}
+
+
+const unsigned short* NormalMapClass::GetLevel(int level)
+{
+	return &m_texels[m_levelOffset[level]];
+}
+
+
+const unsigned short* NormalMapClass::GetTexels()
+{
+	return m_texels;
+}
+
+
+int NormalMapClass::GetTexelCount()
+{
+	return m_texelCount;
+}
+
+
+bool NormalMapClass::SetLevels(int size)
+{
+	int level;
+
+
+	if ((size < 1) || ((size & (size - 1)) != 0))
+	{
+		return false;
+	}
+
+	m_size = size;
+	m_levelCount = 0;
+	m_texelCount = 0;
+
+	// The levels follow each other from the full size down to one texel.
+	for (level = 0; (size >> level) >= 1; level++)
+	{
+		if (level >= NORMAL_MAP_MAX_LEVELS)
+		{
+			return false;
+		}
+
+		m_levelOffset[level] = m_texelCount;
+		m_texelCount += (size >> level) * (size >> level);
+		m_levelCount++;
+	}
+
+	return true;
+}
+
+
+void NormalMapClass::BakeTiles(const float* heights, int width, int firstTileY, int tileRows)
+{
+	ParallelForClass parallel;
+	int tileCount;
+
+
+	// The tiles go down their own levels, every tile on one core with its own float rows.
+	tileCount = m_size / m_tileSize;
+
+	parallel.Run(tileCount * tileRows, 1, [&](int first, int last)
+	{
+		float *x, *y, *z;
+		int tile;
+
+
+		x = new float[m_tileSize * m_tileSize];
+		y = new float[m_tileSize * m_tileSize];
+		z = new float[m_tileSize * m_tileSize];
+
+		if (x && y && z)
+		{
+			for (tile = first; tile < last; tile++)
+			{
+				BakeTile(heights, width, firstTileY * m_tileSize, tile % tileCount, firstTileY + (tile / tileCount), x, y, z);
+			}
+		}
+
+		delete[] x;
+		delete[] y;
+		delete[] z;
+	});
+
+	return;
+}
+
+
+void NormalMapClass::BakeTile(const float* heights, int width, int firstRow, int tileX, int tileY, float* x, float* y, float* z)
+{
+	const float* row;
+	__m128 normalX, normalY, normalZ;
+	int i, j, level;
+
+
+	// The normals of the top level, a texel row reads the height row above and below it. The heights start at the first row.
+	for (j = 0; j < m_tileSize; j++)
+	{
+		row = &heights[((((tileY * m_tileSize) + j) - firstRow) * width) + (tileX * m_tileSize)];
+
+		for (i = 0; i < m_tileSize; i += 4)
+		{
+			CalculateNormals(&row[i], &row[width + i], normalX, normalY, normalZ);
+
+			_mm_storeu_ps(&x[(j * m_tileSize) + i], normalX);
+			_mm_storeu_ps(&y[(j * m_tileSize) + i], normalY);
+			_mm_storeu_ps(&z[(j * m_tileSize) + i], normalZ);
+		}
+	}
+
+	EncodeTile(0, tileX, tileY, x, z);
+
+	// Each level is averaged down in place over the one before it and written out.
+	for (level = 1; (m_tileSize >> level) >= 1; level++)
+	{
+		DownsampleTile(m_tileSize >> (level - 1), x, y, z);
+		EncodeTile(level, tileX, tileY, x, z);
+	}
+
+	return;
+}
+
+
+void NormalMapClass::CalculateNormals(const float* row0, const float* row1, __m128& normalX, __m128& normalY, __m128& normalZ)
+{
+	__m128 h00, h10, h01, h11, scale, dx, dz, length;
+
+
+	// The four corner heights of four cells next to each other.
+	h00 = _mm_loadu_ps(row0);
+	h10 = _mm_loadu_ps(row0 + 1);
+	h01 = _mm_loadu_ps(row1);
+	h11 = _mm_loadu_ps(row1 + 1);
+
+	// Average slope of each cell along x and along z, the second row is the one further south.
+	scale = _mm_set1_ps(0.5f * (float)m_size / m_extent);
+	dx = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(h10, h00), _mm_sub_ps(h11, h01)), scale);
+	dz = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(h00, h01), _mm_sub_ps(h10, h11)), scale);
+
+	// The normal is (-dx, 1, -dz) normalized.
+	length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), _mm_set1_ps(1.0f)));
+	length = _mm_div_ps(_mm_set1_ps(1.0f), length);
+
+	normalX = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(dx, length));
+	normalY = length;
+	normalZ = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(dz, length));
+
+	return;
+}
+
+
+void NormalMapClass::DownsampleTile(int size, float* x, float* y, float* z)
+{
+	float* planes[3];
+	__m128 sums[3], even, odd, length;
+	int half, i, j, k, index;
+	float sumX, sumY, sumZ, scalarLength;
+
+
+	planes[0] = x;
+	planes[1] = y;
+	planes[2] = z;
+
+	/*
+		Every texel of the next level sums the four below it and is normalized again. The next
+		level is written over the start of the rows it is read from, a texel is only written
+		after everything at or before it has been read.
+	*/
+	half = size / 2;
+	for (j = 0; j < half; j++)
+	{
+		i = 0;
+
+		if (half >= 4)
+		{
+			for (; i < half; i += 4)
+			{
+				for (k = 0; k < 3; k++)
+				{
+					even = _mm_shuffle_ps(_mm_loadu_ps(&planes[k][(2 * j * size) + (2 * i)]), _mm_loadu_ps(&planes[k][(2 * j * size) + (2 * i) + 4]), _MM_SHUFFLE(2, 0, 2, 0));
+					odd = _mm_shuffle_ps(_mm_loadu_ps(&planes[k][(2 * j * size) + (2 * i)]), _mm_loadu_ps(&planes[k][(2 * j * size) + (2 * i) + 4]), _MM_SHUFFLE(3, 1, 3, 1));
+					sums[k] = _mm_add_ps(even, odd);
+
+					even = _mm_shuffle_ps(_mm_loadu_ps(&planes[k][(((2 * j) + 1) * size) + (2 * i)]), _mm_loadu_ps(&planes[k][(((2 * j) + 1) * size) + (2 * i) + 4]), _MM_SHUFFLE(2, 0, 2, 0));
+					odd = _mm_shuffle_ps(_mm_loadu_ps(&planes[k][(((2 * j) + 1) * size) + (2 * i)]), _mm_loadu_ps(&planes[k][(((2 * j) + 1) * size) + (2 * i) + 4]), _MM_SHUFFLE(3, 1, 3, 1));
+					sums[k] = _mm_add_ps(sums[k], _mm_add_ps(even, odd));
+				}
+
+				length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sums[0], sums[0]), _mm_mul_ps(sums[1], sums[1])), _mm_mul_ps(sums[2], sums[2]));
+				length = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length));
+
+				for (k = 0; k < 3; k++)
+				{
+					_mm_storeu_ps(&planes[k][(j * half) + i], _mm_mul_ps(sums[k], length));
+				}
+			}
+		}
+
+		// The last levels of a tile are narrower than four texels.
+		for (; i < half; i++)
+		{
+			index = (2 * j * size) + (2 * i);
+			sumX = x[index] + x[index + 1] + x[index + size] + x[index + size + 1];
+			sumY = y[index] + y[index + 1] + y[index + size] + y[index + size + 1];
+			sumZ = z[index] + z[index + 1] + z[index + size] + z[index + size + 1];
+
+			scalarLength = 1.0f / sqrtf((sumX * sumX) + (sumY * sumY) + (sumZ * sumZ));
+
+			x[(j * half) + i] = sumX * scalarLength;
+			y[(j * half) + i] = sumY * scalarLength;
+			z[(j * half) + i] = sumZ * scalarLength;
+		}
+	}
+
+	return;
+}
+
+
+void NormalMapClass::EncodeTile(int level, int tileX, int tileY, const float* x, const float* z)
+{
+	unsigned short* texels;
+	__m128 scale, bias;
+	__m128i packed;
+	int size, levelSize, i, j;
+
+
+	size = m_tileSize >> level;
+	levelSize = m_size >> level;
+	texels = &m_texels[m_levelOffset[level] + (tileY * size * levelSize) + (tileX * size)];
+
+	scale = _mm_set1_ps(127.5f);
+	bias = _mm_set1_ps(127.5f);
+
+	for (j = 0; j < size; j++)
+	{
+		i = 0;
+
+		if (size >= 4)
+		{
+			/*
+				Round x and z to bytes and put z in the high byte. The 16 bit pack saturates as
+				signed so the values are moved down by 0x8000 before it and back up after it.
+			*/
+			for (; i < size; i += 4)
+			{
+				packed = _mm_or_si128(_mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&x[(j * size) + i]), scale), bias)),
+					_mm_slli_epi32(_mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&z[(j * size) + i]), scale), bias)), 8));
+				packed = _mm_sub_epi32(packed, _mm_set1_epi32(0x8000));
+				packed = _mm_add_epi16(_mm_packs_epi32(packed, packed), _mm_set1_epi16((short)0x8000));
+
+				_mm_storel_epi64((__m128i*)&texels[(j * levelSize) + i], packed);
+			}
+		}
+
+		for (; i < size; i++)
+		{
+			texels[(j * levelSize) + i] = EncodeNormal(x[(j * size) + i], 0.0f, z[(j * size) + i]);
+		}
+	}
+
+	return;
+}
+
+
+void NormalMapClass::BuildLevel(int level, int left, int top, int right, int bottom)
+{
+	const unsigned short* source;
+	unsigned short* texels;
+	int sourceSize, levelSize, i, j, index;
+	float x, y, z, sumX, sumY, sumZ, length;
+
+
+	source = &m_texels[m_levelOffset[level - 1]];
+	texels = &m_texels[m_levelOffset[level]];
+	sourceSize = m_size >> (level - 1);
+	levelSize = m_size >> level;
+
+	// Every texel sums the four decoded normals below it and is normalized again.
+	for (j = top; j <= bottom; j++)
+	{
+		for (i = left; i <= right; i++)
+		{
+			index = (2 * j * sourceSize) + (2 * i);
+
+			DecodeNormal(source[index], sumX, sumY, sumZ);
+
+			DecodeNormal(source[index + 1], x, y, z);
+			sumX += x;
+			sumY += y;
+			sumZ += z;
+
+			DecodeNormal(source[index + sourceSize], x, y, z);
+			sumX += x;
+			sumY += y;
+			sumZ += z;
+
+			DecodeNormal(source[index + sourceSize + 1], x, y, z);
+			sumX += x;
+			sumY += y;
+			sumZ += z;
+
+			length = sqrtf((sumX * sumX) + (sumY * sumY) + (sumZ * sumZ));
+
+			texels[(j * levelSize) + i] = EncodeNormal(sumX / length, sumY / length, sumZ / length);
+		}
+	}
+
+	return;
+}
+
+
+unsigned short NormalMapClass::EncodeNormal(float x, float y, float z)
+{
+	int red, green;
+
+
+	// The y is not stored, the normals of a height map always point up.
+	red = (int)floorf((x * 127.5f) + 128.0f);
+	green = (int)floorf((z * 127.5f) + 128.0f);
+
+	red = (red < 0) ? 0 : ((red > 255) ? 255 : red);
+	green = (green < 0) ? 0 : ((green > 255) ? 255 : green);
+
+	return (unsigned short)(red | (green << 8));
+}
+
+
+void NormalMapClass::DecodeNormal(unsigned short texel, float& x, float& y, float& z)
+{
+	float lengthSquared;
+
+
+	x = ((float)(texel & 0xff) / 127.5f) - 1.0f;
+	z = ((float)(texel >> 8) / 127.5f) - 1.0f;
+
+	lengthSquared = 1.0f - (x * x) - (z * z);
+	y = (lengthSquared > 0.0f) ? sqrtf(lengthSquared) : 0.0f;
+
+	return;
+}
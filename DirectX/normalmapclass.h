@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: normalmapclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _NORMALMAPCLASS_H_
+#define _NORMALMAPCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <math.h>
+#include <emmintrin.h>
+
+#include "parallelforclass.h"
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int NORMAL_MAP_TILE_SIZE = 256;
+const int NORMAL_MAP_MAX_LEVELS = 16;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: NormalMapClass
+////////////////////////////////////////////////////////////////////////////////
+// World space normal map of the terrain baked from a heightfield that can be
+// denser than the vertices, so coarse patches keep the shading of the fine
+// heights. Every texel covers one cell of the heightfield and holds the x and
+// z of the normal as two bytes, red and green, the y is rebuilt from them. The
+// layout is the one BC5 compresses, a full mip chain follows the top level.
+// The extent is the width of the map in world units, the slopes are scaled by
+// it so the normals do not depend on how dense the heights were.
+//
+// The map is baked in square tiles on all the cores. A tile works out its
+// normals four texels at a time with SSE2 into float rows and averages them
+// down through the levels it covers before they are rounded to bytes, the few
+// levels above the tiles are averaged from the bytes. Texels handed in from a
+// terrain file are not copied and have to outlive the map.
+//
+// Heights too big to hold at once are baked a band of tiles at a time. The
+// caller hands in the band height plus one rows of every band in turn and
+// finishes the map once the last band is baked.
+class NormalMapClass
+{
+public:
+	NormalMapClass();
+	NormalMapClass(const NormalMapClass&);
+	~NormalMapClass();
+
+	bool Initialize(const float*, int, int, float);
+	bool Initialize(int, float, unsigned short*);
+	bool InitializeBands(int, float);
+	void BakeBand(const float*, int);
+	void FinishBands();
+	void Shutdown();
+
+	void UpdateRegion(const float*, int, int, int&, int&, int&, int&);
+
+	int GetSize();
+	int GetBandHeight();
+	int GetBandCount();
+	int GetLevelCount();
+	int GetLevelSize(int);
+	const unsigned short* GetLevel(int);
+	const unsigned short* GetTexels();
+	int GetTexelCount();
+
+private:
+	bool SetLevels(int);
+	void BakeTiles(const float*, int, int, int);
+	void BakeTile(const float*, int, int, int, int, float*, float*, float*);
+	void CalculateNormals(const float*, const float*, __m128&, __m128&, __m128&);
+	void DownsampleTile(int, float*, float*, float*);
+	void EncodeTile(int, int, int, const float*, const float*);
+	void BuildLevel(int, int, int, int, int);
+
+	unsigned short EncodeNormal(float, float, float);
+	void DecodeNormal(unsigned short, float&, float&, float&);
+
+private:
+	int m_size, m_levelCount, m_texelCount, m_tileSize;
+	float m_extent;
+	int m_levelOffset[NORMAL_MAP_MAX_LEVELS];
+	unsigned short* m_texels;
+	bool m_ownsTexels;
+};
+
+#endif
@@ -0,0 +1,207 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: parallelforclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "parallelforclass.h"
+
+
+// The worker threads are shared by every ParallelForClass and live until the program exits.
+struct ParallelPoolType
+{
+	thread workers[PARALLEL_MAX_THREADS];
+	int workerCount;
+
+	mutex runMutex;
+	mutex poolMutex;
+	condition_variable startCondition, doneCondition;
+	int generation, busyCount;
+	bool stop;
+
+	void (*body)(const void*, int, int);
+	const void* context;
+	int count, grain;
+	atomic<int> next;
+
+	~ParallelPoolType()
+	{
+		int i;
+
+
+		// Wake the workers up to stop and wait for them.
+		{
+			lock_guard<mutex> lock(poolMutex);
+			stop = true;
+		}
+
+		startCondition.notify_all();
+
+		for (i = 0; i < workerCount; i++)
+		{
+			workers[i].join();
+		}
+	}
+};
+
+static ParallelPoolType g_pool;
+
+
+ParallelForClass::ParallelForClass()
+{
+	// Use every hardware thread, the count can be 0 when it is not known.
+	m_threadCount = (int)thread::hardware_concurrency();
+	if (m_threadCount < 1)
+	{
+		m_threadCount = 1;
+	}
+
+	if (m_threadCount > PARALLEL_MAX_THREADS)
+	{
+		m_threadCount = PARALLEL_MAX_THREADS;
+	}
+}
+
+
+ParallelForClass::ParallelForClass(const ParallelForClass& other)
+{
+}
+
+
+ParallelForClass::~ParallelForClass()
+{
+}
+
+
+void ParallelForClass::RunRange(int count, int grain, BodyType body, const void* context)
+{
+	int chunkCount;
+
+
+	if (grain < 1)
+	{
+		grain = 1;
+	}
+
+	// Not worth waking the workers for a single chunk.
+	chunkCount = (count + grain - 1) / grain;
+	if ((chunkCount <= 1) || (m_threadCount <= 1))
+	{
+		body(context, 0, count);
+		return;
+	}
+
+	// A Run from inside a body or from another thread while the workers are busy does its range here.
+	unique_lock<mutex> runLock(g_pool.runMutex, try_to_lock);
+	if (!runLock.owns_lock())
+	{
+		body(context, 0, count);
+		return;
+	}
+
+	// Hand the range to the workers, they are started the first time there is one.
+	{
+		lock_guard<mutex> lock(g_pool.poolMutex);
+
+		if (g_pool.workerCount == 0)
+		{
+			g_pool.generation = 0;
+			g_pool.busyCount = 0;
+			g_pool.stop = false;
+
+			for (g_pool.workerCount = 0; g_pool.workerCount < (m_threadCount - 1); g_pool.workerCount++)
+			{
+				g_pool.workers[g_pool.workerCount] = thread(&ParallelForClass::WorkerThread);
+			}
+		}
+
+		g_pool.body = body;
+		g_pool.context = context;
+		g_pool.count = count;
+		g_pool.grain = grain;
+		g_pool.next = 0;
+		g_pool.busyCount = g_pool.workerCount;
+		g_pool.generation++;
+	}
+
+	g_pool.startCondition.notify_all();
+
+	// The calling thread takes chunks as well, then waits for the workers to finish theirs.
+	RunChunks();
+
+	{
+		unique_lock<mutex> lock(g_pool.poolMutex);
+
+		while (g_pool.busyCount > 0)
+		{
+			g_pool.doneCondition.wait(lock);
+		}
+	}
+
+	return;
+}
+
+
+void ParallelForClass::RunChunks()
+{
+	int begin, end;
+
+
+	// Keep taking the next chunk until the range is used up.
+	while (true)
+	{
+		begin = g_pool.next.fetch_add(g_pool.grain);
+		if (begin >= g_pool.count)
+		{
+			return;
+		}
+
+		end = (begin + g_pool.grain < g_pool.count) ? begin + g_pool.grain : g_pool.count;
+		g_pool.body(g_pool.context, begin, end);
+	}
+}
+
+
+void ParallelForClass::WorkerThread()
+{
+	int generation;
+
+
+	generation = 0;
+
+	while (true)
+	{
+		// Wait for a new range.
+		{
+			unique_lock<mutex> lock(g_pool.poolMutex);
+
+			while ((g_pool.generation == generation) && !g_pool.stop)
+			{
+				g_pool.startCondition.wait(lock);
+			}
+
+			if (g_pool.stop)
+			{
+				return;
+			}
+
+			generation = g_pool.generation;
+		}
+
+		RunChunks();
+
+		// The last worker to finish wakes the thread that called Run.
+		{
+			lock_guard<mutex> lock(g_pool.poolMutex);
+
+			g_pool.busyCount--;
+			if (g_pool.busyCount == 0)
+			{
+				g_pool.doneCondition.notify_one();
+			}
+		}
+	}
+}
+
+
+int ParallelForClass::GetThreadCount()
+{
+	return m_threadCount;
+}
@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: parallelforclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _PARALLELFORCLASS_H_
+#define _PARALLELFORCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int PARALLEL_MAX_THREADS = 16;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: ParallelForClass
+////////////////////////////////////////////////////////////////////////////////
+// Splits a range into chunks and runs them on all the cores, the calling
+// thread takes part and Run returns once every chunk is done. The worker
+// threads are started by the first Run and then wait for the next one, so a
+// Run in the frame loop (a deformation or a relight) does not allocate. Only
+// one range at a time goes through the workers, a Run made while they are busy
+// does its range on the calling thread.
+class ParallelForClass
+{
+private:
+	typedef void (*BodyType)(const void*, int, int);
+
+public:
+	ParallelForClass();
+	ParallelForClass(const ParallelForClass&);
+	~ParallelForClass();
+
+	template <typename T>
+	void Run(int count, int grain, const T& body)
+	{
+		// The body is called through a plain function pointer, wrapping it in a std::function would allocate.
+		RunRange(count, grain, &CallBody<T>, &body);
+	}
+
+	int GetThreadCount();
+
+private:
+	template <typename T>
+	static void CallBody(const void* body, int first, int last)
+	{
+		(*(const T*)body)(first, last);
+	}
+
+	void RunRange(int, int, BodyType, const void*);
+	static void RunChunks();
+	static void WorkerThread();
+
+private:
+	int m_threadCount;
+};
+
+#endif
@@ -0,0 +1,1072 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: roamclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "roamclass.h"
+
+
+RoamClass::RoamClass()
+{
+	m_heights = 0;
+	m_errors = 0;
+	m_nodes = 0;
+	m_freeNodes = 0;
+	m_indices = 0;
+	m_freeSlots = 0;
+	m_queues[SPLIT_QUEUE].items = 0;
+	m_queues[MERGE_QUEUE].items = 0;
+}
+
+
+RoamClass::RoamClass(const RoamClass& other)
+{
+}
+
+
+RoamClass::~RoamClass()
+{
+}
+
+
+bool RoamClass::Initialize(float* heights, int terrainWidth, int triangleBudget)
+{
+	int i, size, topLeft, topRight, bottomLeft, bottomRight, root0, root1;
+
+
+	m_terrainWidth = terrainWidth;
+	m_triangleBudget = triangleBudget;
+	m_maxTriangleBudget = triangleBudget;
+
+	// Until a target is set the errors are projected with the fixed scale and threshold.
+	m_errorScale = ROAM_ERROR_SCALE;
+	m_minError = ROAM_MIN_ERROR;
+
+	// The bintree needs a power of two number of quads along each side.
+	size = m_terrainWidth - 1;
+	if ((size < 2) || ((size & (size - 1)) != 0))
+	{
+		return false;
+	}
+
+	// Every two levels of the bintree halve the leg length, the last level has legs of one quad.
+	m_maxLevel = 0;
+	for (i = 1; i < size; i *= 2)
+	{
+		m_maxLevel += 2;
+	}
+	m_treeSize = 1 << (m_maxLevel + 1);
+
+	// Keep a copy of the heights for the priority distances.
+	m_heights = new float[m_terrainWidth * m_terrainWidth];
+	if (!m_heights)
+	{
+		return false;
+	}
+
+	for (i = 0; i < (m_terrainWidth * m_terrainWidth); i++)
+	{
+		m_heights[i] = heights[i];
+	}
+
+	// Create the error trees, one for each of the two root triangles.
+	m_errors = new float[m_treeSize * 2];
+	if (!m_errors)
+	{
+		return false;
+	}
+
+	topLeft = 0;
+	topRight = size;
+	bottomLeft = m_terrainWidth * size;
+	bottomRight = (m_terrainWidth * size) + size;
+
+	ComputeErrors(0, 1, bottomLeft, topLeft, bottomRight, 0);
+	ComputeErrors(1, 1, topRight, bottomRight, topLeft, 0);
+
+	// Size the node pool from the budget with room for the forced splits of a full descent.
+	m_nodeCapacity = (m_triangleBudget * 4) + (8 * (m_maxLevel + 1));
+
+	m_nodes = new TriNodeType[m_nodeCapacity];
+	if (!m_nodes)
+	{
+		return false;
+	}
+
+	m_freeNodes = new int[m_nodeCapacity];
+	if (!m_freeNodes)
+	{
+		return false;
+	}
+
+	for (i = 0; i < m_nodeCapacity; i++)
+	{
+		m_freeNodes[i] = m_nodeCapacity - 1 - i;
+		m_nodes[i].position[SPLIT_QUEUE] = -1;
+		m_nodes[i].position[MERGE_QUEUE] = -1;
+	}
+	m_freeNodeCount = m_nodeCapacity;
+
+	// Every leaf owns one slot of three indices in the index array.
+	m_indices = new unsigned long[m_nodeCapacity * 3];
+	if (!m_indices)
+	{
+		return false;
+	}
+
+	for (i = 0; i < (m_nodeCapacity * 3); i++)
+	{
+		m_indices[i] = 0;
+	}
+
+	m_freeSlots = new int[m_nodeCapacity];
+	if (!m_freeSlots)
+	{
+		return false;
+	}
+	m_freeSlotCount = 0;
+	m_slotHighWater = 0;
+	m_dirtyFirst = -1;
+	m_dirtyLast = -1;
+
+	// Create the split and merge priority queues.
+	for (i = 0; i < 2; i++)
+	{
+		m_queues[i].items = new int[m_nodeCapacity];
+		if (!m_queues[i].items)
+		{
+			return false;
+		}
+		m_queues[i].count = 0;
+	}
+	m_queues[SPLIT_QUEUE].largestFirst = true;
+	m_queues[MERGE_QUEUE].largestFirst = false;
+
+	// Start from the camera above the center of the terrain.
+	m_cameraX = (float)size / 2.0f;
+	m_cameraY = 0.0f;
+	m_cameraZ = (float)size / 2.0f;
+
+	/*
+		The two root triangles share the diagonal as their base.
+
+		TL ---------- TR
+		|  \     1     |
+		|     \        |
+		|  0     \     |
+		BL ---------- BR
+	*/
+
+	root0 = AllocateNode();
+	root1 = AllocateNode();
+
+	m_nodes[root0].apex = bottomLeft;
+	m_nodes[root0].left = topLeft;
+	m_nodes[root0].right = bottomRight;
+	m_nodes[root0].root = 0;
+
+	m_nodes[root1].apex = topRight;
+	m_nodes[root1].left = bottomRight;
+	m_nodes[root1].right = topLeft;
+	m_nodes[root1].root = 1;
+
+	m_nodes[root0].baseNeighbor = root1;
+	m_nodes[root1].baseNeighbor = root0;
+
+	for (i = root0; i <= root1; i++)
+	{
+		m_nodes[i].errorId = 1;
+		m_nodes[i].level = 0;
+		m_nodes[i].slot = AllocateSlot();
+		WriteSlot(i);
+		UpdateSplitState(i);
+	}
+
+	m_triangleCount = 2;
+	m_operationCount = 0;
+	m_reprioritizeCursor = 0;
+
+	return true;
+}
+
+
+void RoamClass::Shutdown()
+{
+	int i;
+
+
+	// Release the priority queues.
+	for (i = 0; i < 2; i++)
+	{
+		if (m_queues[i].items)
+		{
+			delete[] m_queues[i].items;
+			m_queues[i].items = 0;
+		}
+	}
+
+	// Release the slot free list.
+	if (m_freeSlots)
+	{
+		delete[] m_freeSlots;
+		m_freeSlots = 0;
+	}
+
+	// Release the index array.
+	if (m_indices)
+	{
+		delete[] m_indices;
+		m_indices = 0;
+	}
+
+	// Release the node free list.
+	if (m_freeNodes)
+	{
+		delete[] m_freeNodes;
+		m_freeNodes = 0;
+	}
+
+	// Release the node pool.
+	if (m_nodes)
+	{
+		delete[] m_nodes;
+		m_nodes = 0;
+	}
+
+	// Release the error trees.
+	if (m_errors)
+	{
+		delete[] m_errors;
+		m_errors = 0;
+	}
+
+	// Release the heights.
+	if (m_heights)
+	{
+		delete[] m_heights;
+		m_heights = 0;
+	}
+
+	return;
+}
+
+
+void RoamClass::SetErrorTarget(float errorScale, float minError, int triangleBudget)
+{
+	m_errorScale = errorScale;
+	m_minError = minError;
+
+	// The node pool was sized for the budget given to Initialize, so that is as far as it can go.
+	m_triangleBudget = triangleBudget;
+	if ((m_triangleBudget <= 0) || (m_triangleBudget > m_maxTriangleBudget))
+	{
+		m_triangleBudget = m_maxTriangleBudget;
+	}
+
+	return;
+}
+
+
+void RoamClass::Update(float cameraX, float cameraY, float cameraZ)
+{
+	int i, node, split, merge, reserve;
+	float splitPriority, mergePriority;
+
+
+	m_cameraX = cameraX;
+	m_cameraY = cameraY;
+	m_cameraZ = cameraZ;
+
+	// Refresh the priorities of a bounded slice of the node pool, the rest keep last frame's values.
+	for (i = 0; (i < ROAM_REPRIORITIZE_COUNT) && (i < m_nodeCapacity); i++)
+	{
+		node = m_reprioritizeCursor;
+		m_reprioritizeCursor = (m_reprioritizeCursor + 1) % m_nodeCapacity;
+
+		if (QueueContains(SPLIT_QUEUE, node))
+		{
+			QueueUpdate(SPLIT_QUEUE, node, GetPriority(node));
+		}
+
+		if (QueueContains(MERGE_QUEUE, node))
+		{
+			QueueUpdate(MERGE_QUEUE, node, GetMergePriority(node));
+		}
+	}
+
+	// A split can force splits all the way up the tree so keep enough nodes in reserve for it.
+	reserve = 4 * (m_maxLevel + 1);
+
+	// Apply only as many splits and merges as needed to reach the budget, bounded per frame.
+	m_operationCount = 0;
+	while (m_operationCount < ROAM_MAX_OPERATIONS)
+	{
+		merge = (m_queues[MERGE_QUEUE].count > 0) ? m_queues[MERGE_QUEUE].items[0] : -1;
+		mergePriority = (merge != -1) ? m_nodes[merge].key[MERGE_QUEUE] : 0.0f;
+
+		// Over budget, or a diamond is below the error threshold, so coarsen.
+		if ((m_triangleCount > m_triangleBudget) || ((merge != -1) && (mergePriority < m_minError)))
+		{
+			if (merge == -1)
+			{
+				break;
+			}
+
+			Merge(merge);
+			m_operationCount++;
+			continue;
+		}
+
+		if (m_queues[SPLIT_QUEUE].count == 0)
+		{
+			break;
+		}
+
+		split = m_queues[SPLIT_QUEUE].items[0];
+		splitPriority = m_nodes[split].key[SPLIT_QUEUE];
+
+		// Stop once the worst remaining triangle is within the error threshold.
+		if (splitPriority <= m_minError)
+		{
+			break;
+		}
+
+		// At the budget only trade a merge for a split when the split matters more.
+		if (((m_triangleCount + 2) > m_triangleBudget) || (m_freeNodeCount < reserve))
+		{
+			if ((merge == -1) || (mergePriority >= splitPriority))
+			{
+				break;
+			}
+
+			Merge(merge);
+			m_operationCount++;
+			continue;
+		}
+
+		if (!Split(split))
+		{
+			break;
+		}
+		m_operationCount++;
+	}
+
+	return;
+}
+
+
+unsigned long* RoamClass::GetIndices()
+{
+	return m_indices;
+}
+
+
+int RoamClass::GetIndexCount()
+{
+	return m_slotHighWater * 3;
+}
+
+
+int RoamClass::GetMaxIndexCount()
+{
+	return m_nodeCapacity * 3;
+}
+
+
+bool RoamClass::GetDirtyRange(int& firstIndex, int& indexCount)
+{
+	if (m_dirtyFirst == -1)
+	{
+		return false;
+	}
+
+	firstIndex = m_dirtyFirst * 3;
+	indexCount = (m_dirtyLast - m_dirtyFirst + 1) * 3;
+
+	return true;
+}
+
+
+void RoamClass::ClearDirtyRange()
+{
+	m_dirtyFirst = -1;
+	m_dirtyLast = -1;
+
+	return;
+}
+
+
+int RoamClass::GetTriangleCount()
+{
+	return m_triangleCount;
+}
+
+
+int RoamClass::GetOperationCount()
+{
+	return m_operationCount;
+}
+
+
+float RoamClass::GetScreenError()
+{
+	// The worst triangle left unsplit is at the front of the split queue, with the priority it was last given.
+	if (m_queues[SPLIT_QUEUE].count == 0)
+	{
+		return 0.0f;
+	}
+
+	return m_nodes[m_queues[SPLIT_QUEUE].items[0]].key[SPLIT_QUEUE];
+}
+
+
+float RoamClass::ComputeErrors(int root, int id, int apex, int left, int right, int level)
+{
+	int center;
+	float error, childError;
+
+
+	if (level >= m_maxLevel)
+	{
+		m_errors[(root * m_treeSize) + id] = 0.0f;
+		return 0.0f;
+	}
+
+	// The hypotenuse midpoint is the vertex a split would add.
+	center = (((left / m_terrainWidth) + (right / m_terrainWidth)) / 2) * m_terrainWidth + (((left % m_terrainWidth) + (right % m_terrainWidth)) / 2);
+
+	// The error of this triangle is how far that vertex sits from the interpolated hypotenuse.
+	error = fabsf(m_heights[center] - ((m_heights[left] + m_heights[right]) / 2.0f));
+
+	// Keep the errors nested so a parent is never less important than its children.
+	childError = ComputeErrors(root, id * 2, center, apex, left, level + 1);
+	if (childError > error)
+	{
+		error = childError;
+	}
+
+	childError = ComputeErrors(root, (id * 2) + 1, center, right, apex, level + 1);
+	if (childError > error)
+	{
+		error = childError;
+	}
+
+	m_errors[(root * m_treeSize) + id] = error;
+
+	return error;
+}
+
+
+float RoamClass::GetPriority(int node)
+{
+	int left, right;
+	float x, y, z, dx, dy, dz, distance;
+
+
+	left = m_nodes[node].left;
+	right = m_nodes[node].right;
+
+	// Measure from the middle of the hypotenuse.
+	x = (float)((left % m_terrainWidth) + (right % m_terrainWidth)) / 2.0f;
+	z = (float)(m_terrainWidth - 1) - ((float)((left / m_terrainWidth) + (right / m_terrainWidth)) / 2.0f);
+	y = (m_heights[left] + m_heights[right]) / 2.0f;
+
+	dx = x - m_cameraX;
+	dy = y - m_cameraY;
+	dz = z - m_cameraZ;
+	distance = sqrtf((dx * dx) + (dy * dy) + (dz * dz));
+	if (distance < 1.0f)
+	{
+		distance = 1.0f;
+	}
+
+	// Project the world space error to a screen space error, in pixels once a target has been set.
+	return m_errors[(m_nodes[node].root * m_treeSize) + m_nodes[node].errorId] * m_errorScale / distance;
+}
+
+
+float RoamClass::GetMergePriority(int node)
+{
+	int base;
+	float priority, basePriority;
+
+
+	// A diamond is as important as the more important of its two halves.
+	priority = GetPriority(node);
+
+	base = m_nodes[node].baseNeighbor;
+	if (base != -1)
+	{
+		basePriority = GetPriority(base);
+		if (basePriority > priority)
+		{
+			priority = basePriority;
+		}
+	}
+
+	return priority;
+}
+
+
+int RoamClass::AllocateNode()
+{
+	int node;
+
+
+	m_freeNodeCount--;
+	node = m_freeNodes[m_freeNodeCount];
+
+	m_nodes[node].parent = -1;
+	m_nodes[node].leftChild = -1;
+	m_nodes[node].rightChild = -1;
+	m_nodes[node].leftNeighbor = -1;
+	m_nodes[node].rightNeighbor = -1;
+	m_nodes[node].baseNeighbor = -1;
+	m_nodes[node].slot = -1;
+	m_nodes[node].position[SPLIT_QUEUE] = -1;
+	m_nodes[node].position[MERGE_QUEUE] = -1;
+
+	return node;
+}
+
+
+void RoamClass::FreeNode(int node)
+{
+	m_freeNodes[m_freeNodeCount] = node;
+	m_freeNodeCount++;
+
+	return;
+}
+
+
+int RoamClass::AllocateSlot()
+{
+	int slot;
+
+
+	// Reuse a hole left by an earlier merge before growing the drawn range.
+	if (m_freeSlotCount > 0)
+	{
+		m_freeSlotCount--;
+		slot = m_freeSlots[m_freeSlotCount];
+	}
+	else
+	{
+		slot = m_slotHighWater;
+	}
+
+	if (slot >= m_slotHighWater)
+	{
+		m_slotHighWater = slot + 1;
+	}
+
+	return slot;
+}
+
+
+void RoamClass::FreeSlot(int slot)
+{
+	// Leave a degenerate triangle in the hole so the range can be drawn as is.
+	m_indices[(slot * 3)] = 0;
+	m_indices[(slot * 3) + 1] = 0;
+	m_indices[(slot * 3) + 2] = 0;
+	MarkDirty(slot);
+
+	// Shrink the drawn range when the last slot is released.
+	if (slot == m_slotHighWater - 1)
+	{
+		m_slotHighWater--;
+	}
+
+	m_freeSlots[m_freeSlotCount] = slot;
+	m_freeSlotCount++;
+
+	return;
+}
+
+
+void RoamClass::WriteSlot(int node)
+{
+	int slot;
+
+
+	slot = m_nodes[node].slot;
+
+	m_indices[(slot * 3)] = m_nodes[node].apex;
+	m_indices[(slot * 3) + 1] = m_nodes[node].left;
+	m_indices[(slot * 3) + 2] = m_nodes[node].right;
+	MarkDirty(slot);
+
+	return;
+}
+
+
+void RoamClass::MarkDirty(int slot)
+{
+	if ((m_dirtyFirst == -1) || (slot < m_dirtyFirst))
+	{
+		m_dirtyFirst = slot;
+	}
+
+	if ((m_dirtyLast == -1) || (slot > m_dirtyLast))
+	{
+		m_dirtyLast = slot;
+	}
+
+	return;
+}
+
+
+bool RoamClass::Split(int node)
+{
+	int base, leftChild, rightChild, left, right, center, parent;
+
+
+	if (!IsLeaf(node))
+	{
+		return true;
+	}
+
+	if (m_nodes[node].level >= m_maxLevel)
+	{
+		return false;
+	}
+
+	// The base neighbour must form a diamond with this triangle first, split it if it is coarser.
+	base = m_nodes[node].baseNeighbor;
+	if ((base != -1) && (m_nodes[base].baseNeighbor != node))
+	{
+		if (!Split(base))
+		{
+			return false;
+		}
+		base = m_nodes[node].baseNeighbor;
+	}
+
+	if (m_freeNodeCount < 2)
+	{
+		return false;
+	}
+
+	left = m_nodes[node].left;
+	right = m_nodes[node].right;
+	center = (((left / m_terrainWidth) + (right / m_terrainWidth)) / 2) * m_terrainWidth + (((left % m_terrainWidth) + (right % m_terrainWidth)) / 2);
+
+	leftChild = AllocateNode();
+	rightChild = AllocateNode();
+
+	m_nodes[node].leftChild = leftChild;
+	m_nodes[node].rightChild = rightChild;
+
+	m_nodes[leftChild].apex = center;
+	m_nodes[leftChild].left = m_nodes[node].apex;
+	m_nodes[leftChild].right = left;
+
+	m_nodes[rightChild].apex = center;
+	m_nodes[rightChild].left = right;
+	m_nodes[rightChild].right = m_nodes[node].apex;
+
+	m_nodes[leftChild].parent = node;
+	m_nodes[leftChild].root = m_nodes[node].root;
+	m_nodes[leftChild].level = m_nodes[node].level + 1;
+	m_nodes[leftChild].errorId = m_nodes[node].errorId * 2;
+
+	m_nodes[rightChild].parent = node;
+	m_nodes[rightChild].root = m_nodes[node].root;
+	m_nodes[rightChild].level = m_nodes[node].level + 1;
+	m_nodes[rightChild].errorId = (m_nodes[node].errorId * 2) + 1;
+
+	// Link the children to each other and to the outer neighbours.
+	m_nodes[leftChild].baseNeighbor = m_nodes[node].leftNeighbor;
+	m_nodes[leftChild].leftNeighbor = rightChild;
+	m_nodes[rightChild].baseNeighbor = m_nodes[node].rightNeighbor;
+	m_nodes[rightChild].rightNeighbor = leftChild;
+
+	if (m_nodes[node].leftNeighbor != -1)
+	{
+		ReplaceNeighbor(m_nodes[node].leftNeighbor, node, leftChild);
+	}
+
+	if (m_nodes[node].rightNeighbor != -1)
+	{
+		ReplaceNeighbor(m_nodes[node].rightNeighbor, node, rightChild);
+	}
+
+	// The left child takes over the parent's slot, the right child gets a new one.
+	m_nodes[leftChild].slot = m_nodes[node].slot;
+	m_nodes[node].slot = -1;
+	m_nodes[rightChild].slot = AllocateSlot();
+	WriteSlot(leftChild);
+	WriteSlot(rightChild);
+
+	m_triangleCount++;
+
+	QueueRemove(SPLIT_QUEUE, node);
+	UpdateSplitState(leftChild);
+	UpdateSplitState(rightChild);
+
+	// Finish the diamond by linking to the children of the base, splitting it when needed.
+	if (base != -1)
+	{
+		if (!IsLeaf(base))
+		{
+			m_nodes[m_nodes[base].leftChild].rightNeighbor = rightChild;
+			m_nodes[m_nodes[base].rightChild].leftNeighbor = leftChild;
+			m_nodes[leftChild].rightNeighbor = m_nodes[base].rightChild;
+			m_nodes[rightChild].leftNeighbor = m_nodes[base].leftChild;
+		}
+		else
+		{
+			Split(base);
+		}
+	}
+	else
+	{
+		m_nodes[leftChild].rightNeighbor = -1;
+		m_nodes[rightChild].leftNeighbor = -1;
+	}
+
+	// This triangle is now a mergeable diamond, its parent no longer is.
+	UpdateMergeState(node);
+
+	parent = m_nodes[node].parent;
+	if (parent != -1)
+	{
+		UpdateMergeState(parent);
+		UpdateMergeState(m_nodes[parent].baseNeighbor);
+	}
+
+	return true;
+}
+
+
+void RoamClass::Merge(int node)
+{
+	int base, parent;
+
+
+	base = m_nodes[node].baseNeighbor;
+
+	QueueRemove(MERGE_QUEUE, node);
+	MergeHalf(node);
+	UpdateSplitState(node);
+	m_triangleCount--;
+
+	if (base != -1)
+	{
+		QueueRemove(MERGE_QUEUE, base);
+		MergeHalf(base);
+		UpdateSplitState(base);
+		m_triangleCount--;
+	}
+
+	// The parents may have become mergeable diamonds again.
+	parent = m_nodes[node].parent;
+	if (parent != -1)
+	{
+		UpdateMergeState(parent);
+		UpdateMergeState(m_nodes[parent].baseNeighbor);
+	}
+
+	if (base != -1)
+	{
+		parent = m_nodes[base].parent;
+		if (parent != -1)
+		{
+			UpdateMergeState(parent);
+			UpdateMergeState(m_nodes[parent].baseNeighbor);
+		}
+	}
+
+	return;
+}
+
+
+void RoamClass::MergeHalf(int node)
+{
+	int leftChild, rightChild;
+
+
+	leftChild = m_nodes[node].leftChild;
+	rightChild = m_nodes[node].rightChild;
+
+	// Point the outer neighbours back at this triangle.
+	m_nodes[node].leftNeighbor = m_nodes[leftChild].baseNeighbor;
+	if (m_nodes[node].leftNeighbor != -1)
+	{
+		ReplaceNeighbor(m_nodes[node].leftNeighbor, leftChild, node);
+	}
+
+	m_nodes[node].rightNeighbor = m_nodes[rightChild].baseNeighbor;
+	if (m_nodes[node].rightNeighbor != -1)
+	{
+		ReplaceNeighbor(m_nodes[node].rightNeighbor, rightChild, node);
+	}
+
+	// Take back the left child's slot and release the right child's one.
+	m_nodes[node].slot = m_nodes[leftChild].slot;
+	WriteSlot(node);
+	FreeSlot(m_nodes[rightChild].slot);
+
+	QueueRemove(SPLIT_QUEUE, leftChild);
+	QueueRemove(SPLIT_QUEUE, rightChild);
+
+	FreeNode(leftChild);
+	FreeNode(rightChild);
+
+	m_nodes[node].leftChild = -1;
+	m_nodes[node].rightChild = -1;
+
+	return;
+}
+
+
+bool RoamClass::IsLeaf(int node)
+{
+	return m_nodes[node].leftChild == -1;
+}
+
+
+bool RoamClass::IsMergeable(int node)
+{
+	int base;
+
+
+	if (IsLeaf(node) || !IsLeaf(m_nodes[node].leftChild) || !IsLeaf(m_nodes[node].rightChild))
+	{
+		return false;
+	}
+
+	// The other half of the diamond must be split exactly once as well.
+	base = m_nodes[node].baseNeighbor;
+	if (base != -1)
+	{
+		if ((m_nodes[base].baseNeighbor != node) || IsLeaf(base))
+		{
+			return false;
+		}
+
+		if (!IsLeaf(m_nodes[base].leftChild) || !IsLeaf(m_nodes[base].rightChild))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void RoamClass::UpdateMergeState(int node)
+{
+	if (node == -1)
+	{
+		return;
+	}
+
+	if (IsMergeable(node))
+	{
+		if (QueueContains(MERGE_QUEUE, node))
+		{
+			QueueUpdate(MERGE_QUEUE, node, GetMergePriority(node));
+		}
+		else
+		{
+			QueuePush(MERGE_QUEUE, node, GetMergePriority(node));
+		}
+	}
+	else
+	{
+		QueueRemove(MERGE_QUEUE, node);
+	}
+
+	return;
+}
+
+
+void RoamClass::UpdateSplitState(int node)
+{
+	if (node == -1)
+	{
+		return;
+	}
+
+	if (IsLeaf(node) && (m_nodes[node].level < m_maxLevel))
+	{
+		if (QueueContains(SPLIT_QUEUE, node))
+		{
+			QueueUpdate(SPLIT_QUEUE, node, GetPriority(node));
+		}
+		else
+		{
+			QueuePush(SPLIT_QUEUE, node, GetPriority(node));
+		}
+	}
+	else
+	{
+		QueueRemove(SPLIT_QUEUE, node);
+	}
+
+	return;
+}
+
+
+void RoamClass::ReplaceNeighbor(int node, int oldNeighbor, int newNeighbor)
+{
+	if (m_nodes[node].baseNeighbor == oldNeighbor)
+	{
+		m_nodes[node].baseNeighbor = newNeighbor;
+	}
+	else if (m_nodes[node].leftNeighbor == oldNeighbor)
+	{
+		m_nodes[node].leftNeighbor = newNeighbor;
+	}
+	else if (m_nodes[node].rightNeighbor == oldNeighbor)
+	{
+		m_nodes[node].rightNeighbor = newNeighbor;
+	}
+
+	return;
+}
+
+
+void RoamClass::QueuePush(int queue, int node, float key)
+{
+	int position;
+
+
+	position = m_queues[queue].count;
+	m_queues[queue].count++;
+
+	m_queues[queue].items[position] = node;
+	m_nodes[node].position[queue] = position;
+	m_nodes[node].key[queue] = key;
+
+	QueueSiftUp(queue, position);
+
+	return;
+}
+
+
+void RoamClass::QueueRemove(int queue, int node)
+{
+	int position, last;
+
+
+	position = m_nodes[node].position[queue];
+	if (position == -1)
+	{
+		return;
+	}
+
+	// Move the last item into the hole and restore the heap order around it.
+	m_queues[queue].count--;
+	last = m_queues[queue].items[m_queues[queue].count];
+	m_nodes[node].position[queue] = -1;
+
+	if (position != m_queues[queue].count)
+	{
+		m_queues[queue].items[position] = last;
+		m_nodes[last].position[queue] = position;
+		QueueSiftUp(queue, position);
+		QueueSiftDown(queue, m_nodes[last].position[queue]);
+	}
+
+	return;
+}
+
+
+void RoamClass::QueueUpdate(int queue, int node, float key)
+{
+	m_nodes[node].key[queue] = key;
+
+	QueueSiftUp(queue, m_nodes[node].position[queue]);
+	QueueSiftDown(queue, m_nodes[node].position[queue]);
+
+	return;
+}
+
+
+bool RoamClass::QueueContains(int queue, int node)
+{
+	return m_nodes[node].position[queue] != -1;
+}
+
+
+void RoamClass::QueueSiftUp(int queue, int position)
+{
+	int parent;
+
+
+	while (position > 0)
+	{
+		parent = (position - 1) / 2;
+		if (!QueueBefore(queue, m_queues[queue].items[position], m_queues[queue].items[parent]))
+		{
+			break;
+		}
+
+		QueueSwap(queue, position, parent);
+		position = parent;
+	}
+
+	return;
+}
+
+
+void RoamClass::QueueSiftDown(int queue, int position)
+{
+	int child, best;
+
+
+	while (true)
+	{
+		best = position;
+
+		child = (position * 2) + 1;
+		if ((child < m_queues[queue].count) && QueueBefore(queue, m_queues[queue].items[child], m_queues[queue].items[best]))
+		{
+			best = child;
+		}
+
+		child++;
+		if ((child < m_queues[queue].count) && QueueBefore(queue, m_queues[queue].items[child], m_queues[queue].items[best]))
+		{
+			best = child;
+		}
+
+		if (best == position)
+		{
+			break;
+		}
+
+		QueueSwap(queue, position, best);
+		position = best;
+	}
+
+	return;
+}
+
+
+bool RoamClass::QueueBefore(int queue, int first, int second)
+{
+	if (m_queues[queue].largestFirst)
+	{
+		return m_nodes[first].key[queue] > m_nodes[second].key[queue];
+	}
+
+	return m_nodes[first].key[queue] < m_nodes[second].key[queue];
+}
+
+
+void RoamClass::QueueSwap(int queue, int first, int second)
+{
+	int node;
+
+
+	node = m_queues[queue].items[first];
+	m_queues[queue].items[first] = m_queues[queue].items[second];
+	m_queues[queue].items[second] = node;
+
+	m_nodes[m_queues[queue].items[first]].position[queue] = first;
+	m_nodes[m_queues[queue].items[second]].position[queue] = second;
+
+	return;
+}
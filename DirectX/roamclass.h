@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: roamclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _ROAMCLASS_H_
+#define _ROAMCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <math.h>
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int ROAM_TRIANGLE_BUDGET = 20000;
+const int ROAM_MAX_OPERATIONS = 2000;
+const int ROAM_REPRIORITIZE_COUNT = 4096;
+const float ROAM_ERROR_SCALE = 600.0f;
+const float ROAM_MIN_ERROR = 0.5f;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: RoamClass
+////////////////////////////////////////////////////////////////////////////////
+class RoamClass
+{
+private:
+	enum
+	{
+		SPLIT_QUEUE = 0,
+		MERGE_QUEUE = 1
+	};
+
+	struct TriNodeType
+	{
+		int apex, left, right;
+		int parent, leftChild, rightChild;
+		int leftNeighbor, rightNeighbor, baseNeighbor;
+		int root, errorId, level;
+		int slot;
+		float key[2];
+		int position[2];
+	};
+
+	struct QueueType
+	{
+		int* items;
+		int count;
+		bool largestFirst;
+	};
+
+public:
+	RoamClass();
+	RoamClass(const RoamClass&);
+	~RoamClass();
+
+	bool Initialize(float*, int, int);
+	void Shutdown();
+
+	void SetErrorTarget(float, float, int);
+	void Update(float, float, float);
+
+	unsigned long* GetIndices();
+	int GetIndexCount();
+	int GetMaxIndexCount();
+	bool GetDirtyRange(int&, int&);
+	void ClearDirtyRange();
+
+	int GetTriangleCount();
+	int GetOperationCount();
+	float GetScreenError();
+
+private:
+	float ComputeErrors(int, int, int, int, int, int);
+	float GetPriority(int);
+	float GetMergePriority(int);
+
+	int AllocateNode();
+	void FreeNode(int);
+	int AllocateSlot();
+	void FreeSlot(int);
+	void WriteSlot(int);
+
+	bool Split(int);
+	void Merge(int);
+	bool IsLeaf(int);
+	bool IsMergeable(int);
+	void UpdateMergeState(int);
+	void UpdateSplitState(int);
+	void MergeHalf(int);
+	void ReplaceNeighbor(int, int, int);
+	void MarkDirty(int);
+
+	void QueuePush(int, int, float);
+	void QueueRemove(int, int);
+	void QueueUpdate(int, int, float);
+	bool QueueContains(int, int);
+	void QueueSiftUp(int, int);
+	void QueueSiftDown(int, int);
+	bool QueueBefore(int, int, int);
+	void QueueSwap(int, int, int);
+
+private:
+	int m_terrainWidth, m_maxLevel, m_treeSize;
+	float* m_heights;
+	float* m_errors;
+
+	TriNodeType* m_nodes;
+	int* m_freeNodes;
+	int m_nodeCapacity, m_freeNodeCount;
+
+	unsigned long* m_indices;
+	int* m_freeSlots;
+	int m_freeSlotCount, m_slotHighWater;
+	int m_dirtyFirst, m_dirtyLast;
+
+	QueueType m_queues[2];
+
+	int m_triangleBudget, m_triangleCount, m_operationCount;
+	int m_maxTriangleBudget;
+	float m_errorScale, m_minError;
+	int m_reprioritizeCursor;
+	float m_cameraX, m_cameraY, m_cameraZ;
+};
+
+#endif
@@ -8,6 +8,14 @@ cbuffer MatrixBuffer
     matrix projectionMatrix;
 };
 
+cbuffer PackedBuffer : register(b1)
+{
+    float heightScale;
+    float heightOffset;
+    float textureScale;
+    float padding;
+};
+
 //////////////
 // TYPEDEFS //
 //////////////
@@ -18,6 +26,11 @@ struct VertexInputType
     float3 normal : NORMAL;
 };
 
+struct PackedVertexInputType
+{
+    uint4 packed : POSITION;
+};
+
 struct PixelInputType
 {
     float4 position : SV_POSITION;
@@ -50,5 +63,51 @@ PixelInputType LightVertexShader(VertexInputType input)
     // Normalize the normal vector before sending to pixel shader.
     output.normal = normalize(output.normal);
 
+    return output;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Packed Vertex Shader
+////////////////////////////////////////////////////////////////////////////////
+PixelInputType LightPackedVertexShader(PackedVertexInputType input)
+{
+    PixelInputType output;
+    float4 position;
+    float2 octahedral;
+    float3 normal;
+
+
+    // Rebuild the position from the grid coordinates and the 16 bit height.
+    position.x = (float)input.packed.x;
+    position.y = ((float)input.packed.z * heightScale) + heightOffset;
+    position.z = (float)input.packed.y;
+    position.w = 1.0f;
+
+    // Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(position, worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    // The texture coordinates are a scale of the grid coordinates.
+    output.tex = position.xz * textureScale;
+
+    // Decode the octahedral normal, x is in the low byte and z in the high byte.
+    octahedral.x = ((float)(input.packed.w & 0xff) / 255.0f) * 2.0f - 1.0f;
+    octahedral.y = ((float)(input.packed.w >> 8) / 255.0f) * 2.0f - 1.0f;
+
+    normal = float3(octahedral.x, 1.0f - abs(octahedral.x) - abs(octahedral.y), octahedral.y);
+
+    // Unfold the lower half of the octahedron.
+    if (normal.y < 0.0f)
+    {
+        normal.xz = (1.0f - abs(octahedral.yx)) * (octahedral >= 0.0f ? 1.0f : -1.0f);
+    }
+
+    // Calculate the normal vector against the world matrix only.
+    output.normal = mul(normal, (float3x3)worldMatrix);
+
+    // Normalize the normal vector before sending to pixel shader.
+    output.normal = normalize(output.normal);
+
     return output;
 }
\ No newline at end of file
@@ -0,0 +1,94 @@
+/////////////
+// GLOBALS //
+/////////////
+cbuffer MatrixBuffer
+{
+    matrix worldMatrix;
+    matrix viewMatrix;
+    matrix projectionMatrix;
+};
+
+cbuffer PackedBuffer : register(b1)
+{
+    float heightScale;
+    float heightOffset;
+    float textureScale;
+    float padding;
+};
+
+//////////////
+// TYPEDEFS //
+//////////////
+struct VertexInputType
+{
+    float4 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float4 color : COLOR;
+};
+
+struct PackedVertexInputType
+{
+    uint4 packed : POSITION;
+    float4 color : COLOR;
+};
+
+struct PixelInputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float4 color : COLOR;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Vertex Shader
+////////////////////////////////////////////////////////////////////////////////
+PixelInputType VertexLightVertexShader(VertexInputType input)
+{
+    PixelInputType output;
+
+
+    // Change the position vector to be 4 units for proper matrix calculations.
+    input.position.w = 1.0f;
+
+    // Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(input.position, worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    // Store the texture coordinates for the pixel shader.
+    output.tex = input.tex;
+
+    // The lighting was worked out on the CPU, pass it through.
+    output.color = input.color;
+
+    return output;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Packed Vertex Shader
+////////////////////////////////////////////////////////////////////////////////
+PixelInputType VertexLightPackedVertexShader(PackedVertexInputType input)
+{
+    PixelInputType output;
+    float4 position;
+
+
+    // Rebuild the position from the grid coordinates and the 16 bit height, the normal is not needed.
+    position.x = (float)input.packed.x;
+    position.y = ((float)input.packed.z * heightScale) + heightOffset;
+    position.z = (float)input.packed.y;
+    position.w = 1.0f;
+
+    // Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(position, worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    // The texture coordinates are a scale of the grid coordinates.
+    output.tex = position.xz * textureScale;
+
+    // The lighting was worked out on the CPU, pass it through.
+    output.color = input.color;
+
+    return output;
+}
@@ -9,6 +9,7 @@ ShaderManagerClass::ShaderManagerClass()
 	m_ColorShader = 0;
 	m_TextureShader = 0;
 	m_LightShader = 0;
+	m_VertexLightShader = 0;
 }
 
 
@@ -69,12 +70,34 @@ bool ShaderManagerClass::Initialize(ID3D11Device* device, HWND hwnd)
 		return false;
 	}
 
+	// Create the vertex light shader object.
+	m_VertexLightShader = new VertexLightShaderClass;
+	if (!m_VertexLightShader)
+	{
+		return false;
+	}
+
+	// Initialize the vertex light shader object.
+	result = m_VertexLightShader->Initialize(device, hwnd);
+	if (!result)
+	{
+		return false;
+	}
+
 	return true;
 }
 
 
 void ShaderManagerClass::Shutdown()
 {
+	// Release the vertex light shader object.
+	if (m_VertexLightShader)
+	{
+		m_VertexLightShader->Shutdown();
+		delete m_VertexLightShader;
+		m_VertexLightShader = 0;
+	}
+
 	// Release the light shader object.
 	if (m_LightShader)
 	{
@@ -128,3 +151,23 @@ bool ShaderManagerClass::RenderLightShader(ID3D11DeviceContext* deviceContext, i
 {
 	return m_LightShader->Render(deviceContext, indexCount, worldMatrix, viewMatrix, projectionMatrix, texture, lightDirection, diffuseColor, ambientColor);
 }
+
+bool ShaderManagerClass::SetLightShader(ID3D11DeviceContext* deviceContext, XMMATRIX worldMatrix, XMMATRIX viewMatrix,
+	XMMATRIX projectionMatrix, ID3D11ShaderResourceView* texture, XMFLOAT3 lightDirection, XMFLOAT4 diffuseColor)
+{
+	return m_LightShader->SetShader(deviceContext, worldMatrix, viewMatrix, projectionMatrix, texture, lightDirection, diffuseColor);
+}
+
+bool ShaderManagerClass::SetLightShader(ID3D11DeviceContext* deviceContext, XMMATRIX worldMatrix, XMMATRIX viewMatrix,
+	XMMATRIX projectionMatrix, ID3D11ShaderResourceView* texture, ID3D11ShaderResourceView* splatMap, ID3D11ShaderResourceView* snowTexture,
+	XMFLOAT3 lightDirection, XMFLOAT4 diffuseColor, XMFLOAT4 packedDecode, bool packed)
+{
+	return m_LightShader->SetShader(deviceContext, worldMatrix, viewMatrix, projectionMatrix, texture, splatMap, snowTexture, lightDirection, diffuseColor,
+		packedDecode, packed);
+}
+
+bool ShaderManagerClass::SetVertexLightShader(ID3D11DeviceContext* deviceContext, XMMATRIX worldMatrix, XMMATRIX viewMatrix,
+	XMMATRIX projectionMatrix, ID3D11ShaderResourceView* texture, XMFLOAT4 packedDecode, bool packed)
+{
+	return m_VertexLightShader->SetShader(deviceContext, worldMatrix, viewMatrix, projectionMatrix, texture, packedDecode, packed);
+}
@@ -0,0 +1,200 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: splatmapclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "splatmapclass.h"
+
+
+SplatMapClass::SplatMapClass()
+{
+	m_heights = 0;
+	m_weights = 0;
+}
+
+
+SplatMapClass::SplatMapClass(const SplatMapClass& other)
+{
+}
+
+
+SplatMapClass::~SplatMapClass()
+{
+}
+
+
+bool SplatMapClass::Initialize(const float* heights, int terrainWidth, int terrainHeight, float minHeight, float maxHeight)
+{
+	m_heights = heights;
+	m_terrainWidth = terrainWidth;
+	m_terrainHeight = terrainHeight;
+
+	// Keep the height range the snow line is measured in, a flat terrain still gets a valid one.
+	m_minHeight = minHeight;
+	m_heightRange = (maxHeight > minHeight) ? (maxHeight - minHeight) : 1.0f;
+
+	// Create the weight array, one texel per vertex in the same rows as the heights.
+	m_weights = new unsigned int[m_terrainWidth * m_terrainHeight];
+	if (!m_weights)
+	{
+		return false;
+	}
+
+	// Work out the whole map.
+	Update(0, 0, m_terrainWidth - 1, m_terrainHeight - 1);
+
+	return true;
+}
+
+
+void SplatMapClass::Shutdown()
+{
+	// Release the weight array.
+	if (m_weights)
+	{
+		delete[] m_weights;
+		m_weights = 0;
+	}
+
+	m_heights = 0;
+
+	return;
+}
+
+
+void SplatMapClass::Update(int left, int top, int right, int bottom)
+{
+	int tileColumns, tileRows;
+	ParallelForClass parallel;
+
+
+	// Clamp the rectangle to the map, the corners are included.
+	left = (left > 0) ? left : 0;
+	top = (top > 0) ? top : 0;
+	right = (right < (m_terrainWidth - 1)) ? right : (m_terrainWidth - 1);
+	bottom = (bottom < (m_terrainHeight - 1)) ? bottom : (m_terrainHeight - 1);
+	if ((left > right) || (top > bottom))
+	{
+		return;
+	}
+
+	// Split the rectangle into tiles, a small one is a single tile and runs on this thread.
+	tileColumns = ((right - left) / SPLAT_MAP_TILE_SIZE) + 1;
+	tileRows = ((bottom - top) / SPLAT_MAP_TILE_SIZE) + 1;
+
+	parallel.Run(tileColumns * tileRows, 1, [&](int first, int last)
+	{
+		int tile, tileLeft, tileRight, tileTop, tileBottom, j;
+
+
+		for (tile = first; tile < last; tile++)
+		{
+			tileLeft = left + ((tile % tileColumns) * SPLAT_MAP_TILE_SIZE);
+			tileTop = top + ((tile / tileColumns) * SPLAT_MAP_TILE_SIZE);
+			tileRight = ((tileLeft + SPLAT_MAP_TILE_SIZE - 1) < right) ? (tileLeft + SPLAT_MAP_TILE_SIZE - 1) : right;
+			tileBottom = ((tileTop + SPLAT_MAP_TILE_SIZE - 1) < bottom) ? (tileTop + SPLAT_MAP_TILE_SIZE - 1) : bottom;
+
+			for (j = tileTop; j <= tileBottom; j++)
+			{
+				UpdateRow(j, tileLeft, tileRight);
+			}
+		}
+	});
+
+	return;
+}
+
+
+const unsigned int* SplatMapClass::GetWeights()
+{
+	return m_weights;
+}
+
+
+int SplatMapClass::GetRowPitch()
+{
+	return m_terrainWidth * sizeof(unsigned int);
+}
+
+
+void SplatMapClass::UpdateRow(int j, int first, int last)
+{
+	const float *row, *above, *below;
+	int i, left, right;
+
+
+	// The neighbours past the edges of the map are clamped to the edge.
+	row = &m_heights[j * m_terrainWidth];
+	above = &m_heights[((j > 0) ? (j - 1) : j) * m_terrainWidth];
+	below = &m_heights[((j < (m_terrainHeight - 1)) ? (j + 1) : j) * m_terrainWidth];
+
+	i = first;
+
+	/*
+		Four texels at a time straight from the rows wherever all their neighbours are inside the
+		map, the edge texels and the tail gather theirs into the same registers so every texel goes
+		through the same arithmetic.
+	*/
+	while (i <= last)
+	{
+		if ((i > 0) && ((i + 3) <= last) && ((i + 4) < m_terrainWidth))
+		{
+			_mm_storeu_si128((__m128i*)&m_weights[(j * m_terrainWidth) + i], CalculateTexels(_mm_loadu_ps(&row[i]), _mm_loadu_ps(&row[i - 1]),
+				_mm_loadu_ps(&row[i + 1]), _mm_loadu_ps(&above[i]), _mm_loadu_ps(&below[i])));
+			i += 4;
+		}
+		else
+		{
+			left = (i > 0) ? (i - 1) : i;
+			right = (i < (m_terrainWidth - 1)) ? (i + 1) : i;
+
+			m_weights[(j * m_terrainWidth) + i] = (unsigned int)_mm_cvtsi128_si32(CalculateTexels(_mm_set1_ps(row[i]), _mm_set1_ps(row[left]),
+				_mm_set1_ps(row[right]), _mm_set1_ps(above[i]), _mm_set1_ps(below[i])));
+			i++;
+		}
+	}
+
+	return;
+}
+
+
+__m128i SplatMapClass::CalculateTexels(const __m128& height, const __m128& left, const __m128& right, const __m128& above, const __m128& below)
+{
+	__m128 zero, one, half, gradientX, gradientZ, normalY, rock, snow, dirt, grass, remaining;
+	__m128i texels;
+
+
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0f);
+	half = _mm_set1_ps(0.5f);
+
+	// The slope as the up component of the normal from central differences.
+	gradientX = _mm_mul_ps(_mm_sub_ps(right, left), half);
+	gradientZ = _mm_mul_ps(_mm_sub_ps(below, above), half);
+	normalY = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(one, _mm_add_ps(_mm_mul_ps(gradientX, gradientX), _mm_mul_ps(gradientZ, gradientZ)))));
+
+	// Rock takes over as the ground gets steeper.
+	rock = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(SPLAT_ROCK_NORMAL_START), normalY), _mm_set1_ps(1.0f / (SPLAT_ROCK_NORMAL_START - SPLAT_ROCK_NORMAL_END)));
+	rock = _mm_min_ps(_mm_max_ps(rock, zero), one);
+
+	// Snow covers the high ground.
+	snow = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(height, _mm_set1_ps(m_minHeight)), _mm_set1_ps(1.0f / m_heightRange)), _mm_set1_ps(SPLAT_SNOW_HEIGHT_START));
+	snow = _mm_mul_ps(snow, _mm_set1_ps(1.0f / (SPLAT_SNOW_HEIGHT_END - SPLAT_SNOW_HEIGHT_START)));
+	snow = _mm_min_ps(_mm_max_ps(snow, zero), one);
+
+	// Dirt gathers where the ground curves up on both sides, a positive laplacian.
+	dirt = _mm_sub_ps(_mm_add_ps(_mm_add_ps(left, right), _mm_add_ps(above, below)), _mm_mul_ps(height, _mm_set1_ps(4.0f)));
+	dirt = _mm_min_ps(_mm_max_ps(_mm_mul_ps(dirt, _mm_set1_ps(SPLAT_DIRT_CURVATURE)), zero), one);
+
+	// Each layer only covers what the layers above it left, grass gets the rest.
+	remaining = _mm_mul_ps(_mm_sub_ps(one, rock), _mm_sub_ps(one, snow));
+	snow = _mm_mul_ps(snow, _mm_sub_ps(one, rock));
+	grass = _mm_mul_ps(remaining, _mm_sub_ps(one, dirt));
+	dirt = _mm_mul_ps(remaining, dirt);
+
+	// Round to bytes and pack them red to alpha, lowest byte first.
+	texels = _mm_cvtps_epi32(_mm_mul_ps(dirt, _mm_set1_ps(255.0f)));
+	texels = _mm_or_si128(texels, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(rock, _mm_set1_ps(255.0f))), 8));
+	texels = _mm_or_si128(texels, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(grass, _mm_set1_ps(255.0f))), 16));
+	texels = _mm_or_si128(texels, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(snow, _mm_set1_ps(255.0f))), 24));
+
+	return texels;
+}
@@ -0,0 +1,67 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: splatmapclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _SPLATMAPCLASS_H_
+#define _SPLATMAPCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <emmintrin.h>
+
+#include "parallelforclass.h"
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int SPLAT_MAP_TILE_SIZE = 64;
+const float SPLAT_ROCK_NORMAL_START = 0.85f;
+const float SPLAT_ROCK_NORMAL_END = 0.65f;
+const float SPLAT_SNOW_HEIGHT_START = 0.6f;
+const float SPLAT_SNOW_HEIGHT_END = 0.75f;
+const float SPLAT_DIRT_CURVATURE = 4.0f;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: SplatMapClass
+////////////////////////////////////////////////////////////////////////////////
+// Material weights for texture splatting, one RGBA8 texel per terrain vertex
+// with dirt in red, rock in green, grass in blue and snow in alpha. Steep
+// ground is rock, high ground that is not rock is snow, hollows that are
+// neither are dirt and the rest is grass, so the four weights always add up to
+// one within rounding.
+//
+// The texels are worked out from the height, the slope and the curvature of
+// the resident heights four at a time with SSE2, tile by tile on all the cores.
+// Heights are normalized with the range given at initialization, so a
+// deformed terrain keeps the same snow line. A rectangle can be rebuilt on its
+// own after the heights under it changed.
+class SplatMapClass
+{
+public:
+	SplatMapClass();
+	SplatMapClass(const SplatMapClass&);
+	~SplatMapClass();
+
+	bool Initialize(const float*, int, int, float, float);
+	void Shutdown();
+
+	void Update(int, int, int, int);
+
+	const unsigned int* GetWeights();
+	int GetRowPitch();
+
+private:
+	void UpdateRow(int, int, int);
+	__m128i CalculateTexels(const __m128&, const __m128&, const __m128&, const __m128&, const __m128&);
+
+private:
+	const float* m_heights;
+	int m_terrainWidth, m_terrainHeight;
+	float m_minHeight, m_heightRange;
+	unsigned int* m_weights;
+};
+
+#endif
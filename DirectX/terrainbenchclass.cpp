@@ -0,0 +1,488 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: terrainbenchclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "terrainbenchclass.h"
+
+
+TerrainBenchClass::TerrainBenchClass()
+{
+	m_Terrain = 0;
+}
+
+
+TerrainBenchClass::TerrainBenchClass(const TerrainBenchClass& other)
+{
+}
+
+
+TerrainBenchClass::~TerrainBenchClass()
+{
+}
+
+
+bool TerrainBenchClass::Run(TerrainClass* terrain, const char* filename)
+{
+	ofstream fout;
+	bool result;
+
+
+	m_Terrain = terrain;
+
+	// Open the report, every run of the bench replaces the last one.
+	fout.open(filename);
+	if (fout.fail())
+	{
+		return false;
+	}
+
+	fout.setf(ios::fixed);
+	fout.precision(3);
+
+	fout << "Terrain " << m_Terrain->GetTerrainWidth() << " x " << m_Terrain->GetTerrainHeight() << " vertices" << endl << endl;
+
+	// Each bench writes its own lines, one that fails says so and the rest still run.
+	result = MeasureFileLoad(fout);
+	result = MeasureSimplification(fout) && result;
+	result = MeasureExport(fout, MESH_EXPORT_GLB, false) && result;
+	result = MeasureExport(fout, MESH_EXPORT_GLB, true) && result;
+	result = MeasureExport(fout, MESH_EXPORT_PLY, false) && result;
+	result = MeasureExport(fout, MESH_EXPORT_PLY, true) && result;
+	result = MeasureHeightQueries(fout, TERRAIN_HEIGHT_BILINEAR) && result;
+	result = MeasureHeightQueries(fout, TERRAIN_HEIGHT_TRIANGLE) && result;
+	result = MeasureRayCasts(fout, m_Terrain->GetTerrainWidth()) && result;
+	result = MeasureRayCasts(fout, TERRAIN_BENCH_RAY_SIZE) && result;
+	MeasureVertexCache(fout);
+
+	fout.close();
+
+	m_Terrain = 0;
+
+	return result;
+}
+
+
+bool TerrainBenchClass::MeasureFileLoad(ofstream& fout)
+{
+	TerrainFileClass terrainFile;
+	const TerrainFileClass::HeaderType* header;
+	const unsigned char* data;
+	unsigned long long offset;
+	volatile unsigned int sum;
+	int i, section;
+	float cold, warm;
+	bool result;
+
+
+	cold = 0.0f;
+	warm = 0.0f;
+
+	/*
+		Map the file and touch every page of it, which is what the loader ends up doing once
+		the buffers are created. The first pass pays for the page faults (and the disk reads if
+		the file is not in the system cache yet), the later passes show the warm cost.
+	*/
+	sum = 0;
+	for (i = 0; i < TERRAIN_BENCH_FILE_LOADS; i++)
+	{
+		m_Timer.StartTimer();
+
+		result = terrainFile.Open(TERRAIN_BINARY_FILENAME);
+		if (!result)
+		{
+			terrainFile.Close();
+			fout << "File load: no terrain file, only imported height maps are kept in one" << endl;
+			return true;
+		}
+
+		// The sum only keeps the reads from being optimized away.
+		header = terrainFile.GetHeader();
+		for (section = 0; section < TerrainFileClass::SECTION_COUNT; section++)
+		{
+			data = (const unsigned char*)terrainFile.GetSection(section);
+			for (offset = 0; offset < header->sections[section].size; offset += 4096)
+			{
+				sum += data[offset];
+			}
+		}
+
+		terrainFile.Close();
+
+		m_Timer.StopTimer();
+
+		if (i == 0)
+		{
+			cold = m_Timer.GetPreciseTiming();
+		}
+		else
+		{
+			warm += m_Timer.GetPreciseTiming();
+		}
+	}
+
+	warm /= (float)(TERRAIN_BENCH_FILE_LOADS - 1);
+
+	fout << "File load: cold " << cold << " ms, warm " << warm << " ms" << endl;
+
+	return true;
+}
+
+
+bool TerrainBenchClass::MeasureSimplification(ofstream& fout)
+{
+	TinClass tin;
+	int i, gridTriangles, tinTriangles;
+	float time;
+	bool result;
+
+
+	/*
+		Simplify the heightfield into one TIN per geomipmap patch, the same tiles the chunk
+		table uses, and report how many triangles it takes compared to the full grid at each
+		error. The TIN at the output error is kept as a mesh.
+	*/
+	for (i = 0; i < TERRAIN_BENCH_TIN_ERROR_COUNT; i++)
+	{
+		m_Timer.StartTimer();
+
+		result = tin.Initialize(m_Terrain->GetHeights(), m_Terrain->GetTerrainWidth(), m_Terrain->GetTerrainHeight(), GEOMIPMAP_PATCH_SIZE,
+			TERRAIN_BENCH_TIN_ERRORS[i]);
+
+		m_Timer.StopTimer();
+		time = m_Timer.GetPreciseTiming();
+
+		if (!result)
+		{
+			tin.Shutdown();
+			fout << "Simplification at " << TERRAIN_BENCH_TIN_ERRORS[i] << ": failed" << endl;
+			return false;
+		}
+
+		tin.GetTriangleCounts(gridTriangles, tinTriangles);
+
+		fout << "Simplification at " << TERRAIN_BENCH_TIN_ERRORS[i] << ": " << tinTriangles << " of " << gridTriangles << " triangles ("
+			<< (100.0f * (float)tinTriangles / (float)gridTriangles) << "%), measured error " << tin.GetMaxError() << ", " << time << " ms" << endl;
+
+		if (TERRAIN_BENCH_TIN_ERRORS[i] == TERRAIN_BENCH_TIN_OUTPUT_ERROR)
+		{
+			result = WriteTin(tin, TERRAIN_TIN_FILENAME);
+			fout << "TIN at " << TERRAIN_BENCH_TIN_OUTPUT_ERROR << (result ? " written to " : " could not be written to ") << TERRAIN_TIN_FILENAME << endl;
+		}
+
+		tin.Shutdown();
+
+		if (!result)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool TerrainBenchClass::WriteTin(TinClass& tin, const char* filename)
+{
+	MeshExportClass meshExport;
+	const unsigned short* tileIndices;
+	unsigned long* indices;
+	int gridTriangles, tinTriangles, tile, cornerVertex, tileIndexCount, indexCount, tileStride, width, i;
+	bool result;
+
+
+	tin.GetTriangleCounts(gridTriangles, tinTriangles);
+
+	indices = new unsigned long[tinTriangles * 3];
+	if (!indices)
+	{
+		return false;
+	}
+
+	// The tiles index their own corner, a row of a tile is one longer than the tile so the shared edges line up.
+	width = m_Terrain->GetTerrainWidth();
+	tileStride = GEOMIPMAP_PATCH_SIZE + 1;
+	indexCount = 0;
+
+	for (tile = 0; tile < tin.GetTileCount(); tile++)
+	{
+		tin.GetTile(tile, cornerVertex, tileIndices, tileIndexCount);
+
+		for (i = 0; i < tileIndexCount; i++)
+		{
+			indices[indexCount] = cornerVertex + ((tileIndices[i] / tileStride) * width) + (tileIndices[i] % tileStride);
+			indexCount++;
+		}
+	}
+
+	// The exporter works the normals out from the heights when it is not handed any.
+	result = meshExport.Initialize(m_Terrain->GetHeights(), 0, width, m_Terrain->GetTerrainHeight());
+	if (result)
+	{
+		result = meshExport.Export(filename, MESH_EXPORT_PLY, false, indices, indexCount);
+	}
+
+	meshExport.Shutdown();
+
+	delete[] indices;
+
+	return result;
+}
+
+
+bool TerrainBenchClass::MeasureExport(ofstream& fout, int format, bool quantized)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	const char* filename;
+	unsigned long long size;
+	float time, rate;
+	bool result;
+
+
+	// Export the full resolution model, the time covers both passes and the writes.
+	filename = (format == MESH_EXPORT_PLY) ? TERRAIN_PLY_FILENAME : TERRAIN_GLB_FILENAME;
+
+	m_Timer.StartTimer();
+
+	result = m_Terrain->ExportMesh(filename, format, quantized, false);
+
+	m_Timer.StopTimer();
+	time = m_Timer.GetPreciseTiming();
+
+	fout << "Export " << ((format == MESH_EXPORT_PLY) ? "PLY" : "GLB") << (quantized ? " quantized" : "") << ": ";
+
+	if (!result || !GetFileAttributesExA(filename, GetFileExInfoStandard, &attributes))
+	{
+		fout << "failed" << endl;
+		return false;
+	}
+
+	// Megabytes written per second.
+	size = ((unsigned long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	rate = (time > 0.0f) ? ((float)size / (1024.0f * 1024.0f)) / (time / 1000.0f) : 0.0f;
+
+	fout << time << " ms, " << rate << " MB/s to " << filename << endl;
+
+	return true;
+}
+
+
+bool TerrainBenchClass::MeasureHeightQueries(ofstream& fout, int filter)
+{
+	float *x, *z, *heights;
+	float singleRate, batchedRate;
+	unsigned int seed;
+	int i;
+
+
+	x = new float[TERRAIN_BENCH_HEIGHT_QUERIES * 3];
+	if (!x)
+	{
+		return false;
+	}
+
+	z = &x[TERRAIN_BENCH_HEIGHT_QUERIES];
+	heights = &x[TERRAIN_BENCH_HEIGHT_QUERIES * 2];
+
+	// Spread the points over the whole terrain with a fixed seed so runs can be compared.
+	seed = 12345;
+	for (i = 0; i < TERRAIN_BENCH_HEIGHT_QUERIES; i++)
+	{
+		seed = (seed * 1664525) + 1013904223;
+		x[i] = (float)(seed >> 8) / (float)(1 << 24) * (float)(m_Terrain->GetTerrainWidth() - 1);
+		seed = (seed * 1664525) + 1013904223;
+		z[i] = (float)(seed >> 8) / (float)(1 << 24) * (float)(m_Terrain->GetTerrainHeight() - 1);
+	}
+
+	// Time one query at a time.
+	m_Timer.StartTimer();
+
+	for (i = 0; i < TERRAIN_BENCH_HEIGHT_QUERIES; i++)
+	{
+		m_Terrain->GetHeightAt(x[i], z[i], filter, heights[i]);
+	}
+
+	m_Timer.StopTimer();
+	singleRate = GetRate(TERRAIN_BENCH_HEIGHT_QUERIES);
+
+	// Then the whole batch in one call.
+	m_Timer.StartTimer();
+
+	m_Terrain->GetHeightsAt(x, z, heights, TERRAIN_BENCH_HEIGHT_QUERIES, filter);
+
+	m_Timer.StopTimer();
+	batchedRate = GetRate(TERRAIN_BENCH_HEIGHT_QUERIES);
+
+	delete[] x;
+
+	fout << "Height queries " << ((filter == TERRAIN_HEIGHT_BILINEAR) ? "bilinear" : "triangle") << ": " << singleRate << " million per second one at a time, "
+		<< batchedRate << " million per second batched" << endl;
+
+	return true;
+}
+
+
+bool TerrainBenchClass::MeasureRayCasts(ofstream& fout, int size)
+{
+	HeightPyramidClass pyramid;
+	HeightPyramidClass::RayType* rays;
+	float* heights;
+	float* distances;
+	float distance, angle, targetX, targetZ, length, linearRate, pyramidRate, batchedRate;
+	unsigned int seed;
+	int i, j, mismatches;
+	bool result;
+
+
+	// Use the loaded terrain at its own size, any other size gets a generated one with the same bumpiness per cell.
+	heights = 0;
+	if (size == m_Terrain->GetTerrainWidth())
+	{
+		result = pyramid.Initialize(m_Terrain->GetHeights(), m_Terrain->GetTerrainWidth(), m_Terrain->GetTerrainHeight());
+	}
+	else
+	{
+		heights = new float[size * size];
+		if (!heights)
+		{
+			return false;
+		}
+
+		for (j = 0; j < size; j++)
+		{
+			for (i = 0; i < size; i++)
+			{
+				heights[(j * size) + i] = (8.0f * sinf((float)i * 0.05f) * cosf((float)j * 0.043f)) + (3.0f * sinf(((float)i * 0.21f) + ((float)j * 0.17f))) +
+					(sinf((float)i * 0.9f) * sinf((float)j * 0.77f));
+			}
+		}
+
+		result = pyramid.Initialize(heights, size, size);
+	}
+
+	rays = new HeightPyramidClass::RayType[TERRAIN_BENCH_RAYS];
+	distances = new float[TERRAIN_BENCH_RAYS];
+	if (!result || !rays || !distances)
+	{
+		pyramid.Shutdown();
+		delete[] distances;
+		delete[] rays;
+		delete[] heights;
+		return false;
+	}
+
+	// Half the rays pick down from above the terrain, the other half are line of fire rays skimming over the ground.
+	seed = 12345;
+	for (i = 0; i < TERRAIN_BENCH_RAYS; i++)
+	{
+		seed = (seed * 1664525) + 1013904223;
+		rays[i].origin.x = (float)(seed >> 8) / (float)(1 << 24) * (float)(size - 1);
+		seed = (seed * 1664525) + 1013904223;
+		rays[i].origin.z = (float)(seed >> 8) / (float)(1 << 24) * (float)(size - 1);
+		seed = (seed * 1664525) + 1013904223;
+		angle = (float)(seed >> 8) / (float)(1 << 24) * XM_2PI;
+
+		if ((i & 1) == 0)
+		{
+			rays[i].origin.y = pyramid.GetMaxHeight() + 30.0f;
+			targetX = rays[i].origin.x + (cosf(angle) * 64.0f);
+			targetZ = rays[i].origin.z + (sinf(angle) * 64.0f);
+			rays[i].direction = XMFLOAT3(targetX - rays[i].origin.x, pyramid.GetMinHeight() - rays[i].origin.y, targetZ - rays[i].origin.z);
+		}
+		else
+		{
+			rays[i].origin.y = pyramid.GetMaxHeight() - 2.0f;
+			rays[i].direction = XMFLOAT3(cosf(angle), -0.02f, sinf(angle));
+		}
+
+		length = sqrtf((rays[i].direction.x * rays[i].direction.x) + (rays[i].direction.y * rays[i].direction.y) + (rays[i].direction.z * rays[i].direction.z));
+		rays[i].direction.x /= length;
+		rays[i].direction.y /= length;
+		rays[i].direction.z /= length;
+		rays[i].maxDistance = (float)(size * 2);
+	}
+
+	// Time the plain march, the pyramid one ray at a time and the pyramid on all the cores.
+	m_Timer.StartTimer();
+
+	for (i = 0; i < TERRAIN_BENCH_RAYS; i++)
+	{
+		distances[i] = -1.0f;
+		if (pyramid.IntersectRayLinear(rays[i].origin, rays[i].direction, rays[i].maxDistance, distance))
+		{
+			distances[i] = distance;
+		}
+	}
+
+	m_Timer.StopTimer();
+	linearRate = GetRate(TERRAIN_BENCH_RAYS);
+
+	m_Timer.StartTimer();
+
+	mismatches = 0;
+	for (i = 0; i < TERRAIN_BENCH_RAYS; i++)
+	{
+		if (!pyramid.IntersectRay(rays[i].origin, rays[i].direction, rays[i].maxDistance, distance))
+		{
+			distance = -1.0f;
+		}
+
+		// Both have to find the same hit.
+		if (fabsf(distance - distances[i]) > 0.001f)
+		{
+			mismatches++;
+		}
+	}
+
+	m_Timer.StopTimer();
+	pyramidRate = GetRate(TERRAIN_BENCH_RAYS);
+
+	m_Timer.StartTimer();
+
+	pyramid.IntersectRays(rays, TERRAIN_BENCH_RAYS, distances);
+
+	m_Timer.StopTimer();
+	batchedRate = GetRate(TERRAIN_BENCH_RAYS);
+
+	// Release the rays and the generated terrain.
+	pyramid.Shutdown();
+	delete[] distances;
+	delete[] rays;
+	delete[] heights;
+
+	fout << "Ray casts on " << size << " x " << size << ": " << linearRate << " million per second marched, " << pyramidRate << " million per second through the pyramid, "
+		<< batchedRate << " million per second batched, " << mismatches << " hits differ" << endl;
+
+	return (mismatches == 0);
+}
+
+
+void TerrainBenchClass::MeasureVertexCache(ofstream& fout)
+{
+	float fifoAcmr, lruAcmr, atvr;
+
+
+	// Simulate the vertex cache over the patches drawn in the last frame, a ROAM frame has none.
+	m_Terrain->MeasureVertexCache(TERRAIN_BENCH_CACHE_SIZE, false, fifoAcmr, atvr);
+	m_Terrain->MeasureVertexCache(TERRAIN_BENCH_CACHE_SIZE, true, lruAcmr, atvr);
+
+	if (fifoAcmr == 0.0f)
+	{
+		fout << "Vertex cache: no geomipmap frame drawn yet" << endl;
+		return;
+	}
+
+	fout << "Vertex cache of the last frame, " << TERRAIN_BENCH_CACHE_SIZE << " entries: ACMR " << fifoAcmr << " FIFO, " << lruAcmr << " LRU, ATVR " << atvr << endl;
+
+	return;
+}
+
+
+float TerrainBenchClass::GetRate(int count)
+{
+	float time;
+
+
+	// Millions of runs per second over the span the timer last took.
+	time = m_Timer.GetPreciseTiming();
+
+	return (time > 0.0f) ? ((float)count / 1000000.0f) / (time / 1000.0f) : 0.0f;
+}
@@ -0,0 +1,74 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: terrainbenchclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _TERRAINBENCHCLASS_H_
+#define _TERRAINBENCHCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <windows.h>
+#include <math.h>
+#include <fstream>
+
+#include "terrainclass.h"
+#include "terrainfileclass.h"
+#include "heightpyramidclass.h"
+#include "meshexportclass.h"
+#include "tinclass.h"
+#include "timerclass.h"
+
+using namespace std;
+
+
+/////////////
+// GLOBALS //
+/////////////
+const char TERRAIN_BENCH_FILENAME[] = "./terrain_bench.txt";
+const char TERRAIN_TIN_FILENAME[] = "./terrain_tin.ply";
+const int TERRAIN_BENCH_FILE_LOADS = 5;
+const int TERRAIN_BENCH_TIN_ERROR_COUNT = 4;
+const float TERRAIN_BENCH_TIN_ERRORS[TERRAIN_BENCH_TIN_ERROR_COUNT] = { 0.05f, 0.25f, 0.5f, 1.0f };
+const float TERRAIN_BENCH_TIN_OUTPUT_ERROR = 0.5f;
+const int TERRAIN_BENCH_HEIGHT_QUERIES = 100000;
+const int TERRAIN_BENCH_RAYS = 10000;
+const int TERRAIN_BENCH_RAY_SIZE = 4097;
+const int TERRAIN_BENCH_CACHE_SIZE = 32;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: TerrainBenchClass
+////////////////////////////////////////////////////////////////////////////////
+// Runs the terrain benchmarks and tools on demand, away from the frame loop,
+// and writes what they measured to a text report. Everything goes through
+// the public interface of the terrain: the file load, the TIN simplification,
+// the mesh export, the height queries, the ray casts and the vertex cache of
+// the last frame. The TIN at the output error is written as a PLY file next
+// to the report. One timer times every run.
+class TerrainBenchClass
+{
+public:
+	TerrainBenchClass();
+	TerrainBenchClass(const TerrainBenchClass&);
+	~TerrainBenchClass();
+
+	bool Run(TerrainClass*, const char*);
+
+private:
+	bool MeasureFileLoad(ofstream&);
+	bool MeasureSimplification(ofstream&);
+	bool WriteTin(TinClass&, const char*);
+	bool MeasureExport(ofstream&, int, bool);
+	bool MeasureHeightQueries(ofstream&, int);
+	bool MeasureRayCasts(ofstream&, int);
+	void MeasureVertexCache(ofstream&);
+
+	float GetRate(int);
+
+private:
+	TerrainClass* m_Terrain;
+	TimerClass m_Timer;
+};
+
+#endif
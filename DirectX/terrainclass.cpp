@@ -6,11 +6,69 @@
 
 TerrainClass::TerrainClass()
 {
+	int i;
+
+
 	m_vertexBuffer = 0;
 	m_indexBuffer = 0;
+	m_roamIndexBuffer = 0;
 	m_terrainFilename = 0;
-	m_heightMap = 0;
+	m_importWidth = 0;
+	m_importHeight = 0;
+	m_importStep = 1;
+	m_sourceSize = 0;
+	m_sourceTime = 0;
+	m_heights = 0;
+	m_detailHeights = 0;
+	m_detailSize = 0;
+	m_normals = 0;
 	m_terrainModel = 0;
+	m_packedModel = 0;
+	m_VertexPack = 0;
+	m_Geomipmap = 0;
+	m_Roam = 0;
+	m_LodWorker = 0;
+	m_TileStream = 0;
+	m_HorizonCull = 0;
+	m_chunkBoxes = 0;
+	m_cellBoxes = 0;
+	m_horizonCulling = true;
+	m_ClusterCull = 0;
+	m_clusterCulling = true;
+	m_SplatMap = 0;
+	m_splatTexture = 0;
+	m_splatView = 0;
+	m_splatBuildTime = 0.0f;
+	m_frame = 0;
+	m_Arena = 0;
+	m_HeightPyramid = 0;
+	m_buildTime = 0.0f;
+	m_referenceBuildTime = 0.0f;
+	m_loadTime = 0.0f;
+	m_TerrainFile = 0;
+	m_chunks = 0;
+	m_dirtyRectCount = 0;
+	m_deformVertices = 0;
+	m_deformBytes = 0;
+	m_deformTime = 0.0f;
+	m_HorizonBake = 0;
+	m_bakeTime = 0.0f;
+	m_NormalMap = 0;
+	m_normalTexture = 0;
+	m_normalView = 0;
+	m_normalMapTime = 0.0f;
+	m_VertexLight = 0;
+	m_colorBuffer = 0;
+	m_flatColorBuffer = 0;
+	m_vertexLighting = TERRAIN_VERTEX_LIGHTING;
+	m_vertexLightTime = 0.0f;
+	m_vertexLightCount = 0;
+
+	for (i = 0; i < TERRAIN_BAKE_MAP_COUNT; i++)
+	{
+		m_bakeTextures[i] = 0;
+		m_bakeViews[i] = 0;
+	}
 }
 
 
@@ -23,37 +81,91 @@ TerrainClass::~TerrainClass()
 {
 }
 
-bool TerrainClass::Initialize(ID3D11Device* device)
+bool TerrainClass::Initialize(ID3D11Device* device, ArenaClass* arena)
 {
-	bool result;
+	INT64 frequency, startTime, endTime;
+	bool result, loaded, found;
+
+	// Temporary buffers of the frame loop come from the frame arena, the ones needed while loading are allocated and released here.
+	m_Arena = arena;
 
 	m_heightScale = 12.0;
 	m_terrainHeight = m_terrainWidth = 257;
-	result = LoadDiamondSquareHeightMap();
+	m_packedVertices = TERRAIN_PACKED_VERTICES;
+
+	// Time the whole load so mapping the binary file can be compared with building the terrain.
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	if (frequency == 0)
+	{
+		return false;
+	}
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+
+	// Read the setup file, without one the height map is generated at the default size.
+	result = LoadSetupFile(TERRAIN_SETUP_FILENAME, found);
 	if (!result)
 	{
 		return false;
 	}
 
-	// Setup the X and Z coordinates for the height map as well as scale the terrain height by the height scale value.
-	SetTerrainCoordinates();
+	// Size the terrain to fit the height map file before the binary file is checked against it.
+	if (found)
+	{
+		result = SetImportSize();
+		if (!result)
+		{
+			return false;
+		}
+	}
+
+	/*
+		Map the binary terrain file if there is one that matches, it only holds the packed vertices.
+		Only imported height maps are kept in the file, a generated terrain is seeded from the clock
+		and is different every run so there is nothing to reuse.
+	*/
+	loaded = false;
+	if (m_packedVertices && m_terrainFilename)
+	{
+		result = LoadTerrainFile(TERRAIN_BINARY_FILENAME, loaded);
+		if (!result)
+		{
+			return false;
+		}
+	}
+
+	if (!loaded)
+	{
+		// Generate the height map and build everything from it.
+		result = BuildTerrain();
+		if (!result)
+		{
+			return false;
+		}
+
+		// Save what was just built so the next run can map it, without the file the next run simply builds again.
+		if (m_packedVertices && m_terrainFilename)
+		{
+			WriteTerrainFile(TERRAIN_BINARY_FILENAME);
+		}
+	}
 
-	// Calculate the normals for the terrain data.
-	result = CalculateNormals();
+	// Build the bintree used by the incremental ROAM mode.
+	result = InitializeRoam();
 	if (!result)
 	{
 		return false;
 	}
 
-	// Now build the 3D model of the terrain.
-	result = BuildTerrainModel();
+	// Measure how far every geomipmap level strays from the heights for the screen error mode.
+	result = m_Geomipmap->ComputeErrors(m_heights);
 	if (!result)
 	{
 		return false;
 	}
 
-	// We can now release the height map since it is no longer needed in memory once the 3D terrain model has been built.
-	//ShutdownHeightMap();
+	// Start with the geomipmap mode.
+	m_terrainMode = TERRAIN_MODE_GEOMIPMAP;
 
 	// Load the rendering buffers with the terrain data.
 	result = InitializeBuffers(device);
@@ -62,23 +174,225 @@ bool TerrainClass::Initialize(ID3D11Device* device)
 		return false;
 	}
 
+	// Work out the material weights and load them into the splat map texture.
+	result = InitializeSplatMap(device);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Bake the horizons and the ambient occlusion the light shader samples.
+	result = InitializeBake(device);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Load the normal map into a texture with all of its mips.
+	result = InitializeNormalMap(device);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Create the per vertex lighting used in place of the light shader, it is lit once the first light is set.
+	result = InitializeVertexLight(device);
+	if (!result)
+	{
+		return false;
+	}
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+	m_loadTime = (float)(endTime - startTime) * 1000.0f / (float)frequency;
+
 	// Release the terrain model now that the rendering buffers have been loaded.
 	ShutdownTerrainModel();
 
+	// Create the LOD worker object.
+	m_LodWorker = new LodWorkerClass;
+	if (!m_LodWorker)
+	{
+		return false;
+	}
+
+	// Start the worker thread, from now on only the worker touches the geomipmap and ROAM objects.
+	result = m_LodWorker->Initialize(m_Geomipmap, m_Roam);
+	if (!result)
+	{
+		return false;
+	}
+
+	// The ROAM index buffer holds version 0 of the indices.
+	m_roamVersion = 0;
+
+	// Create the horizon cull object and the chunk boxes it is given every frame.
+	m_HorizonCull = new HorizonCullClass;
+	if (!m_HorizonCull)
+	{
+		return false;
+	}
+
+	result = m_HorizonCull->Initialize(GetChunkCount());
+	if (!result)
+	{
+		return false;
+	}
+
+	m_chunkBoxes = new HorizonCullClass::BoxType[GetChunkCount()];
+	if (!m_chunkBoxes)
+	{
+		return false;
+	}
+
+	// Each chunk is also handed over as the height pyramid nodes it is made of, they hide a lot more than the chunk box.
+	m_cellsPerChunk = (GEOMIPMAP_PATCH_SIZE >> TERRAIN_HORIZON_CELL_LEVEL) * (GEOMIPMAP_PATCH_SIZE >> TERRAIN_HORIZON_CELL_LEVEL);
+
+	m_cellBoxes = new HorizonCullClass::BoxType[GetChunkCount() * m_cellsPerChunk];
+	if (!m_cellBoxes)
+	{
+		return false;
+	}
+
+	// Create the cluster cull object.
+	m_ClusterCull = new ClusterCullClass;
+	if (!m_ClusterCull)
+	{
+		return false;
+	}
+
+	// Bound the clusters of every patch level, they split the index sets of the geomipmap.
+	result = m_ClusterCull->Initialize(m_heights, m_terrainWidth, m_terrainHeight, m_Geomipmap);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Stream the tiles around this terrain, they share its vertex packing and index pool so they need the same size.
+	if (m_packedVertices && (m_terrainWidth == (TILE_STREAM_TILE_SIZE + 1)) && (m_terrainHeight == (TILE_STREAM_TILE_SIZE + 1)))
+	{
+		// Create the tile stream object.
+		m_TileStream = new TileStreamClass;
+		if (!m_TileStream)
+		{
+			return false;
+		}
+
+		// Initialize the tile stream object, this terrain takes the place of tile (0, 0).
+		result = m_TileStream->Initialize(device, m_VertexPack, m_Geomipmap, 0, 0);
+		if (!result)
+		{
+			return false;
+		}
+	}
+
 	return true;
 }
 
 void TerrainClass::Shutdown()
 {
+	// Stop the tile stream threads, they use the vertex pack object.
+	if (m_TileStream)
+	{
+		m_TileStream->Shutdown();
+		delete m_TileStream;
+		m_TileStream = 0;
+	}
+
+	// Stop the LOD worker before anything it uses is released.
+	if (m_LodWorker)
+	{
+		m_LodWorker->Shutdown();
+		delete m_LodWorker;
+		m_LodWorker = 0;
+	}
+
+	// Release the horizon cull object and its boxes.
+	if (m_cellBoxes)
+	{
+		delete[] m_cellBoxes;
+		m_cellBoxes = 0;
+	}
+
+	if (m_chunkBoxes)
+	{
+		delete[] m_chunkBoxes;
+		m_chunkBoxes = 0;
+	}
+
+	if (m_HorizonCull)
+	{
+		m_HorizonCull->Shutdown();
+		delete m_HorizonCull;
+		m_HorizonCull = 0;
+	}
+
+	// Release the cluster cull object.
+	if (m_ClusterCull)
+	{
+		m_ClusterCull->Shutdown();
+		delete m_ClusterCull;
+		m_ClusterCull = 0;
+	}
+
+	// Release the per vertex lighting, it reads the baked maps.
+	ShutdownVertexLight();
+
+	// Release the normal map, its texels can be in the terrain file.
+	ShutdownNormalMap();
+
+	// Release the baked lighting maps.
+	ShutdownBake();
+
+	// Release the splat map.
+	ShutdownSplatMap();
+
 	// Release the rendering buffers.
 	ShutdownBuffers();
 
 	// Release the terrain model.
 	ShutdownTerrainModel();
 
+	// Release the vertex pack object.
+	if (m_VertexPack)
+	{
+		delete m_VertexPack;
+		m_VertexPack = 0;
+	}
+
+	// Release the ROAM object.
+	if (m_Roam)
+	{
+		m_Roam->Shutdown();
+		delete m_Roam;
+		m_Roam = 0;
+	}
+
+	// Release the geomipmap object.
+	if (m_Geomipmap)
+	{
+		m_Geomipmap->Shutdown();
+		delete m_Geomipmap;
+		m_Geomipmap = 0;
+	}
+
+	// Release the height pyramid object, it points into the height map.
+	if (m_HeightPyramid)
+	{
+		m_HeightPyramid->Shutdown();
+		delete m_HeightPyramid;
+		m_HeightPyramid = 0;
+	}
+
 	// Release the height map.
 	ShutdownHeightMap();
 
+	// Release the terrain filename.
+	if (m_terrainFilename)
+	{
+		delete[] m_terrainFilename;
+		m_terrainFilename = 0;
+	}
+
 
 	return;
 }
@@ -86,695 +400,3153 @@ void TerrainClass::Shutdown()
 
 bool TerrainClass::Render(ID3D11DeviceContext* deviceContext, CameraClass* camera)
 {
-	// Put the vertex and index buffers on the graphics pipeline to prepare them for drawing.
+	// Put the vertex and index buffers on the graphics pipeline and draw the patches.
 	RenderBuffers(deviceContext, camera);
 
 	return true;
 }
 
 
-int TerrainClass::GetIndexCount()
-{
-	return m_indexCount;
-}
+int TerrainClass::GetIndexCount()
+{
+	return m_indexCount;
+}
+
+
+void TerrainClass::SetTerrainMode(int mode)
+{
+	m_terrainMode = mode;
+	return;
+}
+
+
+int TerrainClass::GetTerrainMode()
+{
+	return m_terrainMode;
+}
+
+
+void TerrainClass::SetLodTarget(XMMATRIX projectionMatrix, int screenHeight, float maxError, int triangleBudget)
+{
+	XMFLOAT4X4 projection;
+
+
+	// An error of one unit at distance one spans _22 half screens, so this many pixels.
+	XMStoreFloat4x4(&projection, projectionMatrix);
+	m_LodWorker->SetErrorTarget(projection._22 * (float)screenHeight / 2.0f, maxError, triangleBudget);
+
+	return;
+}
+
+
+void TerrainClass::GetLodStats(float& screenError, int& triangleCount)
+{
+	// Largest error in pixels and the triangle count the LOD reached in the frame being drawn.
+	screenError = 0.0f;
+	triangleCount = 0;
+
+	if (m_frame)
+	{
+		screenError = m_frame->screenError;
+		triangleCount = m_frame->triangleCount;
+	}
+
+	return;
+}
+
+
+bool TerrainClass::IsPacked()
+{
+	return m_packedVertices;
+}
+
+
+XMFLOAT4 TerrainClass::GetPackedDecode()
+{
+	if (!m_VertexPack)
+	{
+		return XMFLOAT4(1.0f, 0.0f, 1.0f, 0.0f);
+	}
+
+	return m_VertexPack->GetDecodeParameters();
+}
+
+
+void TerrainClass::GetPackingError(float& heightError, float& normalError)
+{
+	// Largest height difference and normal angle in degrees measured after packing.
+	heightError = m_packingHeightError;
+	normalError = m_packingNormalError;
+	return;
+}
+
+
+void TerrainClass::MeasureVertexCache(int cacheSize, bool lru, float& acmr, float& atvr)
+{
+	acmr = 0.0f;
+	atvr = 0.0f;
+
+	// Simulate the vertex cache over the patches drawn in the last geomipmap frame.
+	if (m_frame && ((m_frame->mode == TERRAIN_MODE_GEOMIPMAP) || (m_frame->mode == TERRAIN_MODE_SCREEN_ERROR)))
+	{
+		m_Geomipmap->MeasureCache(m_frame->draws, m_frame->drawCount, cacheSize, lru, m_Arena, acmr, atvr);
+	}
+
+	return;
+}
+
+
+void TerrainClass::GetLodLatency(float& average, float& maximum)
+{
+	// Milliseconds from handing the camera to the worker until its frame was published.
+	average = m_LodWorker->GetAverageLatency();
+	maximum = m_LodWorker->GetMaxLatency();
+	return;
+}
+
+
+int TerrainClass::GetStaleFrameCount()
+{
+	return m_LodWorker->GetStaleFrameCount();
+}
+
+void TerrainClass::GetBuildTime(float& fused, float& reference)
+{
+	// The reference time is only measured in debug builds.
+	fused = m_buildTime;
+	reference = m_referenceBuildTime;
+	return;
+}
+
+void TerrainClass::GetLoadTime(float& load, bool& mapped)
+{
+	// Milliseconds from the start of Initialize until the rendering buffers were loaded.
+	load = m_loadTime;
+	mapped = (m_TerrainFile != 0);
+	return;
+}
+
+void TerrainClass::GetStreamingStats(float& averageLatency, float& maxLatency, float& hitRate, int& residentBytes)
+{
+	averageLatency = 0.0f;
+	maxLatency = 0.0f;
+	hitRate = 0.0f;
+	residentBytes = 0;
+
+	// Latencies are in milliseconds from asking for a tile until it was uploaded.
+	if (m_TileStream)
+	{
+		averageLatency = m_TileStream->GetAverageLatency();
+		maxLatency = m_TileStream->GetMaxLatency();
+		hitRate = m_TileStream->GetHitRate();
+		residentBytes = m_TileStream->GetResidentBytes();
+	}
+
+	return;
+}
+
+bool TerrainClass::ExportMesh(const char* filename, int format, bool quantized, bool lod)
+{
+	MeshExportClass meshExport;
+	GeomipmapClass::PatchDrawType* draws;
+	int i;
+	bool result;
+	ScratchClass scratch(m_Arena);
+
+
+	// The exporter only needs the resident heights and normals, it streams the file out a buffer at a time.
+	result = meshExport.Initialize(m_heights, m_normals, m_terrainWidth, m_terrainHeight);
+	if (!result)
+	{
+		meshExport.Shutdown();
+		return false;
+	}
+
+	if (lod)
+	{
+		// The triangles of the frame being drawn, in whichever mode the worker built it.
+		if (!m_frame)
+		{
+			result = false;
+		}
+		else if (m_frame->mode == TERRAIN_MODE_ROAM)
+		{
+			result = meshExport.Export(filename, format, quantized, m_frame->indices, m_frame->indexCount);
+		}
+		else
+		{
+			result = meshExport.Export(filename, format, quantized, m_Geomipmap, m_frame->draws, m_frame->drawCount);
+		}
+	}
+	else
+	{
+		// The full resolution model is every patch at level 0 with no stitching.
+		draws = scratch.AllocateArray<GeomipmapClass::PatchDrawType>(m_chunkCountX * m_chunkCountZ);
+		result = (draws != 0);
+
+		if (result)
+		{
+			for (i = 0; i < (m_chunkCountX * m_chunkCountZ); i++)
+			{
+				m_Geomipmap->GetLevelDraw(0, 0, draws[i]);
+				draws[i].baseVertex = m_chunks[i].baseVertex;
+			}
+
+			result = meshExport.Export(filename, format, quantized, m_Geomipmap, draws, m_chunkCountX * m_chunkCountZ);
+		}
+	}
+
+	meshExport.Shutdown();
+
+	return result;
+}
+
+
+int TerrainClass::GetTerrainWidth()
+{
+	return m_terrainWidth;
+}
+
+int TerrainClass::GetTerrainHeight()
+{
+	return m_terrainHeight;
+}
+
+const float* TerrainClass::GetHeights()
+{
+	return m_heights;
+}
+
+float TerrainClass::GetHeight(int i, int j)
+{
+	return m_heights[(j * m_terrainWidth) + i];
+}
+
+XMFLOAT3 TerrainClass::GetPosition(int i, int j)
+{
+	// Row 0 is the far edge of the terrain, the same as the vertex buffer.
+	return XMFLOAT3((float)i, m_heights[(j * m_terrainWidth) + i], (float)(m_terrainHeight - 1 - j));
+}
+
+XMFLOAT3 TerrainClass::GetNormal(int i, int j)
+{
+	VectorType normal;
+
+
+	if (m_normals)
+	{
+		return VertexPackClass::DecodeNormal(m_normals[(j * m_terrainWidth) + i]);
+	}
+
+	// Without resident normals work it out from the heights around the vertex.
+	CalculateBorderNormal(m_heights, i, j, normal);
+
+	return XMFLOAT3(normal.x, normal.y, normal.z);
+}
+
+int TerrainClass::GetChunkCount()
+{
+	return m_chunkCountX * m_chunkCountZ;
+}
+
+void TerrainClass::GetChunkBounds(int chunk, XMFLOAT3& boxMin, XMFLOAT3& boxMax)
+{
+	int row, column;
+
+
+	// The chunks are the patches in row order, rows run towards negative z.
+	row = (chunk / m_chunkCountX) * GEOMIPMAP_PATCH_SIZE;
+	column = (chunk % m_chunkCountX) * GEOMIPMAP_PATCH_SIZE;
+
+	boxMin = XMFLOAT3((float)column, m_chunks[chunk].minHeight, (float)(m_terrainHeight - 1 - row - GEOMIPMAP_PATCH_SIZE));
+	boxMax = XMFLOAT3((float)(column + GEOMIPMAP_PATCH_SIZE), m_chunks[chunk].maxHeight, (float)(m_terrainHeight - 1 - row));
+	return;
+}
+
+
+void TerrainClass::SetHorizonCulling(bool enabled)
+{
+	m_horizonCulling = enabled;
+	return;
+}
+
+
+ID3D11ShaderResourceView* TerrainClass::GetSplatMap()
+{
+	return m_splatView;
+}
+
+
+float TerrainClass::GetSplatBuildTime()
+{
+	return m_splatBuildTime;
+}
+
+
+float TerrainClass::GetBakeTime()
+{
+	return m_bakeTime;
+}
+
+
+float TerrainClass::GetNormalMapTime()
+{
+	return m_normalMapTime;
+}
+
+
+void TerrainClass::SetVertexLighting(bool enabled)
+{
+	m_vertexLighting = enabled;
+	return;
+}
+
+
+bool TerrainClass::IsVertexLighting()
+{
+	return m_vertexLighting;
+}
+
+
+void TerrainClass::SetLight(XMFLOAT3 direction, XMFLOAT4 ambientColor, XMFLOAT4 diffuseColor)
+{
+	// The vertices are only lit again when the light really changed.
+	m_VertexLight->SetLight(direction, ambientColor, diffuseColor);
+	return;
+}
+
+
+float TerrainClass::GetVertexLightTime()
+{
+	return m_vertexLightTime;
+}
+
+
+int TerrainClass::GetVertexLightCount()
+{
+	return m_vertexLightCount;
+}
+
+
+void TerrainClass::GetHorizonCullStats(float& culled, float& averageCulled)
+{
+	// Percentages of the chunks skipped, in the last culled frame and over all of them.
+	culled = m_HorizonCull->GetCulledPercentage();
+	averageCulled = m_HorizonCull->GetAverageCulledPercentage();
+	return;
+}
+
+
+void TerrainClass::SetClusterCulling(bool enabled)
+{
+	m_clusterCulling = enabled;
+	return;
+}
+
+
+void TerrainClass::GetClusterCullStats(int& testedTriangles, int& backFacingTriangles, int& outsideTriangles)
+{
+	// Triangles of the clusters tested in the last frame and how many of them were skipped for each reason.
+	m_ClusterCull->GetStats(testedTriangles, backFacingTriangles, outsideTriangles);
+	return;
+}
+
+
+void TerrainClass::ConstructFrustum(XMMATRIX viewMatrix, XMMATRIX projectionMatrix)
+{
+	// The clusters are culled against the frustum of this frame's camera.
+	m_ClusterCull->ConstructFrustum(XMMatrixMultiply(viewMatrix, projectionMatrix));
+	return;
+}
+
+
+bool TerrainClass::GetHeightAt(float x, float z, int filter, float& height)
+{
+	int column, row, index;
+	float rowPosition, u, v, h00, h10, h01, h11, top, bottom;
+
+
+	// There is no ground outside of the terrain.
+	if ((x < 0.0f) || (z < 0.0f) || (x > (float)(m_terrainWidth - 1)) || (z > (float)(m_terrainHeight - 1)))
+	{
+		return false;
+	}
+
+	// Find the grid cell, row 0 is the far edge of the terrain and the far edges belong to the last cell.
+	rowPosition = (float)(m_terrainHeight - 1) - z;
+
+	column = (int)x;
+	if (column > (m_terrainWidth - 2))
+	{
+		column = m_terrainWidth - 2;
+	}
+
+	row = (int)rowPosition;
+	if (row > (m_terrainHeight - 2))
+	{
+		row = m_terrainHeight - 2;
+	}
+
+	u = x - (float)column;
+	v = rowPosition - (float)row;
+
+	// Get the heights of the four corners.
+	index = (row * m_terrainWidth) + column;
+	h00 = m_heights[index];
+	h10 = m_heights[index + 1];
+	h01 = m_heights[index + m_terrainWidth];
+	h11 = m_heights[index + m_terrainWidth + 1];
+
+	if (filter == TERRAIN_HEIGHT_BILINEAR)
+	{
+		top = h00 + (u * (h10 - h00));
+		bottom = h01 + (u * (h11 - h01));
+		height = top + (v * (bottom - top));
+		return true;
+	}
+
+	/*
+		The full detail mesh is a union jack, the diagonal of a cell depends on the parity of
+		its grid position the same way the geomipmap fans and the ROAM bintree split it.
+		Even cells go from (0, 0) to (1, 1), odd cells from (1, 0) to (0, 1).
+	*/
+	if (((column + row) & 1) == 0)
+	{
+		if (u >= v)
+		{
+			height = h00 + (u * (h10 - h00)) + (v * (h11 - h10));
+		}
+		else
+		{
+			height = h00 + (v * (h01 - h00)) + (u * (h11 - h01));
+		}
+	}
+	else
+	{
+		if ((u + v) <= 1.0f)
+		{
+			height = h00 + (u * (h10 - h00)) + (v * (h01 - h00));
+		}
+		else
+		{
+			height = h11 + ((1.0f - u) * (h01 - h11)) + ((1.0f - v) * (h10 - h11));
+		}
+	}
+
+	return true;
+}
+
+static inline __m128 SelectFloats(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+void TerrainClass::GetHeightsAt(const float* x, const float* z, float* heights, int count, int filter)
+{
+	int i, k;
+	int indices[4];
+	float clampedX, clampedZ;
+	__m128 maxX, maxZ, lastColumn, lastRow, width, one, xv, rowv, column, row, u, v;
+	__m128 h00, h10, h01, h11, top, bottom, even, evenHeight, oddHeight;
+	__m128i parity;
+
+
+	/*
+		Four points at a time. The points are clamped to the terrain instead of being rejected.
+		SSE2 has no gather or 32 bit integer multiply, so the cell index is worked out in floats
+		(exact for any grid under 2^24 vertices) and the sixteen corner heights are loaded one by one.
+	*/
+	maxX = _mm_set1_ps((float)(m_terrainWidth - 1));
+	maxZ = _mm_set1_ps((float)(m_terrainHeight - 1));
+	lastColumn = _mm_set1_ps((float)(m_terrainWidth - 2));
+	lastRow = _mm_set1_ps((float)(m_terrainHeight - 2));
+	width = _mm_set1_ps((float)m_terrainWidth);
+	one = _mm_set1_ps(1.0f);
+
+	for (i = 0; (i + 4) <= count; i += 4)
+	{
+		xv = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(x + i), _mm_setzero_ps()), maxX);
+		rowv = _mm_sub_ps(maxZ, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(z + i), _mm_setzero_ps()), maxZ));
+
+		// The coordinates are positive so truncation is the floor.
+		column = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(xv)), lastColumn);
+		row = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(rowv)), lastRow);
+
+		u = _mm_sub_ps(xv, column);
+		v = _mm_sub_ps(rowv, row);
+
+		_mm_storeu_si128((__m128i*)indices, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(row, width), column)));
+
+		h00 = _mm_set_ps(m_heights[indices[3]], m_heights[indices[2]], m_heights[indices[1]], m_heights[indices[0]]);
+		h10 = _mm_set_ps(m_heights[indices[3] + 1], m_heights[indices[2] + 1], m_heights[indices[1] + 1], m_heights[indices[0] + 1]);
+		h01 = _mm_set_ps(m_heights[indices[3] + m_terrainWidth], m_heights[indices[2] + m_terrainWidth], m_heights[indices[1] + m_terrainWidth],
+			m_heights[indices[0] + m_terrainWidth]);
+		h11 = _mm_set_ps(m_heights[indices[3] + m_terrainWidth + 1], m_heights[indices[2] + m_terrainWidth + 1], m_heights[indices[1] + m_terrainWidth + 1],
+			m_heights[indices[0] + m_terrainWidth + 1]);
+
+		if (filter == TERRAIN_HEIGHT_BILINEAR)
+		{
+			top = _mm_add_ps(h00, _mm_mul_ps(u, _mm_sub_ps(h10, h00)));
+			bottom = _mm_add_ps(h01, _mm_mul_ps(u, _mm_sub_ps(h11, h01)));
+			_mm_storeu_ps(heights + i, _mm_add_ps(top, _mm_mul_ps(v, _mm_sub_ps(bottom, top))));
+			continue;
+		}
+
+		// Work out both triangles of both diagonals and keep the one each point is in.
+		evenHeight = SelectFloats(_mm_cmpge_ps(u, v),
+			_mm_add_ps(_mm_add_ps(h00, _mm_mul_ps(u, _mm_sub_ps(h10, h00))), _mm_mul_ps(v, _mm_sub_ps(h11, h10))),
+			_mm_add_ps(_mm_add_ps(h00, _mm_mul_ps(v, _mm_sub_ps(h01, h00))), _mm_mul_ps(u, _mm_sub_ps(h11, h01))));
+
+		oddHeight = SelectFloats(_mm_cmple_ps(_mm_add_ps(u, v), one),
+			_mm_add_ps(_mm_add_ps(h00, _mm_mul_ps(u, _mm_sub_ps(h10, h00))), _mm_mul_ps(v, _mm_sub_ps(h01, h00))),
+			_mm_add_ps(_mm_add_ps(h11, _mm_mul_ps(_mm_sub_ps(one, u), _mm_sub_ps(h01, h11))), _mm_mul_ps(_mm_sub_ps(one, v), _mm_sub_ps(h10, h11))));
+
+		parity = _mm_and_si128(_mm_add_epi32(_mm_cvttps_epi32(column), _mm_cvttps_epi32(row)), _mm_set1_epi32(1));
+		even = _mm_castsi128_ps(_mm_cmpeq_epi32(parity, _mm_setzero_si128()));
+
+		_mm_storeu_ps(heights + i, SelectFloats(even, evenHeight, oddHeight));
+	}
+
+	// Finish the points that did not fill a group of four.
+	for (k = i; k < count; k++)
+	{
+		clampedX = (x[k] < 0.0f) ? 0.0f : ((x[k] > (float)(m_terrainWidth - 1)) ? (float)(m_terrainWidth - 1) : x[k]);
+		clampedZ = (z[k] < 0.0f) ? 0.0f : ((z[k] > (float)(m_terrainHeight - 1)) ? (float)(m_terrainHeight - 1) : z[k]);
+
+		GetHeightAt(clampedX, clampedZ, filter, heights[k]);
+	}
+
+	return;
+}
+
+bool TerrainClass::IntersectRay(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, float& distance)
+{
+	// The pyramid works in the same space as the vertices, the terrain is drawn with an identity world matrix.
+	return m_HeightPyramid->IntersectRay(origin, direction, maxDistance, distance);
+}
+
+void TerrainClass::IntersectRays(const HeightPyramidClass::RayType* rays, int count, float* distances)
+{
+	m_HeightPyramid->IntersectRays(rays, count, distances);
+	return;
+}
+
+bool TerrainClass::Deform(float x, float z, float radius, float strength, int brush)
+{
+	int i, j, index, left, top, right, bottom, chunkLeft, chunkTop, chunkRight, chunkBottom;
+	float extent, rowPosition, dx, dz, t, falloff, rim, target, minHeight, maxHeight, height;
+	bool result;
+
+
+	if (radius <= 0.0f)
+	{
+		return false;
+	}
+
+	// The crater rim reaches out to one and a half times the radius.
+	extent = (brush == TERRAIN_BRUSH_CRATER) ? radius * 1.5f : radius;
+
+	// Find the grid rectangle under the brush, rows run against z.
+	rowPosition = (float)(m_terrainHeight - 1) - z;
+
+	left = (int)ceilf(x - extent);
+	right = (int)floorf(x + extent);
+	top = (int)ceilf(rowPosition - extent);
+	bottom = (int)floorf(rowPosition + extent);
+
+	left = (left > 0) ? left : 0;
+	top = (top > 0) ? top : 0;
+	right = (right < (m_terrainWidth - 1)) ? right : (m_terrainWidth - 1);
+	bottom = (bottom < (m_terrainHeight - 1)) ? bottom : (m_terrainHeight - 1);
+
+	if ((left > right) || (top > bottom))
+	{
+		return false;
+	}
+
+	// Flattening pulls everything towards the height under the center of the brush.
+	target = 0.0f;
+	if (brush == TERRAIN_BRUSH_FLATTEN)
+	{
+		result = GetHeightAt(x, z, TERRAIN_HEIGHT_TRIANGLE, target);
+		if (!result)
+		{
+			return false;
+		}
+	}
+
+	/*
+		Packed heights can only hold the range the vertex pack was set up with, the brushes stop
+		at its floor and ceiling. The range reaches half the height of the terrain above and
+		below the heights it was built with, the streamed tiles are packed with it as well so it
+		is not moved while the terrain is up.
+	*/
+	minHeight = -FLT_MAX;
+	maxHeight = FLT_MAX;
+	if (m_packedVertices)
+	{
+		m_VertexPack->GetHeightRange(minHeight, maxHeight);
+	}
+
+	for (j = top; j <= bottom; j++)
+	{
+		for (i = left; i <= right; i++)
+		{
+			dx = (float)i - x;
+			dz = (float)j - rowPosition;
+			t = sqrtf((dx * dx) + (dz * dz)) / radius;
+			if ((t * radius) > extent)
+			{
+				continue;
+			}
+
+			index = (m_terrainWidth * j) + i;
+			height = m_heights[index];
+
+			// Smooth falloff to zero at the edge of the brush.
+			falloff = (t < 1.0f) ? (1.0f - (t * t)) * (1.0f - (t * t)) : 0.0f;
+
+			switch (brush)
+			{
+				case TERRAIN_BRUSH_RAISE:
+					height += strength * falloff;
+					break;
+
+				case TERRAIN_BRUSH_LOWER:
+					height -= strength * falloff;
+					break;
+
+				case TERRAIN_BRUSH_FLATTEN:
+					height += (target - height) * ((strength < 1.0f) ? strength : 1.0f) * falloff;
+					break;
+
+				case TERRAIN_BRUSH_CRATER:
+					// A bowl strength deep in the middle and a rim a quarter as high around the edge.
+					rim = 1.0f - (((t - 1.0f) / 0.5f) * ((t - 1.0f) / 0.5f));
+					height += strength * 0.25f * ((rim > 0.0f) ? rim : 0.0f);
+					if (t < 1.0f)
+					{
+						height += strength * ((t * t) - 1.0f);
+					}
+					break;
+
+				default:
+					return false;
+			}
+
+			m_heights[index] = (height < minHeight) ? minHeight : ((height > maxHeight) ? maxHeight : height);
+		}
+	}
+
+	// Height queries and ray casts see the change straight away.
+	m_HeightPyramid->UpdateRegion(left, top, right, bottom);
+
+	// The chunks touching the rectangle, a column or row on a patch border belongs to both sides.
+	chunkLeft = (left > 0) ? (left - 1) / GEOMIPMAP_PATCH_SIZE : 0;
+	chunkTop = (top > 0) ? (top - 1) / GEOMIPMAP_PATCH_SIZE : 0;
+	chunkRight = right / GEOMIPMAP_PATCH_SIZE;
+	chunkBottom = bottom / GEOMIPMAP_PATCH_SIZE;
+
+	chunkRight = (chunkRight < m_chunkCountX) ? chunkRight : (m_chunkCountX - 1);
+	chunkBottom = (chunkBottom < m_chunkCountZ) ? chunkBottom : (m_chunkCountZ - 1);
+
+	for (j = chunkTop; j <= chunkBottom; j++)
+	{
+		for (i = chunkLeft; i <= chunkRight; i++)
+		{
+			UpdateChunk((m_chunkCountX * j) + i);
+		}
+	}
+
+	// The normals and the vertex buffer are brought up to date once per frame for all the edits.
+	AddDirtyRect(left, top, right, bottom);
+
+	return true;
+}
+
+
+void TerrainClass::GetDeformationCost(int& vertices, int& bytes, float& time)
+{
+	// Vertices rebuilt, bytes uploaded and milliseconds spent by the last frame that had edits.
+	vertices = m_deformVertices;
+	bytes = m_deformBytes;
+	time = m_deformTime;
+	return;
+}
+
+
+bool TerrainClass::InitializeRoam()
+{
+	bool result;
+
+
+	// The bintree covers a square terrain.
+	if (m_terrainWidth != m_terrainHeight)
+	{
+		return false;
+	}
+
+	// Create the ROAM object.
+	m_Roam = new RoamClass;
+	if (!m_Roam)
+	{
+		return false;
+	}
+
+	// Initialize the ROAM object, it keeps its own copy of the heights.
+	result = m_Roam->Initialize(m_heights, m_terrainWidth, ROAM_TRIANGLE_BUDGET);
+
+	return result;
+}
+
+
+bool TerrainClass::LoadSetupFile(const char* filename, bool& found)
+{
+	int stringLength;
+	ifstream fin;
+	char input;
+
+
+	found = false;
+
+	// Open the setup file, without one the terrain is generated.
+	fin.open(filename);
+	if (fin.fail())
+	{
+		return true;
+	}
+
+	// Initialize the string that will hold the terrain file name.
+	stringLength = 256;
+	m_terrainFilename = new char[stringLength];
+	if (!m_terrainFilename)
+	{
+		return false;
+	}
+
+	// Read up to the terrain file name.
+	fin.get(input);
+	while (fin.good() && (input != ':'))
+	{
+		fin.get(input);
+	}
+
+	// Read in the terrain file name.
+	fin.width(stringLength);
+	fin >> m_terrainFilename;
+
+	// Read up to the value of terrain height.
+	fin.get(input);
+	while (fin.good() && (input != ':'))
+	{
+		fin.get(input);
+	}
+
+	// Read in the terrain height, 0 takes it from the file.
+	fin >> m_importHeight;
+
+	// Read up to the value of terrain width.
+	fin.get(input);
+	while (fin.good() && (input != ':'))
+	{
+		fin.get(input);
+	}
+
+	// Read in the terrain width.
+	fin >> m_importWidth;
+
+	// Read up to the value of terrain height scaling.
+	fin.get(input);
+	while (fin.good() && (input != ':'))
+	{
+		fin.get(input);
+	}
+
+	// Read in the terrain height scaling.
+	fin >> m_heightScale;
+
+	// A setup file that is there but cannot be read is an error, it is not silently replaced by a generated terrain.
+	if (fin.fail() || (m_heightScale <= 0.0f))
+	{
+		return false;
+	}
+
+	// Close the setup file.
+	fin.close();
+
+	found = true;
+
+	return true;
+}
+
+
+bool TerrainClass::SetImportSize()
+{
+	HeightImportClass heightImport;
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	int size, sampleCount;
+	bool result;
+
+
+	// Only the header is read here, the samples are streamed in when the terrain is built.
+	result = heightImport.Open(m_terrainFilename, m_importWidth, m_importHeight);
+	if (result)
+	{
+		m_importWidth = heightImport.GetWidth();
+		m_importHeight = heightImport.GetHeight();
+	}
+
+	heightImport.Close();
+
+	if (!result)
+	{
+		return false;
+	}
+
+	// The patch indices do not depend on the terrain size, only the memory the resident heights and vertices take limits it,
+	// bigger maps are filtered down by two, four or so as they are read.
+	m_importStep = 1;
+	while ((((m_importWidth + m_importStep - 1) / m_importStep) > TERRAIN_MAX_IMPORT_SIZE) ||
+		(((m_importHeight + m_importStep - 1) / m_importStep) > TERRAIN_MAX_IMPORT_SIZE))
+	{
+		m_importStep *= 2;
+	}
+
+	// The terrain is square with a power of two plus one vertices a side, the samples that do not fill it are padded.
+	sampleCount = (m_importWidth > m_importHeight) ? m_importWidth : m_importHeight;
+	sampleCount = (sampleCount + m_importStep - 1) / m_importStep;
+
+	size = GEOMIPMAP_PATCH_SIZE;
+	while ((size + 1) < sampleCount)
+	{
+		size *= 2;
+	}
+
+	m_terrainWidth = size + 1;
+	m_terrainHeight = size + 1;
+
+	// The binary terrain file is only used while the height map it was built from is unchanged.
+	if (!GetFileAttributesExA(m_terrainFilename, GetFileExInfoStandard, &attributes))
+	{
+		return false;
+	}
+
+	m_sourceSize = ((unsigned long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	m_sourceTime = ((unsigned long long)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+
+	return true;
+}
+
+
+bool TerrainClass::BuildTerrain()
+{
+	bool result;
+
+
+	// Import the height map named in the setup file, without one it is generated.
+	if (m_terrainFilename)
+	{
+		result = ImportHeightMap();
+	}
+	else
+	{
+		result = LoadDiamondSquareHeightMap();
+	}
+
+	if (!result)
+	{
+		return false;
+	}
+
+	// Build the 3D model of the terrain, this sets up the coordinates, scales the heights and calculates the normals in one pass.
+	result = BuildTerrainModel();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Create the height pyramid object.
+	m_HeightPyramid = new HeightPyramidClass;
+	if (!m_HeightPyramid)
+	{
+		return false;
+	}
+
+	// Build the minimum and maximum height levels used to cast rays against the terrain.
+	result = m_HeightPyramid->Initialize(m_heights, m_terrainWidth, m_terrainHeight);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Bake the normal map the light shader uses in place of the vertex normals.
+	result = BuildNormalMap();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Create the geomipmap object.
+	m_Geomipmap = new GeomipmapClass;
+	if (!m_Geomipmap)
+	{
+		return false;
+	}
+
+	// Initialize the geomipmap object, this builds the shared index pool for every patch level and stitch combination and lays out the
+	// patch strips of the vertex buffer.
+	result = m_Geomipmap->Initialize(m_terrainWidth, m_terrainHeight, GEOMIPMAP_PATCH_SIZE, GEOMIPMAP_LOD_DISTANCE);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Pack the model down to 8 bytes per vertex, the full model is kept until the buffers are loaded.
+	if (m_packedVertices)
+	{
+		result = BuildPackedModel();
+		if (!result)
+		{
+			return false;
+		}
+	}
+
+	// Store the height range of every patch.
+	result = BuildChunkTable();
+	if (!result)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+bool TerrainClass::LoadTerrainFile(const char* filename, bool& loaded)
+{
+	const TerrainFileClass::HeaderType* header;
+	bool result;
+
+
+	loaded = false;
+
+	// Create the terrain file object.
+	m_TerrainFile = new TerrainFileClass;
+	if (!m_TerrainFile)
+	{
+		return false;
+	}
+
+	// A missing, old or damaged file or one made for another terrain is rebuilt rather than failing the load.
+	result = m_TerrainFile->Open(filename);
+	if (result)
+	{
+		header = m_TerrainFile->GetHeader();
+		result = (header->width == m_terrainWidth) && (header->height == m_terrainHeight) && (header->heightScale == m_heightScale) &&
+			(header->patchSize == GEOMIPMAP_PATCH_SIZE) && (header->indexCount > 0) && (header->sourceSize == m_sourceSize) && (header->sourceTime == m_sourceTime);
+	}
+
+	if (!result)
+	{
+		m_TerrainFile->Close();
+		delete m_TerrainFile;
+		m_TerrainFile = 0;
+		return true;
+	}
+
+	// Everything below points straight into the mapped file, nothing is parsed or copied.
+	m_heights = (float*)m_TerrainFile->GetSection(TerrainFileClass::SECTION_HEIGHTS);
+	if (TERRAIN_RESIDENT_NORMALS)
+	{
+		m_normals = (unsigned short*)m_TerrainFile->GetSection(TerrainFileClass::SECTION_NORMALS);
+	}
+	m_packedModel = (VertexPackClass::PackedVertexType*)m_TerrainFile->GetSection(TerrainFileClass::SECTION_VERTICES);
+	m_chunks = (TerrainFileClass::ChunkType*)m_TerrainFile->GetSection(TerrainFileClass::SECTION_CHUNKS);
+	m_chunkCountX = header->chunkCountX;
+	m_chunkCountZ = header->chunkCountZ;
+
+	m_vertexCount = m_terrainWidth * m_terrainHeight;
+	m_packingHeightError = header->packingHeightError;
+	m_packingNormalError = header->packingNormalError;
+	m_buildTime = 0.0f;
+	m_referenceBuildTime = 0.0f;
+
+	// Create the vertex pack object with the decode parameters the vertices were packed with.
+	m_VertexPack = new VertexPackClass;
+	if (!m_VertexPack)
+	{
+		return false;
+	}
+
+	m_VertexPack->Initialize(header->minHeight, header->maxHeight, header->textureScale);
+
+	// Create the height pyramid object.
+	m_HeightPyramid = new HeightPyramidClass;
+	if (!m_HeightPyramid)
+	{
+		return false;
+	}
+
+	// Use the levels stored in the file.
+	result = m_HeightPyramid->Initialize(m_heights, m_terrainWidth, m_terrainHeight, (float*)m_TerrainFile->GetSection(TerrainFileClass::SECTION_MIN_HEIGHTS),
+		(float*)m_TerrainFile->GetSection(TerrainFileClass::SECTION_MAX_HEIGHTS));
+	if (!result || (m_HeightPyramid->GetLevelSize() != header->pyramidSize) || (m_HeightPyramid->GetLevelCount() != header->pyramidLevelCount))
+	{
+		return false;
+	}
+
+	// Create the normal map object.
+	m_NormalMap = new NormalMapClass;
+	if (!m_NormalMap)
+	{
+		return false;
+	}
+
+	// Use the baked levels stored in the file.
+	result = m_NormalMap->Initialize(header->normalMapSize, (float)(m_terrainWidth - 1), (unsigned short*)m_TerrainFile->GetSection(TerrainFileClass::SECTION_NORMAL_MAP));
+	if (!result)
+	{
+		return false;
+	}
+
+	// Create the geomipmap object.
+	m_Geomipmap = new GeomipmapClass;
+	if (!m_Geomipmap)
+	{
+		return false;
+	}
+
+	// Initialize the geomipmap object with the optimized index pool from the file.
+	result = m_Geomipmap->Initialize(m_terrainWidth, m_terrainHeight, GEOMIPMAP_PATCH_SIZE, GEOMIPMAP_LOD_DISTANCE,
+		(unsigned short*)m_TerrainFile->GetSection(TerrainFileClass::SECTION_INDICES), header->indexCount);
+	if (!result)
+	{
+		return false;
+	}
+
+	loaded = true;
+
+	return true;
+}
+
+
+bool TerrainClass::WriteTerrainFile(const char* filename)
+{
+	TerrainFileClass terrainFile;
+	TerrainFileClass::HeaderType header;
+	const void* sections[TerrainFileClass::SECTION_COUNT];
+	unsigned short* normals;
+	int i;
+	bool result;
+
+
+	// The normals are taken from the packed vertices so they are there even without resident normals, back in grid order.
+	normals = new unsigned short[m_vertexCount];
+	if (!normals)
+	{
+		return false;
+	}
+
+	for (i = 0; i < m_Geomipmap->GetVertexCount(); i++)
+	{
+		normals[m_Geomipmap->GetGridVertex(i)] = m_packedModel[i].normal;
+	}
+
+	// Fill in everything the loader needs to check and rebuild the objects.
+	memset(&header, 0, sizeof(header));
+	header.width = m_terrainWidth;
+	header.height = m_terrainHeight;
+	header.heightScale = m_heightScale;
+	m_VertexPack->GetHeightRange(header.minHeight, header.maxHeight);
+	header.textureScale = (float)TERRAIN_TEXTURE_REPEAT / (float)(m_terrainWidth - 1);
+	header.packingHeightError = m_packingHeightError;
+	header.packingNormalError = m_packingNormalError;
+	header.pyramidLevelCount = m_HeightPyramid->GetLevelCount();
+	header.pyramidSize = m_HeightPyramid->GetLevelSize();
+	header.patchSize = GEOMIPMAP_PATCH_SIZE;
+	header.chunkCountX = m_chunkCountX;
+	header.chunkCountZ = m_chunkCountZ;
+	header.indexCount = m_Geomipmap->GetIndexPoolSize();
+	header.normalMapSize = m_NormalMap->GetSize();
+	header.sourceSize = m_sourceSize;
+	header.sourceTime = m_sourceTime;
+
+	sections[TerrainFileClass::SECTION_HEIGHTS] = m_heights;
+	sections[TerrainFileClass::SECTION_NORMALS] = normals;
+	sections[TerrainFileClass::SECTION_MIN_HEIGHTS] = m_HeightPyramid->GetMinHeights();
+	sections[TerrainFileClass::SECTION_MAX_HEIGHTS] = m_HeightPyramid->GetMaxHeights();
+	sections[TerrainFileClass::SECTION_VERTICES] = m_packedModel;
+	sections[TerrainFileClass::SECTION_CHUNKS] = m_chunks;
+	sections[TerrainFileClass::SECTION_NORMAL_MAP] = m_NormalMap->GetTexels();
+	sections[TerrainFileClass::SECTION_INDICES] = m_Geomipmap->GetIndexPool();
+
+	result = terrainFile.Write(filename, header, sections);
+
+	// Release the normals.
+	delete[] normals;
+	normals = 0;
+
+	return result;
+}
+
+
+bool TerrainClass::BuildChunkTable()
+{
+	int chunk, i, j;
+
+
+	// There is one chunk for every geomipmap patch.
+	m_chunkCountX = (m_terrainWidth - 1) / GEOMIPMAP_PATCH_SIZE;
+	m_chunkCountZ = (m_terrainHeight - 1) / GEOMIPMAP_PATCH_SIZE;
+
+	m_chunks = new TerrainFileClass::ChunkType[m_chunkCountX * m_chunkCountZ];
+	if (!m_chunks)
+	{
+		return false;
+	}
+
+	for (j = 0; j < m_chunkCountZ; j++)
+	{
+		for (i = 0; i < m_chunkCountX; i++)
+		{
+			chunk = (m_chunkCountX * j) + i;
+
+			// The base vertex is the top left corner of the patch in its vertex buffer strip, the same as the geomipmap draws use.
+			m_chunks[chunk].baseVertex = m_Geomipmap->GetPatchBaseVertex(chunk);
+
+			UpdateChunk(chunk);
+		}
+	}
+
+	return true;
+}
+
+
+void TerrainClass::UpdateChunk(int chunk)
+{
+	int row, column, index, corner;
+	float height;
+
+
+	m_chunks[chunk].minHeight = FLT_MAX;
+	m_chunks[chunk].maxHeight = -FLT_MAX;
+
+	// The top left corner of the patch in the height grid.
+	corner = (m_terrainWidth * (chunk / m_chunkCountX) * GEOMIPMAP_PATCH_SIZE) + ((chunk % m_chunkCountX) * GEOMIPMAP_PATCH_SIZE);
+
+	// The patch shares its border vertices with its neighbours.
+	for (row = 0; row <= GEOMIPMAP_PATCH_SIZE; row++)
+	{
+		for (column = 0; column <= GEOMIPMAP_PATCH_SIZE; column++)
+		{
+			index = corner + (m_terrainWidth * row) + column;
+			height = m_heights[index];
+
+			m_chunks[chunk].minHeight = (height < m_chunks[chunk].minHeight) ? height : m_chunks[chunk].minHeight;
+			m_chunks[chunk].maxHeight = (height > m_chunks[chunk].maxHeight) ? height : m_chunks[chunk].maxHeight;
+		}
+	}
+
+	return;
+}
+
+
+void TerrainClass::AddDirtyRect(int left, int top, int right, int bottom)
+{
+	RectType rect;
+	int i, best, area, growth, bestGrowth;
+	bool merged;
+
+
+	rect.left = left;
+	rect.top = top;
+	rect.right = right;
+	rect.bottom = bottom;
+
+	/*
+		Merge the rectangle with any it overlaps once both have their one vertex border for the
+		normals, the union can then reach others so keep going until nothing else merges.
+	*/
+	merged = true;
+	while (merged)
+	{
+		merged = false;
+
+		for (i = 0; i < m_dirtyRectCount; i++)
+		{
+			if ((rect.left > (m_dirtyRects[i].right + 2)) || (rect.right < (m_dirtyRects[i].left - 2)) ||
+				(rect.top > (m_dirtyRects[i].bottom + 2)) || (rect.bottom < (m_dirtyRects[i].top - 2)))
+			{
+				continue;
+			}
+
+			rect.left = (m_dirtyRects[i].left < rect.left) ? m_dirtyRects[i].left : rect.left;
+			rect.top = (m_dirtyRects[i].top < rect.top) ? m_dirtyRects[i].top : rect.top;
+			rect.right = (m_dirtyRects[i].right > rect.right) ? m_dirtyRects[i].right : rect.right;
+			rect.bottom = (m_dirtyRects[i].bottom > rect.bottom) ? m_dirtyRects[i].bottom : rect.bottom;
+
+			// Take the merged one out of the list.
+			m_dirtyRects[i] = m_dirtyRects[m_dirtyRectCount - 1];
+			m_dirtyRectCount--;
+
+			merged = true;
+			break;
+		}
+	}
+
+	if (m_dirtyRectCount < TERRAIN_MAX_DIRTY_RECTS)
+	{
+		m_dirtyRects[m_dirtyRectCount] = rect;
+		m_dirtyRectCount++;
+		return;
+	}
+
+	// With the list full, grow whichever rectangle gets the least bigger to cover this one.
+	best = 0;
+	bestGrowth = 0;
+	for (i = 0; i < m_dirtyRectCount; i++)
+	{
+		area = (m_dirtyRects[i].right - m_dirtyRects[i].left + 1) * (m_dirtyRects[i].bottom - m_dirtyRects[i].top + 1);
+		growth = ((((m_dirtyRects[i].right > rect.right) ? m_dirtyRects[i].right : rect.right) - ((m_dirtyRects[i].left < rect.left) ? m_dirtyRects[i].left : rect.left) + 1) *
+			(((m_dirtyRects[i].bottom > rect.bottom) ? m_dirtyRects[i].bottom : rect.bottom) - ((m_dirtyRects[i].top < rect.top) ? m_dirtyRects[i].top : rect.top) + 1)) - area;
+
+		if ((i == 0) || (growth < bestGrowth))
+		{
+			best = i;
+			bestGrowth = growth;
+		}
+	}
+
+	m_dirtyRects[best].left = (m_dirtyRects[best].left < rect.left) ? m_dirtyRects[best].left : rect.left;
+	m_dirtyRects[best].top = (m_dirtyRects[best].top < rect.top) ? m_dirtyRects[best].top : rect.top;
+	m_dirtyRects[best].right = (m_dirtyRects[best].right > rect.right) ? m_dirtyRects[best].right : rect.right;
+	m_dirtyRects[best].bottom = (m_dirtyRects[best].bottom > rect.bottom) ? m_dirtyRects[best].bottom : rect.bottom;
+
+	return;
+}
+
+
+void TerrainClass::UpdateDeformation(ID3D11DeviceContext* deviceContext)
+{
+	INT64 frequency, startTime, endTime;
+	int i, j, left, top, right, bottom, mapLeft, mapTop, mapRight, mapBottom, level, levelSize;
+	D3D11_BOX box;
+
+
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+
+	m_deformVertices = 0;
+	m_deformBytes = 0;
+
+	for (i = 0; i < m_dirtyRectCount; i++)
+	{
+		// The normals of the vertices around the edited heights change as well.
+		left = (m_dirtyRects[i].left > 0) ? m_dirtyRects[i].left - 1 : 0;
+		top = (m_dirtyRects[i].top > 0) ? m_dirtyRects[i].top - 1 : 0;
+		right = (m_dirtyRects[i].right < (m_terrainWidth - 1)) ? m_dirtyRects[i].right + 1 : (m_terrainWidth - 1);
+		bottom = (m_dirtyRects[i].bottom < (m_terrainHeight - 1)) ? m_dirtyRects[i].bottom + 1 : (m_terrainHeight - 1);
+
+		// A row of the rectangle is a contiguous range of the vertex buffer.
+		for (j = top; j <= bottom; j++)
+		{
+			UpdateVertexRow(deviceContext, j, left, right);
+		}
+
+		// The material weights depend on the same neighbours as the normals.
+		m_SplatMap->Update(left, top, right, bottom);
+
+		box.left = left;
+		box.right = right + 1;
+		box.top = top;
+		box.bottom = bottom + 1;
+		box.front = 0;
+		box.back = 1;
+
+		deviceContext->UpdateSubresource(m_splatTexture, 0, &box, &m_SplatMap->GetWeights()[(top * m_terrainWidth) + left], m_SplatMap->GetRowPitch(), 0);
+		m_deformBytes += (right - left + 1) * (bottom - top + 1) * sizeof(unsigned int);
+
+		// The normal map is baked again from the deformed heights under the rectangle and every mip above it.
+		mapLeft = left;
+		mapTop = top;
+		mapRight = right;
+		mapBottom = bottom;
+		m_NormalMap->UpdateRegion(m_heights, m_terrainWidth, m_terrainHeight, mapLeft, mapTop, mapRight, mapBottom);
+
+		for (level = 0; (level < m_NormalMap->GetLevelCount()) && (mapLeft <= mapRight); level++)
+		{
+			levelSize = m_NormalMap->GetLevelSize(level);
+
+			box.left = mapLeft >> level;
+			box.right = (mapRight >> level) + 1;
+			box.top = mapTop >> level;
+			box.bottom = (mapBottom >> level) + 1;
+
+			deviceContext->UpdateSubresource(m_normalTexture, level, &box, &m_NormalMap->GetLevel(level)[(box.top * levelSize) + box.left], levelSize * sizeof(unsigned short), 0);
+			m_deformBytes += (box.right - box.left) * (box.bottom - box.top) * sizeof(unsigned short);
+		}
+
+		// The horizons change along every line through the rectangle, far outside of it.
+		m_HorizonBake->AddRect(left, top, right, bottom);
+
+		// The cluster bounds of the patches under the edited heights.
+		m_ClusterCull->UpdateRegion(m_heights, m_dirtyRects[i].left, m_dirtyRects[i].top, m_dirtyRects[i].right, m_dirtyRects[i].bottom);
+
+		// The level errors and height ranges the screen error mode selects from, the worker hands over the geomipmap while they change.
+		m_LodWorker->UpdateRegion(m_heights, m_dirtyRects[i].left, m_dirtyRects[i].top, m_dirtyRects[i].right, m_dirtyRects[i].bottom);
+	}
+
+	// Sweep the lines again and reload the blocks of the baked maps whose horizons changed.
+	if (m_dirtyRectCount > 0)
+	{
+		m_HorizonBake->Update();
+		UpdateBake(deviceContext);
+	}
+
+	m_dirtyRectCount = 0;
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+	m_deformTime = (frequency > 0) ? (float)(endTime - startTime) * 1000.0f / (float)frequency : 0.0f;
+
+	return;
+}
+
+
+void TerrainClass::UpdateBake(ID3D11DeviceContext* deviceContext)
+{
+	D3D11_BOX box;
+	int blockX, blockY, firstBlock, index;
+
+
+	box.front = 0;
+	box.back = 1;
+
+	// A run of changed blocks in a row of blocks goes up as one box into each of the three maps.
+	for (blockY = 0; blockY < m_HorizonBake->GetBlockCountY(); blockY++)
+	{
+		blockX = 0;
+		while (blockX < m_HorizonBake->GetBlockCountX())
+		{
+			if (!m_HorizonBake->IsBlockChanged(blockX, blockY))
+			{
+				blockX++;
+				continue;
+			}
+
+			firstBlock = blockX;
+			while ((blockX < m_HorizonBake->GetBlockCountX()) && m_HorizonBake->IsBlockChanged(blockX, blockY))
+			{
+				blockX++;
+			}
+
+			box.left = firstBlock * HORIZON_BAKE_BLOCK_SIZE;
+			box.right = ((blockX * HORIZON_BAKE_BLOCK_SIZE) < m_terrainWidth) ? (blockX * HORIZON_BAKE_BLOCK_SIZE) : m_terrainWidth;
+			box.top = blockY * HORIZON_BAKE_BLOCK_SIZE;
+			box.bottom = (((blockY + 1) * HORIZON_BAKE_BLOCK_SIZE) < m_terrainHeight) ? ((blockY + 1) * HORIZON_BAKE_BLOCK_SIZE) : m_terrainHeight;
+
+			index = (box.top * m_terrainWidth) + box.left;
+
+			deviceContext->UpdateSubresource(m_bakeTextures[0], 0, &box, &m_HorizonBake->GetOcclusion()[index], m_terrainWidth, 0);
+			deviceContext->UpdateSubresource(m_bakeTextures[1], 0, &box, &m_HorizonBake->GetHorizons(0)[index * 4], m_terrainWidth * 4, 0);
+			deviceContext->UpdateSubresource(m_bakeTextures[2], 0, &box, &m_HorizonBake->GetHorizons(1)[index * 4], m_terrainWidth * 4, 0);
+			m_deformBytes += (box.right - box.left) * (box.bottom - box.top) * (1 + HORIZON_BAKE_DIRECTIONS);
+
+			// The vertex colours hold the same occlusion and horizons, the vertices under the box are lit again before the next draw.
+			m_VertexLight->AddRect(box.left, box.top, box.right - 1, box.bottom - 1);
+		}
+	}
+
+	return;
+}
+
+
+void TerrainClass::UpdateVertexRow(ID3D11DeviceContext* deviceContext, int j, int first, int last)
+{
+	VectorType* normals;
+	VertexType* vertices;
+	VertexPackClass::PackedVertexType* packedVertices;
+	XMFLOAT3 position, normal;
+	D3D11_BOX box;
+	const void* source;
+	int i, count, index, strip, firstStrip, lastStrip, stripFirst, stripLast;
+	float textureScale;
+	ScratchClass scratch(m_Arena);
+
+
+	count = last - first + 1;
+
+	normals = scratch.AllocateArray<VectorType>(count);
+	if (!normals)
+	{
+		return;
+	}
+
+	// Calculate the normals for the span the same way as the full build.
+	CalculateNormalRow(m_heights, j, first, last + 1, normals);
+
+	// Only the span is rebuilt, the rest of the row is already in the vertex buffer.
+	textureScale = (float)TERRAIN_TEXTURE_REPEAT / (float)(m_terrainWidth - 1);
+
+	if (m_packedVertices)
+	{
+		packedVertices = scratch.AllocateArray<VertexPackClass::PackedVertexType>(count);
+		if (!packedVertices)
+		{
+			return;
+		}
+
+		source = packedVertices;
+	}
+	else
+	{
+		vertices = scratch.AllocateArray<VertexType>(count);
+		if (!vertices)
+		{
+			return;
+		}
+
+		source = vertices;
+	}
+
+	for (i = first; i <= last; i++)
+	{
+		index = (m_terrainWidth * j) + i;
+
+		position = XMFLOAT3((float)i, m_heights[index], (float)(m_terrainHeight - 1 - j));
+		normal = XMFLOAT3(normals[i - first].x, normals[i - first].y, normals[i - first].z);
+
+		if (m_normals)
+		{
+			m_normals[index] = VertexPackClass::EncodeNormal(normal);
+		}
+
+		m_VertexLight->SetNormal(index, normal);
+
+		if (m_packedVertices)
+		{
+			m_VertexPack->PackVertex(position, normal, packedVertices[i - first]);
+		}
+		else
+		{
+			vertices[i - first].position = position;
+			vertices[i - first].normal = normal;
+			vertices[i - first].texture = XMFLOAT2(position.x * textureScale, position.z * textureScale);
+		}
+	}
+
+	// Upload just the byte range of the span in every strip it crosses, a column on the border of two strips goes to both.
+	firstStrip = (first > 0) ? (first - 1) / GEOMIPMAP_PATCH_SIZE : 0;
+	lastStrip = last / GEOMIPMAP_PATCH_SIZE;
+	if (lastStrip >= m_Geomipmap->GetStripCount())
+	{
+		lastStrip = m_Geomipmap->GetStripCount() - 1;
+	}
+
+	for (strip = firstStrip; strip <= lastStrip; strip++)
+	{
+		stripFirst = (first > (strip * GEOMIPMAP_PATCH_SIZE)) ? first : (strip * GEOMIPMAP_PATCH_SIZE);
+		stripLast = (last < ((strip + 1) * GEOMIPMAP_PATCH_SIZE)) ? last : ((strip + 1) * GEOMIPMAP_PATCH_SIZE);
+
+		index = m_Geomipmap->GetStripVertex(strip, j) + (stripFirst - (strip * GEOMIPMAP_PATCH_SIZE));
+
+		box.left = index * m_vertexStride;
+		box.right = (index + stripLast - stripFirst + 1) * m_vertexStride;
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+
+		deviceContext->UpdateSubresource(m_vertexBuffer, 0, &box, (const unsigned char*)source + ((stripFirst - first) * m_vertexStride), 0, 0);
+
+		m_deformBytes += (stripLast - stripFirst + 1) * m_vertexStride;
+	}
+
+	m_deformVertices += count;
+
+	return;
+}
+
+
+bool TerrainClass::AllocateHeightMap()
+{
+	// The heights stay resident, the x and z coordinates come from the grid position.
+	m_heights = new float[m_terrainWidth * m_terrainHeight];
+	if (!m_heights)
+	{
+		return false;
+	}
+
+	// The normals are optional, without them they are worked out from the heights when asked for.
+	if (TERRAIN_RESIDENT_NORMALS)
+	{
+		m_normals = new unsigned short[m_terrainWidth * m_terrainHeight];
+		if (!m_normals)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool TerrainClass::ImportHeightMap()
+{
+	HeightImportClass heightImport;
+	bool result;
+
+
+	result = AllocateHeightMap();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Stream the file straight into the height map, it is never held in memory as a whole.
+	result = heightImport.Open(m_terrainFilename, m_importWidth, m_importHeight);
+	if (result)
+	{
+		result = heightImport.Read(m_heights, m_terrainWidth, m_terrainHeight, m_importStep);
+	}
+
+	heightImport.Close();
+
+	return result;
+}
+
+
+bool TerrainClass::LoadDiamondSquareHeightMap()
+{
+	int i, j, index;
+	bool result;
+
+
+	result = AllocateHeightMap();
+	if (!result)
+	{
+		return false;
+	}
+
+	// Generate the heights at the detail of the normal map, the vertices only take every few of them.
+	m_detailSize = ((m_terrainWidth - 1) * TERRAIN_NORMAL_MAP_DETAIL) + 1;
+
+	m_detailHeights = new float[m_detailSize * m_detailSize];
+	if (!m_detailHeights)
+	{
+		return false;
+	}
+
+	DiamondSquare ds(m_detailSize, 50, 0, 0);
+	double** map = ds.process();
+
+	// Read the image data into the full detail array.
+	for (j = 0; j < m_detailSize; j++)
+	{
+		for (i = 0; i < m_detailSize; i++)
+		{
+			// Bitmaps are upside down so load bottom to top into the height map array.
+			index = (m_detailSize * (m_detailSize - 1 - j)) + i;
+
+			m_detailHeights[index] = (float)map[j][i] - 200.0f; // should be 0 < x < 120
+		}
+	}
+
+	// The vertices sit on every detail-th sample, so the mesh has a sixteenth of the samples the normal map is baked from.
+	for (j = 0; j < m_terrainHeight; j++)
+	{
+		for (i = 0; i < m_terrainWidth; i++)
+		{
+			m_heights[(m_terrainWidth * j) + i] = m_detailHeights[(m_detailSize * j * TERRAIN_NORMAL_MAP_DETAIL) + (i * TERRAIN_NORMAL_MAP_DETAIL)];
+		}
+	}
+	
+	return true;
+}
+
+void TerrainClass::ShutdownHeightMap()
+{
+	// Mapped arrays go away with the terrain file.
+	if (m_TerrainFile)
+	{
+		m_heights = 0;
+		m_normals = 0;
+		m_chunks = 0;
+
+		m_TerrainFile->Close();
+		delete m_TerrainFile;
+		m_TerrainFile = 0;
+
+		return;
+	}
+
+	// Release the chunk table.
+	if (m_chunks)
+	{
+		delete[] m_chunks;
+		m_chunks = 0;
+	}
+
+	// Release the height map arrays.
+	if (m_detailHeights)
+	{
+		delete[] m_detailHeights;
+		m_detailHeights = 0;
+	}
+
+	if (m_normals)
+	{
+		delete[] m_normals;
+		m_normals = 0;
+	}
+
+	if (m_heights)
+	{
+		delete[] m_heights;
+		m_heights = 0;
+	}
+
+	return;
+}
+
+bool TerrainClass::BuildTerrainModel()
+{
+	INT64 frequency, startTime, endTime;
+	int tileColumns, tileRows;
+	ParallelForClass parallel;
+#ifdef _DEBUG
+	HeightMapType* reference;
+	int i;
+	bool result;
+#endif
+
+
+	// Get the cycles per second speed for the build timings.
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	if (frequency == 0)
+	{
+		return false;
+	}
+
+	// Calculate the number of vertices in the 3D terrain model.
+	m_vertexCount = (m_terrainHeight) * (m_terrainWidth);
+
+	// Create the 3D terrain model array.
+	m_terrainModel = new VertexType[m_vertexCount];
+	if (!m_terrainModel)
+	{
+		return false;
+	}
+
+	m_referenceBuildTime = 0.0f;
+
+#ifdef _DEBUG
+	// Run the old serial path on the old height map layout first so it can be timed and compared.
+	reference = new HeightMapType[m_vertexCount];
+	if (!reference)
+	{
+		return false;
+	}
+
+	for (i = 0; i < m_vertexCount; i++)
+	{
+		reference[i].y = m_heights[i];
+	}
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+
+	if (!BuildReferenceModel(reference))
+	{
+		delete[] reference;
+		return false;
+	}
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+	m_referenceBuildTime = ((float)(endTime - startTime) / (float)frequency) * 1000.0f;
+#endif
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+
+	// Scale the heights first, the normals of a tile read the rows around it.
+	parallel.Run(m_terrainHeight, TERRAIN_BUILD_TILE_SIZE, [&](int first, int last)
+	{
+		int index;
+
+
+		for (index = first * m_terrainWidth; index < (last * m_terrainWidth); index++)
+		{
+			m_heights[index] /= m_heightScale;
+		}
+	});
+
+	// Then every tile writes its finished normals and vertices in one pass.
+	tileColumns = (m_terrainWidth + TERRAIN_BUILD_TILE_SIZE - 1) / TERRAIN_BUILD_TILE_SIZE;
+	tileRows = (m_terrainHeight + TERRAIN_BUILD_TILE_SIZE - 1) / TERRAIN_BUILD_TILE_SIZE;
+
+	parallel.Run(tileColumns * tileRows, 1, [&](int first, int last)
+	{
+		int tile;
+
+
+		for (tile = first; tile < last; tile++)
+		{
+			BuildTerrainTile((tile % tileColumns) * TERRAIN_BUILD_TILE_SIZE, (tile / tileColumns) * TERRAIN_BUILD_TILE_SIZE);
+		}
+	});
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+	m_buildTime = ((float)(endTime - startTime) / (float)frequency) * 1000.0f;
+
+#ifdef _DEBUG
+	// The fused pass has to give the same positions and normals as the serial one.
+	result = CheckTerrainModel(reference);
+
+	// Release the reference height map.
+	delete[] reference;
+	reference = 0;
+
+	if (!result)
+	{
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+void TerrainClass::BuildTerrainTile(int tileX, int tileY)
+{
+	int i, j, index, lastX, lastY;
+	float textureScale, x, z;
+	VectorType normals[TERRAIN_BUILD_TILE_SIZE];
+
+
+	lastX = (tileX + TERRAIN_BUILD_TILE_SIZE < m_terrainWidth) ? tileX + TERRAIN_BUILD_TILE_SIZE : m_terrainWidth;
+	lastY = (tileY + TERRAIN_BUILD_TILE_SIZE < m_terrainHeight) ? tileY + TERRAIN_BUILD_TILE_SIZE : m_terrainHeight;
+
+	// The texture repeats TERRAIN_TEXTURE_REPEAT times over the terrain, the same as the packed vertices.
+	textureScale = (float)TERRAIN_TEXTURE_REPEAT / (float)(m_terrainWidth - 1);
+
+	for (j = tileY; j < lastY; j++)
+	{
+		// Calculate the normals for this row of the tile.
+		CalculateNormalRow(m_heights, j, tileX, lastX, normals);
+
+		// Move the terrain depth into the positive range.  For example from (0, -256) to (256, 0).
+		z = (float)(m_terrainHeight - 1 - j);
+
+		for (i = tileX; i < lastX; i++)
+		{
+			index = (m_terrainWidth * j) + i;
+			x = (float)i;
+
+			// Keep the normal in the same 16 bit octahedral form as the packed vertices.
+			if (m_normals)
+			{
+				m_normals[index] = VertexPackClass::EncodeNormal(XMFLOAT3(normals[i - tileX].x, normals[i - tileX].y, normals[i - tileX].z));
+			}
+
+			// Write the finished vertex, the texture coordinates only depend on the grid position.
+			m_terrainModel[index].position = XMFLOAT3(x, m_heights[index], z);
+			m_terrainModel[index].normal = XMFLOAT3(normals[i - tileX].x, normals[i - tileX].y, normals[i - tileX].z);
+			m_terrainModel[index].texture = XMFLOAT2(x * textureScale, z * textureScale);
+		}
+	}
+
+	return;
+}
+
+bool TerrainClass::BuildPackedModel()
+{
+	int i, index;
+	float minHeight, maxHeight, headroom;
+
+
+	// Find the height range so the 16 bit heights cover only what the terrain uses.
+	minHeight = maxHeight = m_terrainModel[0].position.y;
+	for (i = 1; i < m_vertexCount; i++)
+	{
+		if (m_terrainModel[i].position.y < minHeight)
+		{
+			minHeight = m_terrainModel[i].position.y;
+		}
+
+		if (m_terrainModel[i].position.y > maxHeight)
+		{
+			maxHeight = m_terrainModel[i].position.y;
+		}
+	}
+
+	// Create the vertex pack object.
+	m_VertexPack = new VertexPackClass;
+	if (!m_VertexPack)
+	{
+		return false;
+	}
+
+	// Leave room above and below it for the deformation brushes.
+	headroom = (maxHeight - minHeight) * TERRAIN_PACKED_HEIGHT_HEADROOM;
+
+	// The texture repeats the same number of times as the full model, the sampler wraps it.
+	m_VertexPack->Initialize(minHeight - headroom, maxHeight + headroom, (float)TERRAIN_TEXTURE_REPEAT / (float)(m_terrainWidth - 1));
+
+	// Create the packed model array, it is laid out in the patch strips of the vertex buffer so it is loaded as it is.
+	m_packedModel = new VertexPackClass::PackedVertexType[m_Geomipmap->GetVertexCount()];
+	if (!m_packedModel)
+	{
+		return false;
+	}
+
+	// Pack every vertex of the full model, the columns shared by two strips are packed twice.
+	for (i = 0; i < m_Geomipmap->GetVertexCount(); i++)
+	{
+		index = m_Geomipmap->GetGridVertex(i);
+		m_VertexPack->PackVertex(m_terrainModel[index].position, m_terrainModel[index].normal, m_packedModel[i]);
+	}
+
+	// Check the packed vertices against the full model.
+	MeasurePackingError();
+
+#ifdef _DEBUG
+	// Half a height step and the octahedral normal precision are the most the packing may lose.
+	if ((m_packingHeightError > (m_VertexPack->GetHeightStep() * 0.5f) + 0.0001f) || (m_packingNormalError > TERRAIN_PACKED_NORMAL_TOLERANCE))
+	{
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+
+void TerrainClass::MeasurePackingError()
+{
+	XMFLOAT3 position, normal;
+	XMFLOAT2 texture;
+	int i, index;
+	float error, dot;
+
+
+	m_packingHeightError = 0.0f;
+	m_packingNormalError = 0.0f;
+
+	// Unpack every vertex the same way the shader does and keep the largest differences.
+	for (i = 0; i < m_Geomipmap->GetVertexCount(); i++)
+	{
+		m_VertexPack->UnpackVertex(m_packedModel[i], position, normal, texture);
+		index = m_Geomipmap->GetGridVertex(i);
+
+		error = fabsf(position.y - m_terrainModel[index].position.y);
+		if ((position.x != m_terrainModel[index].position.x) || (position.z != m_terrainModel[index].position.z))
+		{
+			error = FLT_MAX;
+		}
+
+		if (error > m_packingHeightError)
+		{
+			m_packingHeightError = error;
+		}
+
+		dot = (normal.x * m_terrainModel[index].normal.x) + (normal.y * m_terrainModel[index].normal.y) + (normal.z * m_terrainModel[index].normal.z);
+		if (dot > 1.0f)
+		{
+			dot = 1.0f;
+		}
+
+		error = XMConvertToDegrees(acosf(dot));
+		if (error > m_packingNormalError)
+		{
+			m_packingNormalError = error;
+		}
+	}
+
+	return;
+}
+
+void TerrainClass::ShutdownTerrainModel()
+{
+	// Release the packed model data, unless it is part of the mapped terrain file.
+	if (m_packedModel && !m_TerrainFile)
+	{
+		delete[] m_packedModel;
+	}
+	m_packedModel = 0;
+
+	// Release the terrain model data.
+	if (m_terrainModel)
+	{
+		delete[] m_terrainModel;
+		m_terrainModel = 0;
+	}
+	return;
+}
+
+bool TerrainClass::InitializeBuffers(ID3D11Device* device)
+{
+	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA vertexData, indexData;
+	HRESULT result;
+	XMFLOAT4 color;
+	VertexType* stripModel;
+	unsigned long* roamIndices;
+
+	// The packed model is a quarter of the size of the full one.
+	if (m_packedVertices)
+	{
+		m_vertexStride = sizeof(VertexPackClass::PackedVertexType);
+	}
+	else
+	{
+		m_vertexStride = sizeof(VertexType);
+	}
+
+	// Set up the description of the static vertex buffer, it holds the grid in the patch strips of the geomipmap.
+	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	vertexBufferDesc.ByteWidth = m_vertexStride * m_Geomipmap->GetVertexCount();
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+
+	// Give the subresource structure a pointer to the vertex data, the packed model is already in strips and the full one is copied into them.
+	stripModel = 0;
+	if (m_packedVertices)
+	{
+		vertexData.pSysMem = m_packedModel;
+	}
+	else
+	{
+		stripModel = new VertexType[m_Geomipmap->GetVertexCount()];
+		if (!stripModel)
+		{
+			return false;
+		}
+
+		CopyToStrips(m_terrainModel, sizeof(VertexType), stripModel);
+		vertexData.pSysMem = stripModel;
+	}
+	vertexData.SysMemPitch = 0;
+	vertexData.SysMemSlicePitch = 0;
+	
+	// Create the vertex buffer with data from the terrain model
+	result = device->CreateBuffer(&vertexBufferDesc, &vertexData, &m_vertexBuffer);
+
+	// Release the strip copy of the full model.
+	if (stripModel)
+	{
+		delete[] stripModel;
+		stripModel = 0;
+	}
+
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Set up the description of the static index buffer holding the shared geomipmap index pool, the indices are 16 bit.
+	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	indexBufferDesc.ByteWidth = sizeof(unsigned short) * m_Geomipmap->GetIndexPoolSize();
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+
+	// Give the subresource structure a pointer to the index data.
+	indexData.pSysMem = m_Geomipmap->GetIndexPool();
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+
+	// Create the index buffer, it never changes after this point.
+	result = device->CreateBuffer(&indexBufferDesc, &indexData, &m_indexBuffer);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Set up the description of the ROAM index buffer, it is patched in place as triangles split and merge.
+	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	indexBufferDesc.ByteWidth = sizeof(unsigned long) * m_Roam->GetMaxIndexCount();
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+
+	// The ROAM triangles index the grid, they are moved over to the strips of the vertex buffer as they are uploaded.
+	roamIndices = new unsigned long[m_Roam->GetMaxIndexCount()];
+	if (!roamIndices)
+	{
+		return false;
+	}
+
+	RemapRoamIndices(m_Roam->GetIndices(), m_Roam->GetMaxIndexCount(), roamIndices);
+
+	// Give the subresource structure a pointer to the current ROAM triangulation.
+	indexData.pSysMem = roamIndices;
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+
+	// Create the ROAM index buffer.
+	result = device->CreateBuffer(&indexBufferDesc, &indexData, &m_roamIndexBuffer);
+
+	delete[] roamIndices;
+	roamIndices = 0;
+
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// The whole array has been uploaded.
+	m_Roam->ClearDirtyRange();
+
+	m_indexCount = 0;
+
+	return true;
+}
+
+
+void TerrainClass::ShutdownBuffers()
+{
+	// Release the ROAM index buffer.
+	if (m_roamIndexBuffer)
+	{
+		m_roamIndexBuffer->Release();
+		m_roamIndexBuffer = 0;
+	}
+
+	// Release the index buffer.
+	if(m_indexBuffer)
+	{
+		m_indexBuffer->Release();
+		m_indexBuffer = 0;
+	}
+
+	// Release the vertex buffer.
+	if(m_vertexBuffer)
+	{
+		m_vertexBuffer->Release();
+		m_vertexBuffer = 0;
+	}
+
+	return;
+}
+
+
+void TerrainClass::CopyToStrips(const void* source, int stride, void* destination)
+{
+	int strip;
+
+
+	// Every strip gets all of the rows of its columns.
+	for (strip = 0; strip < m_Geomipmap->GetStripCount(); strip++)
+	{
+		CopyStripRows(source, stride, strip, 0, m_terrainHeight - 1, (unsigned char*)destination + (m_Geomipmap->GetStripVertex(strip, 0) * stride));
+	}
+
+	return;
+}
+
+
+void TerrainClass::CopyStripRows(const void* source, int stride, int strip, int firstRow, int lastRow, void* destination)
+{
+	int row, rowSize;
+	const unsigned char* grid;
+	unsigned char* output;
+
+
+	// A strip row is the patchSize + 1 grid vertices starting at the strip's first column.
+	rowSize = (GEOMIPMAP_PATCH_SIZE + 1) * stride;
+	grid = (const unsigned char*)source + (((firstRow * m_terrainWidth) + (strip * GEOMIPMAP_PATCH_SIZE)) * stride);
+	output = (unsigned char*)destination;
+
+	for (row = firstRow; row <= lastRow; row++)
+	{
+		memcpy(output, grid, rowSize);
+
+		grid += m_terrainWidth * stride;
+		output += rowSize;
+	}
+
+	return;
+}
+
+
+void TerrainClass::UploadStripRows(ID3D11DeviceContext* deviceContext, ID3D11Buffer* buffer, const void* source, int stride, int firstRow, int lastRow,
+	int firstColumn, int lastColumn)
+{
+	D3D11_BOX box;
+	void* rows;
+	int strip, firstStrip, lastStrip;
+	ScratchClass scratch(m_Arena);
+
+
+	// The strips holding the columns, a column on the border of two strips is in both.
+	firstStrip = (firstColumn > 0) ? (firstColumn - 1) / GEOMIPMAP_PATCH_SIZE : 0;
+	lastStrip = lastColumn / GEOMIPMAP_PATCH_SIZE;
+	if (lastStrip >= m_Geomipmap->GetStripCount())
+	{
+		lastStrip = m_Geomipmap->GetStripCount() - 1;
+	}
+
+	rows = scratch.AllocateArray<unsigned char>((lastRow - firstRow + 1) * (GEOMIPMAP_PATCH_SIZE + 1) * stride);
+	if (!rows)
+	{
+		return;
+	}
+
+	// The rows of a strip follow each other in the buffer so each strip goes up as one range.
+	for (strip = firstStrip; strip <= lastStrip; strip++)
+	{
+		CopyStripRows(source, stride, strip, firstRow, lastRow, rows);
+
+		box.left = m_Geomipmap->GetStripVertex(strip, firstRow) * stride;
+		box.right = m_Geomipmap->GetStripVertex(strip, lastRow + 1) * stride;
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+
+		deviceContext->UpdateSubresource(buffer, 0, &box, rows, 0, 0);
+	}
+
+	return;
+}
+
+
+void TerrainClass::RemapRoamIndices(const unsigned long* source, int indexCount, unsigned long* destination)
+{
+	int i;
+
+
+	for (i = 0; i < indexCount; i++)
+	{
+		destination[i] = m_Geomipmap->GetBufferVertex(source[i]);
+	}
+
+	return;
+}
+
+
+bool TerrainClass::CreateMapTexture(ID3D11Device* device, DXGI_FORMAT format, const void* data, int rowPitch, ID3D11Texture2D** texture,
+	ID3D11ShaderResourceView** view)
+{
+	D3D11_TEXTURE2D_DESC textureDesc;
+	D3D11_SUBRESOURCE_DATA textureData;
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	HRESULT result;
+
+
+	// Setup the description of a texture with one texel per vertex.
+	textureDesc.Width = m_terrainWidth;
+	textureDesc.Height = m_terrainHeight;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = format;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT; // to use UpdateSubresource
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+
+	textureData.pSysMem = data;
+	textureData.SysMemPitch = rowPitch;
+	textureData.SysMemSlicePitch = 0;
+
+	// Create the texture with the data.
+	result = device->CreateTexture2D(&textureDesc, &textureData, texture);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Setup the shader resource view description.
+	viewDesc.Format = textureDesc.Format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	viewDesc.Texture2D.MostDetailedMip = 0;
+	viewDesc.Texture2D.MipLevels = 1;
+
+	// Create the shader resource view for the texture.
+	result = device->CreateShaderResourceView(*texture, &viewDesc, view);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+bool TerrainClass::InitializeSplatMap(ID3D11Device* device)
+{
+	INT64 frequency, startTime, endTime;
+	bool result;
+
+
+	// Create the splat map object.
+	m_SplatMap = new SplatMapClass;
+	if (!m_SplatMap)
+	{
+		return false;
+	}
+
+	// Work out the weights of every vertex from the resident heights, timed for the report.
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+
+	result = m_SplatMap->Initialize(m_heights, m_terrainWidth, m_terrainHeight, m_HeightPyramid->GetMinHeight(), m_HeightPyramid->GetMaxHeight());
+	if (!result)
+	{
+		return false;
+	}
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+	m_splatBuildTime = (frequency > 0) ? (float)(endTime - startTime) * 1000.0f / (float)frequency : 0.0f;
+
+	// Load the weights into a texture with one texel per vertex, so deformed rectangles map straight onto it.
+	result = CreateMapTexture(device, DXGI_FORMAT_R8G8B8A8_UNORM, m_SplatMap->GetWeights(), m_SplatMap->GetRowPitch(), &m_splatTexture, &m_splatView);
+	if (!result)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+void TerrainClass::ShutdownSplatMap()
+{
+	// Release the splat map view and texture.
+	if (m_splatView)
+	{
+		m_splatView->Release();
+		m_splatView = 0;
+	}
+
+	if (m_splatTexture)
+	{
+		m_splatTexture->Release();
+		m_splatTexture = 0;
+	}
+
+	// Release the splat map object.
+	if (m_SplatMap)
+	{
+		m_SplatMap->Shutdown();
+		delete m_SplatMap;
+		m_SplatMap = 0;
+	}
+
+	return;
+}
+
+
+bool TerrainClass::InitializeBake(ID3D11Device* device)
+{
+	INT64 frequency, startTime, endTime;
+	bool result;
+
+
+	// Create the horizon bake object.
+	m_HorizonBake = new HorizonBakeClass;
+	if (!m_HorizonBake)
+	{
+		return false;
+	}
+
+	// Sweep the horizons of every vertex and work out the occlusion, timed for the report.
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+
+	result = m_HorizonBake->Initialize(m_heights, m_terrainWidth, m_terrainHeight);
+	if (!result)
+	{
+		return false;
+	}
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+	m_bakeTime = (frequency > 0) ? (float)(endTime - startTime) * 1000.0f / (float)frequency : 0.0f;
+
+	// The occlusion in one byte, then the eight horizons in two RGBA planes.
+	result = CreateMapTexture(device, DXGI_FORMAT_R8_UNORM, m_HorizonBake->GetOcclusion(), m_terrainWidth, &m_bakeTextures[0], &m_bakeViews[0]);
+	if (!result)
+	{
+		return false;
+	}
+
+	result = CreateMapTexture(device, DXGI_FORMAT_R8G8B8A8_UNORM, m_HorizonBake->GetHorizons(0), m_terrainWidth * 4, &m_bakeTextures[1], &m_bakeViews[1]);
+	if (!result)
+	{
+		return false;
+	}
+
+	result = CreateMapTexture(device, DXGI_FORMAT_R8G8B8A8_UNORM, m_HorizonBake->GetHorizons(1), m_terrainWidth * 4, &m_bakeTextures[2], &m_bakeViews[2]);
+	if (!result)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+void TerrainClass::ShutdownBake()
+{
+	int i;
+
+
+	// Release the baked map views and textures.
+	for (i = 0; i < TERRAIN_BAKE_MAP_COUNT; i++)
+	{
+		if (m_bakeViews[i])
+		{
+			m_bakeViews[i]->Release();
+			m_bakeViews[i] = 0;
+		}
+
+		if (m_bakeTextures[i])
+		{
+			m_bakeTextures[i]->Release();
+			m_bakeTextures[i] = 0;
+		}
+	}
+
+	// Release the horizon bake object.
+	if (m_HorizonBake)
+	{
+		m_HorizonBake->Shutdown();
+		delete m_HorizonBake;
+		m_HorizonBake = 0;
+	}
+
+	return;
+}
+
+
+bool TerrainClass::BuildNormalMap()
+{
+	HeightImportClass heightImport;
+	INT64 frequency, startTime, endTime;
+	float* heights;
+	int detail, size, bandHeight, band, i;
+	bool result;
+
+
+	// Create the normal map object.
+	m_NormalMap = new NormalMapClass;
+	if (!m_NormalMap)
+	{
+		return false;
+	}
+
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+
+	// An imported map that was filtered down to fit the vertices still has the samples in the file, up to four times as many a side go into the normal map.
+	detail = 1;
+	if (m_terrainFilename)
+	{
+		detail = (m_importStep < TERRAIN_NORMAL_MAP_DETAIL) ? m_importStep : TERRAIN_NORMAL_MAP_DETAIL;
+	}
+
+	// The map is one texture, it can be no wider than Direct3D 11 allows.
+	while ((detail > 1) && (((m_terrainWidth - 1) * detail) > TERRAIN_NORMAL_MAP_MAX_SIZE))
+	{
+		detail /= 2;
+	}
+
+	// A generated terrain kept the heights it was generated at, they are only needed for the bake.
+	if (m_detailHeights)
+	{
+		// Scale the heights the same way as the vertices.
+		for (i = 0; i < (m_detailSize * m_detailSize); i++)
+		{
+			m_detailHeights[i] /= m_heightScale;
+		}
+
+		result = m_NormalMap->Initialize(m_detailHeights, m_detailSize, m_detailSize, (float)(m_terrainWidth - 1));
+
+		delete[] m_detailHeights;
+		m_detailHeights = 0;
+
+		if (!result)
+		{
+			return false;
+		}
+	}
+
+	// An imported map without more samples than vertices keeps one texel per cell, the coarse patches still get the full detail.
+	else if (detail == 1)
+	{
+		result = m_NormalMap->Initialize(m_heights, m_terrainWidth, m_terrainHeight, (float)(m_terrainWidth - 1));
+		if (!result)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		size = ((m_terrainWidth - 1) * detail) + 1;
+
+		result = m_NormalMap->InitializeBands(size - 1, (float)(m_terrainWidth - 1));
+		if (!result)
+		{
+			return false;
+		}
+
+		// The detail heights are never held as a whole, only one band of them and the row below it.
+		bandHeight = m_NormalMap->GetBandHeight();
+
+		heights = new float[(bandHeight + 1) * size];
+		if (!heights)
+		{
+			return false;
+		}
+
+		// Stream the file in again with the smaller step, the vertices sit on every detail-th texel of it.
+		result = heightImport.Open(m_terrainFilename, m_importWidth, m_importHeight);
+
+		for (band = 0; result && (band < m_NormalMap->GetBandCount()); band++)
+		{
+			result = heightImport.ReadBand(heights, size, size, m_importStep / detail, band * bandHeight, bandHeight + 1);
+			if (result)
+			{
+				// Scale the heights the same way as the vertices.
+				for (i = 0; i < ((bandHeight + 1) * size); i++)
+				{
+					heights[i] /= m_heightScale;
+				}
+
+				m_NormalMap->BakeBand(heights, band);
+			}
+		}
+
+		heightImport.Close();
+
+		delete[] heights;
+
+		if (!result)
+		{
+			return false;
+		}
+
+		m_NormalMap->FinishBands();
+	}
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+	m_normalMapTime = (frequency > 0) ? (float)(endTime - startTime) * 1000.0f / (float)frequency : 0.0f;
+
+	return true;
+}
+
+
+bool TerrainClass::InitializeNormalMap(ID3D11Device* device)
+{
+	D3D11_TEXTURE2D_DESC textureDesc;
+	D3D11_SUBRESOURCE_DATA levelData[NORMAL_MAP_MAX_LEVELS];
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	HRESULT result;
+	int level;
+
+
+	// Setup the description of the normal map texture, the x and z of the normal in two channels and every mip level.
+	textureDesc.Width = m_NormalMap->GetSize();
+	textureDesc.Height = m_NormalMap->GetSize();
+	textureDesc.MipLevels = m_NormalMap->GetLevelCount();
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R8G8_UNORM;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT; // to use UpdateSubresource
+	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+
+	for (level = 0; level < m_NormalMap->GetLevelCount(); level++)
+	{
+		levelData[level].pSysMem = m_NormalMap->GetLevel(level);
+		levelData[level].SysMemPitch = m_NormalMap->GetLevelSize(level) * sizeof(unsigned short);
+		levelData[level].SysMemSlicePitch = 0;
+	}
+
+	// Create the texture with the data of every level.
+	result = device->CreateTexture2D(&textureDesc, levelData, &m_normalTexture);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Setup the shader resource view description.
+	viewDesc.Format = textureDesc.Format;
+	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	viewDesc.Texture2D.MostDetailedMip = 0;
+	viewDesc.Texture2D.MipLevels = textureDesc.MipLevels;
+
+	// Create the shader resource view for the texture.
+	result = device->CreateShaderResourceView(m_normalTexture, &viewDesc, &m_normalView);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+void TerrainClass::ShutdownNormalMap()
+{
+	// Release the normal map view and texture.
+	if (m_normalView)
+	{
+		m_normalView->Release();
+		m_normalView = 0;
+	}
+
+	if (m_normalTexture)
+	{
+		m_normalTexture->Release();
+		m_normalTexture = 0;
+	}
+
+	// Release the normal map object.
+	if (m_NormalMap)
+	{
+		m_NormalMap->Shutdown();
+		delete m_NormalMap;
+		m_NormalMap = 0;
+	}
+
+	return;
+}
+
+
+bool TerrainClass::InitializeVertexLight(ID3D11Device* device)
+{
+	D3D11_BUFFER_DESC colorBufferDesc;
+	D3D11_SUBRESOURCE_DATA colorData;
+	HRESULT result;
+	unsigned int flatColor;
+	unsigned int* stripColors;
+	int i, j;
+	bool initialized;
+
+
+	// Create the vertex light object, it reads the occlusion and horizons straight from the bake.
+	m_VertexLight = new VertexLightClass;
+	if (!m_VertexLight)
+	{
+		return false;
+	}
+
+	initialized = m_VertexLight->Initialize(m_terrainWidth, m_terrainHeight, m_HorizonBake->GetOcclusion(), m_HorizonBake->GetHorizons(0), m_HorizonBake->GetHorizons(1));
+	if (!initialized)
+	{
+		return false;
+	}
+
+	// Hand over the normals, deformed vertices pass their new ones in as they are rebuilt.
+	for (j = 0; j < m_terrainHeight; j++)
+	{
+		for (i = 0; i < m_terrainWidth; i++)
+		{
+			m_VertexLight->SetNormal((j * m_terrainWidth) + i, GetNormal(i, j));
+		}
+	}
+
+	// Set up the description of the colour buffer, the second vertex stream with one RGBA8 colour per vertex in the same strips as the first.
+	colorBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	colorBufferDesc.ByteWidth = sizeof(unsigned int) * m_Geomipmap->GetVertexCount();
+	colorBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	colorBufferDesc.CPUAccessFlags = 0;
+	colorBufferDesc.MiscFlags = 0;
+	colorBufferDesc.StructureByteStride = 0;
+
+	// The colours are lit in grid order.
+	stripColors = new unsigned int[m_Geomipmap->GetVertexCount()];
+	if (!stripColors)
+	{
+		return false;
+	}
+
+	CopyToStrips(m_VertexLight->GetColors(), sizeof(unsigned int), stripColors);
+
+	colorData.pSysMem = stripColors;
+	colorData.SysMemPitch = 0;
+	colorData.SysMemSlicePitch = 0;
+
+	// Create the colour buffer, it is filled in once the first light is set.
+	result = device->CreateBuffer(&colorBufferDesc, &colorData, &m_colorBuffer);
+
+	delete[] stripColors;
+	stripColors = 0;
+
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// The streamed tiles have no baked maps, they read a single flat ground colour with a zero stride.
+	flatColor = 0;
+
+	colorBufferDesc.ByteWidth = sizeof(unsigned int);
+	colorData.pSysMem = &flatColor;
+
+	result = device->CreateBuffer(&colorBufferDesc, &colorData, &m_flatColorBuffer);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+void TerrainClass::ShutdownVertexLight()
+{
+	// Release the colour buffers.
+	if (m_flatColorBuffer)
+	{
+		m_flatColorBuffer->Release();
+		m_flatColorBuffer = 0;
+	}
+
+	if (m_colorBuffer)
+	{
+		m_colorBuffer->Release();
+		m_colorBuffer = 0;
+	}
+
+	// Release the vertex light object.
+	if (m_VertexLight)
+	{
+		m_VertexLight->Shutdown();
+		delete m_VertexLight;
+		m_VertexLight = 0;
+	}
+
+	return;
+}
+
+
+void TerrainClass::UpdateVertexLight(ID3D11DeviceContext* deviceContext)
+{
+	INT64 frequency, startTime, endTime;
+	unsigned int flatColor;
+	int blockX, blockY, firstBlock, top, bottom, left, right;
+
+
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+
+	// Light the blocks that changed since the last frame, usually none.
+	if (!m_VertexLight->Update(m_vertexLightCount))
+	{
+		return;
+	}
+
+	// Upload each run of lit blocks in a row of blocks, the rows of the strips under it.
+	for (blockY = 0; blockY < m_VertexLight->GetBlockCountY(); blockY++)
+	{
+		blockX = 0;
+		while (blockX < m_VertexLight->GetBlockCountX())
+		{
+			if (!m_VertexLight->IsBlockLit(blockX, blockY))
+			{
+				blockX++;
+				continue;
+			}
+
+			firstBlock = blockX;
+			while ((blockX < m_VertexLight->GetBlockCountX()) && m_VertexLight->IsBlockLit(blockX, blockY))
+			{
+				blockX++;
+			}
+
+			left = firstBlock * VERTEX_LIGHT_BLOCK_SIZE;
+			right = ((blockX * VERTEX_LIGHT_BLOCK_SIZE) < m_terrainWidth) ? ((blockX * VERTEX_LIGHT_BLOCK_SIZE) - 1) : (m_terrainWidth - 1);
+			top = blockY * VERTEX_LIGHT_BLOCK_SIZE;
+			bottom = (((blockY + 1) * VERTEX_LIGHT_BLOCK_SIZE) < m_terrainHeight) ? (((blockY + 1) * VERTEX_LIGHT_BLOCK_SIZE) - 1) : (m_terrainHeight - 1);
+
+			UploadStripRows(deviceContext, m_colorBuffer, m_VertexLight->GetColors(), sizeof(unsigned int), top, bottom, left, right);
+		}
+	}
+
+	// The flat colour follows the light as well.
+	flatColor = m_VertexLight->GetFlatColor();
+	deviceContext->UpdateSubresource(m_flatColorBuffer, 0, NULL, &flatColor, 0, 0);
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+	m_vertexLightTime = (frequency > 0) ? (float)(endTime - startTime) * 1000.0f / (float)frequency : 0.0f;
+
+	return;
+}
+
+
+void TerrainClass::RenderBuffers(ID3D11DeviceContext* deviceContext, CameraClass* camera)
+{
+	XMFLOAT3 cameraPosition;
+	unsigned int stride;
+	unsigned int offset;
+
+
+	// Bring the normals and the vertex buffer up to date with this frame's edits.
+	if (m_dirtyRectCount > 0)
+	{
+		UpdateDeformation(deviceContext);
+	}
+
+	// Give the worker this frame's camera, it builds the next frame's LOD while this one renders.
+	cameraPosition = camera->GetPosition();
+	m_LodWorker->SubmitCamera(cameraPosition.x, cameraPosition.y, cameraPosition.z, m_terrainMode);
+
+	// Take the newest frame the worker has finished.
+	m_frame = m_LodWorker->AcquireFrame();
+
+	// Set vertex buffer stride and offset.
+	stride = m_vertexStride;
+	offset = 0;
+
+	// Set the vertex buffer to active in the input assembler so it can be rendered.
+	deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
 
+	// Set the type of primitive that should be rendered from this vertex buffer, in this case triangles.
+	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-bool TerrainClass::LoadDiamondSquareHeightMap()
-{
-	int i, j, index;
+	// The vertex light shader reads the colours as a second stream, the light shader samples the baked occlusion,
+	// horizons and normal map after the surface texture instead.
+	if (m_vertexLighting)
+	{
+		UpdateVertexLight(deviceContext);
 
-	m_heightMap = new HeightMapType[m_terrainWidth * m_terrainHeight];
-	if (!m_heightMap)
+		stride = sizeof(unsigned int);
+		deviceContext->IASetVertexBuffers(1, 1, &m_colorBuffer, &stride, &offset);
+	}
+	else
 	{
-		return false;
+		deviceContext->PSSetShaderResources(1, TERRAIN_BAKE_MAP_COUNT, m_bakeViews);
+		deviceContext->PSSetShaderResources(1 + TERRAIN_BAKE_MAP_COUNT, 1, &m_normalView);
 	}
 
-	DiamondSquare ds(m_terrainWidth, 50, 0, 0);
-	double** map = ds.process();
-
-	// Read the image data into the height map array.
-	for (j = 0; j < m_terrainHeight; j++)
+	// Draw with the mode the frame was built for, a mode change shows up once the worker has caught up.
+	m_indexCount = 0;
+	if (m_frame->mode == TERRAIN_MODE_ROAM)
 	{
-		for (i = 0; i < m_terrainWidth; i++)
+		RenderRoam(deviceContext, m_frame);
+	}
+	else if ((m_frame->mode == TERRAIN_MODE_GEOMIPMAP) || (m_frame->mode == TERRAIN_MODE_SCREEN_ERROR))
+	{
+		// The patches are the chunks, so the ones behind the horizon can be skipped.
+		if (m_horizonCulling)
 		{
-			// Bitmaps are upside down so load bottom to top into the height map array.
-			index = (m_terrainWidth * (m_terrainHeight - 1 - j)) + i;
-
-			m_heightMap[index].y = map[j][i] - 200; // should be 0 < x < 120
+			CullChunks(cameraPosition);
 		}
+
+		// The clusters of the patches left are culled as they are drawn.
+		m_ClusterCull->SetCamera(cameraPosition.x, cameraPosition.y, cameraPosition.z);
+
+		RenderGeomipmap(deviceContext, m_frame);
 	}
-	
-	return true;
-}
 
-void TerrainClass::ShutdownHeightMap()
-{
-	// Release the height map array.
-	if (m_heightMap)
+	// Bring in the tiles around the camera and draw the resident ones.
+	if (m_TileStream)
 	{
-		delete[] m_heightMap;
-		m_heightMap = 0;
+		m_TileStream->Update(deviceContext, cameraPosition.x, cameraPosition.z);
+		RenderTiles(deviceContext, cameraPosition);
 	}
 
 	return;
 }
 
-void TerrainClass::SetTerrainCoordinates()
+
+void TerrainClass::CullChunks(XMFLOAT3 cameraPosition)
 {
-	int i, j, index;
+	HorizonCullClass::BoxType* cell;
+	XMFLOAT3 boxMin, boxMax;
+	int i, x, y, cellSize, cellsAcross, firstX, firstY;
 
 
-	// Loop through all the elements in the height map array and adjust their coordinates correctly.
-	for (j = 0; j < m_terrainHeight; j++)
+	cellSize = 1 << TERRAIN_HORIZON_CELL_LEVEL;
+	cellsAcross = GEOMIPMAP_PATCH_SIZE / cellSize;
+
+	// The boxes are taken fresh every frame so deformed chunks are culled with their new heights.
+	for (i = 0; i < GetChunkCount(); i++)
 	{
-		for (i = 0; i < m_terrainWidth; i++)
-		{
-			index = (m_terrainWidth * j) + i;
+		GetChunkBounds(i, boxMin, boxMax);
 
-			// Set the X and Z coordinates.
-			m_heightMap[index].x = (float)i;
-			m_heightMap[index].z = -(float)j;
+		m_chunkBoxes[i].minX = boxMin.x;
+		m_chunkBoxes[i].minY = boxMin.y;
+		m_chunkBoxes[i].minZ = boxMin.z;
+		m_chunkBoxes[i].maxX = boxMax.x;
+		m_chunkBoxes[i].maxY = boxMax.y;
+		m_chunkBoxes[i].maxZ = boxMax.z;
+
+		// The pyramid nodes under the chunk, rows run towards negative z.
+		firstX = (i % m_chunkCountX) * cellsAcross;
+		firstY = (i / m_chunkCountX) * cellsAcross;
+
+		for (y = 0; y < cellsAcross; y++)
+		{
+			for (x = 0; x < cellsAcross; x++)
+			{
+				cell = &m_cellBoxes[(i * m_cellsPerChunk) + (y * cellsAcross) + x];
 
-			// Move the terrain depth into the positive range.  For example from (0, -256) to (256, 0).
-			m_heightMap[index].z += (float)(m_terrainHeight - 1);
+				m_HeightPyramid->GetCellBounds(TERRAIN_HORIZON_CELL_LEVEL, firstX + x, firstY + y, cell->minY, cell->maxY);
 
-			// Scale the height.
-			m_heightMap[index].y /= m_heightScale;
+				cell->minX = (float)((firstX + x) * cellSize);
+				cell->maxX = cell->minX + (float)cellSize;
+				cell->maxZ = (float)(m_terrainHeight - 1 - ((firstY + y) * cellSize));
+				cell->minZ = cell->maxZ - (float)cellSize;
+			}
 		}
 	}
 
+	m_HorizonCull->Cull(m_chunkBoxes, GetChunkCount(), m_cellBoxes, m_cellsPerChunk, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+
 	return;
 }
 
-bool TerrainClass::BuildTerrainModel()
+
+void TerrainClass::RenderGeomipmap(ID3D11DeviceContext* deviceContext, LodWorkerClass::FrameType* frame)
 {
-	int i, j, index, index1, index2, index3, index4;
+	GeomipmapClass::PatchDrawType clusterDraw;
+	int i, cluster, runOffset, runCount;
 
 
-	// Calculate the number of vertices in the 3D terrain model.
-	m_vertexCount = (m_terrainHeight) * (m_terrainWidth);
+	// Set the index buffer to active in the input assembler so it can be rendered.
+	deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R16_UINT, 0);
 
-	// Create the 3D terrain model array.
-	m_terrainModel = new VertexType[m_vertexCount];
-	if (!m_terrainModel)
+	// Draw each patch from its index set in the pool, offset to the patch corner with the base vertex.
+	for (i = 0; i < frame->drawCount; i++)
 	{
-		return false;
-	}
-
-	int incrementCount, tuCount, tvCount;
-	float incrementValue, tuCoordinate, tvCoordinate;
-
-	const int repeatTexture = 8;
-
-	// Calculate how much to increment the texture coordinates by.
-	incrementValue = (float) repeatTexture / (float)m_terrainWidth;
+		if (m_horizonCulling && !m_HorizonCull->IsVisible(i))
+		{
+			continue;
+		}
 
-	// Calculate how many times to repeat the texture.
-	incrementCount = m_terrainWidth / repeatTexture;
+		if (!m_clusterCulling)
+		{
+			deviceContext->DrawIndexed(frame->draws[i].indexCount, frame->draws[i].indexOffset, frame->draws[i].baseVertex);
 
-	// Initialize the tu and tv coordinate values.
-	tuCoordinate = 1.0f;
-	tvCoordinate = 1.0f;
+			m_indexCount += frame->draws[i].indexCount;
+			continue;
+		}
 
-	// Initialize the tu and tv coordinate indexes.
-	tuCount = 0;
-	tvCount = 0;
+		// The clusters of the set follow each other in the pool, so a run of visible ones is still a single draw.
+		runOffset = frame->draws[i].indexOffset;
+		runCount = 0;
+		for (cluster = 0; cluster < m_Geomipmap->GetClusterCount(frame->draws[i].level); cluster++)
+		{
+			m_Geomipmap->GetClusterDraw(frame->draws[i], cluster, clusterDraw);
 
-	// Initialize the whole vertex array
-	for (int i = 0; i < m_terrainWidth; i++) {
-		for (int j = 0; j < m_terrainHeight; j++) {
-			int HM_index = (m_terrainWidth * j) + i;
-			m_terrainModel[HM_index].position = XMFLOAT3(m_heightMap[HM_index].x, m_heightMap[HM_index].y, m_heightMap[HM_index].z);
-			m_terrainModel[HM_index].texture = XMFLOAT2(tuCoordinate, tvCoordinate);
-			m_terrainModel[HM_index].normal = XMFLOAT3(m_heightMap[HM_index].nx, m_heightMap[HM_index].ny, m_heightMap[HM_index].nz);
+			if (m_ClusterCull->IsVisible(i, clusterDraw.level, cluster, clusterDraw.indexCount / 3))
+			{
+				if (runCount == 0)
+				{
+					runOffset = clusterDraw.indexOffset;
+				}
 
-			tuCoordinate += incrementValue;
-			tuCount++;
+				runCount += clusterDraw.indexCount;
+				continue;
+			}
 
-			if (tuCount == incrementCount)
+			if (runCount > 0)
 			{
-				tuCoordinate = 0.0f;
-				tuCount = 0;
+				deviceContext->DrawIndexed(runCount, runOffset, frame->draws[i].baseVertex);
+				m_indexCount += runCount;
+				runCount = 0;
 			}
 		}
 
-		// Increment the tv texture coordinate by the increment value and increment the index by one.
-		tvCoordinate -= incrementValue;
-		tvCount++;
-
-		// Check if at the top of the texture and if so then start at the bottom again.
-		if (tvCount == incrementCount)
+		if (runCount > 0)
 		{
-			tvCoordinate = 1.0f;
-			tvCount = 0;
+			deviceContext->DrawIndexed(runCount, runOffset, frame->draws[i].baseVertex);
+			m_indexCount += runCount;
 		}
 	}
 
-	return true;
+	return;
 }
 
-void TerrainClass::ShutdownTerrainModel()
+
+void TerrainClass::RenderRoam(ID3D11DeviceContext* deviceContext, LodWorkerClass::FrameType* frame)
 {
-	// Release the terrain model data.
-	if (m_terrainModel)
+	D3D11_BOX box;
+	unsigned long* indices;
+	int firstIndex, indexCount;
+	ScratchClass scratch(m_Arena);
+
+
+	// Upload only the indices that changed since the version already in the buffer.
+	if (m_LodWorker->GetRoamUpload(frame, m_roamVersion, firstIndex, indexCount))
 	{
-		delete[] m_terrainModel;
-		m_terrainModel = 0;
+		// The frame holds grid indices, the vertex buffer is in patch strips.
+		indices = scratch.AllocateArray<unsigned long>(indexCount);
+		if (!indices)
+		{
+			return;
+		}
+
+		RemapRoamIndices(frame->indices + firstIndex, indexCount, indices);
+
+		box.left = firstIndex * sizeof(unsigned long);
+		box.right = (firstIndex + indexCount) * sizeof(unsigned long);
+		box.top = 0;
+		box.bottom = 1;
+		box.front = 0;
+		box.back = 1;
+
+		deviceContext->UpdateSubresource(m_roamIndexBuffer, 0, &box, indices, 0, 0);
 	}
+
+	m_roamVersion = frame->roamVersion;
+
+	// Set the index buffer to active in the input assembler so it can be rendered.
+	deviceContext->IASetIndexBuffer(m_roamIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+
+	// Draw the used slots, holes left by merges are degenerate triangles.
+	m_indexCount = frame->indexCount;
+	deviceContext->DrawIndexed(m_indexCount, 0, 0);
+
 	return;
 }
 
-bool TerrainClass::InitializeBuffers(ID3D11Device* device)
+void TerrainClass::RenderTiles(ID3D11DeviceContext* deviceContext, XMFLOAT3 cameraPosition)
 {
-	unsigned long* indices;
-	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
-	D3D11_SUBRESOURCE_DATA vertexData, indexData;
-	HRESULT result;
-	XMFLOAT4 color;
+	GeomipmapClass::PatchDrawType draw;
+	ID3D11Buffer* vertexBuffer;
+	unsigned int stride, offset;
+	int slot, tileX, tileZ, level, chunk;
+	float dx, dz;
 
-	// Set up the description of the static vertex buffer.
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(VertexType) * m_vertexCount;
-	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexBufferDesc.CPUAccessFlags = 0;
-	vertexBufferDesc.MiscFlags = 0;
-	vertexBufferDesc.StructureByteStride = 0;
 
-	// Give the subresource structure a pointer to the vertex data.
-	vertexData.pSysMem = m_terrainModel;
-	vertexData.SysMemPitch = 0;
-	vertexData.SysMemSlicePitch = 0;
-	
-	// Create the vertex buffer with data from the terrain model
-	result = device->CreateBuffer(&vertexBufferDesc, &vertexData, &m_vertexBuffer);
-	if (FAILED(result))
+	// The tiles are laid out like this terrain so they are drawn from the same index pool.
+	deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R16_UINT, 0);
+
+	// With per vertex lighting every tile vertex reads the same flat colour.
+	if (m_vertexLighting)
 	{
-		return false;
+		stride = 0;
+		offset = 0;
+		deviceContext->IASetVertexBuffers(1, 1, &m_flatColorBuffer, &stride, &offset);
 	}
 
-	// Set up the description of the static index buffer.
-	indexBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	indexBufferDesc.ByteWidth = sizeof(unsigned long) * m_indexCount;
-	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	indexBufferDesc.MiscFlags = 0;
-	indexBufferDesc.StructureByteStride = 0;
+	stride = m_vertexStride;
+	offset = 0;
 
-	// Create the index buffer with no initial data
-	result = device->CreateBuffer(&indexBufferDesc, NULL, &m_indexBuffer);
-	if (FAILED(result))
+	for (slot = 0; slot < m_TileStream->GetSlotCount(); slot++)
 	{
-		return false;
-	}
+		if (!m_TileStream->GetTile(slot, vertexBuffer, tileX, tileZ))
+		{
+			continue;
+		}
 
-	return true;
-}
+		// The whole tile uses one level picked from its center, so its own patches never need stitching.
+		dx = (((float)tileX + 0.5f) * (float)TILE_STREAM_TILE_SIZE) - cameraPosition.x;
+		dz = (((float)tileZ + 0.5f) * (float)TILE_STREAM_TILE_SIZE) - cameraPosition.z;
 
+		level = (int)(sqrtf((dx * dx) + (dz * dz)) / GEOMIPMAP_LOD_DISTANCE);
+		if (level > (m_Geomipmap->GetLevelCount() - 1))
+		{
+			level = m_Geomipmap->GetLevelCount() - 1;
+		}
 
-void TerrainClass::ShutdownBuffers()
-{
-	// Release the index buffer.
-	if(m_indexBuffer)
-	{
-		m_indexBuffer->Release();
-		m_indexBuffer = 0;
-	}
+		m_Geomipmap->GetLevelDraw(level, 0, draw);
 
-	// Release the vertex buffer.
-	if(m_vertexBuffer)
-	{
-		m_vertexBuffer->Release();
-		m_vertexBuffer = 0;
+		deviceContext->IASetVertexBuffers(0, 1, &vertexBuffer, &stride, &offset);
+
+		// Every chunk of the terrain is a patch of the tile as well.
+		for (chunk = 0; chunk < GetChunkCount(); chunk++)
+		{
+			deviceContext->DrawIndexed(draw.indexCount, draw.indexOffset, m_chunks[chunk].baseVertex);
+
+			m_indexCount += draw.indexCount;
+		}
 	}
 
 	return;
 }
 
-
-void TerrainClass::RenderBuffers(ID3D11DeviceContext* deviceContext, CameraClass* camera)
+static inline __m128 ReciprocalSqrt(__m128 value)
 {
-	unsigned int stride;
-	unsigned int offset;
+	__m128 estimate;
 
 
-	// Set vertex buffer stride and offset.
-	stride = sizeof(VertexType);
-	offset = 0;
-
-	UpdateBuffers(deviceContext, camera);
+	// The hardware estimate is good to 12 bits, one Newton step brings it close to full float precision.
+	estimate = _mm_rsqrt_ps(value);
+	return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), estimate), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(value, estimate), estimate)));
+}
 
-	// Set the vertex buffer to active in the input assembler so it can be rendered.
-	deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
+static inline void AddFaceNormal(__m128 a, __m128 b, __m128& x, __m128& y, __m128& z)
+{
+	__m128 ab, scale;
 
-	// Set the index buffer to active in the input assembler so it can be rendered.
-	deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
-	// Set the type of primitive that should be rendered from this vertex buffer, in this case lines.
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
+	// Normalize (a + b, 1, a) and add it to the sum.
+	ab = _mm_add_ps(a, b);
+	scale = ReciprocalSqrt(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ab, ab), _mm_mul_ps(a, a)), _mm_set1_ps(1.0f)));
 
-	// Set the type of primitive that should be rendered from this vertex buffer, in this case triangles.
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	x = _mm_add_ps(x, _mm_mul_ps(ab, scale));
+	y = _mm_add_ps(y, scale);
+	z = _mm_add_ps(z, _mm_mul_ps(a, scale));
 
 	return;
 }
 
-bool TerrainClass::UpdateBuffers(ID3D11DeviceContext* deviceContext, CameraClass* camera)
+void TerrainClass::CalculateNormalRow(const float* heights, int j, int first, int last, VectorType* normals)
 {
-	unsigned long* indices;
-	D3D11_MAPPED_SUBRESOURCE indexData;
+	int i, k, interiorLast;
+	const float *row0, *row1, *row2;
+	__m128 up, upRight, left, center, right, downLeft, down, downRight, x, y, z, scale;
+	float nx[4], ny[4], nz[4];
+
 
-	// Set the index count to the same as the vertex count.
-	m_indexCount = m_vertexCount * 2;
+	/*
+		Every vertex sums the normalized normals of the (up to) four faces around it, each face
+		normal is worked out straight from the heights so there is no face normal array. On the
+		grid the face below and to the right of vertex (i, j) comes out as (a + b, 1, a) with
+		a = h(i, j+1) - h(i, j) and b = h(i, j) - h(i+1, j+1).
+	*/
 
-	// Create the index array.
-	indices = new unsigned long[m_indexCount];
-	if (!indices)
+	// The first and last rows are missing faces, use the checked path for all of them.
+	if ((j == 0) || (j == (m_terrainHeight - 1)))
 	{
-		return false;
+		for (i = first; i < last; i++)
+		{
+			CalculateBorderNormal(heights, i, j, normals[i - first]);
+		}
+
+		return;
 	}
 
-	XMFLOAT3 cameraPosition = camera->GetPosition();
+	i = first;
+	if (i == 0)
+	{
+		CalculateBorderNormal(heights, 0, j, normals[0]);
+		i++;
+	}
+
+	row0 = heights + ((j - 1) * m_terrainWidth);
+	row1 = heights + (j * m_terrainWidth);
+	row2 = heights + ((j + 1) * m_terrainWidth);
+
+	// Interior vertices four at a time, all four faces always exist here.
+	interiorLast = (last < (m_terrainWidth - 1)) ? last : (m_terrainWidth - 1);
+	for (; (i + 4) <= interiorLast; i += 4)
+	{
+		up = _mm_loadu_ps(row0 + i - 1);
+		upRight = _mm_loadu_ps(row0 + i);
+		left = _mm_loadu_ps(row1 + i - 1);
+		center = _mm_loadu_ps(row1 + i);
+		right = _mm_loadu_ps(row1 + i + 1);
+		downLeft = _mm_loadu_ps(row2 + i - 1);
+		down = _mm_loadu_ps(row2 + i);
+		downRight = _mm_loadu_ps(row2 + i + 1);
+
+		x = _mm_setzero_ps();
+		y = _mm_setzero_ps();
+		z = _mm_setzero_ps();
+
+		// Faces at (i-1, j-1), (i, j-1), (i-1, j) and (i, j).
+		AddFaceNormal(_mm_sub_ps(left, up), _mm_sub_ps(up, center), x, y, z);
+		AddFaceNormal(_mm_sub_ps(center, upRight), _mm_sub_ps(upRight, right), x, y, z);
+		AddFaceNormal(_mm_sub_ps(downLeft, left), _mm_sub_ps(left, down), x, y, z);
+		AddFaceNormal(_mm_sub_ps(down, center), _mm_sub_ps(center, downRight), x, y, z);
+
+		// Normalize the sum.
+		scale = ReciprocalSqrt(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+
+		_mm_storeu_ps(nx, _mm_mul_ps(x, scale));
+		_mm_storeu_ps(ny, _mm_mul_ps(y, scale));
+		_mm_storeu_ps(nz, _mm_mul_ps(z, scale));
+
+		for (k = 0; k < 4; k++)
+		{
+			normals[i + k - first].x = nx[k];
+			normals[i + k - first].y = ny[k];
+			normals[i + k - first].z = nz[k];
+		}
+	}
 
-	int LOD = 100;
-	int index = 0;
-	int step = 2;
-	int tmpStep;
-	// Load the vertex array and index array with 3D terrain model data.
-	for (int i = 0; i < m_terrainWidth - step; i += step)
+	// Finish the span with what did not fill a group of four and the right edge.
+	for (; i < last; i++)
 	{
-		// i is the index of the diagonal
-		/*
-			|
-			o_ o_ o_ o <-- (i, i)
-			|		 |
-			o_ o_ o  o
-			|	  |  |
-			o_ o  o  o
-			|\ |  |  |
-			o_\o_ o_ o_ o_
-			
-			
-		*/
-		step = static_cast<int>(pow(2, i / LOD + 1));
+		CalculateBorderNormal(heights, i, j, normals[i - first]);
+	}
 
-		tmpStep = static_cast<int>(pow(2, (i + step) / LOD + 1));
+	return;
+}
 
-		if (step == tmpStep) {
+void TerrainClass::CalculateBorderNormal(const float* heights, int i, int j, VectorType& normal)
+{
+	int fi, fj, face, index;
+	float a, b, scale, sum[3], length;
 
-			for (int j = 0; j < i; j += step)
-			{
 
+	// Initialize the sum.
+	sum[0] = 0.0f;
+	sum[1] = 0.0f;
+	sum[2] = 0.0f;
 
-				/*
-				|
-				o_ o_ o_ o
-				|		 | <- draw this line
-				o_ o_ o  o
-				|	  |  |
-				o_ o  o  o
-				|  |  |  |
-				o_ o_ o_ o_ o_
-
-				No need to distinguish the different case, we draw all the triangle the same way:
-
-				D ---- G ---- C
-				| \  6 | \  8 |
-				|  5 \ |  7 \ |
-				H ---- I ---- F
-				| \  2 | \  4 |
-				| 1  \ |  3 \ |
-				A ---- E ---- B
-
-				*/
-
-				// Get the indexes to the four points of the quad.
-				int A = (m_terrainWidth * j) + i;
-				int B = (m_terrainWidth * j) + (i + step);
-				int D = (m_terrainWidth * (j + step)) + i;
-				int C = (m_terrainWidth * (j + step)) + (i + step);
-
-				int E = (A + B) / 2;
-				int F = (B + C) / 2;
-				int G = (C + D) / 2;
-				int H = (A + D) / 2;
-
-				int I = (m_terrainWidth * (j + step / 2)) + (i + step / 2);
-
-				// Triangle 1
-				indices[index++] = A;
-				indices[index++] = E;
-				indices[index++] = H;
-				// Triangle 2
-				indices[index++] = H;
-				indices[index++] = E;
-				indices[index++] = I;
-				// Triangle 3
-				indices[index++] = E;
-				indices[index++] = B;
-				indices[index++] = I;
-				// Triangle 4
-				indices[index++] = I;
-				indices[index++] = B;
-				indices[index++] = F;
-				// Triangle 5
-				indices[index++] = H;
-				indices[index++] = I;
-				indices[index++] = D;
-				// Triangle 6
-				indices[index++] = D;
-				indices[index++] = I;
-				indices[index++] = G;
-				// Triangle 7
-				indices[index++] = I;
-				indices[index++] = F;
-				indices[index++] = G;
-				// Triangle 8
-				indices[index++] = G;
-				indices[index++] = F;
-				indices[index++] = C;
-
-				/*
-				|
-				o_ o_ o_ o
-				|		 |
-				o_ o_ o  o
-				|	  |  |
-				o_ o  o  o
-				|\ |  |  |
-				o_\o_ o_ o_ o_
-				^
-				|
-				Draw column
-				*/
-
-				// Get the indexes to the four points of the quad.
-				A = (m_terrainWidth * i) + j;
-				B = (m_terrainWidth * i) + (j + step);
-				D = (m_terrainWidth * (i + step)) + j;
-				C = (m_terrainWidth * (i + step)) + (j + step);
-
-				E = (A + B) / 2;
-				F = (B + C) / 2;
-				G = (C + D) / 2;
-				H = (A + D) / 2;
-
-				I = (m_terrainWidth * (i + step / 2)) + (j + step / 2);
-
-				// Triangle 1
-				indices[index++] = A;
-				indices[index++] = E;
-				indices[index++] = H;
-				// Triangle 2
-				indices[index++] = H;
-				indices[index++] = E;
-				indices[index++] = I;
-				// Triangle 3
-				indices[index++] = E;
-				indices[index++] = B;
-				indices[index++] = I;
-				// Triangle 4
-				indices[index++] = I;
-				indices[index++] = B;
-				indices[index++] = F;
-				// Triangle 5
-				indices[index++] = H;
-				indices[index++] = I;
-				indices[index++] = D;
-				// Triangle 6
-				indices[index++] = D;
-				indices[index++] = I;
-				indices[index++] = G;
-				// Triangle 7
-				indices[index++] = I;
-				indices[index++] = F;
-				indices[index++] = G;
-				// Triangle 8
-				indices[index++] = G;
-				indices[index++] = F;
-				indices[index++] = C;
-			}
+	// Add every face around the vertex that is inside the grid.
+	for (face = 0; face < 4; face++)
+	{
+		fi = i - 1 + (face & 1);
+		fj = j - 1 + (face >> 1);
 
-			int A = (m_terrainWidth * i) + i;
-			int B = (m_terrainWidth * i) + (i + step);
-			int D = (m_terrainWidth * (i + step)) + i;
-			int C = (m_terrainWidth * (i + step)) + (i + step);
-
-			int E = (A + B) / 2;
-			int F = (B + C) / 2;
-			int G = (C + D) / 2;
-			int H = (A + D) / 2;
-
-			int I = (m_terrainWidth * (i + step / 2)) + (i + step / 2);
-
-			// Triangle 1
-			indices[index++] = A;
-			indices[index++] = E;
-			indices[index++] = H;
-			// Triangle 2
-			indices[index++] = H;
-			indices[index++] = E;
-			indices[index++] = I;
-			// Triangle 3
-			indices[index++] = E;
-			indices[index++] = B;
-			indices[index++] = I;
-			// Triangle 4
-			indices[index++] = I;
-			indices[index++] = B;
-			indices[index++] = F;
-			// Triangle 5
-			indices[index++] = H;
-			indices[index++] = I;
-			indices[index++] = D;
-			// Triangle 6
-			indices[index++] = D;
-			indices[index++] = I;
-			indices[index++] = G;
-			// Triangle 7
-			indices[index++] = I;
-			indices[index++] = F;
-			indices[index++] = G;
-			// Triangle 8
-			indices[index++] = G;
-			indices[index++] = F;
-			indices[index++] = C;
-		}
-		else {
-
-			for (int j = 0; j < i; j += step)
-			{
-				/*
-				|
-				o_ o_ o_ o
-				|		 | <- draw this line
-				o_ o_ o  o
-				|	  |  |
-				o_ o  o  o
-				|  |  |  |
-				o_ o_ o_ o_ o_
-
-				D ----------- C
-				| \    7    / |
-				|  5 \   /  6 |
-				H ---- I ---- F
-				| \  2 | \  4 |
-				| 1  \ |  3 \ |
-				A ---- E ---- B
-
-				*/
-
-				// Get the indexes to the four points of the quad.
-				int A = (m_terrainWidth * i) + j;
-				int B = (m_terrainWidth * i) + (j + step);
-				int D = (m_terrainWidth * (i + step)) + j;
-				int C = (m_terrainWidth * (i + step)) + (j + step);
-
-				int E = (A + B) / 2;
-				int F = (B + C) / 2;
-				int H = (A + D) / 2;
-
-				int I = (m_terrainWidth * (i + step / 2)) + (j + step / 2);
-
-				// Triangle 1
-				indices[index++] = A;
-				indices[index++] = E;
-				indices[index++] = H;
-				// Triangle 2
-				indices[index++] = H;
-				indices[index++] = E;
-				indices[index++] = I;
-				// Triangle 3
-				indices[index++] = E;
-				indices[index++] = B;
-				indices[index++] = I;
-				// Triangle 4
-				indices[index++] = I;
-				indices[index++] = B;
-				indices[index++] = F;
-				// Triangle 5
-				indices[index++] = H;
-				indices[index++] = I;
-				indices[index++] = D;
-				// Triangle 6
-				indices[index++] = I;
-				indices[index++] = F;
-				indices[index++] = C;
-				// Triangle 7
-				indices[index++] = D;
-				indices[index++] = I;
-				indices[index++] = C;
-
-				/*
-				|
-				o_ o_ o_ o
-				|		 |
-				o_ o_ o  o
-				|	  |  |
-				o_ o  o  o
-				|\ |  |  |
-				o_\o_ o_ o_ o_
-				^
-				|
-				Draw column
-
-				D ---- G ---- C
-				| \  6 |  4 / |
-				|  5 \ | /    |
-				H ---- I    7 |
-				| \  2 | \    |
-				| 1  \ |  3 \ |
-				A ---- E ---- B
-
-				*/
-
-				// Get the indexes to the four points of the quad.
-				A = (m_terrainWidth * j) + i;
-				B = (m_terrainWidth * j) + (i + step);
-				D = (m_terrainWidth * (j + step)) + i;
-				C = (m_terrainWidth * (j + step)) + (i + step);
-
-				E = (A + B) / 2;
-				int G = (C + D) / 2;
-				H = (A + D) / 2;
-
-				I = (m_terrainWidth * (j + step / 2)) + (i + step / 2);
-
-				// Triangle 1
-				indices[index++] = A;
-				indices[index++] = E;
-				indices[index++] = H;
-				// Triangle 2
-				indices[index++] = H;
-				indices[index++] = E;
-				indices[index++] = I;
-				// Triangle 3
-				indices[index++] = E;
-				indices[index++] = B;
-				indices[index++] = I;
-				// Triangle 4
-				indices[index++] = I;
-				indices[index++] = C;
-				indices[index++] = G;
-				// Triangle 5
-				indices[index++] = H;
-				indices[index++] = I;
-				indices[index++] = D;
-				// Triangle 6
-				indices[index++] = D;
-				indices[index++] = I;
-				indices[index++] = G;
-				// Triangle 7
-				indices[index++] = I;
-				indices[index++] = B;
-				indices[index++] = C;
+		if ((fi < 0) || (fj < 0) || (fi >= (m_terrainWidth - 1)) || (fj >= (m_terrainHeight - 1)))
+		{
+			continue;
+		}
 
-			}
-			/*
-			D ----------- C
-			| \    5    / |
-			|  4 \   /    |
-			H ---- I    6 |
-			| \  2 | \    |
-			| 1  \ |  3 \ |
-			A ---- E ---- B
-
-			*/
-
-			int A = (m_terrainWidth * i) + i;
-			int B = (m_terrainWidth * i) + (i + step);
-			int D = (m_terrainWidth * (i + step)) + i;
-			int C = (m_terrainWidth * (i + step)) + (i + step);
-
-			int E = (A + B) / 2;
-			int H = (A + D) / 2;
-
-			int I = (m_terrainWidth * (i + step / 2)) + (i + step / 2);
-
-			// Triangle 1
-			indices[index++] = A;
-			indices[index++] = E;
-			indices[index++] = H;
-			// Triangle 2
-			indices[index++] = H;
-			indices[index++] = E;
-			indices[index++] = I;
-			// Triangle 3
-			indices[index++] = E;
-			indices[index++] = B;
-			indices[index++] = I;
-			// Triangle 4
-			indices[index++] = H;
-			indices[index++] = I;
-			indices[index++] = D;
-			// Triangle 5
-			indices[index++] = D;
-			indices[index++] = I;
-			indices[index++] = C;
-			// Triangle 6
-			indices[index++] = I;
-			indices[index++] = B;
-			indices[index++] = C;
-		}
-
-	}
-
-	//	Disable GPU access to the vertex buffer data.
-	//deviceContext->Map(m_vertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &vertexData);
-	//	Update the vertex buffer here.
-	//memcpy(vertexData.pData, vertices, sizeof(VertexType) * m_vertexCount);
-	//	Reenable GPU access to the vertex buffer data.
-	//deviceContext->Unmap(m_vertexBuffer, 0);
-
-	//	Disable GPU access to the vertex buffer data.
-	deviceContext->Map(m_indexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &indexData);
-	//	Update the vertex buffer here.
-	memcpy(indexData.pData, indices, sizeof(unsigned long) * m_indexCount);
-	//	Reenable GPU access to the vertex buffer data.
-	deviceContext->Unmap(m_indexBuffer, 0);
-
-	// Release the arrays now that the buffers have been created and loaded.
-	//delete[] vertices;
-	//vertices = 0;
-
-	delete[] indices;
-	indices = 0;
-
-}
-
-bool TerrainClass::CalculateNormals()
-{
-	int i, j, index1, index2, index3, index;
+		index = (fj * m_terrainWidth) + fi;
+		a = heights[index + m_terrainWidth] - heights[index];
+		b = heights[index] - heights[index + m_terrainWidth + 1];
+
+		scale = 1.0f / sqrtf(((a + b) * (a + b)) + (a * a) + 1.0f);
+
+		sum[0] += (a + b) * scale;
+		sum[1] += scale;
+		sum[2] += a * scale;
+	}
+
+	// Normalize the final shared normal for this vertex.
+	length = sqrtf((sum[0] * sum[0]) + (sum[1] * sum[1]) + (sum[2] * sum[2]));
+
+	normal.x = (sum[0] / length);
+	normal.y = (sum[1] / length);
+	normal.z = (sum[2] / length);
+
+	return;
+}
+
+#ifdef _DEBUG
+bool TerrainClass::BuildReferenceModel(HeightMapType* heightMap)
+{
+	int i, j, index1, index2, index3, index, incrementCount, tuCount, tvCount;
 	float vertex1[3], vertex2[3], vertex3[3], vector1[3], vector2[3], sum[3], length;
+	float incrementValue, tuCoordinate, tvCoordinate;
 	VectorType* normals;
 
 
-	// Create a temporary array to hold the face normal vectors.
+	// This is the original serial build, it is only kept to time and check the fused pass.
 	normals = new VectorType[(m_terrainHeight - 1) * (m_terrainWidth - 1)];
 	if (!normals)
 	{
 		return false;
 	}
 
+	// Set the X and Z coordinates and scale the heights.
+	for (j = 0; j < m_terrainHeight; j++)
+	{
+		for (i = 0; i < m_terrainWidth; i++)
+		{
+			index = (m_terrainWidth * j) + i;
+
+			heightMap[index].x = (float)i;
+			heightMap[index].z = (float)(m_terrainHeight - 1 - j);
+			heightMap[index].y /= m_heightScale;
+		}
+	}
+
 	// Go through all the faces in the mesh and calculate their normals.
 	for (j = 0; j<(m_terrainHeight - 1); j++)
 	{
@@ -784,18 +3556,18 @@ bool TerrainClass::CalculateNormals()
 			index2 = ((j + 1) * m_terrainWidth) + (i + 1);  // Bottom right vertex.
 			index3 = (j * m_terrainWidth) + i;          // Upper left vertex.
 
-														// Get three vertices from the face.
-			vertex1[0] = m_heightMap[index1].x;
-			vertex1[1] = m_heightMap[index1].y;
-			vertex1[2] = m_heightMap[index1].z;
+			// Get three vertices from the face.
+			vertex1[0] = heightMap[index1].x;
+			vertex1[1] = heightMap[index1].y;
+			vertex1[2] = heightMap[index1].z;
 
-			vertex2[0] = m_heightMap[index2].x;
-			vertex2[1] = m_heightMap[index2].y;
-			vertex2[2] = m_heightMap[index2].z;
+			vertex2[0] = heightMap[index2].x;
+			vertex2[1] = heightMap[index2].y;
+			vertex2[2] = heightMap[index2].z;
 
-			vertex3[0] = m_heightMap[index3].x;
-			vertex3[1] = m_heightMap[index3].y;
-			vertex3[2] = m_heightMap[index3].z;
+			vertex3[0] = heightMap[index3].x;
+			vertex3[1] = heightMap[index3].y;
+			vertex3[2] = heightMap[index3].z;
 
 			// Calculate the two vectors for this face.
 			vector1[0] = vertex1[0] - vertex3[0];
@@ -812,11 +3584,10 @@ bool TerrainClass::CalculateNormals()
 			normals[index].y = (vector1[2] * vector2[0]) - (vector1[0] * vector2[2]);
 			normals[index].z = (vector1[0] * vector2[1]) - (vector1[1] * vector2[0]);
 
-			// Calculate the length.
+			// Normalize the final value for this face using the length.
 			length = (float)sqrt((normals[index].x * normals[index].x) + (normals[index].y * normals[index].y) +
 				(normals[index].z * normals[index].z));
 
-			// Normalize the final value for this face using the length.
 			normals[index].x = (normals[index].x / length);
 			normals[index].y = (normals[index].y / length);
 			normals[index].z = (normals[index].z / length);
@@ -828,7 +3599,6 @@ bool TerrainClass::CalculateNormals()
 	{
 		for (i = 0; i<m_terrainWidth; i++)
 		{
-			// Initialize the sum.
 			sum[0] = 0.0f;
 			sum[1] = 0.0f;
 			sum[2] = 0.0f;
@@ -873,22 +3643,87 @@ bool TerrainClass::CalculateNormals()
 				sum[2] += normals[index].z;
 			}
 
-			// Calculate the length of this normal.
+			// Normalize the final shared normal for this vertex and store it in the height map array.
 			length = (float)sqrt((sum[0] * sum[0]) + (sum[1] * sum[1]) + (sum[2] * sum[2]));
 
-			// Get an index to the vertex location in the height map array.
 			index = (j * m_terrainWidth) + i;
 
-			// Normalize the final shared normal for this vertex and store it in the height map array.
-			m_heightMap[index].nx = (sum[0] / length);
-			m_heightMap[index].ny = (sum[1] / length);
-			m_heightMap[index].nz = (sum[2] / length);
+			heightMap[index].nx = (sum[0] / length);
+			heightMap[index].ny = (sum[1] / length);
+			heightMap[index].nz = (sum[2] / length);
 		}
 	}
 
-	// Release the temporary normals.
+	// Release the face normals.
 	delete[] normals;
 	normals = 0;
 
+	// Copy into the model column by column with the running texture coordinates, the fused pass overwrites it.
+	incrementValue = (float)TERRAIN_TEXTURE_REPEAT / (float)m_terrainWidth;
+	incrementCount = m_terrainWidth / TERRAIN_TEXTURE_REPEAT;
+
+	tuCoordinate = 1.0f;
+	tvCoordinate = 1.0f;
+	tuCount = 0;
+	tvCount = 0;
+
+	for (i = 0; i < m_terrainWidth; i++)
+	{
+		for (j = 0; j < m_terrainHeight; j++)
+		{
+			index = (m_terrainWidth * j) + i;
+			m_terrainModel[index].position = XMFLOAT3(heightMap[index].x, heightMap[index].y, heightMap[index].z);
+			m_terrainModel[index].texture = XMFLOAT2(tuCoordinate, tvCoordinate);
+			m_terrainModel[index].normal = XMFLOAT3(heightMap[index].nx, heightMap[index].ny, heightMap[index].nz);
+
+			tuCoordinate += incrementValue;
+			tuCount++;
+
+			if (tuCount == incrementCount)
+			{
+				tuCoordinate = 0.0f;
+				tuCount = 0;
+			}
+		}
+
+		tvCoordinate -= incrementValue;
+		tvCount++;
+
+		if (tvCount == incrementCount)
+		{
+			tvCoordinate = 1.0f;
+			tvCount = 0;
+		}
+	}
+
 	return true;
-}
\ No newline at end of file
+}
+
+bool TerrainClass::CheckTerrainModel(const HeightMapType* reference)
+{
+	int i;
+	float error, maxError;
+
+
+	maxError = 0.0f;
+
+	// Positions have to match exactly, the normals within the rsqrt precision.
+	for (i = 0; i < m_vertexCount; i++)
+	{
+		if ((m_terrainModel[i].position.x != reference[i].x) || (m_terrainModel[i].position.y != reference[i].y) ||
+			(m_terrainModel[i].position.z != reference[i].z))
+		{
+			return false;
+		}
+
+		error = fabsf(m_terrainModel[i].normal.x - reference[i].nx) + fabsf(m_terrainModel[i].normal.y - reference[i].ny) +
+			fabsf(m_terrainModel[i].normal.z - reference[i].nz);
+		if (error > maxError)
+		{
+			maxError = error;
+		}
+	}
+
+	return (maxError <= TERRAIN_NORMAL_TOLERANCE);
+}
+#endif
\ No newline at end of file
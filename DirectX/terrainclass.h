@@ -12,13 +12,66 @@
 #include <directxmath.h>
 #include <fstream>
 #include <stdio.h>
+#include <float.h>
+#include <emmintrin.h>
 
 #include "diamondSquare.h"
 #include "cameraclass.h"
+#include "geomipmapclass.h"
+#include "roamclass.h"
+#include "lodworkerclass.h"
+#include "arenaclass.h"
+#include "vertexpackclass.h"
+#include "parallelforclass.h"
+#include "heightpyramidclass.h"
+#include "terrainfileclass.h"
+#include "tilestreamclass.h"
+#include "horizoncullclass.h"
+#include "heightimportclass.h"
+#include "splatmapclass.h"
+#include "horizonbakeclass.h"
+#include "vertexlightclass.h"
+#include "normalmapclass.h"
+#include "meshexportclass.h"
+#include "clustercullclass.h"
 
 using namespace DirectX;
 using namespace std;
 
+
+/////////////
+// GLOBALS //
+/////////////
+const int TERRAIN_MODE_GEOMIPMAP = LOD_WORKER_GEOMIPMAP;
+const int TERRAIN_MODE_ROAM = LOD_WORKER_ROAM;
+const int TERRAIN_MODE_SCREEN_ERROR = LOD_WORKER_SCREEN_ERROR;
+const bool TERRAIN_PACKED_VERTICES = true;
+const int TERRAIN_TEXTURE_REPEAT = 8;
+const float TERRAIN_PACKED_NORMAL_TOLERANCE = 1.0f;
+const float TERRAIN_NORMAL_TOLERANCE = 0.0001f;
+const int TERRAIN_BUILD_TILE_SIZE = 64;
+const bool TERRAIN_RESIDENT_NORMALS = true;
+const int TERRAIN_HEIGHT_BILINEAR = 0;
+const int TERRAIN_HEIGHT_TRIANGLE = 1;
+const char TERRAIN_BINARY_FILENAME[] = "./terrain.bin";
+const char TERRAIN_GLB_FILENAME[] = "./terrain.glb";
+const char TERRAIN_PLY_FILENAME[] = "./terrain.ply";
+const int TERRAIN_BRUSH_RAISE = 0;
+const int TERRAIN_BRUSH_LOWER = 1;
+const int TERRAIN_BRUSH_FLATTEN = 2;
+const int TERRAIN_BRUSH_CRATER = 3;
+const int TERRAIN_MAX_DIRTY_RECTS = 16;
+const int TERRAIN_HORIZON_CELL_LEVEL = 2;
+const char TERRAIN_SETUP_FILENAME[] = "./setup.txt";
+const int TERRAIN_MAX_IMPORT_SIZE = 8193;
+const int TERRAIN_BAKE_MAP_COUNT = 3;
+const bool TERRAIN_VERTEX_LIGHTING = false;
+const int TERRAIN_NORMAL_MAP_DETAIL = 4;
+const int TERRAIN_NORMAL_MAP_MAX_SIZE = 16384;
+const float TERRAIN_PACKED_HEIGHT_HEADROOM = 0.5f;
+const float TERRAIN_LOD_MAX_ERROR = 2.0f;
+const int TERRAIN_LOD_TRIANGLE_BUDGET = 100000;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Class name: TerrainClass
 ////////////////////////////////////////////////////////////////////////////////
@@ -33,6 +86,7 @@ private:
 		XMFLOAT2 texture;
 	};
 
+	// The old array of structs layout, only the debug reference build still uses it.
 	struct HeightMapType
 	{
 		float x, y, z;
@@ -51,42 +105,183 @@ private:
 		float x, y, z;
 	};
 
+	// Inclusive range of grid columns and rows.
+	struct RectType
+	{
+		int left, top, right, bottom;
+	};
+
 public:
 	TerrainClass();
 	TerrainClass(const TerrainClass&);
 	~TerrainClass();
 
-	bool Initialize(ID3D11Device * device);
+	bool Initialize(ID3D11Device*, ArenaClass*);
 
 	void Shutdown();
 	bool Render(ID3D11DeviceContext*, CameraClass*);
 
 	int GetIndexCount();
 
+	void SetTerrainMode(int);
+	int GetTerrainMode();
+	void SetLodTarget(XMMATRIX, int, float, int);
+	void GetLodStats(float&, int&);
+
+	bool IsPacked();
+	XMFLOAT4 GetPackedDecode();
+	void GetPackingError(float&, float&);
+	void MeasureVertexCache(int, bool, float&, float&);
+	void GetLodLatency(float&, float&);
+	int GetStaleFrameCount();
+	void GetBuildTime(float&, float&);
+	void GetLoadTime(float&, bool&);
+	void GetStreamingStats(float&, float&, float&, int&);
+	bool ExportMesh(const char*, int, bool, bool);
+
+	int GetTerrainWidth();
+	int GetTerrainHeight();
+	const float* GetHeights();
+	float GetHeight(int, int);
+	XMFLOAT3 GetPosition(int, int);
+	XMFLOAT3 GetNormal(int, int);
+	int GetChunkCount();
+	void GetChunkBounds(int, XMFLOAT3&, XMFLOAT3&);
+	void SetHorizonCulling(bool);
+	void GetHorizonCullStats(float&, float&);
+	void SetClusterCulling(bool);
+	void GetClusterCullStats(int&, int&, int&);
+	void ConstructFrustum(XMMATRIX, XMMATRIX);
+	ID3D11ShaderResourceView* GetSplatMap();
+	float GetSplatBuildTime();
+	float GetBakeTime();
+	float GetNormalMapTime();
+
+	void SetVertexLighting(bool);
+	bool IsVertexLighting();
+	void SetLight(XMFLOAT3, XMFLOAT4, XMFLOAT4);
+	float GetVertexLightTime();
+	int GetVertexLightCount();
+
+	bool GetHeightAt(float, float, int, float&);
+	void GetHeightsAt(const float*, const float*, float*, int, int);
+
+	bool IntersectRay(XMFLOAT3, XMFLOAT3, float, float&);
+	void IntersectRays(const HeightPyramidClass::RayType*, int, float*);
+
+	bool Deform(float, float, float, float, int);
+	void GetDeformationCost(int&, int&, float&);
+
 private:
-//	bool LoadSetupFile(char*);
+	bool LoadSetupFile(const char*, bool&);
+	bool SetImportSize();
 	void ShutdownHeightMap();
-	void SetTerrainCoordinates();
-	bool CalculateNormals();
+	bool BuildTerrain();
+	bool LoadTerrainFile(const char*, bool&);
+	bool WriteTerrainFile(const char*);
+	bool BuildChunkTable();
+	void UpdateChunk(int);
+	void AddDirtyRect(int, int, int, int);
+	void UpdateDeformation(ID3D11DeviceContext*);
+	void UpdateBake(ID3D11DeviceContext*);
+	void UpdateVertexRow(ID3D11DeviceContext*, int, int, int);
 	bool BuildTerrainModel();
+	void BuildTerrainTile(int, int);
+	void CalculateNormalRow(const float*, int, int, int, VectorType*);
+	void CalculateBorderNormal(const float*, int, int, VectorType&);
+#ifdef _DEBUG
+	bool BuildReferenceModel(HeightMapType*);
+	bool CheckTerrainModel(const HeightMapType*);
+#endif
+	bool BuildPackedModel();
+	void MeasurePackingError();
 	void ShutdownTerrainModel();
 
 	bool InitializeBuffers(ID3D11Device*);
 	void ShutdownBuffers();
+	void CopyToStrips(const void*, int, void*);
+	void CopyStripRows(const void*, int, int, int, int, void*);
+	void UploadStripRows(ID3D11DeviceContext*, ID3D11Buffer*, const void*, int, int, int, int, int);
+	void RemapRoamIndices(const unsigned long*, int, unsigned long*);
+	bool CreateMapTexture(ID3D11Device*, DXGI_FORMAT, const void*, int, ID3D11Texture2D**, ID3D11ShaderResourceView**);
+	bool InitializeSplatMap(ID3D11Device*);
+	void ShutdownSplatMap();
+	bool InitializeBake(ID3D11Device*);
+	void ShutdownBake();
+	bool BuildNormalMap();
+	bool InitializeNormalMap(ID3D11Device*);
+	void ShutdownNormalMap();
+	bool InitializeVertexLight(ID3D11Device*);
+	void ShutdownVertexLight();
+	void UpdateVertexLight(ID3D11DeviceContext*);
 	void RenderBuffers(ID3D11DeviceContext*, CameraClass*);
-	bool UpdateBuffers(ID3D11DeviceContext*, CameraClass*);
+	void CullChunks(XMFLOAT3);
+	void RenderGeomipmap(ID3D11DeviceContext*, LodWorkerClass::FrameType*);
+	void RenderRoam(ID3D11DeviceContext*, LodWorkerClass::FrameType*);
+	void RenderTiles(ID3D11DeviceContext*, XMFLOAT3);
+	bool InitializeRoam();
 
+	bool AllocateHeightMap();
+	bool ImportHeightMap();
 	bool LoadDiamondSquareHeightMap();
 
 private:
-	ID3D11Buffer *m_vertexBuffer, *m_indexBuffer;
-	int m_vertexCount, m_indexCount;
+	ID3D11Buffer *m_vertexBuffer, *m_indexBuffer, *m_roamIndexBuffer;
+	int m_vertexCount, m_indexCount, m_vertexStride;
 
 	int m_terrainHeight, m_terrainWidth;
 	float m_heightScale;
 	char* m_terrainFilename;
-	HeightMapType* m_heightMap;
+	int m_importWidth, m_importHeight, m_importStep;
+	unsigned long long m_sourceSize, m_sourceTime;
+	float* m_heights;
+	float* m_detailHeights;
+	int m_detailSize;
+	unsigned short* m_normals;
 	VertexType* m_terrainModel;
+	VertexPackClass::PackedVertexType* m_packedModel;
+	VertexPackClass* m_VertexPack;
+	bool m_packedVertices;
+	float m_packingHeightError, m_packingNormalError;
+	float m_buildTime, m_referenceBuildTime, m_loadTime;
+	TerrainFileClass* m_TerrainFile;
+	TerrainFileClass::ChunkType* m_chunks;
+	int m_chunkCountX, m_chunkCountZ;
+	GeomipmapClass* m_Geomipmap;
+	RoamClass* m_Roam;
+	HeightPyramidClass* m_HeightPyramid;
+	LodWorkerClass* m_LodWorker;
+	TileStreamClass* m_TileStream;
+	HorizonCullClass* m_HorizonCull;
+	HorizonCullClass::BoxType* m_chunkBoxes;
+	HorizonCullClass::BoxType* m_cellBoxes;
+	int m_cellsPerChunk;
+	bool m_horizonCulling;
+	ClusterCullClass* m_ClusterCull;
+	bool m_clusterCulling;
+	SplatMapClass* m_SplatMap;
+	ID3D11Texture2D* m_splatTexture;
+	ID3D11ShaderResourceView* m_splatView;
+	float m_splatBuildTime;
+	HorizonBakeClass* m_HorizonBake;
+	ID3D11Texture2D* m_bakeTextures[TERRAIN_BAKE_MAP_COUNT];
+	ID3D11ShaderResourceView* m_bakeViews[TERRAIN_BAKE_MAP_COUNT];
+	float m_bakeTime;
+	NormalMapClass* m_NormalMap;
+	ID3D11Texture2D* m_normalTexture;
+	ID3D11ShaderResourceView* m_normalView;
+	float m_normalMapTime;
+	VertexLightClass* m_VertexLight;
+	ID3D11Buffer *m_colorBuffer, *m_flatColorBuffer;
+	bool m_vertexLighting;
+	float m_vertexLightTime;
+	int m_vertexLightCount;
+	LodWorkerClass::FrameType* m_frame;
+	ArenaClass* m_Arena;
+	int m_terrainMode, m_roamVersion;
+	RectType m_dirtyRects[TERRAIN_MAX_DIRTY_RECTS];
+	int m_dirtyRectCount, m_deformVertices, m_deformBytes;
+	float m_deformTime;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,271 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: terrainfileclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "terrainfileclass.h"
+
+
+TerrainFileClass::TerrainFileClass()
+{
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = 0;
+	m_view = 0;
+	m_fileSize = 0;
+}
+
+
+TerrainFileClass::TerrainFileClass(const TerrainFileClass& other)
+{
+}
+
+
+TerrainFileClass::~TerrainFileClass()
+{
+}
+
+
+bool TerrainFileClass::Open(const char* filename)
+{
+	LARGE_INTEGER fileSize;
+	const HeaderType* header;
+	unsigned long long end;
+	int i;
+
+
+	// Open the file for mapping, a missing file is not an error the caller has to report.
+	m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	if (!GetFileSizeEx(m_file, &fileSize) || (fileSize.QuadPart < (long long)sizeof(HeaderType)))
+	{
+		return false;
+	}
+
+	m_fileSize = (unsigned long long)fileSize.QuadPart;
+
+	// Map the whole file copy on write, pages are only read from disk when they are first touched.
+	m_mapping = CreateFileMappingA(m_file, 0, PAGE_WRITECOPY, 0, 0, 0);
+	if (!m_mapping)
+	{
+		return false;
+	}
+
+	m_view = (unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (!m_view)
+	{
+		return false;
+	}
+
+	// Check the header before anything else looks at the file.
+	header = (const HeaderType*)m_view;
+	if ((header->magic != TERRAIN_FILE_MAGIC) || (header->version != TERRAIN_FILE_VERSION))
+	{
+		return false;
+	}
+
+	if ((header->width < 2) || (header->height < 2) || (header->pyramidSize < 1) || (header->indexCount < 0))
+	{
+		return false;
+	}
+
+	// Every section has to have the size the header implies, start aligned and lie inside the file.
+	for (i = 0; i < SECTION_COUNT; i++)
+	{
+		if (header->sections[i].size != GetSectionSize(*header, i))
+		{
+			return false;
+		}
+
+		if ((header->sections[i].offset % TERRAIN_FILE_ALIGNMENT) != 0)
+		{
+			return false;
+		}
+
+		end = header->sections[i].offset + header->sections[i].size;
+		if ((header->sections[i].offset < sizeof(HeaderType)) || (end < header->sections[i].offset) || (end > m_fileSize))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void TerrainFileClass::Close()
+{
+	// Release the view, the mapping and the file.
+	if (m_view)
+	{
+		UnmapViewOfFile(m_view);
+		m_view = 0;
+	}
+
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = 0;
+	}
+
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+
+	m_fileSize = 0;
+
+	return;
+}
+
+
+bool TerrainFileClass::Write(const char* filename, HeaderType& header, const void* const* sections)
+{
+	unsigned char padding[TERRAIN_FILE_ALIGNMENT];
+	FILE* filePtr;
+	unsigned long long offset;
+	size_t count;
+	int error, i;
+
+
+	// The caller fills in the sizes, the layout is worked out here.
+	header.magic = TERRAIN_FILE_MAGIC;
+	header.version = TERRAIN_FILE_VERSION;
+
+	offset = ((sizeof(HeaderType) + TERRAIN_FILE_ALIGNMENT - 1) / TERRAIN_FILE_ALIGNMENT) * TERRAIN_FILE_ALIGNMENT;
+	for (i = 0; i < SECTION_COUNT; i++)
+	{
+		header.sections[i].offset = offset;
+		header.sections[i].size = GetSectionSize(header, i);
+
+		offset += ((header.sections[i].size + TERRAIN_FILE_ALIGNMENT - 1) / TERRAIN_FILE_ALIGNMENT) * TERRAIN_FILE_ALIGNMENT;
+	}
+
+	memset(padding, 0, sizeof(padding));
+
+	// Open the file for writing in binary.
+	error = fopen_s(&filePtr, filename, "wb");
+	if (error != 0)
+	{
+		return false;
+	}
+
+	// Write the header and pad it out to the first section.
+	count = fwrite(&header, sizeof(HeaderType), 1, filePtr);
+	if (count != 1)
+	{
+		fclose(filePtr);
+		return false;
+	}
+
+	count = fwrite(padding, 1, (size_t)(header.sections[0].offset - sizeof(HeaderType)), filePtr);
+	if (count != (size_t)(header.sections[0].offset - sizeof(HeaderType)))
+	{
+		fclose(filePtr);
+		return false;
+	}
+
+	// Write every section followed by the padding up to the next boundary.
+	for (i = 0; i < SECTION_COUNT; i++)
+	{
+		if (header.sections[i].size > 0)
+		{
+			count = fwrite(sections[i], 1, (size_t)header.sections[i].size, filePtr);
+			if (count != (size_t)header.sections[i].size)
+			{
+				fclose(filePtr);
+				return false;
+			}
+		}
+
+		count = (size_t)((TERRAIN_FILE_ALIGNMENT - (header.sections[i].size % TERRAIN_FILE_ALIGNMENT)) % TERRAIN_FILE_ALIGNMENT);
+		if (fwrite(padding, 1, count, filePtr) != count)
+		{
+			fclose(filePtr);
+			return false;
+		}
+	}
+
+	// Close the file.
+	error = fclose(filePtr);
+	if (error != 0)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+const TerrainFileClass::HeaderType* TerrainFileClass::GetHeader()
+{
+	return (const HeaderType*)m_view;
+}
+
+
+void* TerrainFileClass::GetSection(int section)
+{
+	const HeaderType* header;
+
+
+	// An empty section has no data to point at.
+	header = (const HeaderType*)m_view;
+	if (header->sections[section].size == 0)
+	{
+		return 0;
+	}
+
+	return m_view + header->sections[section].offset;
+}
+
+
+unsigned long long TerrainFileClass::GetSectionSize(const HeaderType& header, int section)
+{
+	unsigned long long vertexCount, texelCount;
+	int size;
+
+
+	vertexCount = (unsigned long long)header.width * (unsigned long long)header.height;
+
+	switch (section)
+	{
+		case SECTION_HEIGHTS:
+			return vertexCount * sizeof(float);
+
+		case SECTION_NORMALS:
+			return vertexCount * sizeof(unsigned short);
+
+		case SECTION_MIN_HEIGHTS:
+		case SECTION_MAX_HEIGHTS:
+			return (unsigned long long)header.pyramidSize * sizeof(float);
+
+		case SECTION_VERTICES:
+			// x, z, height and normal, 8 bytes like VertexPackClass::PackedVertexType, in strips one patch wide that repeat the
+			// column they share.
+			if (header.patchSize <= 0)
+			{
+				return 0;
+			}
+
+			return ((unsigned long long)(header.width - 1) / header.patchSize) * (header.patchSize + 1) * header.height * 4 * sizeof(unsigned short);
+
+		case SECTION_CHUNKS:
+			return (unsigned long long)header.chunkCountX * (unsigned long long)header.chunkCountZ * sizeof(ChunkType);
+
+		case SECTION_NORMAL_MAP:
+			// Two bytes a texel for the full size and every mip level below it.
+			texelCount = 0;
+			for (size = header.normalMapSize; size >= 1; size /= 2)
+			{
+				texelCount += (unsigned long long)size * (unsigned long long)size;
+			}
+			return texelCount * sizeof(unsigned short);
+
+		case SECTION_INDICES:
+			return (unsigned long long)header.indexCount * sizeof(unsigned short);
+	}
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: terrainfileclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _TERRAINFILECLASS_H_
+#define _TERRAINFILECLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/////////////
+// GLOBALS //
+/////////////
+const unsigned int TERRAIN_FILE_MAGIC = 0x4e525254; // "TRRN"
+const unsigned int TERRAIN_FILE_VERSION = 6;
+const int TERRAIN_FILE_ALIGNMENT = 64;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: TerrainFileClass
+////////////////////////////////////////////////////////////////////////////////
+// Binary terrain file holding everything the terrain builds at load time. Every
+// section starts on a 64 byte boundary in the order the terrain uses it, so the
+// file is mapped and the sections are handed out as pointers into the view
+// without being read or copied. The view is copy on write, changes made through
+// the pointers stay in memory and never reach the file. Close has to be called
+// whether or not Open succeeded.
+class TerrainFileClass
+{
+public:
+	enum
+	{
+		SECTION_HEIGHTS,         // float per vertex, already scaled
+		SECTION_NORMALS,         // 8:8 octahedral normal per vertex
+		SECTION_MIN_HEIGHTS,     // height pyramid minimum levels
+		SECTION_MAX_HEIGHTS,     // height pyramid maximum levels
+		SECTION_VERTICES,        // packed vertices in patch strips, ready for the vertex buffer
+		SECTION_CHUNKS,          // bounds of every geomipmap patch
+		SECTION_NORMAL_MAP,      // RG8 normal map texels, every mip level
+		SECTION_INDICES,         // optimized 16 bit geomipmap index pool, optional
+		SECTION_COUNT
+	};
+
+	struct SectionType
+	{
+		unsigned long long offset;
+		unsigned long long size;
+	};
+
+	struct HeaderType
+	{
+		unsigned int magic;
+		unsigned int version;
+		int width, height;
+		float heightScale;
+		float minHeight, maxHeight, textureScale;
+		float packingHeightError, packingNormalError;
+		int pyramidLevelCount, pyramidSize;
+		int patchSize, chunkCountX, chunkCountZ;
+		int indexCount;
+		int normalMapSize;
+		unsigned long long sourceSize, sourceTime;
+		SectionType sections[SECTION_COUNT];
+	};
+
+	struct ChunkType
+	{
+		float minHeight, maxHeight;
+		int baseVertex;
+	};
+
+public:
+	TerrainFileClass();
+	TerrainFileClass(const TerrainFileClass&);
+	~TerrainFileClass();
+
+	bool Open(const char*);
+	void Close();
+	bool Write(const char*, HeaderType&, const void* const*);
+
+	const HeaderType* GetHeader();
+	void* GetSection(int);
+
+private:
+	unsigned long long GetSectionSize(const HeaderType&, int);
+
+private:
+	HANDLE m_file, m_mapping;
+	unsigned char* m_view;
+	unsigned long long m_fileSize;
+};
+
+#endif
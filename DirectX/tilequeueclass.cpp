@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: tilequeueclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "tilequeueclass.h"
+
+
+TileQueueClass::TileQueueClass()
+{
+	m_items = 0;
+	m_mask = 0;
+	m_head = 0;
+	m_tail = 0;
+}
+
+
+TileQueueClass::TileQueueClass(const TileQueueClass& other)
+{
+}
+
+
+TileQueueClass::~TileQueueClass()
+{
+}
+
+
+bool TileQueueClass::Initialize(int capacity)
+{
+	unsigned int size;
+
+
+	// Round the capacity up to a power of two so the positions wrap with a mask.
+	size = 1;
+	while (size < (unsigned int)capacity)
+	{
+		size *= 2;
+	}
+
+	m_items = new int[size];
+	if (!m_items)
+	{
+		return false;
+	}
+
+	m_mask = size - 1;
+	m_head = 0;
+	m_tail = 0;
+
+	return true;
+}
+
+
+void TileQueueClass::Shutdown()
+{
+	// Release the ring.
+	if (m_items)
+	{
+		delete[] m_items;
+		m_items = 0;
+	}
+
+	return;
+}
+
+
+bool TileQueueClass::Push(int item)
+{
+	unsigned int tail;
+
+
+	// Only the producer moves the tail, the head is read to see if there is room (the positions wrap around).
+	tail = m_tail.load(memory_order_relaxed);
+	if ((tail - m_head.load(memory_order_acquire)) > m_mask)
+	{
+		return false;
+	}
+
+	m_items[tail & m_mask] = item;
+
+	// Publishing the new tail also publishes everything written to the tile before the push.
+	m_tail.store(tail + 1, memory_order_release);
+
+	return true;
+}
+
+
+bool TileQueueClass::Pop(int& item)
+{
+	unsigned int head;
+
+
+	// Only the consumer moves the head, the tail is read to see if there is anything.
+	head = m_head.load(memory_order_relaxed);
+	if (head == m_tail.load(memory_order_acquire))
+	{
+		return false;
+	}
+
+	item = m_items[head & m_mask];
+
+	m_head.store(head + 1, memory_order_release);
+
+	return true;
+}
+
+
+bool TileQueueClass::IsEmpty()
+{
+	return (m_head.load(memory_order_acquire) == m_tail.load(memory_order_acquire));
+}
@@ -0,0 +1,46 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: tilequeueclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _TILEQUEUECLASS_H_
+#define _TILEQUEUECLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <atomic>
+
+using namespace std;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: TileQueueClass
+////////////////////////////////////////////////////////////////////////////////
+// Fixed size ring of tile slot numbers between exactly one producer thread and
+// one consumer thread. Neither side ever waits on the other, a full queue makes
+// Push fail and an empty one makes Pop fail.
+class TileQueueClass
+{
+public:
+	TileQueueClass();
+	TileQueueClass(const TileQueueClass&);
+	~TileQueueClass();
+
+	bool Initialize(int);
+	void Shutdown();
+
+	bool Push(int);
+	bool Pop(int&);
+	bool IsEmpty();
+
+private:
+	int* m_items;
+	unsigned int m_mask;
+
+	// Written by the consumer and the producer respectively, padded onto separate cache lines.
+	atomic<unsigned int> m_head;
+	char m_padding[64];
+	atomic<unsigned int> m_tail;
+};
+
+#endif
@@ -0,0 +1,703 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: tilestreamclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "tilestreamclass.h"
+
+
+TileStreamClass::TileStreamClass()
+{
+	m_VertexPack = 0;
+	m_Geomipmap = 0;
+	m_tiles = 0;
+	m_tileCount = 0;
+}
+
+
+TileStreamClass::TileStreamClass(const TileStreamClass& other)
+{
+}
+
+
+TileStreamClass::~TileStreamClass()
+{
+}
+
+
+bool TileStreamClass::Initialize(ID3D11Device* device, VertexPackClass* vertexPack, GeomipmapClass* geomipmap, int excludeX, int excludeZ)
+{
+	D3D11_BUFFER_DESC vertexBufferDesc;
+	INT64 frequency;
+	XMFLOAT4 decode;
+	HRESULT hresult;
+	int i, vertexCount;
+	bool result;
+
+
+	m_VertexPack = vertexPack;
+	m_Geomipmap = geomipmap;
+	m_excludeX = excludeX;
+	m_excludeZ = excludeZ;
+
+	// Get the cycles per second speed for the latency measurements.
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	if (frequency == 0)
+	{
+		return false;
+	}
+
+	m_frequency = (float)frequency;
+
+	// Generated tiles use the height range the vertices can be packed with.
+	decode = m_VertexPack->GetDecodeParameters();
+	m_minHeight = decode.y;
+	m_maxHeight = decode.y + (decode.x * 65535.0f);
+
+	// Every tile keeps its heights and vertices in memory as well as its vertex buffer, the budget decides the slot count.
+	vertexCount = (TILE_STREAM_TILE_SIZE + 1) * (TILE_STREAM_TILE_SIZE + 1);
+	m_tileBytes = (vertexCount * sizeof(float)) + (m_Geomipmap->GetVertexCount() * 2 * sizeof(VertexPackClass::PackedVertexType));
+
+	m_tileCount = TILE_STREAM_BUDGET / m_tileBytes;
+	if (m_tileCount < 1)
+	{
+		return false;
+	}
+
+	// Create the tile slots.
+	m_tiles = new TileType[m_tileCount];
+	if (!m_tiles)
+	{
+		return false;
+	}
+
+	for (i = 0; i < m_tileCount; i++)
+	{
+		m_tiles[i].heights = 0;
+		m_tiles[i].vertices = 0;
+		m_tiles[i].vertexBuffer = 0;
+	}
+
+	// Set up the description of a tile vertex buffer, the contents are replaced every time a new tile lands in the slot.
+	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	vertexBufferDesc.ByteWidth = sizeof(VertexPackClass::PackedVertexType) * m_Geomipmap->GetVertexCount();
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+
+	for (i = 0; i < m_tileCount; i++)
+	{
+		m_tiles[i].state = TILE_EMPTY;
+		m_tiles[i].lastUsed = 0;
+
+		m_tiles[i].heights = new float[vertexCount];
+		if (!m_tiles[i].heights)
+		{
+			return false;
+		}
+
+		m_tiles[i].vertices = new VertexPackClass::PackedVertexType[m_Geomipmap->GetVertexCount()];
+		if (!m_tiles[i].vertices)
+		{
+			return false;
+		}
+
+		hresult = device->CreateBuffer(&vertexBufferDesc, NULL, &m_tiles[i].vertexBuffer);
+		if (FAILED(hresult))
+		{
+			return false;
+		}
+	}
+
+	// No tile is in a slot or wanted yet.
+	for (i = 0; i < (TILE_STREAM_WORLD_TILES * TILE_STREAM_WORLD_TILES); i++)
+	{
+		m_tileSlots[i] = TILE_STREAM_NO_SLOT;
+		m_wantedFrame[i] = 0;
+	}
+
+	// A slot is in at most one queue at a time so none of them can fill up.
+	result = m_loadQueue.Initialize(m_tileCount);
+	if (!result)
+	{
+		return false;
+	}
+
+	for (i = 0; i < TILE_STREAM_WORKERS; i++)
+	{
+		result = m_buildQueues[i].Initialize(m_tileCount);
+		if (!result)
+		{
+			return false;
+		}
+
+		result = m_doneQueues[i].Initialize(m_tileCount);
+		if (!result)
+		{
+			return false;
+		}
+	}
+
+	// Clear the statistics.
+	m_frame = 1;
+	m_hits = 0;
+	m_misses = 0;
+	m_latencyCount = 0;
+	m_latencySum = 0.0f;
+	m_maxLatency = 0.0f;
+
+	// Start the loader and the worker threads.
+	m_stop = false;
+	m_nextWorker = 0;
+
+	m_loader = thread(&TileStreamClass::RunLoader, this);
+
+	for (i = 0; i < TILE_STREAM_WORKERS; i++)
+	{
+		m_workers[i] = thread(&TileStreamClass::RunWorker, this, i);
+	}
+
+	return true;
+}
+
+
+void TileStreamClass::Shutdown()
+{
+	int i;
+
+
+	// Stop the threads, a tile that is half built is simply dropped.
+	m_stop = true;
+
+	if (m_loader.joinable())
+	{
+		Wake(m_loaderMutex, m_loaderCondition);
+		m_loader.join();
+	}
+
+	for (i = 0; i < TILE_STREAM_WORKERS; i++)
+	{
+		if (m_workers[i].joinable())
+		{
+			Wake(m_workerMutex[i], m_workerCondition[i]);
+			m_workers[i].join();
+		}
+	}
+
+	// Release the queues.
+	m_loadQueue.Shutdown();
+	for (i = 0; i < TILE_STREAM_WORKERS; i++)
+	{
+		m_buildQueues[i].Shutdown();
+		m_doneQueues[i].Shutdown();
+	}
+
+	// Release the tile slots.
+	if (m_tiles)
+	{
+		for (i = 0; i < m_tileCount; i++)
+		{
+			if (m_tiles[i].vertexBuffer)
+			{
+				m_tiles[i].vertexBuffer->Release();
+				m_tiles[i].vertexBuffer = 0;
+			}
+
+			if (m_tiles[i].vertices)
+			{
+				delete[] m_tiles[i].vertices;
+				m_tiles[i].vertices = 0;
+			}
+
+			if (m_tiles[i].heights)
+			{
+				delete[] m_tiles[i].heights;
+				m_tiles[i].heights = 0;
+			}
+		}
+
+		delete[] m_tiles;
+		m_tiles = 0;
+	}
+
+	return;
+}
+
+
+void TileStreamClass::Update(ID3D11DeviceContext* deviceContext, float cameraX, float cameraZ)
+{
+	m_frame++;
+
+	// Upload the tiles the workers have finished first so they count as resident this frame.
+	UploadTiles(deviceContext);
+
+	// Ask for the tiles around the camera that are not resident yet.
+	RequestTiles(cameraX, cameraZ);
+
+	return;
+}
+
+
+int TileStreamClass::GetSlotCount()
+{
+	return m_tileCount;
+}
+
+
+bool TileStreamClass::GetTile(int slot, ID3D11Buffer*& vertexBuffer, int& tileX, int& tileZ)
+{
+	// Only resident tiles have a vertex buffer worth drawing.
+	if (m_tiles[slot].state != TILE_RESIDENT)
+	{
+		return false;
+	}
+
+	vertexBuffer = m_tiles[slot].vertexBuffer;
+	tileX = m_tiles[slot].x;
+	tileZ = m_tiles[slot].z;
+
+	return true;
+}
+
+
+int TileStreamClass::GetResidentCount()
+{
+	int i, count;
+
+
+	count = 0;
+	for (i = 0; i < m_tileCount; i++)
+	{
+		if (m_tiles[i].state == TILE_RESIDENT)
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+
+int TileStreamClass::GetResidentBytes()
+{
+	return GetResidentCount() * m_tileBytes;
+}
+
+
+float TileStreamClass::GetHitRate()
+{
+	// The share of tiles coming back into range that were still in the cache.
+	if ((m_hits + m_misses) == 0)
+	{
+		return 0.0f;
+	}
+
+	return (float)m_hits / (float)(m_hits + m_misses);
+}
+
+
+float TileStreamClass::GetAverageLatency()
+{
+	// Milliseconds from asking for a tile until it was uploaded.
+	if (m_latencyCount == 0)
+	{
+		return 0.0f;
+	}
+
+	return m_latencySum / (float)m_latencyCount;
+}
+
+
+float TileStreamClass::GetMaxLatency()
+{
+	return m_maxLatency;
+}
+
+
+void TileStreamClass::UploadTiles(ID3D11DeviceContext* deviceContext)
+{
+	INT64 currentTime;
+	int i, slot, uploads;
+	float latency;
+
+
+	// Limit the uploads so a burst of finished tiles is spread over a few frames.
+	uploads = 0;
+	for (i = 0; i < TILE_STREAM_WORKERS; i++)
+	{
+		while ((uploads < TILE_STREAM_UPLOADS_PER_FRAME) && m_doneQueues[i].Pop(slot))
+		{
+			deviceContext->UpdateSubresource(m_tiles[slot].vertexBuffer, 0, NULL, m_tiles[slot].vertices, 0, 0);
+			m_tiles[slot].state = TILE_RESIDENT;
+			uploads++;
+
+			QueryPerformanceCounter((LARGE_INTEGER*)&currentTime);
+			latency = (float)(currentTime - m_tiles[slot].requestTime) * 1000.0f / m_frequency;
+
+			m_latencySum += latency;
+			m_latencyCount++;
+			if (latency > m_maxLatency)
+			{
+				m_maxLatency = latency;
+			}
+		}
+	}
+
+	return;
+}
+
+
+void TileStreamClass::RequestTiles(float cameraX, float cameraZ)
+{
+	int centerX, centerZ, ring, pass, dx, dz, x, z, tile, slot;
+
+
+	centerX = (int)floorf(cameraX / (float)TILE_STREAM_TILE_SIZE);
+	centerZ = (int)floorf(cameraZ / (float)TILE_STREAM_TILE_SIZE);
+
+	/*
+		The first pass marks every tile in range as used so none of them can be evicted, the
+		second pass finds slots for the ones that are missing. Both go out ring by ring from
+		the camera so the nearest tiles get the slots when the budget runs out.
+	*/
+	for (pass = 0; pass < 2; pass++)
+	{
+		for (ring = 0; ring <= TILE_STREAM_RADIUS; ring++)
+		{
+			for (dz = -ring; dz <= ring; dz++)
+			{
+				for (dx = -ring; dx <= ring; dx++)
+				{
+					if ((abs(dx) != ring) && (abs(dz) != ring))
+					{
+						continue;
+					}
+
+					x = centerX + dx;
+					z = centerZ + dz;
+					if ((x < 0) || (x >= TILE_STREAM_WORLD_TILES) || (z < 0) || (z >= TILE_STREAM_WORLD_TILES) || ((x == m_excludeX) && (z == m_excludeZ)))
+					{
+						continue;
+					}
+
+					tile = (z * TILE_STREAM_WORLD_TILES) + x;
+					slot = m_tileSlots[tile];
+
+					if (pass == 0)
+					{
+						// A tile coming back into range is a hit if it is still resident.
+						if (m_wantedFrame[tile] != (m_frame - 1))
+						{
+							if ((slot != TILE_STREAM_NO_SLOT) && (m_tiles[slot].state == TILE_RESIDENT))
+							{
+								m_hits++;
+							}
+							else
+							{
+								m_misses++;
+							}
+						}
+
+						m_wantedFrame[tile] = m_frame;
+						if (slot != TILE_STREAM_NO_SLOT)
+						{
+							m_tiles[slot].lastUsed = m_frame;
+						}
+
+						continue;
+					}
+
+					if (slot != TILE_STREAM_NO_SLOT)
+					{
+						continue;
+					}
+
+					// Take a free slot or evict a tile that is out of range, none left means the budget is used up.
+					slot = FindSlot(cameraX, cameraZ);
+					if (slot == TILE_STREAM_NO_SLOT)
+					{
+						return;
+					}
+
+					if (m_tiles[slot].state == TILE_RESIDENT)
+					{
+						m_tileSlots[(m_tiles[slot].z * TILE_STREAM_WORLD_TILES) + m_tiles[slot].x] = TILE_STREAM_NO_SLOT;
+					}
+
+					m_tiles[slot].x = x;
+					m_tiles[slot].z = z;
+					m_tiles[slot].state = TILE_LOADING;
+					m_tiles[slot].lastUsed = m_frame;
+					QueryPerformanceCounter((LARGE_INTEGER*)&m_tiles[slot].requestTime);
+					m_tileSlots[tile] = slot;
+
+					// Hand the slot to the loader.
+					m_loadQueue.Push(slot);
+					Wake(m_loaderMutex, m_loaderCondition);
+				}
+			}
+		}
+	}
+
+	return;
+}
+
+
+int TileStreamClass::FindSlot(float cameraX, float cameraZ)
+{
+	int i, best;
+	float dx, dz, distance, bestDistance;
+
+
+	// An empty slot costs nothing.
+	for (i = 0; i < m_tileCount; i++)
+	{
+		if (m_tiles[i].state == TILE_EMPTY)
+		{
+			return i;
+		}
+	}
+
+	// Otherwise evict the least recently used resident tile, the farthest one when several were last used together.
+	best = TILE_STREAM_NO_SLOT;
+	bestDistance = 0.0f;
+	for (i = 0; i < m_tileCount; i++)
+	{
+		// Tiles in range this frame and tiles still being loaded are never evicted.
+		if ((m_tiles[i].state != TILE_RESIDENT) || (m_tiles[i].lastUsed == m_frame))
+		{
+			continue;
+		}
+
+		dx = (((float)m_tiles[i].x + 0.5f) * (float)TILE_STREAM_TILE_SIZE) - cameraX;
+		dz = (((float)m_tiles[i].z + 0.5f) * (float)TILE_STREAM_TILE_SIZE) - cameraZ;
+		distance = sqrtf((dx * dx) + (dz * dz));
+
+		if ((best == TILE_STREAM_NO_SLOT) || (m_tiles[i].lastUsed < m_tiles[best].lastUsed) ||
+			((m_tiles[i].lastUsed == m_tiles[best].lastUsed) && (distance > bestDistance)))
+		{
+			best = i;
+			bestDistance = distance;
+		}
+	}
+
+	return best;
+}
+
+
+void TileStreamClass::RunLoader()
+{
+	int slot;
+
+
+	while (true)
+	{
+		// Sleep until there is a tile to load or the stream is shut down.
+		{
+			unique_lock<mutex> lock(m_loaderMutex);
+			m_loaderCondition.wait(lock, [&]() { return m_stop || !m_loadQueue.IsEmpty(); });
+		}
+
+		if (m_stop)
+		{
+			return;
+		}
+
+		while (m_loadQueue.Pop(slot))
+		{
+			// A tile without a file is generated by the worker instead.
+			m_tiles[slot].fromDisk = ReadTile(m_tiles[slot]);
+
+			// Hand the tiles to the workers in turn.
+			m_buildQueues[m_nextWorker].Push(slot);
+			Wake(m_workerMutex[m_nextWorker], m_workerCondition[m_nextWorker]);
+
+			m_nextWorker = (m_nextWorker + 1) % TILE_STREAM_WORKERS;
+		}
+	}
+}
+
+
+void TileStreamClass::RunWorker(int worker)
+{
+	int slot;
+
+
+	while (true)
+	{
+		// Sleep until there is a tile to build or the stream is shut down.
+		{
+			unique_lock<mutex> lock(m_workerMutex[worker]);
+			m_workerCondition[worker].wait(lock, [&]() { return m_stop || !m_buildQueues[worker].IsEmpty(); });
+		}
+
+		if (m_stop)
+		{
+			return;
+		}
+
+		while (m_buildQueues[worker].Pop(slot))
+		{
+			if (!m_tiles[slot].fromDisk)
+			{
+				GenerateHeights(m_tiles[slot]);
+			}
+
+			BuildVertices(m_tiles[slot]);
+
+			// The render thread picks the tile up on its next frame.
+			m_doneQueues[worker].Push(slot);
+		}
+	}
+}
+
+
+bool TileStreamClass::ReadTile(TileType& tile)
+{
+	char filename[64];
+	FILE* filePtr;
+	int error, vertexCount;
+	size_t count;
+
+
+	sprintf_s(filename, sizeof(filename), "./tiles/tile_%d_%d.raw", tile.x, tile.z);
+
+	// Open the tile file for reading in binary.
+	error = fopen_s(&filePtr, filename, "rb");
+	if (error != 0)
+	{
+		return false;
+	}
+
+	// Read in the heights, a short file is treated as missing.
+	vertexCount = (TILE_STREAM_TILE_SIZE + 1) * (TILE_STREAM_TILE_SIZE + 1);
+	count = fread(tile.heights, sizeof(float), vertexCount, filePtr);
+
+	fclose(filePtr);
+
+	return (count == (size_t)vertexCount);
+}
+
+
+void TileStreamClass::GenerateHeights(TileType& tile)
+{
+	int i, j;
+	float x, z;
+
+
+	// Sample the noise at world positions so neighbouring tiles meet without a seam.
+	for (j = 0; j <= TILE_STREAM_TILE_SIZE; j++)
+	{
+		for (i = 0; i <= TILE_STREAM_TILE_SIZE; i++)
+		{
+			x = (float)((tile.x * TILE_STREAM_TILE_SIZE) + i);
+			z = (float)((tile.z * TILE_STREAM_TILE_SIZE) + (TILE_STREAM_TILE_SIZE - j));
+
+			tile.heights[(j * (TILE_STREAM_TILE_SIZE + 1)) + i] = m_minHeight + ((m_maxHeight - m_minHeight) * GetNoise(x * TILE_STREAM_NOISE_SCALE, z * TILE_STREAM_NOISE_SCALE));
+		}
+	}
+
+	return;
+}
+
+
+void TileStreamClass::BuildVertices(TileType& tile)
+{
+	XMFLOAT3 position, normal;
+	int vertex, index, i, j, width, left, right, up, down;
+	float slopeX, slopeZ, length;
+
+
+	width = TILE_STREAM_TILE_SIZE + 1;
+
+	// Build the vertices in the order of the vertex buffer, the columns shared by two strips are built twice.
+	for (vertex = 0; vertex < m_Geomipmap->GetVertexCount(); vertex++)
+	{
+		index = m_Geomipmap->GetGridVertex(vertex);
+		j = index / width;
+		i = index % width;
+
+		// Rows run towards negative z like the rest of the terrain.
+		position.x = (float)((tile.x * TILE_STREAM_TILE_SIZE) + i);
+		position.y = tile.heights[index];
+		position.z = (float)((tile.z * TILE_STREAM_TILE_SIZE) + (TILE_STREAM_TILE_SIZE - j));
+
+		// Central differences, one sided on the tile border.
+		left = (i > 0) ? i - 1 : i;
+		right = (i < (width - 1)) ? i + 1 : i;
+		up = (j > 0) ? j - 1 : j;
+		down = (j < (width - 1)) ? j + 1 : j;
+
+		slopeX = (tile.heights[(j * width) + right] - tile.heights[(j * width) + left]) / (float)(right - left);
+		slopeZ = (tile.heights[(up * width) + i] - tile.heights[(down * width) + i]) / (float)(down - up);
+
+		length = sqrtf((slopeX * slopeX) + 1.0f + (slopeZ * slopeZ));
+		normal = XMFLOAT3(-slopeX / length, 1.0f / length, -slopeZ / length);
+
+		m_VertexPack->PackVertex(position, normal, tile.vertices[vertex]);
+	}
+
+	return;
+}
+
+
+float TileStreamClass::GetNoise(float x, float z)
+{
+	int i, cellX, cellZ;
+	float sum, amplitude, total, fractionX, fractionZ, top, bottom;
+
+
+	// A few octaves of smoothed value noise, scaled back to 0 to 1.
+	sum = 0.0f;
+	total = 0.0f;
+	amplitude = 1.0f;
+
+	for (i = 0; i < TILE_STREAM_NOISE_OCTAVES; i++)
+	{
+		cellX = (int)floorf(x);
+		cellZ = (int)floorf(z);
+
+		fractionX = x - (float)cellX;
+		fractionZ = z - (float)cellZ;
+		fractionX = fractionX * fractionX * (3.0f - (2.0f * fractionX));
+		fractionZ = fractionZ * fractionZ * (3.0f - (2.0f * fractionZ));
+
+		bottom = GetLatticeValue(cellX, cellZ) + ((GetLatticeValue(cellX + 1, cellZ) - GetLatticeValue(cellX, cellZ)) * fractionX);
+		top = GetLatticeValue(cellX, cellZ + 1) + ((GetLatticeValue(cellX + 1, cellZ + 1) - GetLatticeValue(cellX, cellZ + 1)) * fractionX);
+
+		sum += (bottom + ((top - bottom) * fractionZ)) * amplitude;
+		total += amplitude;
+
+		x *= 2.0f;
+		z *= 2.0f;
+		amplitude *= 0.5f;
+	}
+
+	return sum / total;
+}
+
+
+float TileStreamClass::GetLatticeValue(int x, int z)
+{
+	unsigned int hash;
+
+
+	// Integer hash of the lattice point, the same point always gets the same value.
+	hash = ((unsigned int)x * 73856093u) ^ ((unsigned int)z * 19349663u);
+	hash = (hash ^ (hash >> 13)) * 1274126177u;
+	hash = hash ^ (hash >> 16);
+
+	return (float)(hash & 0xffff) / 65535.0f;
+}
+
+
+void TileStreamClass::Wake(mutex& sleepMutex, condition_variable& condition)
+{
+	// Taking the lock orders the wake up after the sleeper's check, so it cannot be missed.
+	{
+		lock_guard<mutex> lock(sleepMutex);
+	}
+
+	condition.notify_one();
+
+	return;
+}
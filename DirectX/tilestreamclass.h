@@ -0,0 +1,140 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: tilestreamclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _TILESTREAMCLASS_H_
+#define _TILESTREAMCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <d3d11.h>
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "vertexpackclass.h"
+#include "geomipmapclass.h"
+#include "tilequeueclass.h"
+
+using namespace std;
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int TILE_STREAM_TILE_SIZE = 256;
+const int TILE_STREAM_WORLD_TILES = 16;
+const int TILE_STREAM_RADIUS = 2;
+const int TILE_STREAM_BUDGET = 48 * 1024 * 1024;
+const int TILE_STREAM_WORKERS = 2;
+const int TILE_STREAM_UPLOADS_PER_FRAME = 2;
+const int TILE_STREAM_NO_SLOT = -1;
+const float TILE_STREAM_NOISE_SCALE = 1.0f / 96.0f;
+const int TILE_STREAM_NOISE_OCTAVES = 5;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: TileStreamClass
+////////////////////////////////////////////////////////////////////////////////
+// Keeps the terrain tiles around the camera resident within a fixed memory
+// budget. The world is a square of tiles, tile (x, z) covers the grid from
+// (x, z) * TILE_STREAM_TILE_SIZE and one tile is left out for the terrain that
+// is always loaded.
+//
+// The render thread asks for tiles and uploads them, a loader thread reads the
+// tile files (./tiles/tile_x_z.raw, rows of floats from the far side) and the
+// worker threads generate missing tiles and build their vertices, laid out in
+// the patch strips of the terrain's geomipmap so they share its index pool. Tiles only
+// move between the threads as slot numbers through single producer, single
+// consumer queues.
+class TileStreamClass
+{
+private:
+	enum
+	{
+		TILE_EMPTY,
+		TILE_LOADING,
+		TILE_RESIDENT
+	};
+
+	// One slot of the cache, the arrays are allocated once and reused by every tile that lands in it.
+	struct TileType
+	{
+		int x, z;
+		int state;
+		bool fromDisk;
+		unsigned int lastUsed;
+		INT64 requestTime;
+		float* heights;
+		VertexPackClass::PackedVertexType* vertices;
+		ID3D11Buffer* vertexBuffer;
+	};
+
+public:
+	TileStreamClass();
+	TileStreamClass(const TileStreamClass&);
+	~TileStreamClass();
+
+	bool Initialize(ID3D11Device*, VertexPackClass*, GeomipmapClass*, int, int);
+	void Shutdown();
+
+	void Update(ID3D11DeviceContext*, float, float);
+
+	int GetSlotCount();
+	bool GetTile(int, ID3D11Buffer*&, int&, int&);
+
+	int GetResidentCount();
+	int GetResidentBytes();
+	float GetHitRate();
+	float GetAverageLatency();
+	float GetMaxLatency();
+
+private:
+	void UploadTiles(ID3D11DeviceContext*);
+	void RequestTiles(float, float);
+	int FindSlot(float, float);
+	void RunLoader();
+	void RunWorker(int);
+	bool ReadTile(TileType&);
+	void GenerateHeights(TileType&);
+	void BuildVertices(TileType&);
+	float GetNoise(float, float);
+	float GetLatticeValue(int, int);
+	void Wake(mutex&, condition_variable&);
+
+private:
+	VertexPackClass* m_VertexPack;
+	GeomipmapClass* m_Geomipmap;
+	TileType* m_tiles;
+	int m_tileCount, m_tileBytes;
+	int m_tileSlots[TILE_STREAM_WORLD_TILES * TILE_STREAM_WORLD_TILES];
+	unsigned int m_wantedFrame[TILE_STREAM_WORLD_TILES * TILE_STREAM_WORLD_TILES];
+	int m_excludeX, m_excludeZ;
+	unsigned int m_frame;
+	float m_minHeight, m_maxHeight;
+
+	TileQueueClass m_loadQueue;
+	TileQueueClass m_buildQueues[TILE_STREAM_WORKERS];
+	TileQueueClass m_doneQueues[TILE_STREAM_WORKERS];
+
+	thread m_loader;
+	thread m_workers[TILE_STREAM_WORKERS];
+	mutex m_loaderMutex;
+	condition_variable m_loaderCondition;
+	mutex m_workerMutex[TILE_STREAM_WORKERS];
+	condition_variable m_workerCondition[TILE_STREAM_WORKERS];
+	atomic<bool> m_stop;
+	int m_nextWorker;
+
+	float m_frequency;
+	int m_hits, m_misses, m_latencyCount;
+	float m_latencySum, m_maxLatency;
+};
+
+#endif
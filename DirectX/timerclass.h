@@ -29,6 +29,7 @@ public:
 	void StartTimer();
 	void StopTimer();
 	int GetTiming();
+	float GetPreciseTiming();
 
 private:
 	float m_frequency;
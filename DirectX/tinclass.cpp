@@ -0,0 +1,955 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: tinclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "tinclass.h"
+
+
+TinClass::TinClass()
+{
+	m_heights = 0;
+	m_tiles = 0;
+	m_tileCountX = 0;
+	m_tileCountZ = 0;
+	m_gridTriangleCount = 0;
+	m_tinTriangleCount = 0;
+}
+
+
+TinClass::TinClass(const TinClass& other)
+{
+}
+
+
+TinClass::~TinClass()
+{
+}
+
+
+bool TinClass::Initialize(const float* heights, int terrainWidth, int terrainHeight, int tileSize, float maxError)
+{
+	ParallelForClass parallel;
+	atomic<bool> failed;
+	int i;
+
+
+	// The tiles have to cover the terrain exactly and their indices have to fit in 16 bits.
+	if ((tileSize < 2) || (((terrainWidth - 1) % tileSize) != 0) || (((terrainHeight - 1) % tileSize) != 0))
+	{
+		return false;
+	}
+
+	if (((tileSize + 1) * (tileSize + 1)) > 65536)
+	{
+		return false;
+	}
+
+	m_heights = heights;
+	m_terrainWidth = terrainWidth;
+	m_terrainHeight = terrainHeight;
+	m_tileSize = tileSize;
+	m_maxError = maxError;
+
+	m_tileCountX = (terrainWidth - 1) / tileSize;
+	m_tileCountZ = (terrainHeight - 1) / tileSize;
+
+	m_tiles = new TileType[m_tileCountX * m_tileCountZ];
+	if (!m_tiles)
+	{
+		return false;
+	}
+
+	for (i = 0; i < (m_tileCountX * m_tileCountZ); i++)
+	{
+		m_tiles[i].indices = 0;
+		m_tiles[i].indexCount = 0;
+		m_tiles[i].maxError = 0.0f;
+	}
+
+	// The tiles do not share anything while they are simplified, every thread takes whole tiles.
+	failed = false;
+	parallel.Run(m_tileCountX * m_tileCountZ, 1, [&](int begin, int end)
+	{
+		WorkspaceType workspace;
+		int tile;
+
+
+		if (!CreateWorkspace(workspace))
+		{
+			ReleaseWorkspace(workspace);
+			failed = true;
+			return;
+		}
+
+		for (tile = begin; tile < end; tile++)
+		{
+			if (!SimplifyTile(tile, workspace))
+			{
+				failed = true;
+			}
+		}
+
+		ReleaseWorkspace(workspace);
+	});
+
+	if (failed)
+	{
+		return false;
+	}
+
+	// Add up the triangles for the reduction report.
+	m_gridTriangleCount = m_tileCountX * m_tileCountZ * m_tileSize * m_tileSize * 2;
+	m_tinTriangleCount = 0;
+	for (i = 0; i < (m_tileCountX * m_tileCountZ); i++)
+	{
+		m_tinTriangleCount += m_tiles[i].indexCount / 3;
+	}
+
+	return true;
+}
+
+
+void TinClass::Shutdown()
+{
+	int i;
+
+
+	// Release the tiles.
+	if (m_tiles)
+	{
+		for (i = 0; i < (m_tileCountX * m_tileCountZ); i++)
+		{
+			if (m_tiles[i].indices)
+			{
+				delete[] m_tiles[i].indices;
+				m_tiles[i].indices = 0;
+			}
+		}
+
+		delete[] m_tiles;
+		m_tiles = 0;
+	}
+
+	m_heights = 0;
+
+	return;
+}
+
+
+int TinClass::GetTileCount()
+{
+	return m_tileCountX * m_tileCountZ;
+}
+
+
+void TinClass::GetTile(int tile, int& cornerVertex, const unsigned short*& indices, int& indexCount)
+{
+	cornerVertex = m_tiles[tile].cornerVertex;
+	indices = m_tiles[tile].indices;
+	indexCount = m_tiles[tile].indexCount;
+	return;
+}
+
+
+void TinClass::GetTriangleCounts(int& gridTriangles, int& tinTriangles)
+{
+	gridTriangles = m_gridTriangleCount;
+	tinTriangles = m_tinTriangleCount;
+	return;
+}
+
+
+float TinClass::GetMaxError()
+{
+	float maxError;
+	int i;
+
+
+	// The largest vertical error actually left at any grid sample.
+	maxError = 0.0f;
+	for (i = 0; i < (m_tileCountX * m_tileCountZ); i++)
+	{
+		maxError = (m_tiles[i].maxError > maxError) ? m_tiles[i].maxError : maxError;
+	}
+
+	return maxError;
+}
+
+
+bool TinClass::CreateWorkspace(WorkspaceType& workspace)
+{
+	int vertexCount, triangleCount;
+
+
+	// Null everything first so a partly created workspace can be released.
+	memset(&workspace, 0, sizeof(WorkspaceType));
+
+	vertexCount = (m_tileSize + 1) * (m_tileSize + 1);
+	triangleCount = m_tileSize * m_tileSize * 2;
+
+	workspace.heights = new float[vertexCount];
+	workspace.quadrics = new double[vertexCount * 10];
+	workspace.locked = new bool[vertexCount];
+	workspace.removed = new bool[vertexCount];
+	workspace.vertexCorner = new int[vertexCount];
+	workspace.cornerVertex = new int[triangleCount * 3];
+	workspace.cornerNext = new int[triangleCount * 3];
+	workspace.triangleAlive = new bool[triangleCount];
+	workspace.pointFirst = new int[triangleCount];
+	workspace.pointNext = new int[vertexCount];
+	workspace.heapVertices = new int[vertexCount];
+	workspace.heapCosts = new double[vertexCount];
+	workspace.heapPositions = new int[vertexCount];
+	workspace.star = new int[triangleCount];
+	workspace.points = new int[vertexCount];
+	workspace.pointTriangles = new int[vertexCount];
+	workspace.candidates = new int[vertexCount];
+	workspace.candidateCosts = new double[vertexCount];
+
+	if (!workspace.heights || !workspace.quadrics || !workspace.locked || !workspace.removed || !workspace.vertexCorner ||
+		!workspace.cornerVertex || !workspace.cornerNext || !workspace.triangleAlive || !workspace.pointFirst ||
+		!workspace.pointNext || !workspace.heapVertices || !workspace.heapCosts || !workspace.heapPositions ||
+		!workspace.star || !workspace.points || !workspace.pointTriangles || !workspace.candidates || !workspace.candidateCosts)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+void TinClass::ReleaseWorkspace(WorkspaceType& workspace)
+{
+	// Delete of a null pointer does nothing, so every array can go regardless.
+	delete[] workspace.heights;
+	delete[] workspace.quadrics;
+	delete[] workspace.locked;
+	delete[] workspace.removed;
+	delete[] workspace.vertexCorner;
+	delete[] workspace.cornerVertex;
+	delete[] workspace.cornerNext;
+	delete[] workspace.triangleAlive;
+	delete[] workspace.pointFirst;
+	delete[] workspace.pointNext;
+	delete[] workspace.heapVertices;
+	delete[] workspace.heapCosts;
+	delete[] workspace.heapPositions;
+	delete[] workspace.star;
+	delete[] workspace.points;
+	delete[] workspace.pointTriangles;
+	delete[] workspace.candidates;
+	delete[] workspace.candidateCosts;
+
+	memset(&workspace, 0, sizeof(WorkspaceType));
+
+	return;
+}
+
+
+bool TinClass::SimplifyTile(int tile, WorkspaceType& workspace)
+{
+	int i, vertexCount, u, starCount, candidateCount, best, k, corner, neighbour;
+	bool found;
+
+
+	BuildGrid(tile, workspace);
+
+	// Queue every vertex that can move with the cost of its cheapest collapse.
+	vertexCount = (m_tileSize + 1) * (m_tileSize + 1);
+	workspace.heapCount = 0;
+
+	for (i = 0; i < vertexCount; i++)
+	{
+		workspace.heapPositions[i] = TIN_NOT_IN_HEAP;
+	}
+
+	for (i = 0; i < vertexCount; i++)
+	{
+		UpdateVertex(i, workspace);
+	}
+
+	/*
+		Take the cheapest vertex and collapse it onto the neighbour with the lowest quadric
+		error that keeps the mesh valid and within the vertical error. A vertex that cannot
+		go anywhere drops out of the queue until a collapse next to it puts it back.
+	*/
+	while (workspace.heapCount > 0)
+	{
+		u = HeapPop(workspace);
+		starCount = GatherStar(u, workspace);
+
+		candidateCount = 0;
+		for (i = 0; i < starCount; i++)
+		{
+			for (k = 0; k < 3; k++)
+			{
+				corner = (workspace.star[i] * 3) + k;
+				neighbour = workspace.cornerVertex[corner];
+				if (neighbour == u)
+				{
+					continue;
+				}
+
+				found = false;
+				for (best = 0; best < candidateCount; best++)
+				{
+					found = found || (workspace.candidates[best] == neighbour);
+				}
+
+				if (!found)
+				{
+					workspace.candidates[candidateCount] = neighbour;
+					workspace.candidateCosts[candidateCount] = GetCollapseCost(u, neighbour, workspace);
+					candidateCount++;
+				}
+			}
+		}
+
+		// Try the neighbours cheapest first.
+		while (candidateCount > 0)
+		{
+			best = 0;
+			for (i = 1; i < candidateCount; i++)
+			{
+				if (workspace.candidateCosts[i] < workspace.candidateCosts[best])
+				{
+					best = i;
+				}
+			}
+
+			if (TryCollapse(u, workspace.candidates[best], starCount, workspace))
+			{
+				break;
+			}
+
+			candidateCount--;
+			workspace.candidates[best] = workspace.candidates[candidateCount];
+			workspace.candidateCosts[best] = workspace.candidateCosts[candidateCount];
+		}
+	}
+
+	return WriteTile(tile, workspace);
+}
+
+
+void TinClass::BuildGrid(int tile, WorkspaceType& workspace)
+{
+	int size, tileX, tileZ, row, column, index, triangle, a, b, c, d;
+
+
+	size = m_tileSize + 1;
+	tileX = tile % m_tileCountX;
+	tileZ = tile / m_tileCountX;
+
+	m_tiles[tile].cornerVertex = (m_terrainWidth * tileZ * m_tileSize) + (tileX * m_tileSize);
+
+	// Copy the heights of the tile, the border vertices are locked so the neighbours keep matching.
+	for (row = 0; row < size; row++)
+	{
+		for (column = 0; column < size; column++)
+		{
+			index = (size * row) + column;
+
+			workspace.heights[index] = m_heights[m_tiles[tile].cornerVertex + (m_terrainWidth * row) + column];
+			workspace.locked[index] = (row == 0) || (column == 0) || (row == m_tileSize) || (column == m_tileSize);
+			workspace.removed[index] = false;
+			workspace.vertexCorner[index] = -1;
+			workspace.pointNext[index] = -1;
+		}
+	}
+
+	memset(workspace.quadrics, 0, sizeof(double) * size * size * 10);
+
+	/*
+		Start from the full detail union jack, the diagonal of a cell depends on the parity of
+		its position in the whole terrain. The triangles wind the same way as the geomipmap fans,
+		which is a positive area with x along the columns and y down the rows.
+	*/
+	triangle = 0;
+	for (row = 0; row < m_tileSize; row++)
+	{
+		for (column = 0; column < m_tileSize; column++)
+		{
+			a = (size * row) + column;
+			b = a + 1;
+			d = a + size;
+			c = d + 1;
+
+			if ((((tileX * m_tileSize) + column + (tileZ * m_tileSize) + row) & 1) == 0)
+			{
+				AddTriangle(triangle, a, b, c, workspace);
+				AddTriangle(triangle + 1, a, c, d, workspace);
+			}
+			else
+			{
+				AddTriangle(triangle, a, b, d, workspace);
+				AddTriangle(triangle + 1, b, c, d, workspace);
+			}
+
+			triangle += 2;
+		}
+	}
+
+	return;
+}
+
+
+void TinClass::AddTriangle(int triangle, int a, int b, int c, WorkspaceType& workspace)
+{
+	int k, corner;
+
+
+	workspace.cornerVertex[(triangle * 3)] = a;
+	workspace.cornerVertex[(triangle * 3) + 1] = b;
+	workspace.cornerVertex[(triangle * 3) + 2] = c;
+
+	// Link every corner into the list of triangles around its vertex.
+	for (k = 0; k < 3; k++)
+	{
+		corner = (triangle * 3) + k;
+		workspace.cornerNext[corner] = workspace.vertexCorner[workspace.cornerVertex[corner]];
+		workspace.vertexCorner[workspace.cornerVertex[corner]] = corner;
+	}
+
+	workspace.triangleAlive[triangle] = true;
+	workspace.pointFirst[triangle] = -1;
+
+	AddPlane(triangle, workspace);
+
+	return;
+}
+
+
+void TinClass::AddPlane(int triangle, WorkspaceType& workspace)
+{
+	double x[3], y[3], z[3], plane[4], length, area;
+	double* quadric;
+	int size, k, vertex;
+
+
+	size = m_tileSize + 1;
+
+	for (k = 0; k < 3; k++)
+	{
+		vertex = workspace.cornerVertex[(triangle * 3) + k];
+		x[k] = (double)(vertex % size);
+		y[k] = (double)workspace.heights[vertex];
+		z[k] = (double)(vertex / size);
+	}
+
+	// The plane of the triangle, weighted by its area so small triangles count for less.
+	plane[0] = ((y[1] - y[0]) * (z[2] - z[0])) - ((z[1] - z[0]) * (y[2] - y[0]));
+	plane[1] = ((z[1] - z[0]) * (x[2] - x[0])) - ((x[1] - x[0]) * (z[2] - z[0]));
+	plane[2] = ((x[1] - x[0]) * (y[2] - y[0])) - ((y[1] - y[0]) * (x[2] - x[0]));
+
+	length = sqrt((plane[0] * plane[0]) + (plane[1] * plane[1]) + (plane[2] * plane[2]));
+	if (length == 0.0)
+	{
+		return;
+	}
+
+	plane[0] /= length;
+	plane[1] /= length;
+	plane[2] /= length;
+	plane[3] = -((plane[0] * x[0]) + (plane[1] * y[0]) + (plane[2] * z[0]));
+
+	area = length * 0.5;
+
+	// Add the plane to the quadric of each corner, the upper half of the symmetric 4x4 matrix.
+	for (k = 0; k < 3; k++)
+	{
+		quadric = &workspace.quadrics[workspace.cornerVertex[(triangle * 3) + k] * 10];
+
+		quadric[0] += area * plane[0] * plane[0];
+		quadric[1] += area * plane[0] * plane[1];
+		quadric[2] += area * plane[0] * plane[2];
+		quadric[3] += area * plane[0] * plane[3];
+		quadric[4] += area * plane[1] * plane[1];
+		quadric[5] += area * plane[1] * plane[2];
+		quadric[6] += area * plane[1] * plane[3];
+		quadric[7] += area * plane[2] * plane[2];
+		quadric[8] += area * plane[2] * plane[3];
+		quadric[9] += area * plane[3] * plane[3];
+	}
+
+	return;
+}
+
+
+double TinClass::GetCollapseCost(int u, int v, WorkspaceType& workspace)
+{
+	double q[10];
+	double x, y, z;
+	int size, k;
+
+
+	// The combined quadric of both vertices measured at the vertex that stays.
+	for (k = 0; k < 10; k++)
+	{
+		q[k] = workspace.quadrics[(u * 10) + k] + workspace.quadrics[(v * 10) + k];
+	}
+
+	size = m_tileSize + 1;
+	x = (double)(v % size);
+	y = (double)workspace.heights[v];
+	z = (double)(v / size);
+
+	return (q[0] * x * x) + (2.0 * q[1] * x * y) + (2.0 * q[2] * x * z) + (2.0 * q[3] * x) +
+		(q[4] * y * y) + (2.0 * q[5] * y * z) + (2.0 * q[6] * y) +
+		(q[7] * z * z) + (2.0 * q[8] * z) + q[9];
+}
+
+
+void TinClass::UpdateVertex(int u, WorkspaceType& workspace)
+{
+	double cost, lowest;
+	int corner, triangle, k, neighbour;
+	bool found;
+
+
+	if (workspace.locked[u] || workspace.removed[u])
+	{
+		return;
+	}
+
+	// Queue the vertex with the cost of the cheapest of its edges.
+	found = false;
+	lowest = 0.0;
+	for (corner = workspace.vertexCorner[u]; corner != -1; corner = workspace.cornerNext[corner])
+	{
+		triangle = corner / 3;
+
+		for (k = 0; k < 3; k++)
+		{
+			neighbour = workspace.cornerVertex[(triangle * 3) + k];
+			if (neighbour == u)
+			{
+				continue;
+			}
+
+			cost = GetCollapseCost(u, neighbour, workspace);
+			if (!found || (cost < lowest))
+			{
+				lowest = cost;
+				found = true;
+			}
+		}
+	}
+
+	if (found)
+	{
+		HeapSet(u, lowest, workspace);
+	}
+
+	return;
+}
+
+
+int TinClass::GatherStar(int u, WorkspaceType& workspace)
+{
+	int corner, count;
+
+
+	// The triangles around the vertex, dead triangles are already unlinked.
+	count = 0;
+	for (corner = workspace.vertexCorner[u]; corner != -1; corner = workspace.cornerNext[corner])
+	{
+		workspace.star[count] = corner / 3;
+		count++;
+	}
+
+	return count;
+}
+
+
+bool TinClass::TryCollapse(int u, int v, int starCount, WorkspaceType& workspace)
+{
+	int size, i, k, triangle, corner, pointCount, dying, point, vertex[3], x[3], y[3];
+	float height;
+	bool inside;
+
+
+	size = m_tileSize + 1;
+
+	/*
+		Every triangle around u either shares the edge and goes away or has u moved onto v.
+		Those must keep a positive area, the grid positions are integers so the test is exact.
+		With u inside the tile that is enough to keep the triangulation valid.
+	*/
+	dying = 0;
+	for (i = 0; i < starCount; i++)
+	{
+		triangle = workspace.star[i];
+
+		for (k = 0; k < 3; k++)
+		{
+			vertex[k] = workspace.cornerVertex[(triangle * 3) + k];
+		}
+
+		if ((vertex[0] == v) || (vertex[1] == v) || (vertex[2] == v))
+		{
+			dying++;
+			continue;
+		}
+
+		for (k = 0; k < 3; k++)
+		{
+			vertex[k] = (vertex[k] == u) ? v : vertex[k];
+			x[k] = vertex[k] % size;
+			y[k] = vertex[k] / size;
+		}
+
+		if ((((x[1] - x[0]) * (y[2] - y[0])) - ((y[1] - y[0]) * (x[2] - x[0]))) <= 0)
+		{
+			return false;
+		}
+	}
+
+	if (dying != 2)
+	{
+		return false;
+	}
+
+	// The samples that were under the old triangles, u included, have to stay within the error of the new ones.
+	pointCount = 0;
+	workspace.points[pointCount] = u;
+	pointCount++;
+
+	for (i = 0; i < starCount; i++)
+	{
+		for (point = workspace.pointFirst[workspace.star[i]]; point != -1; point = workspace.pointNext[point])
+		{
+			workspace.points[pointCount] = point;
+			pointCount++;
+		}
+	}
+
+	for (k = 0; k < pointCount; k++)
+	{
+		inside = false;
+
+		for (i = 0; (i < starCount) && !inside; i++)
+		{
+			triangle = workspace.star[i];
+
+			vertex[0] = workspace.cornerVertex[(triangle * 3)];
+			vertex[1] = workspace.cornerVertex[(triangle * 3) + 1];
+			vertex[2] = workspace.cornerVertex[(triangle * 3) + 2];
+			if ((vertex[0] == v) || (vertex[1] == v) || (vertex[2] == v))
+			{
+				continue;
+			}
+
+			vertex[0] = (vertex[0] == u) ? v : vertex[0];
+			vertex[1] = (vertex[1] == u) ? v : vertex[1];
+			vertex[2] = (vertex[2] == u) ? v : vertex[2];
+
+			inside = GetBarycentricHeight(vertex[0], vertex[1], vertex[2], workspace.points[k], workspace, height);
+			if (inside)
+			{
+				if (fabsf(height - workspace.heights[workspace.points[k]]) > m_maxError)
+				{
+					return false;
+				}
+
+				workspace.pointTriangles[k] = triangle;
+			}
+		}
+
+		if (!inside)
+		{
+			return false;
+		}
+	}
+
+	// The collapse is good, take the shared triangles out and move the others onto v.
+	for (i = 0; i < starCount; i++)
+	{
+		triangle = workspace.star[i];
+		workspace.pointFirst[triangle] = -1;
+
+		if ((workspace.cornerVertex[(triangle * 3)] == v) || (workspace.cornerVertex[(triangle * 3) + 1] == v) ||
+			(workspace.cornerVertex[(triangle * 3) + 2] == v))
+		{
+			workspace.triangleAlive[triangle] = false;
+
+			for (k = 0; k < 3; k++)
+			{
+				corner = (triangle * 3) + k;
+				if (workspace.cornerVertex[corner] != u)
+				{
+					RemoveCorner(workspace.cornerVertex[corner], corner, workspace);
+				}
+			}
+
+			continue;
+		}
+
+		for (k = 0; k < 3; k++)
+		{
+			corner = (triangle * 3) + k;
+			if (workspace.cornerVertex[corner] == u)
+			{
+				workspace.cornerVertex[corner] = v;
+				workspace.cornerNext[corner] = workspace.vertexCorner[v];
+				workspace.vertexCorner[v] = corner;
+			}
+		}
+	}
+
+	workspace.vertexCorner[u] = -1;
+	workspace.removed[u] = true;
+
+	for (k = 0; k < pointCount; k++)
+	{
+		point = workspace.points[k];
+		triangle = workspace.pointTriangles[k];
+
+		workspace.pointNext[point] = workspace.pointFirst[triangle];
+		workspace.pointFirst[triangle] = point;
+	}
+
+	for (k = 0; k < 10; k++)
+	{
+		workspace.quadrics[(v * 10) + k] += workspace.quadrics[(u * 10) + k];
+	}
+
+	// The costs of v and of everything around it have changed.
+	UpdateVertex(v, workspace);
+
+	for (corner = workspace.vertexCorner[v]; corner != -1; corner = workspace.cornerNext[corner])
+	{
+		triangle = corner / 3;
+
+		for (k = 0; k < 3; k++)
+		{
+			UpdateVertex(workspace.cornerVertex[(triangle * 3) + k], workspace);
+		}
+	}
+
+	return true;
+}
+
+
+bool TinClass::GetBarycentricHeight(int a, int b, int c, int point, WorkspaceType& workspace, float& height)
+{
+	int size, ax, ay, bx, by, cx, cy, px, py, area, edgeA, edgeB, edgeC;
+
+
+	size = m_tileSize + 1;
+
+	ax = a % size;
+	ay = a / size;
+	bx = b % size;
+	by = b / size;
+	cx = c % size;
+	cy = c / size;
+	px = point % size;
+	py = point / size;
+
+	// The edge functions give the barycentric weights, a point on an edge counts as inside.
+	area = ((bx - ax) * (cy - ay)) - ((by - ay) * (cx - ax));
+	edgeA = ((cx - bx) * (py - by)) - ((cy - by) * (px - bx));
+	edgeB = ((ax - cx) * (py - cy)) - ((ay - cy) * (px - cx));
+	edgeC = ((bx - ax) * (py - ay)) - ((by - ay) * (px - ax));
+
+	if ((area <= 0) || (edgeA < 0) || (edgeB < 0) || (edgeC < 0))
+	{
+		return false;
+	}
+
+	height = (float)((((double)edgeA * workspace.heights[a]) + ((double)edgeB * workspace.heights[b]) +
+		((double)edgeC * workspace.heights[c])) / (double)area);
+
+	return true;
+}
+
+
+void TinClass::RemoveCorner(int vertex, int corner, WorkspaceType& workspace)
+{
+	int* link;
+
+
+	// Walk the list of the vertex to the link pointing at the corner and skip it.
+	link = &workspace.vertexCorner[vertex];
+	while (*link != -1)
+	{
+		if (*link == corner)
+		{
+			*link = workspace.cornerNext[corner];
+			return;
+		}
+
+		link = &workspace.cornerNext[*link];
+	}
+
+	return;
+}
+
+
+bool TinClass::WriteTile(int tile, WorkspaceType& workspace)
+{
+	int triangleCount, triangle, count, k, point;
+	float height, error;
+
+
+	triangleCount = m_tileSize * m_tileSize * 2;
+
+	count = 0;
+	for (triangle = 0; triangle < triangleCount; triangle++)
+	{
+		count += workspace.triangleAlive[triangle] ? 3 : 0;
+	}
+
+	m_tiles[tile].indices = new unsigned short[count];
+	if (!m_tiles[tile].indices)
+	{
+		return false;
+	}
+
+	m_tiles[tile].indexCount = count;
+	m_tiles[tile].maxError = 0.0f;
+
+	count = 0;
+	for (triangle = 0; triangle < triangleCount; triangle++)
+	{
+		if (!workspace.triangleAlive[triangle])
+		{
+			continue;
+		}
+
+		// Indexes are relative to the top left vertex of the tile with the row pitch of the tile, the same as the tile workspace.
+		for (k = 0; k < 3; k++)
+		{
+			m_tiles[tile].indices[count] = (unsigned short)workspace.cornerVertex[(triangle * 3) + k];
+			count++;
+		}
+
+		// Record the error actually left at the samples the triangle covers.
+		for (point = workspace.pointFirst[triangle]; point != -1; point = workspace.pointNext[point])
+		{
+			GetBarycentricHeight(workspace.cornerVertex[(triangle * 3)], workspace.cornerVertex[(triangle * 3) + 1],
+				workspace.cornerVertex[(triangle * 3) + 2], point, workspace, height);
+
+			error = fabsf(height - workspace.heights[point]);
+			m_tiles[tile].maxError = (error > m_tiles[tile].maxError) ? error : m_tiles[tile].maxError;
+		}
+	}
+
+	return true;
+}
+
+
+void TinClass::HeapSet(int vertex, double cost, WorkspaceType& workspace)
+{
+	int position;
+
+
+	// Add the vertex at the bottom or change its cost where it is, then restore the order.
+	position = workspace.heapPositions[vertex];
+	if (position == TIN_NOT_IN_HEAP)
+	{
+		position = workspace.heapCount;
+		workspace.heapVertices[position] = vertex;
+		workspace.heapPositions[vertex] = position;
+		workspace.heapCount++;
+	}
+
+	workspace.heapCosts[position] = cost;
+
+	HeapUp(position, workspace);
+	HeapDown(workspace.heapPositions[vertex], workspace);
+
+	return;
+}
+
+
+int TinClass::HeapPop(WorkspaceType& workspace)
+{
+	int vertex;
+
+
+	vertex = workspace.heapVertices[0];
+
+	// Move the last entry to the top and let it sink.
+	workspace.heapCount--;
+	if (workspace.heapCount > 0)
+	{
+		HeapSwap(0, workspace.heapCount, workspace);
+		HeapDown(0, workspace);
+	}
+
+	workspace.heapPositions[vertex] = TIN_NOT_IN_HEAP;
+
+	return vertex;
+}
+
+
+void TinClass::HeapSwap(int a, int b, WorkspaceType& workspace)
+{
+	int vertex;
+	double cost;
+
+
+	vertex = workspace.heapVertices[a];
+	workspace.heapVertices[a] = workspace.heapVertices[b];
+	workspace.heapVertices[b] = vertex;
+
+	cost = workspace.heapCosts[a];
+	workspace.heapCosts[a] = workspace.heapCosts[b];
+	workspace.heapCosts[b] = cost;
+
+	workspace.heapPositions[workspace.heapVertices[a]] = a;
+	workspace.heapPositions[workspace.heapVertices[b]] = b;
+
+	return;
+}
+
+
+void TinClass::HeapUp(int position, WorkspaceType& workspace)
+{
+	int parent;
+
+
+	while (position > 0)
+	{
+		parent = (position - 1) / 2;
+		if (workspace.heapCosts[parent] <= workspace.heapCosts[position])
+		{
+			return;
+		}
+
+		HeapSwap(parent, position, workspace);
+		position = parent;
+	}
+
+	return;
+}
+
+
+void TinClass::HeapDown(int position, WorkspaceType& workspace)
+{
+	int child;
+
+
+	while (true)
+	{
+		child = (position * 2) + 1;
+		if (child >= workspace.heapCount)
+		{
+			return;
+		}
+
+		if (((child + 1) < workspace.heapCount) && (workspace.heapCosts[child + 1] < workspace.heapCosts[child]))
+		{
+			child++;
+		}
+
+		if (workspace.heapCosts[position] <= workspace.heapCosts[child])
+		{
+			return;
+		}
+
+		HeapSwap(position, child, workspace);
+		position = child;
+	}
+}
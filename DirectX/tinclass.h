@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: tinclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _TINCLASS_H_
+#define _TINCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <math.h>
+#include <string.h>
+#include <atomic>
+
+#include "parallelforclass.h"
+
+using namespace std;
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int TIN_NOT_IN_HEAP = -1;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: TinClass
+////////////////////////////////////////////////////////////////////////////////
+// Offline simplification of the heightfield into a triangulated irregular
+// network per tile. Each tile starts out as the full union jack grid and has
+// its vertices collapsed onto neighbours in quadric error order for as long as
+// every grid sample stays within the maximum vertical error of the surface.
+//
+// The vertices on the tile borders never move, so neighbouring tiles keep the
+// same edges and stay watertight. The tiles are simplified on all the cores.
+// The indices are relative to the top left vertex of the tile with a row pitch
+// of the tile size plus one, the same as the geomipmap patches in their vertex
+// buffer strips, so a tile the size of a patch can be drawn straight from the
+// terrain vertex buffer at the patch's base vertex.
+class TinClass
+{
+private:
+	struct TileType
+	{
+		int cornerVertex;
+		unsigned short* indices;
+		int indexCount;
+		float maxError;
+	};
+
+	// Everything one thread needs to simplify a tile, sized for a single tile.
+	struct WorkspaceType
+	{
+		float* heights;
+		double* quadrics;
+		bool* locked;
+		bool* removed;
+		int* vertexCorner;
+		int* cornerVertex;
+		int* cornerNext;
+		bool* triangleAlive;
+		int* pointFirst;
+		int* pointNext;
+		int* heapVertices;
+		double* heapCosts;
+		int* heapPositions;
+		int heapCount;
+		int* star;
+		int* points;
+		int* pointTriangles;
+		int* candidates;
+		double* candidateCosts;
+	};
+
+public:
+	TinClass();
+	TinClass(const TinClass&);
+	~TinClass();
+
+	bool Initialize(const float*, int, int, int, float);
+	void Shutdown();
+
+	int GetTileCount();
+	void GetTile(int, int&, const unsigned short*&, int&);
+	void GetTriangleCounts(int&, int&);
+	float GetMaxError();
+
+private:
+	bool CreateWorkspace(WorkspaceType&);
+	void ReleaseWorkspace(WorkspaceType&);
+	bool SimplifyTile(int, WorkspaceType&);
+	void BuildGrid(int, WorkspaceType&);
+	void AddTriangle(int, int, int, int, WorkspaceType&);
+	void AddPlane(int, WorkspaceType&);
+	double GetCollapseCost(int, int, WorkspaceType&);
+	void UpdateVertex(int, WorkspaceType&);
+	int GatherStar(int, WorkspaceType&);
+	bool TryCollapse(int, int, int, WorkspaceType&);
+	bool GetBarycentricHeight(int, int, int, int, WorkspaceType&, float&);
+	void RemoveCorner(int, int, WorkspaceType&);
+	bool WriteTile(int, WorkspaceType&);
+	void HeapSet(int, double, WorkspaceType&);
+	int HeapPop(WorkspaceType&);
+	void HeapSwap(int, int, WorkspaceType&);
+	void HeapUp(int, WorkspaceType&);
+	void HeapDown(int, WorkspaceType&);
+
+private:
+	const float* m_heights;
+	int m_terrainWidth, m_terrainHeight, m_tileSize, m_tileCountX, m_tileCountZ;
+	int m_gridTriangleCount, m_tinTriangleCount;
+	float m_maxError;
+	TileType* m_tiles;
+};
+
+#endif
@@ -0,0 +1,458 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: vertexcacheclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "vertexcacheclass.h"
+
+
+VertexCacheClass::VertexCacheClass()
+{
+}
+
+
+VertexCacheClass::VertexCacheClass(const VertexCacheClass& other)
+{
+}
+
+
+VertexCacheClass::~VertexCacheClass()
+{
+}
+
+
+bool VertexCacheClass::OptimizeTriangles(unsigned long* indices, int indexCount, int cacheSize, ArenaClass* arena)
+{
+	int triangleCount, vertexCount, maxIndex, i, j, k, v, triangle, best, cacheCount, newCount;
+	int* remap;
+	int* localIndices;
+	int* triangleLists;
+	int* cache;
+	int* newCache;
+	unsigned long* output;
+	VertexDataType* vertices;
+	TriangleDataType* triangles;
+	float bestScore;
+	ScratchClass scratch(arena);
+
+
+	/*
+		Tom Forsyth's linear-speed vertex cache optimisation. Every vertex is scored from its
+		position in a simulated LRU cache and the number of triangles still using it, and the
+		next triangle drawn is always the best scoring one among those touching the cache.
+		The vertex order inside each triangle is kept so the winding does not change.
+	*/
+
+	triangleCount = indexCount / 3;
+	if ((triangleCount < 2) || (cacheSize < 4))
+	{
+		return true;
+	}
+
+	// Give the vertices dense ids, the indices are only a sparse part of the terrain grid.
+	// All the temporary arrays come from the scratch arena.
+	maxIndex = 0;
+	for (i = 0; i < indexCount; i++)
+	{
+		if ((int)indices[i] > maxIndex)
+		{
+			maxIndex = (int)indices[i];
+		}
+	}
+
+	remap = scratch.AllocateArray<int>(maxIndex + 1);
+	if (!remap)
+	{
+		return false;
+	}
+
+	localIndices = scratch.AllocateArray<int>(indexCount);
+	if (!localIndices)
+	{
+		return false;
+	}
+
+	for (i = 0; i <= maxIndex; i++)
+	{
+		remap[i] = -1;
+	}
+
+	vertexCount = 0;
+	for (i = 0; i < indexCount; i++)
+	{
+		if (remap[indices[i]] == -1)
+		{
+			remap[indices[i]] = vertexCount;
+			vertexCount++;
+		}
+
+		localIndices[i] = remap[indices[i]];
+	}
+
+	// Create the per vertex and per triangle data.
+	vertices = scratch.AllocateArray<VertexDataType>(vertexCount);
+	if (!vertices)
+	{
+		return false;
+	}
+
+	triangles = scratch.AllocateArray<TriangleDataType>(triangleCount);
+	if (!triangles)
+	{
+		return false;
+	}
+
+	triangleLists = scratch.AllocateArray<int>(indexCount);
+	if (!triangleLists)
+	{
+		return false;
+	}
+
+	// The cache holds three extra entries for the vertices pushed out by the last triangle.
+	cache = scratch.AllocateArray<int>(cacheSize + 3);
+	if (!cache)
+	{
+		return false;
+	}
+
+	newCache = scratch.AllocateArray<int>(cacheSize + 3);
+	if (!newCache)
+	{
+		return false;
+	}
+
+	output = scratch.AllocateArray<unsigned long>(indexCount);
+	if (!output)
+	{
+		return false;
+	}
+
+	// Count the triangles using each vertex and lay out the adjacency lists.
+	for (i = 0; i < vertexCount; i++)
+	{
+		vertices[i].cachePosition = -1;
+		vertices[i].remainingTriangles = 0;
+	}
+
+	for (i = 0; i < indexCount; i++)
+	{
+		vertices[localIndices[i]].remainingTriangles++;
+	}
+
+	j = 0;
+	for (i = 0; i < vertexCount; i++)
+	{
+		vertices[i].triangleStart = j;
+		j += vertices[i].remainingTriangles;
+		vertices[i].remainingTriangles = 0;
+	}
+
+	for (i = 0; i < indexCount; i++)
+	{
+		v = localIndices[i];
+		triangleLists[vertices[v].triangleStart + vertices[v].remainingTriangles] = i / 3;
+		vertices[v].remainingTriangles++;
+	}
+
+	// Score every vertex and triangle before anything is in the cache.
+	for (i = 0; i < vertexCount; i++)
+	{
+		vertices[i].score = GetVertexScore(-1, vertices[i].remainingTriangles, cacheSize);
+	}
+
+	best = -1;
+	bestScore = -1.0f;
+	for (i = 0; i < triangleCount; i++)
+	{
+		triangles[i].added = false;
+		triangles[i].score = vertices[localIndices[i * 3]].score + vertices[localIndices[i * 3 + 1]].score + vertices[localIndices[i * 3 + 2]].score;
+
+		if (triangles[i].score > bestScore)
+		{
+			bestScore = triangles[i].score;
+			best = i;
+		}
+	}
+
+	cacheCount = 0;
+	for (triangle = 0; triangle < triangleCount; triangle++)
+	{
+		// Nothing in the cache has triangles left, take the best remaining triangle anywhere.
+		if (best == -1)
+		{
+			bestScore = -1.0f;
+			for (i = 0; i < triangleCount; i++)
+			{
+				if ((!triangles[i].added) && (triangles[i].score > bestScore))
+				{
+					bestScore = triangles[i].score;
+					best = i;
+				}
+			}
+		}
+
+		// Emit the triangle with its original vertex order.
+		output[triangle * 3] = indices[best * 3];
+		output[triangle * 3 + 1] = indices[best * 3 + 1];
+		output[triangle * 3 + 2] = indices[best * 3 + 2];
+		triangles[best].added = true;
+
+		// Remove the triangle from the adjacency list of its vertices.
+		for (k = 0; k < 3; k++)
+		{
+			v = localIndices[best * 3 + k];
+			for (j = 0; j < vertices[v].remainingTriangles; j++)
+			{
+				if (triangleLists[vertices[v].triangleStart + j] == best)
+				{
+					triangleLists[vertices[v].triangleStart + j] = triangleLists[vertices[v].triangleStart + vertices[v].remainingTriangles - 1];
+					vertices[v].remainingTriangles--;
+					break;
+				}
+			}
+		}
+
+		// Move the triangle's vertices to the front of the cache.
+		newCount = 0;
+		for (k = 0; k < 3; k++)
+		{
+			newCache[newCount] = localIndices[best * 3 + k];
+			newCount++;
+		}
+
+		for (i = 0; i < cacheCount; i++)
+		{
+			v = cache[i];
+			if ((v != newCache[0]) && (v != newCache[1]) && (v != newCache[2]))
+			{
+				newCache[newCount] = v;
+				newCount++;
+			}
+		}
+
+		// Rescore the cached vertices, including the ones that just fell out of it.
+		for (i = 0; i < newCount; i++)
+		{
+			v = newCache[i];
+			vertices[v].cachePosition = (i < cacheSize) ? i : -1;
+			vertices[v].score = GetVertexScore(vertices[v].cachePosition, vertices[v].remainingTriangles, cacheSize);
+		}
+
+		// Rescore the triangles around them and pick the best for the next step.
+		best = -1;
+		bestScore = -1.0f;
+		for (i = 0; i < newCount; i++)
+		{
+			v = newCache[i];
+			for (j = 0; j < vertices[v].remainingTriangles; j++)
+			{
+				k = triangleLists[vertices[v].triangleStart + j];
+				triangles[k].score = vertices[localIndices[k * 3]].score + vertices[localIndices[k * 3 + 1]].score + vertices[localIndices[k * 3 + 2]].score;
+
+				if (triangles[k].score > bestScore)
+				{
+					bestScore = triangles[k].score;
+					best = k;
+				}
+			}
+		}
+
+		// Keep only what still fits in the cache.
+		cacheCount = (newCount < cacheSize) ? newCount : cacheSize;
+		for (i = 0; i < cacheCount; i++)
+		{
+			cache[i] = newCache[i];
+		}
+	}
+
+	// Copy the new order back over the input.
+	for (i = 0; i < indexCount; i++)
+	{
+		indices[i] = output[i];
+	}
+
+	// The temporary arrays are released with the scratch scope.
+	return true;
+}
+
+
+int VertexCacheClass::SimulateCache(const unsigned long* indices, int indexCount, int cacheSize, bool lru)
+{
+	unsigned long cache[VERTEX_CACHE_MAX_SIZE];
+	int i, j, position, cacheCount, oldest, misses;
+
+
+	// The simulated post transform cache lives on the stack.
+	if (cacheSize > VERTEX_CACHE_MAX_SIZE)
+	{
+		cacheSize = VERTEX_CACHE_MAX_SIZE;
+	}
+
+	if (cacheSize < 1)
+	{
+		return indexCount;
+	}
+
+	cacheCount = 0;
+	oldest = 0;
+	misses = 0;
+
+	for (i = 0; i < indexCount; i++)
+	{
+		// Look for the vertex in the cache.
+		position = -1;
+		for (j = 0; j < cacheCount; j++)
+		{
+			if (cache[j] == indices[i])
+			{
+				position = j;
+				break;
+			}
+		}
+
+		if (lru)
+		{
+			// An LRU cache keeps the most recent vertex at the front, a miss pushes the last one out.
+			if (position == -1)
+			{
+				misses++;
+
+				if (cacheCount < cacheSize)
+				{
+					cacheCount++;
+				}
+
+				position = cacheCount - 1;
+			}
+
+			for (j = position; j > 0; j--)
+			{
+				cache[j] = cache[j - 1];
+			}
+
+			cache[0] = indices[i];
+		}
+		else
+		{
+			// A FIFO cache only changes on a miss, replacing the oldest entry.
+			if (position == -1)
+			{
+				misses++;
+
+				if (cacheCount < cacheSize)
+				{
+					cache[cacheCount] = indices[i];
+					cacheCount++;
+				}
+				else
+				{
+					cache[oldest] = indices[i];
+					oldest = (oldest + 1) % cacheSize;
+				}
+			}
+		}
+	}
+
+	return misses;
+}
+
+
+int VertexCacheClass::CountVertices(const unsigned long* indices, int indexCount, ArenaClass* arena)
+{
+	bool* used;
+	int i, maxIndex, count;
+	ScratchClass scratch(arena);
+
+
+	maxIndex = 0;
+	for (i = 0; i < indexCount; i++)
+	{
+		if ((int)indices[i] > maxIndex)
+		{
+			maxIndex = (int)indices[i];
+		}
+	}
+
+	used = scratch.AllocateArray<bool>(maxIndex + 1);
+	if (!used)
+	{
+		return 0;
+	}
+
+	for (i = 0; i <= maxIndex; i++)
+	{
+		used[i] = false;
+	}
+
+	// Count each distinct index once.
+	count = 0;
+	for (i = 0; i < indexCount; i++)
+	{
+		if (!used[indices[i]])
+		{
+			used[indices[i]] = true;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+
+void VertexCacheClass::MeasureCache(const unsigned long* indices, int indexCount, int cacheSize, bool lru, ArenaClass* arena, float& acmr, float& atvr)
+{
+	int misses, vertexCount;
+
+
+	acmr = 0.0f;
+	atvr = 0.0f;
+
+	if (indexCount < 3)
+	{
+		return;
+	}
+
+	misses = SimulateCache(indices, indexCount, cacheSize, lru);
+	vertexCount = CountVertices(indices, indexCount, arena);
+
+	// ACMR is vertex shader runs per triangle, ATVR is runs per distinct vertex (1.0 is the best possible).
+	acmr = (float)misses / (float)(indexCount / 3);
+	if (vertexCount > 0)
+	{
+		atvr = (float)misses / (float)vertexCount;
+	}
+
+	return;
+}
+
+
+float VertexCacheClass::GetVertexScore(int cachePosition, int remainingTriangles, int cacheSize)
+{
+	float score;
+
+
+	// A vertex with no triangles left is never worth drawing.
+	if (remainingTriangles == 0)
+	{
+		return -1.0f;
+	}
+
+	score = 0.0f;
+
+	if (cachePosition >= 0)
+	{
+		// The three vertices of the last triangle get a fixed score so the next triangle does not favour any of them.
+		if (cachePosition < 3)
+		{
+			score = VERTEX_CACHE_LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			score = 1.0f - ((float)(cachePosition - 3) / (float)(cacheSize - 3));
+			score = powf(score, VERTEX_CACHE_DECAY_POWER);
+		}
+	}
+
+	// Boost vertices with few triangles left so they get finished off and leave the cache.
+	score += VERTEX_CACHE_VALENCE_SCALE * powf((float)remainingTriangles, -VERTEX_CACHE_VALENCE_POWER);
+
+	return score;
+}
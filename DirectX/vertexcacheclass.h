@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: vertexcacheclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _VERTEXCACHECLASS_H_
+#define _VERTEXCACHECLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <math.h>
+
+#include "arenaclass.h"
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int VERTEX_CACHE_SIZE = 32;
+const int VERTEX_CACHE_REPORT_SIZE = 16;
+const int VERTEX_CACHE_MAX_SIZE = 64;
+const float VERTEX_CACHE_DECAY_POWER = 1.5f;
+const float VERTEX_CACHE_LAST_TRIANGLE_SCORE = 0.75f;
+const float VERTEX_CACHE_VALENCE_SCALE = 2.0f;
+const float VERTEX_CACHE_VALENCE_POWER = 0.5f;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: VertexCacheClass
+////////////////////////////////////////////////////////////////////////////////
+class VertexCacheClass
+{
+private:
+	struct VertexDataType
+	{
+		int cachePosition;
+		int triangleStart;
+		int remainingTriangles;
+		float score;
+	};
+
+	struct TriangleDataType
+	{
+		float score;
+		bool added;
+	};
+
+public:
+	VertexCacheClass();
+	VertexCacheClass(const VertexCacheClass&);
+	~VertexCacheClass();
+
+	bool OptimizeTriangles(unsigned long*, int, int, ArenaClass*);
+
+	int SimulateCache(const unsigned long*, int, int, bool);
+	int CountVertices(const unsigned long*, int, ArenaClass*);
+	void MeasureCache(const unsigned long*, int, int, bool, ArenaClass*, float&, float&);
+
+private:
+	float GetVertexScore(int, int, int);
+};
+
+#endif
@@ -0,0 +1,472 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: vertexlightclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "vertexlightclass.h"
+
+
+VertexLightClass::VertexLightClass()
+{
+	m_occlusion = 0;
+	m_horizons[0] = 0;
+	m_horizons[1] = 0;
+	m_normalX = 0;
+	m_normalY = 0;
+	m_normalZ = 0;
+	m_colors = 0;
+	m_dirtyBlocks = 0;
+	m_litBlocks = 0;
+	m_lightSet = false;
+}
+
+
+VertexLightClass::VertexLightClass(const VertexLightClass& other)
+{
+}
+
+
+VertexLightClass::~VertexLightClass()
+{
+}
+
+
+bool VertexLightClass::Initialize(int width, int height, const unsigned char* occlusion, const unsigned char* firstHorizons,
+	const unsigned char* lastHorizons)
+{
+	int i;
+
+
+	m_width = width;
+	m_height = height;
+	m_vertexCount = m_width * m_height;
+
+	// The baked maps stay with the horizon bake object, they are only read here.
+	m_occlusion = occlusion;
+	m_horizons[0] = firstHorizons;
+	m_horizons[1] = lastHorizons;
+
+	// Create the normal arrays, one per component so four vertices load at once.
+	m_normalX = new float[m_vertexCount];
+	if (!m_normalX)
+	{
+		return false;
+	}
+
+	m_normalY = new float[m_vertexCount];
+	if (!m_normalY)
+	{
+		return false;
+	}
+
+	m_normalZ = new float[m_vertexCount];
+	if (!m_normalZ)
+	{
+		return false;
+	}
+
+	// Start flat until the terrain hands over its normals.
+	for (i = 0; i < m_vertexCount; i++)
+	{
+		m_normalX[i] = 0.0f;
+		m_normalY[i] = 1.0f;
+		m_normalZ[i] = 0.0f;
+	}
+
+	// Create the colour array, it is what goes into the vertex buffer.
+	m_colors = new unsigned int[m_vertexCount];
+	if (!m_colors)
+	{
+		return false;
+	}
+
+	memset(m_colors, 0, m_vertexCount * sizeof(unsigned int));
+
+	// Create the block flags, the blocks waiting to be lit and the blocks the last update lit.
+	m_blockCountX = (m_width + VERTEX_LIGHT_BLOCK_SIZE - 1) / VERTEX_LIGHT_BLOCK_SIZE;
+	m_blockCountY = (m_height + VERTEX_LIGHT_BLOCK_SIZE - 1) / VERTEX_LIGHT_BLOCK_SIZE;
+
+	m_dirtyBlocks = new bool[m_blockCountX * m_blockCountY];
+	if (!m_dirtyBlocks)
+	{
+		return false;
+	}
+
+	m_litBlocks = new bool[m_blockCountX * m_blockCountY];
+	if (!m_litBlocks)
+	{
+		return false;
+	}
+
+	memset(m_litBlocks, 0, m_blockCountX * m_blockCountY * sizeof(bool));
+
+	// Nothing is lit until the first light is set.
+	m_toLight = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	m_ambientColor = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+	m_diffuseColor = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+	m_lightSet = false;
+	AddRect(0, 0, m_width - 1, m_height - 1);
+
+	return true;
+}
+
+
+void VertexLightClass::Shutdown()
+{
+	// Release the block flags.
+	if (m_litBlocks)
+	{
+		delete[] m_litBlocks;
+		m_litBlocks = 0;
+	}
+
+	if (m_dirtyBlocks)
+	{
+		delete[] m_dirtyBlocks;
+		m_dirtyBlocks = 0;
+	}
+
+	// Release the colour array.
+	if (m_colors)
+	{
+		delete[] m_colors;
+		m_colors = 0;
+	}
+
+	// Release the normal arrays.
+	if (m_normalZ)
+	{
+		delete[] m_normalZ;
+		m_normalZ = 0;
+	}
+
+	if (m_normalY)
+	{
+		delete[] m_normalY;
+		m_normalY = 0;
+	}
+
+	if (m_normalX)
+	{
+		delete[] m_normalX;
+		m_normalX = 0;
+	}
+
+	m_occlusion = 0;
+	m_horizons[0] = 0;
+	m_horizons[1] = 0;
+
+	return;
+}
+
+
+void VertexLightClass::SetNormal(int index, XMFLOAT3 normal)
+{
+	m_normalX[index] = normal.x;
+	m_normalY[index] = normal.y;
+	m_normalZ[index] = normal.z;
+
+	// Only the block of the vertex is lit again.
+	m_dirtyBlocks[(((index / m_width) / VERTEX_LIGHT_BLOCK_SIZE) * m_blockCountX) + ((index % m_width) / VERTEX_LIGHT_BLOCK_SIZE)] = true;
+
+	return;
+}
+
+
+void VertexLightClass::SetLight(XMFLOAT3 direction, XMFLOAT4 ambientColor, XMFLOAT4 diffuseColor)
+{
+	float length, azimuth;
+	int k, first;
+
+
+	// The light is handed over every frame, only a real change lights the vertices again.
+	if (m_lightSet &&
+		(fabsf(direction.x - m_direction.x) < VERTEX_LIGHT_TOLERANCE) && (fabsf(direction.y - m_direction.y) < VERTEX_LIGHT_TOLERANCE) &&
+		(fabsf(direction.z - m_direction.z) < VERTEX_LIGHT_TOLERANCE) &&
+		(fabsf(ambientColor.x - m_ambientColor.x) < VERTEX_LIGHT_TOLERANCE) && (fabsf(ambientColor.y - m_ambientColor.y) < VERTEX_LIGHT_TOLERANCE) &&
+		(fabsf(ambientColor.z - m_ambientColor.z) < VERTEX_LIGHT_TOLERANCE) &&
+		(fabsf(diffuseColor.x - m_diffuseColor.x) < VERTEX_LIGHT_TOLERANCE) && (fabsf(diffuseColor.y - m_diffuseColor.y) < VERTEX_LIGHT_TOLERANCE) &&
+		(fabsf(diffuseColor.z - m_diffuseColor.z) < VERTEX_LIGHT_TOLERANCE))
+	{
+		return;
+	}
+
+	m_direction = direction;
+	m_ambientColor = ambientColor;
+	m_diffuseColor = diffuseColor;
+
+	// Invert the light direction for calculations, a zero direction is taken as light from straight above.
+	length = sqrtf((direction.x * direction.x) + (direction.y * direction.y) + (direction.z * direction.z));
+	if (length > 0.0f)
+	{
+		m_toLight = XMFLOAT3(-direction.x / length, -direction.y / length, -direction.z / length);
+	}
+	else
+	{
+		m_toLight = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	}
+
+	// The horizons are stored as the sine of their elevation, so the light is compared the same way.
+	m_lightSine = m_toLight.y;
+
+	// The light falls between two of the eight baked directions, counter clockwise from east.
+	azimuth = atan2f(m_toLight.z, m_toLight.x) / (XM_PI / 4.0f);
+	azimuth = (azimuth < 0.0f) ? (azimuth + 8.0f) : azimuth;
+
+	first = (int)azimuth;
+	m_horizonWeight = azimuth - (float)first;
+
+	for (k = 0; k < 2; k++)
+	{
+		m_horizonPlane[k] = ((first + k) % 8) / 4;
+		m_horizonShift[k] = (((first + k) % 8) % 4) * 8;
+	}
+
+	m_lightSet = true;
+
+	// Every vertex has to be lit again.
+	AddRect(0, 0, m_width - 1, m_height - 1);
+
+	return;
+}
+
+
+void VertexLightClass::AddRect(int left, int top, int right, int bottom)
+{
+	int blockX, blockY;
+
+
+	// Mark every block the rectangle touches to be lit on the next update.
+	for (blockY = top / VERTEX_LIGHT_BLOCK_SIZE; blockY <= bottom / VERTEX_LIGHT_BLOCK_SIZE; blockY++)
+	{
+		for (blockX = left / VERTEX_LIGHT_BLOCK_SIZE; blockX <= right / VERTEX_LIGHT_BLOCK_SIZE; blockX++)
+		{
+			m_dirtyBlocks[(blockY * m_blockCountX) + blockX] = true;
+		}
+	}
+
+	return;
+}
+
+
+bool VertexLightClass::Update(int& litCount)
+{
+	ParallelForClass parallel;
+	int i, blockCount, blockX, blockY, blockWidth, blockHeight;
+	bool dirty;
+
+
+	// Nothing to do before the first light.
+	if (!m_lightSet)
+	{
+		return false;
+	}
+
+	// The blocks waiting become the blocks lit by this update.
+	blockCount = m_blockCountX * m_blockCountY;
+	dirty = false;
+
+	for (i = 0; i < blockCount; i++)
+	{
+		m_litBlocks[i] = m_dirtyBlocks[i];
+		dirty = dirty || m_dirtyBlocks[i];
+	}
+
+	if (!dirty)
+	{
+		return false;
+	}
+
+	memset(m_dirtyBlocks, 0, blockCount * sizeof(bool));
+
+	// Light the rows of the lit blocks, a row of blocks at a time on all the cores.
+	parallel.Run(m_blockCountY, 1, [&](int firstBlockY, int lastBlockY)
+	{
+		int blockX, blockY, firstBlockX, j, top, bottom, left, right;
+
+
+		for (blockY = firstBlockY; blockY < lastBlockY; blockY++)
+		{
+			top = blockY * VERTEX_LIGHT_BLOCK_SIZE;
+			bottom = ((top + VERTEX_LIGHT_BLOCK_SIZE) < m_height) ? (top + VERTEX_LIGHT_BLOCK_SIZE - 1) : (m_height - 1);
+
+			// A run of lit blocks is one span per vertex row.
+			blockX = 0;
+			while (blockX < m_blockCountX)
+			{
+				if (!m_litBlocks[(blockY * m_blockCountX) + blockX])
+				{
+					blockX++;
+					continue;
+				}
+
+				firstBlockX = blockX;
+				while ((blockX < m_blockCountX) && m_litBlocks[(blockY * m_blockCountX) + blockX])
+				{
+					blockX++;
+				}
+
+				left = firstBlockX * VERTEX_LIGHT_BLOCK_SIZE;
+				right = ((blockX * VERTEX_LIGHT_BLOCK_SIZE) < m_width) ? ((blockX * VERTEX_LIGHT_BLOCK_SIZE) - 1) : (m_width - 1);
+
+				for (j = top; j <= bottom; j++)
+				{
+					UpdateBlock((j * m_width) + left, (j * m_width) + right);
+				}
+			}
+		}
+	});
+
+	// Count the vertices that were lit, the last row and column of blocks can be narrower.
+	litCount = 0;
+
+	for (blockY = 0; blockY < m_blockCountY; blockY++)
+	{
+		for (blockX = 0; blockX < m_blockCountX; blockX++)
+		{
+			if (m_litBlocks[(blockY * m_blockCountX) + blockX])
+			{
+				blockWidth = (((blockX + 1) * VERTEX_LIGHT_BLOCK_SIZE) < m_width) ? VERTEX_LIGHT_BLOCK_SIZE : (m_width - (blockX * VERTEX_LIGHT_BLOCK_SIZE));
+				blockHeight = (((blockY + 1) * VERTEX_LIGHT_BLOCK_SIZE) < m_height) ? VERTEX_LIGHT_BLOCK_SIZE : (m_height - (blockY * VERTEX_LIGHT_BLOCK_SIZE));
+				litCount += blockWidth * blockHeight;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+int VertexLightClass::GetBlockCountX()
+{
+	return m_blockCountX;
+}
+
+
+int VertexLightClass::GetBlockCountY()
+{
+	return m_blockCountY;
+}
+
+
+bool VertexLightClass::IsBlockLit(int blockX, int blockY)
+{
+	return m_litBlocks[(blockY * m_blockCountX) + blockX];
+}
+
+
+const unsigned int* VertexLightClass::GetColors()
+{
+	return m_colors;
+}
+
+
+unsigned int VertexLightClass::GetFlatColor()
+{
+	float diffuse, red, green, blue;
+
+
+	// Flat open ground, for geometry that has no baked maps of its own.
+	diffuse = (m_toLight.y > 0.0f) ? m_toLight.y : 0.0f;
+
+	red = m_ambientColor.x + (m_diffuseColor.x * diffuse);
+	green = m_ambientColor.y + (m_diffuseColor.y * diffuse);
+	blue = m_ambientColor.z + (m_diffuseColor.z * diffuse);
+
+	red = (red > 0.0f) ? ((red < 1.0f) ? red : 1.0f) : 0.0f;
+	green = (green > 0.0f) ? ((green < 1.0f) ? green : 1.0f) : 0.0f;
+	blue = (blue > 0.0f) ? ((blue < 1.0f) ? blue : 1.0f) : 0.0f;
+
+	return (unsigned int)((red * 255.0f) + 0.5f) | ((unsigned int)((green * 255.0f) + 0.5f) << 8) |
+		((unsigned int)((blue * 255.0f) + 0.5f) << 16) | 0xff000000;
+}
+
+
+void VertexLightClass::UpdateBlock(int first, int last)
+{
+	__m128i occlusion, firstHorizons, lastHorizons, firstShift, lastShift, mask, zero;
+	int i, occlusionBytes;
+
+
+	zero = _mm_setzero_si128();
+	mask = _mm_set1_epi32(0xff);
+	firstShift = _mm_cvtsi32_si128(m_horizonShift[0]);
+	lastShift = _mm_cvtsi32_si128(m_horizonShift[1]);
+
+	i = first;
+
+	/*
+		Four vertices at a time straight from the arrays, the horizons of four vertices are one
+		16 byte load from each plane and the direction is shifted down out of every texel. The
+		tail gathers its vertex into the same registers so every vertex goes through the same
+		arithmetic.
+	*/
+	while (i <= last)
+	{
+		if ((i + 3) <= last)
+		{
+			memcpy(&occlusionBytes, &m_occlusion[i], sizeof(int));
+			occlusion = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(occlusionBytes), zero), zero);
+
+			firstHorizons = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128((const __m128i*)&m_horizons[m_horizonPlane[0]][i * 4]), firstShift), mask);
+			lastHorizons = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128((const __m128i*)&m_horizons[m_horizonPlane[1]][i * 4]), lastShift), mask);
+
+			_mm_storeu_si128((__m128i*)&m_colors[i], CalculateColors(_mm_loadu_ps(&m_normalX[i]), _mm_loadu_ps(&m_normalY[i]),
+				_mm_loadu_ps(&m_normalZ[i]), _mm_cvtepi32_ps(occlusion), _mm_cvtepi32_ps(firstHorizons), _mm_cvtepi32_ps(lastHorizons)));
+			i += 4;
+		}
+		else
+		{
+			m_colors[i] = (unsigned int)_mm_cvtsi128_si32(CalculateColors(_mm_set1_ps(m_normalX[i]), _mm_set1_ps(m_normalY[i]),
+				_mm_set1_ps(m_normalZ[i]), _mm_set1_ps((float)m_occlusion[i]),
+				_mm_set1_ps((float)m_horizons[m_horizonPlane[0]][(i * 4) + (m_horizonShift[0] / 8)]),
+				_mm_set1_ps((float)m_horizons[m_horizonPlane[1]][(i * 4) + (m_horizonShift[1] / 8)])));
+			i++;
+		}
+	}
+
+	return;
+}
+
+
+__m128i VertexLightClass::CalculateColors(const __m128& normalX, const __m128& normalY, const __m128& normalZ, const __m128& occlusion,
+	const __m128& firstHorizon, const __m128& lastHorizon)
+{
+	__m128 zero, one, byteScale, intensity, horizon, shadow, ambient, red, green, blue;
+	__m128i colors;
+
+
+	zero = _mm_setzero_ps();
+	one = _mm_set1_ps(1.0f);
+	byteScale = _mm_set1_ps(1.0f / 255.0f);
+
+	// Calculate the amount of light on the vertices.
+	intensity = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, _mm_set1_ps(m_toLight.x)), _mm_mul_ps(normalY, _mm_set1_ps(m_toLight.y))),
+		_mm_mul_ps(normalZ, _mm_set1_ps(m_toLight.z)));
+	intensity = _mm_max_ps(intensity, zero);
+
+	// Blend the two baked horizons either side of the light and soften the edge of the shadow the same way as the light shader.
+	horizon = _mm_mul_ps(_mm_add_ps(firstHorizon, _mm_mul_ps(_mm_sub_ps(lastHorizon, firstHorizon), _mm_set1_ps(m_horizonWeight))), byteScale);
+	shadow = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_set1_ps(m_lightSine), horizon), _mm_set1_ps(VERTEX_LIGHT_SHADOW_SOFTNESS)),
+		_mm_set1_ps(0.5f / VERTEX_LIGHT_SHADOW_SOFTNESS));
+	shadow = _mm_min_ps(_mm_max_ps(shadow, zero), one);
+	shadow = _mm_mul_ps(_mm_mul_ps(shadow, shadow), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_add_ps(shadow, shadow)));
+
+	intensity = _mm_mul_ps(intensity, shadow);
+	ambient = _mm_mul_ps(occlusion, byteScale);
+
+	// The ambient light less what the terrain around hides, plus the diffuse light.
+	red = _mm_add_ps(_mm_mul_ps(ambient, _mm_set1_ps(m_ambientColor.x)), _mm_mul_ps(intensity, _mm_set1_ps(m_diffuseColor.x)));
+	green = _mm_add_ps(_mm_mul_ps(ambient, _mm_set1_ps(m_ambientColor.y)), _mm_mul_ps(intensity, _mm_set1_ps(m_diffuseColor.y)));
+	blue = _mm_add_ps(_mm_mul_ps(ambient, _mm_set1_ps(m_ambientColor.z)), _mm_mul_ps(intensity, _mm_set1_ps(m_diffuseColor.z)));
+
+	red = _mm_min_ps(_mm_max_ps(red, zero), one);
+	green = _mm_min_ps(_mm_max_ps(green, zero), one);
+	blue = _mm_min_ps(_mm_max_ps(blue, zero), one);
+
+	// Round to bytes and pack them red to alpha, lowest byte first, the alpha is always opaque.
+	colors = _mm_cvtps_epi32(_mm_mul_ps(red, _mm_set1_ps(255.0f)));
+	colors = _mm_or_si128(colors, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(green, _mm_set1_ps(255.0f))), 8));
+	colors = _mm_or_si128(colors, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(blue, _mm_set1_ps(255.0f))), 16));
+	colors = _mm_or_si128(colors, _mm_set1_epi32((int)0xff000000));
+
+	return colors;
+}
@@ -0,0 +1,87 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: vertexlightclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _VERTEXLIGHTCLASS_H_
+#define _VERTEXLIGHTCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <math.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <directxmath.h>
+
+#include "parallelforclass.h"
+
+using namespace DirectX;
+
+
+/////////////
+// GLOBALS //
+/////////////
+const int VERTEX_LIGHT_BLOCK_SIZE = 32;
+const float VERTEX_LIGHT_SHADOW_SOFTNESS = 0.05f;
+const float VERTEX_LIGHT_TOLERANCE = 0.0001f;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: VertexLightClass
+////////////////////////////////////////////////////////////////////////////////
+// Precomputed lighting for clients that cannot afford the per pixel light
+// shader. Every vertex gets one RGBA8 colour holding the ambient light scaled
+// by the baked occlusion plus the diffuse light on its normal, shadowed by the
+// baked horizon towards the light. The pixel shader then only multiplies the
+// texture by it.
+//
+// The normals are kept here as separate x, y and z arrays so four vertices are
+// lit at a time with SSE2, in rows of blocks on all the cores. The grid is
+// split into square blocks and only the blocks that changed since the last
+// update are lit again: all of them when the light moves, the blocks of the
+// edited vertices and of the re-swept bake blocks when the terrain is
+// deformed. The blocks lit by the last update are kept so only their rows
+// are uploaded.
+class VertexLightClass
+{
+public:
+	VertexLightClass();
+	VertexLightClass(const VertexLightClass&);
+	~VertexLightClass();
+
+	bool Initialize(int, int, const unsigned char*, const unsigned char*, const unsigned char*);
+	void Shutdown();
+
+	void SetNormal(int, XMFLOAT3);
+	void SetLight(XMFLOAT3, XMFLOAT4, XMFLOAT4);
+	void AddRect(int, int, int, int);
+	bool Update(int&);
+
+	int GetBlockCountX();
+	int GetBlockCountY();
+	bool IsBlockLit(int, int);
+
+	const unsigned int* GetColors();
+	unsigned int GetFlatColor();
+
+private:
+	void UpdateBlock(int, int);
+	__m128i CalculateColors(const __m128&, const __m128&, const __m128&, const __m128&, const __m128&, const __m128&);
+
+private:
+	int m_width, m_height, m_vertexCount;
+	const unsigned char* m_occlusion;
+	const unsigned char* m_horizons[2];
+	float *m_normalX, *m_normalY, *m_normalZ;
+	unsigned int* m_colors;
+	XMFLOAT3 m_direction;
+	XMFLOAT4 m_ambientColor, m_diffuseColor;
+	XMFLOAT3 m_toLight;
+	float m_lightSine, m_horizonWeight;
+	int m_horizonPlane[2], m_horizonShift[2];
+	bool m_lightSet;
+	int m_blockCountX, m_blockCountY;
+	bool *m_dirtyBlocks, *m_litBlocks;
+};
+
+#endif
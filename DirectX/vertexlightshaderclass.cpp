@@ -0,0 +1,479 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: vertexlightshaderclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "vertexlightshaderclass.h"
+
+
+VertexLightShaderClass::VertexLightShaderClass()
+{
+	m_vertexShader = 0;
+	m_packedVertexShader = 0;
+	m_pixelShader = 0;
+	m_layout = 0;
+	m_packedLayout = 0;
+	m_sampleState = 0;
+	m_matrixBuffer = 0;
+	m_packedBuffer = 0;
+}
+
+
+VertexLightShaderClass::VertexLightShaderClass(const VertexLightShaderClass& other)
+{
+}
+
+
+VertexLightShaderClass::~VertexLightShaderClass()
+{
+}
+
+
+bool VertexLightShaderClass::Initialize(ID3D11Device* device, HWND hwnd)
+{
+	bool result;
+
+
+	// Initialize the vertex and pixel shaders.
+	result = InitializeShader(device, hwnd, L"./shader/vertexlight.vs", L"./shader/vertexlight.ps");
+	if (!result)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+void VertexLightShaderClass::Shutdown()
+{
+	// Shutdown the vertex and pixel shaders as well as the related objects.
+	ShutdownShader();
+
+	return;
+}
+
+
+bool VertexLightShaderClass::SetShader(ID3D11DeviceContext* deviceContext, XMMATRIX worldMatrix, XMMATRIX viewMatrix,
+	XMMATRIX projectionMatrix, ID3D11ShaderResourceView* texture, XMFLOAT4 packedDecode, bool packed)
+{
+	bool result;
+
+
+	// Set the shader parameters that it will use for rendering.
+	result = SetShaderParameters(deviceContext, worldMatrix, viewMatrix, projectionMatrix, texture, packedDecode, packed);
+	if (!result)
+	{
+		return false;
+	}
+
+	// Bind the shader without drawing, the caller issues its own draw calls afterwards.
+	SetShaderState(deviceContext, packed);
+
+	return true;
+}
+
+
+bool VertexLightShaderClass::InitializeShader(ID3D11Device* device, HWND hwnd, WCHAR* vsFilename, WCHAR* psFilename)
+{
+	HRESULT result;
+	bool compiled;
+	ID3D10Blob* vertexShaderBuffer;
+	ID3D10Blob* pixelShaderBuffer;
+	D3D11_INPUT_ELEMENT_DESC polygonLayout[3];
+	D3D11_INPUT_ELEMENT_DESC packedLayout[2];
+	unsigned int numElements;
+	D3D11_SAMPLER_DESC samplerDesc;
+	D3D11_BUFFER_DESC matrixBufferDesc;
+	D3D11_BUFFER_DESC packedBufferDesc;
+
+
+	// Initialize the pointers this function will use to null.
+	vertexShaderBuffer = 0;
+	pixelShaderBuffer = 0;
+
+	// Compile the pixel shader code and create the pixel shader from the buffer.
+	compiled = CompileShader(hwnd, psFilename, "VertexLightPixelShader", "ps_4_0", &pixelShaderBuffer);
+	if (!compiled)
+	{
+		return false;
+	}
+
+	result = device->CreatePixelShader(pixelShaderBuffer->GetBufferPointer(), pixelShaderBuffer->GetBufferSize(), NULL, &m_pixelShader);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	pixelShaderBuffer->Release();
+	pixelShaderBuffer = 0;
+
+	// Compile the vertex shader code for the full terrain vertex and create the vertex shader from the buffer.
+	compiled = CompileShader(hwnd, vsFilename, "VertexLightVertexShader", "vs_4_0", &vertexShaderBuffer);
+	if (!compiled)
+	{
+		return false;
+	}
+
+	result = device->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &m_vertexShader);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// The position and texture coordinates come from the VertexType structure in the TerrainClass, the normal is skipped.
+	// The colour is a second stream of RGBA8 values, one per vertex.
+	polygonLayout[0].SemanticName = "POSITION";
+	polygonLayout[0].SemanticIndex = 0;
+	polygonLayout[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
+	polygonLayout[0].InputSlot = 0;
+	polygonLayout[0].AlignedByteOffset = 0;
+	polygonLayout[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+	polygonLayout[0].InstanceDataStepRate = 0;
+
+	polygonLayout[1].SemanticName = "TEXCOORD";
+	polygonLayout[1].SemanticIndex = 0;
+	polygonLayout[1].Format = DXGI_FORMAT_R32G32_FLOAT;
+	polygonLayout[1].InputSlot = 0;
+	polygonLayout[1].AlignedByteOffset = 24;
+	polygonLayout[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+	polygonLayout[1].InstanceDataStepRate = 0;
+
+	polygonLayout[2].SemanticName = "COLOR";
+	polygonLayout[2].SemanticIndex = 0;
+	polygonLayout[2].Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	polygonLayout[2].InputSlot = 1;
+	polygonLayout[2].AlignedByteOffset = 0;
+	polygonLayout[2].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+	polygonLayout[2].InstanceDataStepRate = 0;
+
+	// Get a count of the elements in the layout.
+	numElements = sizeof(polygonLayout) / sizeof(polygonLayout[0]);
+
+	// Create the vertex input layout.
+	result = device->CreateInputLayout(polygonLayout, numElements, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(),
+		&m_layout);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	vertexShaderBuffer->Release();
+	vertexShaderBuffer = 0;
+
+	// Compile the packed vertex shader code, it decodes the 8 byte terrain vertex.
+	compiled = CompileShader(hwnd, vsFilename, "VertexLightPackedVertexShader", "vs_4_0", &vertexShaderBuffer);
+	if (!compiled)
+	{
+		return false;
+	}
+
+	result = device->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &m_packedVertexShader);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// The packed vertex is read as four 16 bit integers, this setup needs to match the PackedVertexType structure in the VertexPackClass.
+	packedLayout[0].SemanticName = "POSITION";
+	packedLayout[0].SemanticIndex = 0;
+	packedLayout[0].Format = DXGI_FORMAT_R16G16B16A16_UINT;
+	packedLayout[0].InputSlot = 0;
+	packedLayout[0].AlignedByteOffset = 0;
+	packedLayout[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+	packedLayout[0].InstanceDataStepRate = 0;
+
+	packedLayout[1].SemanticName = "COLOR";
+	packedLayout[1].SemanticIndex = 0;
+	packedLayout[1].Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	packedLayout[1].InputSlot = 1;
+	packedLayout[1].AlignedByteOffset = 0;
+	packedLayout[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+	packedLayout[1].InstanceDataStepRate = 0;
+
+	// Get a count of the elements in the layout.
+	numElements = sizeof(packedLayout) / sizeof(packedLayout[0]);
+
+	// Create the packed vertex input layout.
+	result = device->CreateInputLayout(packedLayout, numElements, vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(),
+		&m_packedLayout);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	vertexShaderBuffer->Release();
+	vertexShaderBuffer = 0;
+
+	// Create a texture sampler state description.
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.MipLODBias = 0.0f;
+	samplerDesc.MaxAnisotropy = 1;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+	samplerDesc.BorderColor[0] = 0;
+	samplerDesc.BorderColor[1] = 0;
+	samplerDesc.BorderColor[2] = 0;
+	samplerDesc.BorderColor[3] = 0;
+	samplerDesc.MinLOD = 0;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+	// Create the texture sampler state.
+	result = device->CreateSamplerState(&samplerDesc, &m_sampleState);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Setup the description of the dynamic matrix constant buffer that is in the vertex shader.
+	matrixBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	matrixBufferDesc.ByteWidth = sizeof(MatrixBufferType);
+	matrixBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	matrixBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	matrixBufferDesc.MiscFlags = 0;
+	matrixBufferDesc.StructureByteStride = 0;
+
+	// Create the constant buffer pointer so we can access the vertex shader constant buffer from within this class.
+	result = device->CreateBuffer(&matrixBufferDesc, NULL, &m_matrixBuffer);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Setup the description of the packed vertex decode constant buffer that is in the vertex shader.
+	packedBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	packedBufferDesc.ByteWidth = sizeof(PackedBufferType);
+	packedBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	packedBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	packedBufferDesc.MiscFlags = 0;
+	packedBufferDesc.StructureByteStride = 0;
+
+	// Create the packed decode constant buffer.
+	result = device->CreateBuffer(&packedBufferDesc, NULL, &m_packedBuffer);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+bool VertexLightShaderClass::CompileShader(HWND hwnd, WCHAR* filename, const char* entryPoint, const char* target, ID3D10Blob** shaderBuffer)
+{
+	HRESULT result;
+	ID3D10Blob* errorMessage;
+
+
+	errorMessage = 0;
+
+	// Compile the shader code.
+	result = D3DCompileFromFile(filename, NULL, NULL, entryPoint, target, D3D10_SHADER_ENABLE_STRICTNESS, 0, shaderBuffer, &errorMessage);
+	if (FAILED(result))
+	{
+		// If the shader failed to compile it should have writen something to the error message.
+		if (errorMessage)
+		{
+			OutputShaderErrorMessage(errorMessage, hwnd, filename);
+		}
+		// If there was nothing in the error message then it simply could not find the shader file itself.
+		else
+		{
+			MessageBox(hwnd, filename, L"Missing Shader File", MB_OK);
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+
+void VertexLightShaderClass::ShutdownShader()
+{
+	// Release the packed decode constant buffer.
+	if (m_packedBuffer)
+	{
+		m_packedBuffer->Release();
+		m_packedBuffer = 0;
+	}
+
+	// Release the matrix constant buffer.
+	if (m_matrixBuffer)
+	{
+		m_matrixBuffer->Release();
+		m_matrixBuffer = 0;
+	}
+
+	// Release the sampler state.
+	if (m_sampleState)
+	{
+		m_sampleState->Release();
+		m_sampleState = 0;
+	}
+
+	// Release the layouts.
+	if (m_packedLayout)
+	{
+		m_packedLayout->Release();
+		m_packedLayout = 0;
+	}
+
+	if (m_layout)
+	{
+		m_layout->Release();
+		m_layout = 0;
+	}
+
+	// Release the pixel shader.
+	if (m_pixelShader)
+	{
+		m_pixelShader->Release();
+		m_pixelShader = 0;
+	}
+
+	// Release the vertex shaders.
+	if (m_packedVertexShader)
+	{
+		m_packedVertexShader->Release();
+		m_packedVertexShader = 0;
+	}
+
+	if (m_vertexShader)
+	{
+		m_vertexShader->Release();
+		m_vertexShader = 0;
+	}
+
+	return;
+}
+
+
+void VertexLightShaderClass::OutputShaderErrorMessage(ID3D10Blob* errorMessage, HWND hwnd, WCHAR* shaderFilename)
+{
+	char* compileErrors;
+	unsigned long bufferSize, i;
+	ofstream fout;
+
+
+	// Get a pointer to the error message text buffer.
+	compileErrors = (char*)(errorMessage->GetBufferPointer());
+
+	// Get the length of the message.
+	bufferSize = errorMessage->GetBufferSize();
+
+	// Open a file to write the error message to.
+	fout.open("shader-error.txt");
+
+	// Write out the error message.
+	for (i = 0; i<bufferSize; i++)
+	{
+		fout << compileErrors[i];
+	}
+
+	// Close the file.
+	fout.close();
+
+	// Release the error message.
+	errorMessage->Release();
+	errorMessage = 0;
+
+	// Pop a message up on the screen to notify the user to check the text file for compile errors.
+	MessageBox(hwnd, L"Error compiling shader.  Check shader-error.txt for message.", shaderFilename, MB_OK);
+
+	return;
+}
+
+
+bool VertexLightShaderClass::SetShaderParameters(ID3D11DeviceContext* deviceContext, XMMATRIX worldMatrix, XMMATRIX viewMatrix,
+	XMMATRIX projectionMatrix, ID3D11ShaderResourceView* texture, XMFLOAT4 packedDecode, bool packed)
+{
+	HRESULT result;
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	MatrixBufferType* dataPtr;
+	PackedBufferType* dataPtr2;
+	unsigned int bufferNumber;
+
+
+	// Transpose the matrices to prepare them for the shader.
+	worldMatrix = XMMatrixTranspose(worldMatrix);
+	viewMatrix = XMMatrixTranspose(viewMatrix);
+	projectionMatrix = XMMatrixTranspose(projectionMatrix);
+
+	// Lock the constant buffer so it can be written to.
+	result = deviceContext->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Get a pointer to the data in the constant buffer.
+	dataPtr = (MatrixBufferType*)mappedResource.pData;
+
+	// Copy the matrices into the constant buffer.
+	dataPtr->world = worldMatrix;
+	dataPtr->view = viewMatrix;
+	dataPtr->projection = projectionMatrix;
+
+	// Unlock the constant buffer.
+	deviceContext->Unmap(m_matrixBuffer, 0);
+
+	// Set the position of the constant buffer in the vertex shader.
+	bufferNumber = 0;
+
+	// Now set the constant buffer in the vertex shader with the updated values.
+	deviceContext->VSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
+
+	// The packed vertex shader also needs the height and texture scales to decode the vertices.
+	if (packed)
+	{
+		result = deviceContext->Map(m_packedBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		dataPtr2 = (PackedBufferType*)mappedResource.pData;
+
+		dataPtr2->heightScale = packedDecode.x;
+		dataPtr2->heightOffset = packedDecode.y;
+		dataPtr2->textureScale = packedDecode.z;
+		dataPtr2->padding = 0.0f;
+
+		deviceContext->Unmap(m_packedBuffer, 0);
+
+		// The decode buffer sits after the matrix buffer in the vertex shader.
+		bufferNumber = 1;
+
+		deviceContext->VSSetConstantBuffers(bufferNumber, 1, &m_packedBuffer);
+	}
+
+	// Set shader texture resource in the pixel shader.
+	deviceContext->PSSetShaderResources(0, 1, &texture);
+
+	return true;
+}
+
+
+void VertexLightShaderClass::SetShaderState(ID3D11DeviceContext* deviceContext, bool packed)
+{
+	// Set the vertex input layout and the vertex shader that matches it.
+	if (packed)
+	{
+		deviceContext->IASetInputLayout(m_packedLayout);
+		deviceContext->VSSetShader(m_packedVertexShader, NULL, 0);
+	}
+	else
+	{
+		deviceContext->IASetInputLayout(m_layout);
+		deviceContext->VSSetShader(m_vertexShader, NULL, 0);
+	}
+
+	// Set the pixel shader that will be used to render this triangle.
+	deviceContext->PSSetShader(m_pixelShader, NULL, 0);
+
+	// Set the sampler state in the pixel shader.
+	deviceContext->PSSetSamplers(0, 1, &m_sampleState);
+
+	return;
+}
@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: vertexlightshaderclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _VERTEXLIGHTSHADERCLASS_H_
+#define _VERTEXLIGHTSHADERCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <d3d11.h>
+#include <d3dcompiler.h>
+#include <directxmath.h>
+#include <fstream>
+using namespace DirectX;
+using namespace std;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: VertexLightShaderClass
+////////////////////////////////////////////////////////////////////////////////
+// The cheap counterpart of the light shader for the terrain: the lighting
+// comes in a second vertex stream of RGBA8 colours worked out on the CPU and
+// the pixel shader only multiplies it with the texture.
+class VertexLightShaderClass
+{
+private:
+	struct MatrixBufferType
+	{
+		XMMATRIX world;
+		XMMATRIX view;
+		XMMATRIX projection;
+	};
+
+	struct PackedBufferType
+	{
+		float heightScale;
+		float heightOffset;
+		float textureScale;
+		float padding;
+	};
+
+public:
+	VertexLightShaderClass();
+	VertexLightShaderClass(const VertexLightShaderClass&);
+	~VertexLightShaderClass();
+
+	bool Initialize(ID3D11Device*, HWND);
+	void Shutdown();
+	bool SetShader(ID3D11DeviceContext*, XMMATRIX, XMMATRIX, XMMATRIX, ID3D11ShaderResourceView*, XMFLOAT4, bool);
+
+private:
+	bool InitializeShader(ID3D11Device*, HWND, WCHAR*, WCHAR*);
+	bool CompileShader(HWND, WCHAR*, const char*, const char*, ID3D10Blob**);
+	void ShutdownShader();
+	void OutputShaderErrorMessage(ID3D10Blob*, HWND, WCHAR*);
+
+	bool SetShaderParameters(ID3D11DeviceContext*, XMMATRIX, XMMATRIX, XMMATRIX, ID3D11ShaderResourceView*, XMFLOAT4, bool);
+	void SetShaderState(ID3D11DeviceContext*, bool);
+
+private:
+	ID3D11VertexShader* m_vertexShader;
+	ID3D11VertexShader* m_packedVertexShader;
+	ID3D11PixelShader* m_pixelShader;
+	ID3D11InputLayout* m_layout;
+	ID3D11InputLayout* m_packedLayout;
+	ID3D11SamplerState* m_sampleState;
+	ID3D11Buffer* m_matrixBuffer;
+	ID3D11Buffer* m_packedBuffer;
+};
+
+#endif
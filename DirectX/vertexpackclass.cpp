@@ -0,0 +1,173 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: vertexpackclass.cpp
+////////////////////////////////////////////////////////////////////////////////
+#include "vertexpackclass.h"
+
+
+VertexPackClass::VertexPackClass()
+{
+	m_minHeight = 0.0f;
+	m_heightStep = 1.0f;
+	m_textureScale = 1.0f;
+}
+
+
+VertexPackClass::VertexPackClass(const VertexPackClass& other)
+{
+}
+
+
+VertexPackClass::~VertexPackClass()
+{
+}
+
+
+void VertexPackClass::Initialize(float minHeight, float maxHeight, float textureScale)
+{
+	// Spread the 16 bit height range over the heights actually used by the terrain.
+	m_minHeight = minHeight;
+	m_heightStep = (maxHeight - minHeight) / 65535.0f;
+	if (m_heightStep <= 0.0f)
+	{
+		m_heightStep = 1.0f;
+	}
+
+	m_textureScale = textureScale;
+
+	return;
+}
+
+
+void VertexPackClass::PackVertex(XMFLOAT3 position, XMFLOAT3 normal, PackedVertexType& vertex)
+{
+	// The x and z coordinates are whole grid positions.
+	vertex.x = (unsigned short)(position.x + 0.5f);
+	vertex.z = (unsigned short)(position.z + 0.5f);
+
+	vertex.height = EncodeHeight(position.y);
+	vertex.normal = EncodeNormal(normal);
+
+	return;
+}
+
+
+void VertexPackClass::UnpackVertex(const PackedVertexType& vertex, XMFLOAT3& position, XMFLOAT3& normal, XMFLOAT2& texture)
+{
+	// This mirrors LightPackedVertexShader in light.vs.
+	position.x = (float)vertex.x;
+	position.y = DecodeHeight(vertex.height);
+	position.z = (float)vertex.z;
+
+	normal = DecodeNormal(vertex.normal);
+
+	texture.x = position.x * m_textureScale;
+	texture.y = position.z * m_textureScale;
+
+	return;
+}
+
+
+unsigned short VertexPackClass::EncodeHeight(float height)
+{
+	float value;
+
+
+	value = ((height - m_minHeight) / m_heightStep) + 0.5f;
+	if (value < 0.0f)
+	{
+		value = 0.0f;
+	}
+
+	if (value > 65535.0f)
+	{
+		value = 65535.0f;
+	}
+
+	return (unsigned short)value;
+}
+
+
+float VertexPackClass::DecodeHeight(unsigned short height)
+{
+	return ((float)height * m_heightStep) + m_minHeight;
+}
+
+
+unsigned short VertexPackClass::EncodeNormal(XMFLOAT3 normal)
+{
+	float sum, x, z, folded;
+	int qx, qz;
+
+
+	/*
+		Project the normal onto the octahedron |x| + |y| + |z| = 1 and keep x and z.
+		The lower half (y < 0) is folded over the diagonals so it fits the same square.
+	*/
+	sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	x = normal.x / sum;
+	z = normal.z / sum;
+
+	if (normal.y < 0.0f)
+	{
+		folded = (1.0f - fabsf(z)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+		z = (1.0f - fabsf(x)) * ((z >= 0.0f) ? 1.0f : -1.0f);
+		x = folded;
+	}
+
+	// Quantize each component to 8 bits, x goes in the low byte.
+	qx = (int)floorf(((x * 0.5f) + 0.5f) * 255.0f + 0.5f);
+	qz = (int)floorf(((z * 0.5f) + 0.5f) * 255.0f + 0.5f);
+
+	return (unsigned short)(qx | (qz << 8));
+}
+
+
+XMFLOAT3 VertexPackClass::DecodeNormal(unsigned short normal)
+{
+	XMFLOAT3 result;
+	float x, z, length;
+
+
+	x = ((float)(normal & 0xff) / 255.0f) * 2.0f - 1.0f;
+	z = ((float)(normal >> 8) / 255.0f) * 2.0f - 1.0f;
+
+	result.x = x;
+	result.y = 1.0f - fabsf(x) - fabsf(z);
+	result.z = z;
+
+	// Unfold the lower half.
+	if (result.y < 0.0f)
+	{
+		result.x = (1.0f - fabsf(z)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+		result.z = (1.0f - fabsf(x)) * ((z >= 0.0f) ? 1.0f : -1.0f);
+	}
+
+	length = sqrtf((result.x * result.x) + (result.y * result.y) + (result.z * result.z));
+	result.x /= length;
+	result.y /= length;
+	result.z /= length;
+
+	return result;
+}
+
+
+XMFLOAT4 VertexPackClass::GetDecodeParameters()
+{
+	// Height scale, height offset and texture scale for the packed vertex shader.
+	return XMFLOAT4(m_heightStep, m_minHeight, m_textureScale, 0.0f);
+}
+
+
+float VertexPackClass::GetHeightStep()
+{
+	return m_heightStep;
+}
+
+
+void VertexPackClass::GetHeightRange(float& minHeight, float& maxHeight)
+{
+	// The lowest and highest heights the 16 bits can hold.
+	minHeight = m_minHeight;
+	maxHeight = m_minHeight + (m_heightStep * 65535.0f);
+	return;
+}
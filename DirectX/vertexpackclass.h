@@ -0,0 +1,54 @@
+////////////////////////////////////////////////////////////////////////////////
+// Filename: vertexpackclass.h
+////////////////////////////////////////////////////////////////////////////////
+#ifndef _VERTEXPACKCLASS_H_
+#define _VERTEXPACKCLASS_H_
+
+
+//////////////
+// INCLUDES //
+//////////////
+#include <directxmath.h>
+#include <math.h>
+
+using namespace DirectX;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Class name: VertexPackClass
+////////////////////////////////////////////////////////////////////////////////
+class VertexPackClass
+{
+public:
+	// 8 bytes: grid x and z, quantized height and an 8:8 octahedral normal.
+	struct PackedVertexType
+	{
+		unsigned short x, z;
+		unsigned short height;
+		unsigned short normal;
+	};
+
+public:
+	VertexPackClass();
+	VertexPackClass(const VertexPackClass&);
+	~VertexPackClass();
+
+	void Initialize(float, float, float);
+
+	void PackVertex(XMFLOAT3, XMFLOAT3, PackedVertexType&);
+	void UnpackVertex(const PackedVertexType&, XMFLOAT3&, XMFLOAT3&, XMFLOAT2&);
+
+	unsigned short EncodeHeight(float);
+	float DecodeHeight(unsigned short);
+	static unsigned short EncodeNormal(XMFLOAT3);
+	static XMFLOAT3 DecodeNormal(unsigned short);
+
+	XMFLOAT4 GetDecodeParameters();
+	float GetHeightStep();
+	void GetHeightRange(float&, float&);
+
+private:
+	float m_minHeight, m_heightStep, m_textureScale;
+};
+
+#endif
@@ -23,8 +23,9 @@ ZoneClass::~ZoneClass()
 }
 
 
-bool ZoneClass::Initialize(D3DClass* Direct3D, HWND hwnd, int screenWidth, int screenHeight, float screenDepth)
+bool ZoneClass::Initialize(D3DClass* Direct3D, HWND hwnd, int screenWidth, int screenHeight, float screenDepth, ArenaClass* FrameArena)
 {
+	XMMATRIX projectionMatrix;
 	bool result;
 
 
@@ -48,6 +49,7 @@ bool ZoneClass::Initialize(D3DClass* Direct3D, HWND hwnd, int screenWidth, int s
 	}
 
 	// Initialize the light object.
+	m_Light->SetAmbientColor(0.15f, 0.15f, 0.15f, 1.0f);
 	m_Light->SetDiffuseColor(1.0f, 1.0f, 1.0f, 1.0f);
 	m_Light->SetDirection(-0.5f, -1.0f, -0.5f);
 
@@ -71,13 +73,17 @@ bool ZoneClass::Initialize(D3DClass* Direct3D, HWND hwnd, int screenWidth, int s
 	}
 
 	// Initialize the terrain object.
-	result = m_Terrain->Initialize(Direct3D->GetDevice());
+	result = m_Terrain->Initialize(Direct3D->GetDevice(), FrameArena);
 	if(!result)
 	{
 		MessageBox(hwnd, L"Could not initialize the terrain object.", L"Error", MB_OK);
 		return false;
 	}
 
+	// Give the screen error mode the projection and the screen height to turn its errors into pixels.
+	Direct3D->GetProjectionMatrix(projectionMatrix);
+	m_Terrain->SetLodTarget(projectionMatrix, screenHeight, TERRAIN_LOD_MAX_ERROR, TERRAIN_LOD_TRIANGLE_BUDGET);
+
 	// Set wire frame rendering initially to enabled.
 	m_wireFrame = true;
 
@@ -145,8 +151,9 @@ bool ZoneClass::Frame(D3DClass* Direct3D, InputClass* Input, ShaderManagerClass*
 
 void ZoneClass::HandleMovementInput(InputClass* Input, float frameTime)
 {
+	TerrainBenchClass terrainBench;
 	bool keyDown;
-	float posX, posY, posZ, rotX, rotY, rotZ;
+	float posX, posY, posZ, rotX, rotY, rotZ, height;
 
 
 	// Set the frame time for calculating the updated position.
@@ -181,6 +188,16 @@ void ZoneClass::HandleMovementInput(InputClass* Input, float frameTime)
 	m_Position->GetPosition(posX, posY, posZ);
 	m_Position->GetRotation(rotX, rotY, rotZ);
 
+	// Keep the camera above the ground, the height follows the triangles that are drawn.
+	if (m_Terrain->GetHeightAt(posX, posZ, TERRAIN_HEIGHT_TRIANGLE, height))
+	{
+		if (posY < (height + CAMERA_GROUND_CLEARANCE))
+		{
+			posY = height + CAMERA_GROUND_CLEARANCE;
+			m_Position->SetPosition(posX, posY, posZ);
+		}
+	}
+
 	// Set the position of the camera.
 	m_Camera->SetPosition(posX, posY, posZ);
 	m_Camera->SetRotation(rotX, rotY, rotZ);
@@ -191,6 +208,41 @@ void ZoneClass::HandleMovementInput(InputClass* Input, float frameTime)
 		m_wireFrame = !m_wireFrame;
 	}
 
+	// Cycle through the geomipmap, the screen error and the incremental ROAM terrain modes.
+	if (Input->IsF3Toggled())
+	{
+		if (m_Terrain->GetTerrainMode() == TERRAIN_MODE_GEOMIPMAP)
+		{
+			m_Terrain->SetTerrainMode(TERRAIN_MODE_SCREEN_ERROR);
+		}
+		else if (m_Terrain->GetTerrainMode() == TERRAIN_MODE_SCREEN_ERROR)
+		{
+			m_Terrain->SetTerrainMode(TERRAIN_MODE_ROAM);
+		}
+		else
+		{
+			m_Terrain->SetTerrainMode(TERRAIN_MODE_GEOMIPMAP);
+		}
+	}
+
+	// Switch between the per pixel light shader and the lighting baked into the vertices.
+	if (Input->IsF4Toggled())
+	{
+		m_Terrain->SetVertexLighting(!m_Terrain->IsVertexLighting());
+	}
+
+	// Write the triangles the LOD picked for the last frame to a GLB file, a failed export just leaves no file.
+	if (Input->IsF5Toggled())
+	{
+		m_Terrain->ExportMesh(TERRAIN_GLB_FILENAME, MESH_EXPORT_GLB, false, true);
+	}
+
+	// Run the terrain benches and write their report and the simplified mesh, the frame stalls for a few seconds while they run.
+	if (Input->IsF6Toggled())
+	{
+		terrainBench.Run(m_Terrain, TERRAIN_BENCH_FILENAME);
+	}
+
 	return;
 }
 
@@ -220,13 +272,32 @@ bool ZoneClass::Render(D3DClass* Direct3D, ShaderManagerClass* ShaderManager, Te
 		Direct3D->EnableWireframe();
 	}
 
-	// Render the terrain using the texture shader.
-	m_Terrain->Render(Direct3D->GetDeviceContext(), m_Camera);
-	
-	result = ShaderManager->RenderLightShader(Direct3D->GetDeviceContext(), m_Terrain->GetIndexCount(), worldMatrix, viewMatrix,
-		projectionMatrix, TextureManager->GetTexture(1), m_Light->GetDirection(),
-		m_Light->GetDiffuseColor()); // ->GetAmbientColor());
+	// Set the light shader, the terrain then issues one draw per patch with it.
+	if (m_Terrain->IsVertexLighting())
+	{
+		// The lighting is in the vertex colours, the terrain lights them again when the light changes.
+		m_Terrain->SetLight(m_Light->GetDirection(), m_Light->GetAmbientColor(), m_Light->GetDiffuseColor());
+
+		result = ShaderManager->SetVertexLightShader(Direct3D->GetDeviceContext(), worldMatrix, viewMatrix, projectionMatrix,
+			TextureManager->GetTexture(1), m_Terrain->GetPackedDecode(), m_Terrain->IsPacked());
+	}
+	else
+	{
+		// The dirt texture is blended with the snow texture by the terrain's material weights.
+		result = ShaderManager->SetLightShader(Direct3D->GetDeviceContext(), worldMatrix, viewMatrix, projectionMatrix,
+			TextureManager->GetTexture(1), m_Terrain->GetSplatMap(), TextureManager->GetTexture(2), m_Light->GetDirection(), m_Light->GetDiffuseColor(),
+			m_Terrain->GetPackedDecode(), m_Terrain->IsPacked());
+	}
+	if (!result)
+	{
+		return false;
+	}
+
+	// Build the frustum the terrain clusters are culled against.
+	m_Terrain->ConstructFrustum(viewMatrix, projectionMatrix);
 
+	// Render the terrain patches.
+	result = m_Terrain->Render(Direct3D->GetDeviceContext(), m_Camera);
 	if (!result)
 	{
 		return false;
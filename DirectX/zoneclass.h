@@ -9,15 +9,22 @@
 // MY CLASS INCLUDES //
 ///////////////////////
 #include "d3dclass.h"
+#include "arenaclass.h"
 #include "inputclass.h"
 #include "shadermanagerclass.h"
 #include "texturemanagerclass.h"
 #include "cameraclass.h"
 #include "positionclass.h"
 #include "terrainclass.h"
+#include "terrainbenchclass.h"
 #include "lightclass.h"
 
 
+/////////////
+// GLOBALS //
+/////////////
+const float CAMERA_GROUND_CLEARANCE = 2.0f;
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // Class name: ZoneClass
@@ -29,7 +36,7 @@ public:
 	ZoneClass(const ZoneClass&);
 	~ZoneClass();
 
-	bool Initialize(D3DClass*, HWND, int, int, float);
+	bool Initialize(D3DClass*, HWND, int, int, float, ArenaClass*);
 	void Shutdown();
 	bool Frame(D3DClass*, InputClass*, ShaderManagerClass*, TextureManagerClass*, float);
 